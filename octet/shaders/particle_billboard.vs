@@ -0,0 +1,43 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+// Billboard particles expanded on the GPU. Each particle is one instance; the vertex
+// buffer holds the four corners of a quad. Use with the default fragment shaders.
+//
+
+// matrices
+uniform mat4 modelToProjection;
+uniform mat4 modelToCamera;
+
+// attributes from vertex buffer: corner of the quad, -1..1
+attribute vec2 uv;
+
+// attributes from instance buffer
+attribute vec4 particle_pos;    // xyz = position, w = angle in radians
+attribute vec2 particle_size;   // half size
+attribute vec4 particle_uv;     // xy = bottom left, zw = top right
+
+// outputs
+varying vec3 normal_;
+varying vec2 uv_;
+varying vec4 color_;
+varying vec3 model_pos_;
+varying vec3 camera_pos_;
+
+void main() {
+  // the camera x and y axes in model space
+  vec3 right = normalize(vec3(modelToCamera[0][0], modelToCamera[1][0], modelToCamera[2][0]));
+  vec3 up = normalize(vec3(modelToCamera[0][1], modelToCamera[1][1], modelToCamera[2][1]));
+
+  float c = cos(particle_pos.w);
+  float s = sin(particle_pos.w);
+  vec2 corner = uv * particle_size;
+  vec2 offset = vec2(corner.x * c - corner.y * s, corner.x * s + corner.y * c);
+
+  vec4 pos = vec4(particle_pos.xyz + right * offset.x + up * offset.y, 1.0);
+  gl_Position = modelToProjection * pos;
+  normal_ = vec3(0.0, 0.0, 1.0);
+  uv_ = mix(particle_uv.xy, particle_uv.zw, uv * 0.5 + 0.5);
+  color_ = vec4(1.0, 1.0, 1.0, 1.0);
+  camera_pos_ = (modelToCamera * pos).xyz;
+  model_pos_ = pos.xyz;
+}
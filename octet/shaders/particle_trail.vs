@@ -0,0 +1,50 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+// Trail particles expanded on the GPU. Each segment between two trail particles is one
+// instance; the vertex buffer holds the four corners of a quad. Use with the default
+// fragment shaders.
+//
+
+// matrices
+uniform mat4 modelToProjection;
+uniform mat4 modelToCamera;
+
+// attributes from vertex buffer: x = -1 at the tail, 1 at the head; y = -1 bottom, 1 top
+attribute vec2 uv;
+
+// attributes from instance buffer
+attribute vec4 particle_pos;      // head: xyz = position, w = half width
+attribute vec4 particle_tail;     // tail: xyz = position, w = half width
+attribute vec3 particle_axis;     // direction across the trail, zero to face the camera
+attribute vec4 particle_uv;       // head: xy = top, zw = bottom
+attribute vec4 particle_tail_uv;  // tail: xy = top, zw = bottom
+
+// outputs
+varying vec3 normal_;
+varying vec2 uv_;
+varying vec4 color_;
+varying vec3 model_pos_;
+varying vec3 camera_pos_;
+
+void main() {
+  float t = uv.x * 0.5 + 0.5;
+  vec4 centre = mix(particle_tail, particle_pos, t);
+  vec3 dir = particle_pos.xyz - particle_tail.xyz;
+
+  // lasers and the like have no axis: turn the ribbon to face the camera.
+  vec3 axis = particle_axis;
+  if (dot(axis, axis) == 0.0) {
+    vec3 view = vec3(modelToCamera[0][2], modelToCamera[1][2], modelToCamera[2][2]);
+    axis = cross(dir, view);
+  }
+  axis = normalize(axis);
+
+  vec4 pos = vec4(centre.xyz + axis * (centre.w * uv.y), 1.0);
+  gl_Position = modelToProjection * pos;
+  normal_ = normalize((modelToCamera * vec4(cross(axis, dir), 0.0)).xyz);
+  vec4 uvs = mix(particle_tail_uv, particle_uv, t);
+  uv_ = uv.y > 0.0 ? uvs.xy : uvs.zw;
+  color_ = vec4(1.0, 1.0, 1.0, 1.0);
+  camera_pos_ = (modelToCamera * pos).xyz;
+  model_pos_ = pos.xyz;
+}
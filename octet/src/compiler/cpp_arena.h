@@ -0,0 +1,185 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// C/C++ language subset parser
+//
+
+namespace octet
+{
+  namespace compiler
+  {
+    /// Bump allocator that owns the nodes of one translation unit.
+    ///
+    /// Expressions, statements, types, scopes and values are carved out of large chunks
+    /// and never freed individually. reset() frees the lot, calling destructors only
+    /// for the few classes (like scopes) that own containers.
+    class cpp_arena
+    {
+    public:
+      enum
+      {
+        chunk_size = 64 * 1024,
+        alignment = 16,
+      };
+
+    private:
+      struct chunk
+      {
+        chunk *next;
+        size_t size;
+      };
+
+      struct destructor
+      {
+        void (*destroy)( void *object );
+        void *object;
+        destructor *next;
+      };
+
+      chunk *chunks;
+      uint8_t *pos;
+      uint8_t *end;
+      destructor *destructors;
+      size_t num_allocs;
+      size_t bytes_used;
+      size_t bytes_reserved;
+
+      static size_t round_up( size_t size )
+      {
+        return ( size + alignment - 1 ) & ~(size_t)( alignment - 1 );
+      }
+
+      static size_t header_size()
+      {
+        return round_up( sizeof( chunk ) );
+      }
+
+      template < class type > static void destroy( void *object )
+      {
+        ((type*)object)->~type();
+      }
+
+      void new_chunk( size_t bytes )
+      {
+        size_t size = bytes + header_size() > chunk_size ? bytes + header_size() : chunk_size;
+        chunk *c = (chunk*)allocator::malloc( size );
+        c->next = chunks;
+        c->size = size;
+        chunks = c;
+        pos = (uint8_t*)c + header_size();
+        end = (uint8_t*)c + size;
+        bytes_reserved += size;
+      }
+
+      // destroy everything, keeping the first chunk if keep_first is true.
+      void release( bool keep_first )
+      {
+        // newest first, so that objects go before anything they were built from.
+        for( destructor *d = destructors; d != NULL; d = d->next )
+        {
+          d->destroy( d->object );
+        }
+        destructors = NULL;
+
+        while( chunks && ( !keep_first || chunks->next ) )
+        {
+          chunk *c = chunks;
+          chunks = c->next;
+          bytes_reserved -= c->size;
+          allocator::free( c, c->size );
+        }
+
+        if( chunks )
+        {
+          pos = (uint8_t*)chunks + header_size();
+          end = (uint8_t*)chunks + chunks->size;
+        } else
+        {
+          pos = end = NULL;
+        }
+        num_allocs = bytes_used = 0;
+      }
+
+    public:
+      cpp_arena()
+      {
+        chunks = NULL;
+        pos = end = NULL;
+        destructors = NULL;
+        num_allocs = bytes_used = bytes_reserved = 0;
+      }
+
+      ~cpp_arena()
+      {
+        release( false );
+      }
+
+      /// allocate size bytes, aligned to 16 bytes.
+      void *alloc( size_t size )
+      {
+        size_t bytes = round_up( size ? size : 1 );
+        if( pos + bytes > end )
+        {
+          new_chunk( bytes );
+        }
+        void *result = pos;
+        pos += bytes;
+        num_allocs++;
+        bytes_used += bytes;
+        return result;
+      }
+
+      /// construct an object in the arena.
+      template < class type, class... args_t > type *make( args_t&&... args )
+      {
+        type *result = new ( alloc( sizeof( type ) ), dynarray_dummy_t() ) type( std::forward< args_t >( args )... );
+        if( !std::is_trivially_destructible< type >::value )
+        {
+          destructor *d = new ( alloc( sizeof( destructor ) ), dynarray_dummy_t() ) destructor;
+          d->destroy = &destroy< type >;
+          d->object = result;
+          d->next = destructors;
+          destructors = d;
+        }
+        return result;
+      }
+
+      /// copy a string into the arena.
+      const char *strdup( const char *text )
+      {
+        size_t len = strlen( text ) + 1;
+        char *result = (char*)alloc( len );
+        memcpy( result, text, len );
+        return result;
+      }
+
+      /// destroy everything in the arena in one go.
+      /// The first chunk is kept for the next translation unit.
+      void reset()
+      {
+        release( true );
+      }
+
+      /// number of objects and strings allocated since the last reset.
+      size_t get_num_allocs() const
+      {
+        return num_allocs;
+      }
+
+      /// bytes allocated since the last reset.
+      size_t get_bytes_used() const
+      {
+        return bytes_used;
+      }
+
+      /// bytes taken from the heap.
+      size_t get_bytes_reserved() const
+      {
+        return bytes_reserved;
+      }
+    };
+  }
+}
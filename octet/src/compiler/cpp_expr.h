@@ -237,6 +237,48 @@ namespace octet
       {
         return swiz;
       }
+
+      void setKid( size_t n, cpp_expr *expr )
+      {
+        kid[ n ] = expr;
+      }
+
+      bool getIsConstant()
+      {
+        return kind == kind_int_value || kind == kind_double_value;
+      }
+
+      /// turn this node into an integer constant, eg. when folding "2 + 3"
+      void setIntValue( cpp_type *type_, long long value )
+      {
+        kind = kind_int_value;
+        kid[ 0 ] = kid[ 1 ] = kid[ 2 ] = NULL;
+        int_value = value;
+        type = type_;
+      }
+
+      /// turn this node into a floating point constant
+      void setDoubleValue( cpp_type *type_, double value )
+      {
+        kind = kind_double_value;
+        kid[ 0 ] = kid[ 1 ] = kid[ 2 ] = NULL;
+        double_value = value;
+        type = type_;
+      }
+
+      /// the items of a list like the parameters of a call, in order.
+      /// "a, b, c" is parsed as ( a, b ), c
+      void getCommaList( dynarray< cpp_expr * > &list )
+      {
+        if( kind == kind_comma )
+        {
+          kid[ 0 ]->getCommaList( list );
+          kid[ 1 ]->getCommaList( list );
+        } else
+        {
+          list.push_back( this );
+        }
+      }
     
       #if 0
       // generate an llvm pointer to this cg expression
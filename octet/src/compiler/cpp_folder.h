@@ -0,0 +1,385 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// C/C++ language subset parser
+//
+
+namespace octet
+{
+  namespace compiler
+  {
+    /// Constant folding for parsed expressions.
+    ///
+    /// Scalar sub-expressions whose values are known are replaced by a single kind_int_value
+    /// or kind_double_value node, so "2.0 * 3.14159 / 180.0" becomes one constant.
+    /// const variables with constant initialisers are replaced by their values.
+    ///
+    /// Float arithmetic is done in single precision and int arithmetic wraps at 32 bits,
+    /// as it does in cpp_interpreter and on the GPU.
+    ///
+    ///     cpp_folder folder;
+    ///     expr = folder.fold( expr );
+    ///     if( expr->getIsConstant() ) ...
+    class cpp_folder
+    {
+      // a folded scalar. bools are 0 or 1.
+      struct constant
+      {
+        bool is_float;
+        float f;
+        int32_t i;
+      };
+
+      unsigned num_folded;
+
+      static bool is_float_kind( cpp_type *type )
+      {
+        return type->getIsFloat();
+      }
+
+      // only scalars are folded, vectors are left to the back end.
+      static bool can_fold( cpp_type *type )
+      {
+        return type != NULL && type->getIsScalar() && type->getKind() != cpp_type::kind_void;
+      }
+
+      static bool get_constant( cpp_expr *expr, constant &value )
+      {
+        if( expr == NULL || !expr->getIsConstant() || !can_fold( expr->getType() ) )
+        {
+          return false;
+        }
+        if( expr->getKind() == cpp_expr::kind_double_value )
+        {
+          value.is_float = true;
+          value.f = (float)expr->getDoubleValue();
+        } else
+        {
+          value.is_float = false;
+          value.i = (int32_t)(long long)expr->getIntValue();
+        }
+        return true;
+      }
+
+      // convert a constant to the kind of a scalar type.
+      static constant convert( const constant &value, cpp_type *type )
+      {
+        constant result;
+        result.is_float = is_float_kind( type );
+        if( result.is_float )
+        {
+          result.f = value.is_float ? value.f : (float)value.i;
+          result.i = 0;
+        } else if( type->getKind() == cpp_type::kind_bool )
+        {
+          result.i = value.is_float ? value.f != 0 : value.i != 0;
+          result.f = 0;
+        } else
+        {
+          result.i = value.is_float ? (int32_t)value.f : value.i;
+          result.f = 0;
+        }
+        return result;
+      }
+
+      cpp_expr *set_constant( cpp_expr *expr, const constant &value )
+      {
+        constant converted = convert( value, expr->getType() );
+        if( converted.is_float )
+        {
+          expr->setDoubleValue( expr->getType(), converted.f );
+        } else
+        {
+          expr->setIntValue( expr->getType(), converted.i );
+        }
+        num_folded++;
+        return expr;
+      }
+
+      // evaluate a binary operator on two constants of the same kind.
+      // returns false for things like divide by zero that should be left to run time.
+      static bool evaluate( cpp_expr::kind_enum kind, const constant &lhs, const constant &rhs, constant &result )
+      {
+        result.is_float = lhs.is_float;
+        result.f = 0;
+        result.i = 0;
+        if( lhs.is_float )
+        {
+          float a = lhs.f, b = rhs.f;
+          switch( kind )
+          {
+            case cpp_expr::kind_plus: result.f = a + b; return true;
+            case cpp_expr::kind_minus: result.f = a - b; return true;
+            case cpp_expr::kind_star: result.f = a * b; return true;
+            case cpp_expr::kind_divide: result.f = a / b; return true;
+            case cpp_expr::kind_mod: result.f = fmodf( a, b ); return true;
+            default: break;
+          }
+          result.is_float = false;
+          switch( kind )
+          {
+            case cpp_expr::kind_lt: result.i = a < b; return true;
+            case cpp_expr::kind_gt: result.i = a > b; return true;
+            case cpp_expr::kind_le: result.i = a <= b; return true;
+            case cpp_expr::kind_ge: result.i = a >= b; return true;
+            case cpp_expr::kind_eq: result.i = a == b; return true;
+            case cpp_expr::kind_ne: result.i = a != b; return true;
+            case cpp_expr::kind_or_or: result.i = a != 0 || b != 0; return true;
+            case cpp_expr::kind_and_and: result.i = a != 0 && b != 0; return true;
+            default: return false;
+          }
+        } else
+        {
+          // unsigned arithmetic to wrap without undefined behaviour.
+          int32_t a = lhs.i, b = rhs.i;
+          uint32_t ua = (uint32_t)a, ub = (uint32_t)b;
+          switch( kind )
+          {
+            case cpp_expr::kind_plus: result.i = (int32_t)( ua + ub ); return true;
+            case cpp_expr::kind_minus: result.i = (int32_t)( ua - ub ); return true;
+            case cpp_expr::kind_star: result.i = (int32_t)( ua * ub ); return true;
+            case cpp_expr::kind_divide: if( b == 0 || ( b == -1 && a == (int32_t)0x80000000 ) ) return false; result.i = a / b; return true;
+            case cpp_expr::kind_mod: if( b == 0 || ( b == -1 && a == (int32_t)0x80000000 ) ) return false; result.i = a % b; return true;
+            case cpp_expr::kind_or: result.i = a | b; return true;
+            case cpp_expr::kind_and: result.i = a & b; return true;
+            case cpp_expr::kind_xor: result.i = a ^ b; return true;
+            case cpp_expr::kind_shift_left: result.i = (int32_t)( ua << ( b & 31 ) ); return true;
+            case cpp_expr::kind_shift_right: result.i = a >> ( b & 31 ); return true;
+            case cpp_expr::kind_lt: result.i = a < b; return true;
+            case cpp_expr::kind_gt: result.i = a > b; return true;
+            case cpp_expr::kind_le: result.i = a <= b; return true;
+            case cpp_expr::kind_ge: result.i = a >= b; return true;
+            case cpp_expr::kind_eq: result.i = a == b; return true;
+            case cpp_expr::kind_ne: result.i = a != b; return true;
+            case cpp_expr::kind_or_or: result.i = a != 0 || b != 0; return true;
+            case cpp_expr::kind_and_and: result.i = a != 0 && b != 0; return true;
+            default: return false;
+          }
+        }
+      }
+
+      // the target of an assignment stays a variable, but array indices can be folded.
+      void fold_lvalue( cpp_expr *expr )
+      {
+        switch( expr->getKind() )
+        {
+          case cpp_expr::kind_swiz:
+          case cpp_expr::kind_dot:
+          {
+            fold_lvalue( expr->getKid( 0 ) );
+          } break;
+          case cpp_expr::kind_index:
+          {
+            fold_lvalue( expr->getKid( 0 ) );
+            expr->setKid( 1, fold( expr->getKid( 1 ) ) );
+          } break;
+          default:
+          {
+          } break;
+        }
+      }
+
+      // the arguments of a call or constructor are a comma list, but every value is used.
+      cpp_expr *fold_list( cpp_expr *expr )
+      {
+        if( expr != NULL && expr->getKind() == cpp_expr::kind_comma )
+        {
+          expr->setKid( 0, fold_list( expr->getKid( 0 ) ) );
+          expr->setKid( 1, fold( expr->getKid( 1 ) ) );
+          return expr;
+        }
+        return fold( expr );
+      }
+
+    public:
+      cpp_folder() : num_folded( 0 )
+      {
+      }
+
+      /// fold an expression tree in place. Returns the new root, which may be one of the kids.
+      cpp_expr *fold( cpp_expr *expr )
+      {
+        if( expr == NULL )
+        {
+          return NULL;
+        }
+
+        cpp_expr::kind_enum kind = expr->getKind();
+        switch( kind )
+        {
+          case cpp_expr::kind_int_value:
+          case cpp_expr::kind_double_value:
+          case cpp_expr::kind_statement:
+          case cpp_expr::kind_nop:
+          {
+            return expr;
+          }
+          case cpp_expr::kind_value:
+          {
+            // const int n = 4; ... n ...
+            cpp_value *value = expr->getValue();
+            cpp_type *type = value->getType();
+            constant c;
+            if( can_fold( type ) && type->getIsConst() && value->getInit() )
+            {
+              value->setInit( fold( value->getInit() ) );
+              if( get_constant( value->getInit(), c ) )
+              {
+                return set_constant( expr, c );
+              }
+            }
+            return expr;
+          }
+          case cpp_expr::kind_cast:
+          {
+            // casts made by the parser with no kid are int constants.
+            if( expr->getKid( 0 ) == NULL )
+            {
+              constant c;
+              c.is_float = false;
+              c.i = (int32_t)(long long)expr->getIntValue();
+              c.f = 0;
+              return can_fold( expr->getType() ) ? set_constant( expr, c ) : expr;
+            }
+            expr->setKid( 0, fold( expr->getKid( 0 ) ) );
+            constant c;
+            if( can_fold( expr->getType() ) && get_constant( expr->getKid( 0 ), c ) )
+            {
+              return set_constant( expr, c );
+            }
+            return expr;
+          }
+          case cpp_expr::kind_comma:
+          {
+            cpp_expr *lhs = fold( expr->getKid( 0 ) );
+            cpp_expr *rhs = fold( expr->getKid( 1 ) );
+            expr->setKid( 0, lhs );
+            expr->setKid( 1, rhs );
+            // a constant on the left has no side effects.
+            return lhs->getIsConstant() ? rhs : expr;
+          }
+          case cpp_expr::kind_question:
+          {
+            for( size_t i = 0; i != 3; ++i )
+            {
+              expr->setKid( i, fold( expr->getKid( i ) ) );
+            }
+            constant c;
+            if( get_constant( expr->getKid( 0 ), c ) )
+            {
+              bool cond = c.is_float ? c.f != 0 : c.i != 0;
+              num_folded++;
+              return expr->getKid( cond ? 1 : 2 );
+            }
+            return expr;
+          }
+          case cpp_expr::kind_equals:
+          case cpp_expr::kind_times_equals:
+          case cpp_expr::kind_divide_equals:
+          case cpp_expr::kind_mod_equals:
+          case cpp_expr::kind_plus_equals:
+          case cpp_expr::kind_minus_equals:
+          case cpp_expr::kind_shift_left_equals:
+          case cpp_expr::kind_shift_right_equals:
+          case cpp_expr::kind_and_equals:
+          case cpp_expr::kind_xor_equals:
+          case cpp_expr::kind_or_equals:
+          {
+            fold_lvalue( expr->getKid( 0 ) );
+            expr->setKid( 1, fold( expr->getKid( 1 ) ) );
+            return expr;
+          }
+          case cpp_expr::kind_call:
+          {
+            // kid 0 is the function
+            expr->setKid( 1, fold_list( expr->getKid( 1 ) ) );
+            return expr;
+          }
+          case cpp_expr::kind_init:
+          {
+            expr->setKid( 0, fold_list( expr->getKid( 0 ) ) );
+            return expr;
+          }
+          case cpp_expr::kind_or:
+          case cpp_expr::kind_and:
+          case cpp_expr::kind_xor:
+          case cpp_expr::kind_lt:
+          case cpp_expr::kind_gt:
+          case cpp_expr::kind_le:
+          case cpp_expr::kind_ge:
+          case cpp_expr::kind_eq:
+          case cpp_expr::kind_ne:
+          case cpp_expr::kind_shift_left:
+          case cpp_expr::kind_shift_right:
+          case cpp_expr::kind_plus:
+          case cpp_expr::kind_minus:
+          case cpp_expr::kind_star:
+          case cpp_expr::kind_divide:
+          case cpp_expr::kind_mod:
+          case cpp_expr::kind_or_or:
+          case cpp_expr::kind_and_and:
+          {
+            expr->setKid( 0, fold( expr->getKid( 0 ) ) );
+            expr->setKid( 1, fold( expr->getKid( 1 ) ) );
+            constant lhs, rhs, result;
+            if( can_fold( expr->getType() ) && get_constant( expr->getKid( 0 ), lhs ) && get_constant( expr->getKid( 1 ), rhs ) )
+            {
+              // the parser casts both sides to the same type, but constants may still differ.
+              if( lhs.is_float != rhs.is_float )
+              {
+                cpp_type *type = lhs.is_float ? expr->getKid( 0 )->getType() : expr->getKid( 1 )->getType();
+                lhs = convert( lhs, type );
+                rhs = convert( rhs, type );
+              }
+              if( evaluate( kind, lhs, rhs, result ) )
+              {
+                return set_constant( expr, result );
+              }
+            }
+            return expr;
+          }
+          default:
+          {
+            for( size_t i = 0; i != 3; ++i )
+            {
+              expr->setKid( i, fold( expr->getKid( i ) ) );
+            }
+            return expr;
+          }
+        }
+      }
+
+      /// fold every expression in a list of statements and the statements inside them.
+      void fold( cpp_statement *statement )
+      {
+        for( ; statement != NULL; statement = statement->getNext() )
+        {
+          statement->setExpression( fold( statement->getExpression() ) );
+          fold( statement->getStatements() );
+          fold( statement->getElse() );
+        }
+      }
+
+      /// get the value of a constant int expression, eg. an array dimension.
+      static bool get_int_constant( cpp_expr *expr, long long &value )
+      {
+        constant c;
+        if( !get_constant( expr, c ) || c.is_float )
+        {
+          return false;
+        }
+        value = c.i;
+        return true;
+      }
+
+      /// number of nodes replaced by constants since construction.
+      unsigned get_num_folded() const
+      {
+        return num_folded;
+      }
+    };
+  }
+}
@@ -0,0 +1,1960 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// C/C++ language subset interpreter
+//
+
+namespace octet
+{
+  namespace compiler
+  {
+    /// Runs a function parsed by cpp_parser on the CPU, for many sets of inputs at once.
+    ///
+    /// compile() turns the function, and everything it calls, into bytecode for a register machine.
+    /// Each register holds one float or int component for "lanes" invocations side by side,
+    /// so every instruction is a short loop that the C++ compiler can vectorise and the cost
+    /// of decoding it is shared between all the lanes.
+    ///
+    /// Vectors are split into components, so swizzles and scalar to vector casts cost nothing.
+    /// Calls are inlined and constants are folded. if, for and while run both ways with a mask
+    /// of the active lanes, skipping the code when no lane is active.
+    ///
+    /// Inputs and outputs are arrays of floats, one for each component (structure of arrays).
+    /// The inputs are the function's parameters, the outputs are the return value followed
+    /// by any out parameters. int and bool components are converted to and from float.
+    ///
+    ///     cpp_parser parser;
+    ///     parser.parse( "float3 scale( float3 v, float s ) { return normalize( v ) * s; }" );
+    ///
+    ///     cpp_interpreter interp;
+    ///     if( interp.compile( parser, "scale" ) ) {
+    ///       const float *inputs[] = { xs, ys, zs, scales };
+    ///       float *outputs[] = { rx, ry, rz };
+    ///       interp.run( inputs, outputs, count );
+    ///     }
+    ///
+    /// Global variables without an initialiser, and uniforms, are set with set_uniform().
+    /// Structures, arrays, matrices, textures and recursion are not supported.
+    class cpp_interpreter
+    {
+    public:
+      enum
+      {
+        /// invocations run side by side.
+        lanes = 64,
+      };
+
+    private:
+      // one component of one lane. bools are 0 or -1 so that they can be used as masks.
+      union lane_value
+      {
+        float f;
+        int32_t i;
+      };
+
+      enum op_enum
+      {
+        op_move,          // dst = a
+        op_select,        // dst = a ? b : c where a is a mask
+
+        op_fadd,
+        op_fsub,
+        op_fmul,
+        op_fdiv,
+        op_fmod,
+        op_fmad,          // dst = a * b + c
+        op_fmin,
+        op_fmax,
+        op_fpow,
+        op_fatan2,
+        op_flt,
+        op_fle,
+        op_feq,
+        op_fne,
+        op_fabs,
+        op_fsign,
+        op_ffloor,
+        op_fceil,
+        op_ffrac,
+        op_fsqrt,
+        op_frsqrt,
+        op_fexp,
+        op_fexp2,
+        op_flog,
+        op_flog2,
+        op_fsin,
+        op_fcos,
+        op_ftan,
+        op_fasin,
+        op_facos,
+        op_fatan,
+
+        op_iadd,
+        op_isub,
+        op_imul,
+        op_idiv,
+        op_imod,
+        op_iand,
+        op_iandn,         // dst = a & ~b
+        op_ior,
+        op_ixor,
+        op_ishl,
+        op_ishr,
+        op_ilt,
+        op_ile,
+        op_ieq,
+        op_ine,
+
+        op_itof,
+        op_ftoi,
+
+        // jumps go to instruction a
+        op_jump,
+        op_jump_if_none,  // if no lane of mask b is set
+        op_jump_if_any,   // if any lane of mask b is set
+      };
+
+      struct instruction
+      {
+        uint16_t op;
+        uint16_t dst;
+        uint16_t a;
+        uint16_t b;
+        uint16_t c;
+      };
+
+      enum base_enum
+      {
+        base_void,
+        base_float,
+        base_int,
+        base_bool,
+      };
+
+      enum slot_kind_enum
+      {
+        slot_temp,        // part of an expression, free at the end of the statement
+        slot_variable,    // a variable, parameter, result or mask
+        slot_constant,    // never written by the program
+        slot_uniform,     // set by set_uniform
+      };
+
+      enum
+      {
+        max_slots = 0xffff,
+        max_instructions = 0xffff,
+        no_mask = ~0u,
+        max_call_depth = 64,
+      };
+
+      // the registers that hold the components of a value.
+      struct operand
+      {
+        unsigned slots[ 4 ];
+        unsigned dim;
+        base_enum base;
+      };
+
+      struct slot_info
+      {
+        uint32_t bits;
+        uint8_t kind;
+      };
+
+      struct io_slot
+      {
+        unsigned slot;
+        base_enum base;
+      };
+
+      // a function being inlined.
+      struct frame
+      {
+        frame *parent;
+        cpp_value *function;
+        cpp_type *return_type;
+        hash_map< cpp_value *, operand > variables;
+        operand result;
+
+        // masks[ first_mask ... ] belong to this function. At the top level there are top_masks.
+        unsigned first_mask;
+        unsigned top_masks;
+
+        // every lane has returned, so the rest of the function is not compiled.
+        bool returned;
+      };
+
+      // the program
+      dynarray< instruction > code;
+      dynarray< slot_info > slots;
+      dynarray< io_slot > inputs;
+      dynarray< io_slot > outputs;
+      dynarray< operand > uniforms;
+      dictionary< unsigned > uniforms_by_name;
+      dynarray< lane_value > registers;
+      string error;
+
+      // used while compiling
+      cpp_folder folder;
+      cpp_scope *global_scope;
+      frame *cur_frame;
+      unsigned call_depth;
+      hash_map< cpp_value *, operand > globals;
+      hash_map< cpp_value *, unsigned > folded;
+      hash_map< uint64_t, unsigned > constants;
+      dynarray< unsigned > masks;
+      dynarray< unsigned > free_masks;
+      dynarray< unsigned > temps;
+      dynarray< unsigned > free_temps;
+      unsigned all_ones;
+
+      static unsigned get_num_args( unsigned op )
+      {
+        switch( op )
+        {
+          case op_select: case op_fmad: return 3;
+          case op_move: case op_fabs: case op_fsign: case op_ffloor: case op_fceil: case op_ffrac: case op_fsqrt: case op_frsqrt:
+          case op_fexp: case op_fexp2: case op_flog: case op_flog2: case op_fsin: case op_fcos: case op_ftan: case op_fasin:
+          case op_facos: case op_fatan: case op_itof: case op_ftoi: return 1;
+          case op_jump: case op_jump_if_none: case op_jump_if_any: return 0;
+          default: return 2;
+        }
+      }
+
+      static int32_t idiv( int32_t a, int32_t b )
+      {
+        return b == 0 || ( b == -1 && a == (int32_t)0x80000000 ) ? 0 : a / b;
+      }
+
+      static int32_t imod( int32_t a, int32_t b )
+      {
+        return b == 0 || b == -1 ? 0 : a % b;
+      }
+
+      static float fsign( float a )
+      {
+        return (float)( ( a > 0 ) - ( a < 0 ) );
+      }
+
+      // run instructions on n lanes. regs has n values for each slot.
+      template < unsigned n > static void execute( const instruction *code, size_t num_instructions, lane_value *regs )
+      {
+        size_t pc = 0;
+        while( pc != num_instructions )
+        {
+          const instruction &ins = code[ pc++ ];
+          if( ins.op >= op_jump )
+          {
+            int32_t any = 0;
+            if( ins.op != op_jump )
+            {
+              const lane_value *mask = regs + ins.b * n;
+              for( unsigned i = 0; i != n; ++i ) any |= mask[ i ].i;
+            }
+            if( ins.op == op_jump || ( ins.op == op_jump_if_none ) == ( any == 0 ) )
+            {
+              pc = ins.a;
+            }
+            continue;
+          }
+
+          lane_value *d = regs + ins.dst * n;
+          const lane_value *a = regs + ins.a * n;
+          const lane_value *b = regs + ins.b * n;
+          const lane_value *c = regs + ins.c * n;
+          switch( ins.op )
+          {
+            case op_move: for( unsigned i = 0; i != n; ++i ) d[ i ].i = a[ i ].i; break;
+            case op_select: for( unsigned i = 0; i != n; ++i ) d[ i ].i = ( b[ i ].i & a[ i ].i ) | ( c[ i ].i & ~a[ i ].i ); break;
+
+            case op_fadd: for( unsigned i = 0; i != n; ++i ) d[ i ].f = a[ i ].f + b[ i ].f; break;
+            case op_fsub: for( unsigned i = 0; i != n; ++i ) d[ i ].f = a[ i ].f - b[ i ].f; break;
+            case op_fmul: for( unsigned i = 0; i != n; ++i ) d[ i ].f = a[ i ].f * b[ i ].f; break;
+            case op_fdiv: for( unsigned i = 0; i != n; ++i ) d[ i ].f = a[ i ].f / b[ i ].f; break;
+            case op_fmod: for( unsigned i = 0; i != n; ++i ) d[ i ].f = fmodf( a[ i ].f, b[ i ].f ); break;
+            case op_fmad: for( unsigned i = 0; i != n; ++i ) d[ i ].f = a[ i ].f * b[ i ].f + c[ i ].f; break;
+            case op_fmin: for( unsigned i = 0; i != n; ++i ) d[ i ].f = a[ i ].f < b[ i ].f ? a[ i ].f : b[ i ].f; break;
+            case op_fmax: for( unsigned i = 0; i != n; ++i ) d[ i ].f = a[ i ].f > b[ i ].f ? a[ i ].f : b[ i ].f; break;
+            case op_fpow: for( unsigned i = 0; i != n; ++i ) d[ i ].f = powf( a[ i ].f, b[ i ].f ); break;
+            case op_fatan2: for( unsigned i = 0; i != n; ++i ) d[ i ].f = atan2f( a[ i ].f, b[ i ].f ); break;
+            case op_flt: for( unsigned i = 0; i != n; ++i ) d[ i ].i = -( a[ i ].f < b[ i ].f ); break;
+            case op_fle: for( unsigned i = 0; i != n; ++i ) d[ i ].i = -( a[ i ].f <= b[ i ].f ); break;
+            case op_feq: for( unsigned i = 0; i != n; ++i ) d[ i ].i = -( a[ i ].f == b[ i ].f ); break;
+            case op_fne: for( unsigned i = 0; i != n; ++i ) d[ i ].i = -( a[ i ].f != b[ i ].f ); break;
+            case op_fabs: for( unsigned i = 0; i != n; ++i ) d[ i ].f = fabsf( a[ i ].f ); break;
+            case op_fsign: for( unsigned i = 0; i != n; ++i ) d[ i ].f = fsign( a[ i ].f ); break;
+            case op_ffloor: for( unsigned i = 0; i != n; ++i ) d[ i ].f = floorf( a[ i ].f ); break;
+            case op_fceil: for( unsigned i = 0; i != n; ++i ) d[ i ].f = ceilf( a[ i ].f ); break;
+            case op_ffrac: for( unsigned i = 0; i != n; ++i ) d[ i ].f = a[ i ].f - floorf( a[ i ].f ); break;
+            case op_fsqrt: for( unsigned i = 0; i != n; ++i ) d[ i ].f = sqrtf( a[ i ].f ); break;
+            case op_frsqrt: for( unsigned i = 0; i != n; ++i ) d[ i ].f = 1.0f / sqrtf( a[ i ].f ); break;
+            case op_fexp: for( unsigned i = 0; i != n; ++i ) d[ i ].f = expf( a[ i ].f ); break;
+            case op_fexp2: for( unsigned i = 0; i != n; ++i ) d[ i ].f = exp2f( a[ i ].f ); break;
+            case op_flog: for( unsigned i = 0; i != n; ++i ) d[ i ].f = logf( a[ i ].f ); break;
+            case op_flog2: for( unsigned i = 0; i != n; ++i ) d[ i ].f = log2f( a[ i ].f ); break;
+            case op_fsin: for( unsigned i = 0; i != n; ++i ) d[ i ].f = sinf( a[ i ].f ); break;
+            case op_fcos: for( unsigned i = 0; i != n; ++i ) d[ i ].f = cosf( a[ i ].f ); break;
+            case op_ftan: for( unsigned i = 0; i != n; ++i ) d[ i ].f = tanf( a[ i ].f ); break;
+            case op_fasin: for( unsigned i = 0; i != n; ++i ) d[ i ].f = asinf( a[ i ].f ); break;
+            case op_facos: for( unsigned i = 0; i != n; ++i ) d[ i ].f = acosf( a[ i ].f ); break;
+            case op_fatan: for( unsigned i = 0; i != n; ++i ) d[ i ].f = atanf( a[ i ].f ); break;
+
+            // unsigned arithmetic to wrap without undefined behaviour.
+            case op_iadd: for( unsigned i = 0; i != n; ++i ) d[ i ].i = (int32_t)( (uint32_t)a[ i ].i + (uint32_t)b[ i ].i ); break;
+            case op_isub: for( unsigned i = 0; i != n; ++i ) d[ i ].i = (int32_t)( (uint32_t)a[ i ].i - (uint32_t)b[ i ].i ); break;
+            case op_imul: for( unsigned i = 0; i != n; ++i ) d[ i ].i = (int32_t)( (uint32_t)a[ i ].i * (uint32_t)b[ i ].i ); break;
+            case op_idiv: for( unsigned i = 0; i != n; ++i ) d[ i ].i = idiv( a[ i ].i, b[ i ].i ); break;
+            case op_imod: for( unsigned i = 0; i != n; ++i ) d[ i ].i = imod( a[ i ].i, b[ i ].i ); break;
+            case op_iand: for( unsigned i = 0; i != n; ++i ) d[ i ].i = a[ i ].i & b[ i ].i; break;
+            case op_iandn: for( unsigned i = 0; i != n; ++i ) d[ i ].i = a[ i ].i & ~b[ i ].i; break;
+            case op_ior: for( unsigned i = 0; i != n; ++i ) d[ i ].i = a[ i ].i | b[ i ].i; break;
+            case op_ixor: for( unsigned i = 0; i != n; ++i ) d[ i ].i = a[ i ].i ^ b[ i ].i; break;
+            case op_ishl: for( unsigned i = 0; i != n; ++i ) d[ i ].i = (int32_t)( (uint32_t)a[ i ].i << ( b[ i ].i & 31 ) ); break;
+            case op_ishr: for( unsigned i = 0; i != n; ++i ) d[ i ].i = a[ i ].i >> ( b[ i ].i & 31 ); break;
+            case op_ilt: for( unsigned i = 0; i != n; ++i ) d[ i ].i = -( a[ i ].i < b[ i ].i ); break;
+            case op_ile: for( unsigned i = 0; i != n; ++i ) d[ i ].i = -( a[ i ].i <= b[ i ].i ); break;
+            case op_ieq: for( unsigned i = 0; i != n; ++i ) d[ i ].i = -( a[ i ].i == b[ i ].i ); break;
+            case op_ine: for( unsigned i = 0; i != n; ++i ) d[ i ].i = -( a[ i ].i != b[ i ].i ); break;
+
+            case op_itof: for( unsigned i = 0; i != n; ++i ) d[ i ].f = (float)a[ i ].i; break;
+            case op_ftoi: for( unsigned i = 0; i != n; ++i ) d[ i ].i = (int32_t)a[ i ].f; break;
+          }
+        }
+      }
+
+      bool fail( const char *fmt, ... )
+      {
+        if( error.size() == 0 )
+        {
+          va_list list;
+          va_start( list, fmt );
+          error.vformat( fmt, list );
+          va_end( list );
+          cpp_log( "error: %s\n", error.c_str() );
+        }
+        return false;
+      }
+
+      ////////////////////////////////////////
+      //
+      // slots and instructions
+      //
+
+      unsigned new_slot( slot_kind_enum kind )
+      {
+        slot_info info = { 0, (uint8_t)kind };
+        slots.push_back( info );
+        return slots.size() - 1;
+      }
+
+      unsigned alloc_temp()
+      {
+        unsigned slot;
+        if( free_temps.size() )
+        {
+          slot = free_temps.back();
+          free_temps.pop_back();
+        } else
+        {
+          slot = new_slot( slot_temp );
+        }
+        temps.push_back( slot );
+        return slot;
+      }
+
+      // temps are freed at the end of each statement.
+      void release_temps( unsigned mark )
+      {
+        while( temps.size() > mark )
+        {
+          free_temps.push_back( temps.back() );
+          temps.pop_back();
+        }
+      }
+
+      unsigned alloc_mask()
+      {
+        if( free_masks.size() )
+        {
+          unsigned slot = free_masks.back();
+          free_masks.pop_back();
+          return slot;
+        }
+        return new_slot( slot_variable );
+      }
+
+      unsigned cur_mask()
+      {
+        return masks.size() ? masks.back() : (unsigned)no_mask;
+      }
+
+      unsigned get_constant( uint32_t bits )
+      {
+        uint64_t key = bits | 0x100000000ull;
+        int index = constants.get_index( key );
+        if( index != -1 )
+        {
+          return constants.get_value( index );
+        }
+        unsigned slot = new_slot( slot_constant );
+        slots[ slot ].bits = bits;
+        constants[ key ] = slot;
+        return slot;
+      }
+
+      unsigned float_constant( float value )
+      {
+        lane_value v;
+        v.f = value;
+        return get_constant( (uint32_t)v.i );
+      }
+
+      unsigned int_constant( int32_t value )
+      {
+        return get_constant( (uint32_t)value );
+      }
+
+      bool is_constant( unsigned slot )
+      {
+        return slots[ slot ].kind == slot_constant;
+      }
+
+      void emit_to( unsigned op, unsigned dst, unsigned a, unsigned b = 0, unsigned c = 0 )
+      {
+        instruction ins = { (uint16_t)op, (uint16_t)dst, (uint16_t)a, (uint16_t)b, (uint16_t)c };
+        code.push_back( ins );
+      }
+
+      // emit an instruction that writes a new temp, or work out the result now if the arguments are constants.
+      unsigned emit( unsigned op, unsigned a, unsigned b = 0, unsigned c = 0 )
+      {
+        unsigned args[ 3 ] = { a, b, c };
+        unsigned num_args = get_num_args( op );
+        bool constant = true;
+        for( unsigned i = 0; i != num_args; ++i )
+        {
+          constant = constant && is_constant( args[ i ] );
+        }
+
+        if( constant )
+        {
+          lane_value scratch[ 4 ];
+          scratch[ 0 ].i = 0;
+          for( unsigned i = 0; i != 3; ++i )
+          {
+            scratch[ i + 1 ].i = i < num_args ? (int32_t)slots[ args[ i ] ].bits : 0;
+          }
+          instruction ins = { (uint16_t)op, 0, 1, 2, 3 };
+          execute< 1 >( &ins, 1, scratch );
+          return get_constant( (uint32_t)scratch[ 0 ].i );
+        }
+
+        unsigned dst = alloc_temp();
+        emit_to( op, dst, a, b, c );
+        return dst;
+      }
+
+      unsigned emit_jump( unsigned op, unsigned mask = 0 )
+      {
+        emit_to( op, 0, 0, mask );
+        return code.size() - 1;
+      }
+
+      // make a jump go to the next instruction.
+      void patch( unsigned jump )
+      {
+        code[ jump ].a = (uint16_t)code.size();
+      }
+
+      // copy a value to a variable for every lane. Used for new variables where inactive lanes don't matter.
+      void copy( const operand &dst, const operand &src )
+      {
+        for( unsigned i = 0; i != dst.dim; ++i )
+        {
+          unsigned s = src.slots[ i ], d = dst.slots[ i ];
+          if( s == d )
+          {
+            continue;
+          }
+
+          // write the result of the last instruction straight to the variable if it was a temp used only here.
+          bool retarget = slots[ s ].kind == slot_temp && code.size() && code.back().dst == s && code.back().op < op_jump;
+          for( unsigned j = 0; j != src.dim; ++j )
+          {
+            retarget = retarget && ( j == i || src.slots[ j ] != s );
+          }
+
+          if( retarget )
+          {
+            code.back().dst = (uint16_t)d;
+          } else
+          {
+            emit_to( op_move, d, s );
+          }
+        }
+      }
+
+      // copy a value to a variable for the active lanes only.
+      void store( const operand &dst, operand src )
+      {
+        // v.xy = v.yx needs a copy of the old values first.
+        bool overlap = false;
+        for( unsigned i = 0; i != src.dim; ++i )
+        {
+          for( unsigned j = 0; j != dst.dim; ++j )
+          {
+            overlap = overlap || ( i != j && src.slots[ i ] == dst.slots[ j ] );
+          }
+        }
+        if( overlap )
+        {
+          for( unsigned i = 0; i != src.dim; ++i )
+          {
+            src.slots[ i ] = emit( op_move, src.slots[ i ] );
+          }
+        }
+
+        unsigned mask = cur_mask();
+        if( mask == no_mask )
+        {
+          copy( dst, src );
+        } else
+        {
+          for( unsigned i = 0; i != dst.dim; ++i )
+          {
+            if( src.slots[ i ] != dst.slots[ i ] )
+            {
+              emit_to( op_select, dst.slots[ i ], mask, src.slots[ i ], dst.slots[ i ] );
+            }
+          }
+        }
+      }
+
+      ////////////////////////////////////////
+      //
+      // types and conversions
+      //
+
+      static bool get_type( cpp_type *type, base_enum &base, unsigned &dim )
+      {
+        cpp_type *scalar = type;
+        dim = 1;
+        if( type->getIsVector() )
+        {
+          scalar = type->getSubType();
+          dim = type->getDimension();
+        } else if( !type->getIsScalar() )
+        {
+          return false;
+        }
+
+        switch( scalar->getKind() )
+        {
+          case cpp_type::kind_float: case cpp_type::kind_half: case cpp_type::kind_cfloat: base = base_float; break;
+          case cpp_type::kind_int: case cpp_type::kind_cint: base = base_int; break;
+          case cpp_type::kind_bool: base = base_bool; break;
+          case cpp_type::kind_void: base = base_void; dim = 0; return true;
+          default: return false;
+        }
+        return dim >= 1 && dim <= 4;
+      }
+
+      bool check_type( cpp_type *type, base_enum &base, unsigned &dim )
+      {
+        if( !get_type( type, base, dim ) )
+        {
+          return fail( "only scalar and vector types are supported (%s)", cpp_type::typeName( type->getKind() ) );
+        }
+        return true;
+      }
+
+      bool make_variable( cpp_type *type, operand &result )
+      {
+        if( !check_type( type, result.base, result.dim ) )
+        {
+          return false;
+        }
+        for( unsigned i = 0; i != result.dim; ++i )
+        {
+          result.slots[ i ] = new_slot( slot_variable );
+        }
+        return true;
+      }
+
+      operand make_constant( base_enum base, unsigned dim, long long value )
+      {
+        operand result;
+        result.base = base;
+        result.dim = dim;
+        unsigned slot =
+          base == base_float ? float_constant( (float)value ) :
+          base == base_bool ? int_constant( value ? -1 : 0 ) :
+          int_constant( (int32_t)value )
+        ;
+        for( unsigned i = 0; i != dim; ++i )
+        {
+          result.slots[ i ] = slot;
+        }
+        return result;
+      }
+
+      void convert( operand &value, base_enum base )
+      {
+        if( value.base == base || value.base == base_void || base == base_void )
+        {
+          return;
+        }
+
+        for( unsigned i = 0; i != value.dim; ++i )
+        {
+          // casts from scalars have the same slot in every component.
+          unsigned slot = value.slots[ i ];
+          if( i != 0 && slot == value.slots[ i - 1 ] )
+          {
+            value.slots[ i ] = value.slots[ i - 1 ];
+            continue;
+          }
+
+          switch( value.base )
+          {
+            case base_float:
+            {
+              value.slots[ i ] = base == base_int ? emit( op_ftoi, slot ) : emit( op_fne, slot, float_constant( 0 ) );
+            } break;
+            case base_int:
+            {
+              value.slots[ i ] = base == base_float ? emit( op_itof, slot ) : emit( op_ine, slot, int_constant( 0 ) );
+            } break;
+            default:
+            {
+              value.slots[ i ] = emit( op_iand, slot, base == base_float ? float_constant( 1 ) : int_constant( 1 ) );
+            } break;
+          }
+        }
+        value.base = base;
+      }
+
+      // scalars are copied to every component, vectors are truncated or have the last component repeated.
+      bool resize( operand &value, unsigned dim )
+      {
+        if( value.dim == 0 && dim != 0 )
+        {
+          return fail( "void value used" );
+        }
+        for( unsigned i = value.dim; i < dim; ++i )
+        {
+          value.slots[ i ] = value.slots[ i - 1 ];
+        }
+        value.dim = dim;
+        return true;
+      }
+
+      bool cast( operand &value, cpp_type *type )
+      {
+        base_enum base;
+        unsigned dim;
+        if( !check_type( type, base, dim ) )
+        {
+          return false;
+        }
+        if( base == base_void )
+        {
+          value.base = base_void;
+          value.dim = 0;
+          return true;
+        }
+        convert( value, base );
+        return resize( value, dim );
+      }
+
+      ////////////////////////////////////////
+      //
+      // expressions
+      //
+
+      bool get_variable( cpp_value *value, operand &result )
+      {
+        int index = cur_frame->variables.get_index( value );
+        if( index != -1 )
+        {
+          result = cur_frame->variables.get_value( index );
+          return true;
+        }
+
+        index = globals.get_index( value );
+        if( index != -1 )
+        {
+          result = globals.get_value( index );
+          return true;
+        }
+
+        if( value->getType()->getKind() == cpp_type::kind_function )
+        {
+          return fail( "'%s' is a function", value->getName() );
+        }
+
+        if( global_scope->getExistingValue( value ) == value )
+        {
+          return fail( "global '%s' has a type that is not supported", value->getName() );
+        }
+
+        // locals get registers when they are first used.
+        if( !make_variable( value->getType(), result ) )
+        {
+          return false;
+        }
+        cur_frame->variables[ value ] = result;
+        return true;
+      }
+
+      bool compile_lvalue( cpp_expr *expr, operand &result )
+      {
+        switch( expr->getKind() )
+        {
+          case cpp_expr::kind_value:
+          {
+            return get_variable( expr->getValue(), result );
+          }
+          case cpp_expr::kind_swiz:
+          {
+            operand value;
+            if( !compile_lvalue( expr->getKid( 0 ), value ) || !check_type( expr->getType(), result.base, result.dim ) )
+            {
+              return false;
+            }
+            unsigned char *swiz = expr->getSwiz();
+            for( unsigned i = 0; i != result.dim; ++i )
+            {
+              for( unsigned j = 0; j != i; ++j )
+              {
+                if( swiz[ i ] == swiz[ j ] )
+                {
+                  return fail( "can't assign to the same component twice" );
+                }
+              }
+              if( swiz[ i ] >= value.dim )
+              {
+                return fail( "swizzle is bigger than the vector" );
+              }
+              result.slots[ i ] = value.slots[ swiz[ i ] ];
+            }
+            return true;
+          }
+          case cpp_expr::kind_index:
+          {
+            operand value;
+            long long index = 0;
+            if( !compile_lvalue( expr->getKid( 0 ), value ) )
+            {
+              return false;
+            }
+            if( !cpp_folder::get_int_constant( folder.fold( expr->getKid( 1 ) ), index ) || index < 0 || index >= value.dim )
+            {
+              return fail( "vectors can only be assigned to with a constant index" );
+            }
+            result.base = value.base;
+            result.dim = 1;
+            result.slots[ 0 ] = value.slots[ index ];
+            return true;
+          }
+          default:
+          {
+            return fail( "%s can't be assigned to", cpp_expr::kindName( expr->getKind() ) );
+          }
+        }
+      }
+
+      static bool is_relational( cpp_expr::kind_enum kind )
+      {
+        return kind >= cpp_expr::kind_lt && kind <= cpp_expr::kind_ne;
+      }
+
+      static bool is_arithmetic( cpp_expr::kind_enum kind )
+      {
+        return kind >= cpp_expr::kind_plus && kind <= cpp_expr::kind_mod;
+      }
+
+      // the operator in a compound assignment
+      static cpp_expr::kind_enum get_assignment_op( cpp_expr::kind_enum kind )
+      {
+        switch( kind )
+        {
+          case cpp_expr::kind_times_equals: return cpp_expr::kind_star;
+          case cpp_expr::kind_divide_equals: return cpp_expr::kind_divide;
+          case cpp_expr::kind_mod_equals: return cpp_expr::kind_mod;
+          case cpp_expr::kind_plus_equals: return cpp_expr::kind_plus;
+          case cpp_expr::kind_minus_equals: return cpp_expr::kind_minus;
+          case cpp_expr::kind_shift_left_equals: return cpp_expr::kind_shift_left;
+          case cpp_expr::kind_shift_right_equals: return cpp_expr::kind_shift_right;
+          case cpp_expr::kind_and_equals: return cpp_expr::kind_and;
+          case cpp_expr::kind_xor_equals: return cpp_expr::kind_xor;
+          case cpp_expr::kind_or_equals: return cpp_expr::kind_or;
+          default: return cpp_expr::kind_nop;
+        }
+      }
+
+      // a binary operator on two values. Bools are done as ints for arithmetic.
+      bool binary( cpp_expr::kind_enum kind, operand lhs, operand rhs, operand &result )
+      {
+        if( kind == cpp_expr::kind_or_or || kind == cpp_expr::kind_and_and )
+        {
+          convert( lhs, base_bool );
+          convert( rhs, base_bool );
+          kind = kind == cpp_expr::kind_or_or ? cpp_expr::kind_or : cpp_expr::kind_and;
+        }
+
+        base_enum base = lhs.base == base_bool && is_arithmetic( kind ) ? base_int : lhs.base;
+        convert( lhs, base );
+        convert( rhs, base );
+        unsigned dim = lhs.dim > rhs.dim ? lhs.dim : rhs.dim;
+        if( !resize( lhs, dim ) || !resize( rhs, dim ) )
+        {
+          return false;
+        }
+
+        unsigned op = 0;
+        bool swap = false;
+        if( base == base_float )
+        {
+          switch( kind )
+          {
+            case cpp_expr::kind_plus: op = op_fadd; break;
+            case cpp_expr::kind_minus: op = op_fsub; break;
+            case cpp_expr::kind_star: op = op_fmul; break;
+            case cpp_expr::kind_divide: op = op_fdiv; break;
+            case cpp_expr::kind_mod: op = op_fmod; break;
+            case cpp_expr::kind_lt: op = op_flt; break;
+            case cpp_expr::kind_gt: op = op_flt; swap = true; break;
+            case cpp_expr::kind_le: op = op_fle; break;
+            case cpp_expr::kind_ge: op = op_fle; swap = true; break;
+            case cpp_expr::kind_eq: op = op_feq; break;
+            case cpp_expr::kind_ne: op = op_fne; break;
+            default: return fail( "%s is not allowed on floats", cpp_expr::kindName( kind ) );
+          }
+        } else
+        {
+          switch( kind )
+          {
+            case cpp_expr::kind_plus: op = op_iadd; break;
+            case cpp_expr::kind_minus: op = op_isub; break;
+            case cpp_expr::kind_star: op = op_imul; break;
+            case cpp_expr::kind_divide: op = op_idiv; break;
+            case cpp_expr::kind_mod: op = op_imod; break;
+            case cpp_expr::kind_or: op = op_ior; break;
+            case cpp_expr::kind_and: op = op_iand; break;
+            case cpp_expr::kind_xor: op = op_ixor; break;
+            case cpp_expr::kind_shift_left: op = op_ishl; break;
+            case cpp_expr::kind_shift_right: op = op_ishr; break;
+            case cpp_expr::kind_lt: op = op_ilt; break;
+            case cpp_expr::kind_gt: op = op_ilt; swap = true; break;
+            case cpp_expr::kind_le: op = op_ile; break;
+            case cpp_expr::kind_ge: op = op_ile; swap = true; break;
+            case cpp_expr::kind_eq: op = op_ieq; break;
+            case cpp_expr::kind_ne: op = op_ine; break;
+            default: return fail( "%s is not supported", cpp_expr::kindName( kind ) );
+          }
+        }
+
+        result.base = is_relational( kind ) ? base_bool : base;
+        result.dim = dim;
+        for( unsigned i = 0; i != dim; ++i )
+        {
+          result.slots[ i ] = swap ? emit( op, rhs.slots[ i ], lhs.slots[ i ] ) : emit( op, lhs.slots[ i ], rhs.slots[ i ] );
+        }
+        return true;
+      }
+
+      bool compile_expr( cpp_expr *expr, operand &result )
+      {
+        cpp_expr::kind_enum kind = expr->getKind();
+        switch( kind )
+        {
+          case cpp_expr::kind_nop:
+          {
+            result.base = base_void;
+            result.dim = 0;
+            return true;
+          }
+          case cpp_expr::kind_int_value:
+          {
+            if( !check_type( expr->getType(), result.base, result.dim ) )
+            {
+              return false;
+            }
+            result = make_constant( result.base, result.dim, (long long)expr->getIntValue() );
+            return true;
+          }
+          case cpp_expr::kind_double_value:
+          {
+            if( !check_type( expr->getType(), result.base, result.dim ) )
+            {
+              return false;
+            }
+            if( result.base == base_float )
+            {
+              unsigned slot = float_constant( (float)expr->getDoubleValue() );
+              for( unsigned i = 0; i != result.dim; ++i )
+              {
+                result.slots[ i ] = slot;
+              }
+            } else
+            {
+              result = make_constant( result.base, result.dim, (long long)expr->getDoubleValue() );
+            }
+            return true;
+          }
+          case cpp_expr::kind_value:
+          {
+            return get_variable( expr->getValue(), result );
+          }
+          case cpp_expr::kind_cast:
+          {
+            // the parser makes casts of int constants with no kid.
+            if( expr->getKid( 0 ) == NULL )
+            {
+              if( !check_type( expr->getType(), result.base, result.dim ) )
+              {
+                return false;
+              }
+              result = make_constant( result.base, result.dim, (long long)expr->getIntValue() );
+              return true;
+            }
+            return compile_expr( expr->getKid( 0 ), result ) && cast( result, expr->getType() );
+          }
+          case cpp_expr::kind_init:
+          {
+            // float4( v.xyz, 1.0 )
+            dynarray< cpp_expr * > args;
+            if( expr->getKid( 0 ) )
+            {
+              expr->getKid( 0 )->getCommaList( args );
+            }
+            if( !check_type( expr->getType(), result.base, result.dim ) )
+            {
+              return false;
+            }
+            unsigned num = 0;
+            for( unsigned i = 0; i != args.size(); ++i )
+            {
+              operand arg;
+              if( !compile_expr( args[ i ], arg ) )
+              {
+                return false;
+              }
+              convert( arg, result.base );
+              for( unsigned j = 0; j != arg.dim && num != 4; ++j )
+              {
+                result.slots[ num++ ] = arg.slots[ j ];
+              }
+            }
+            if( num == 1 )
+            {
+              operand scalar = result;
+              scalar.dim = 1;
+              return resize( scalar, result.dim ) && ( result = scalar, true );
+            }
+            if( num < result.dim )
+            {
+              return fail( "not enough values to make a vector of %d", result.dim );
+            }
+            return true;
+          }
+          case cpp_expr::kind_swiz:
+          {
+            operand value;
+            if( !compile_expr( expr->getKid( 0 ), value ) || !check_type( expr->getType(), result.base, result.dim ) )
+            {
+              return false;
+            }
+            unsigned char *swiz = expr->getSwiz();
+            for( unsigned i = 0; i != result.dim; ++i )
+            {
+              if( swiz[ i ] >= value.dim )
+              {
+                return fail( "swizzle is bigger than the vector" );
+              }
+              result.slots[ i ] = value.slots[ swiz[ i ] ];
+            }
+            result.base = value.base;
+            return true;
+          }
+          case cpp_expr::kind_index:
+          {
+            operand value, index;
+            if( !expr->getKid( 0 )->getType()->getIsVector() )
+            {
+              return fail( "only vectors can be indexed" );
+            }
+            if( !compile_expr( expr->getKid( 0 ), value ) || !compile_expr( expr->getKid( 1 ), index ) )
+            {
+              return false;
+            }
+            convert( index, base_int );
+            result.base = value.base;
+            result.dim = 1;
+            if( is_constant( index.slots[ 0 ] ) )
+            {
+              int32_t i = (int32_t)slots[ index.slots[ 0 ] ].bits;
+              if( i < 0 || i >= (int32_t)value.dim )
+              {
+                return fail( "index out of range" );
+              }
+              result.slots[ 0 ] = value.slots[ i ];
+              return true;
+            }
+
+            // pick the component in each lane.
+            unsigned slot = value.slots[ 0 ];
+            for( unsigned i = 1; i != value.dim; ++i )
+            {
+              unsigned mask = emit( op_ieq, index.slots[ 0 ], int_constant( i ) );
+              slot = emit( op_select, mask, value.slots[ i ], slot );
+            }
+            result.slots[ 0 ] = slot;
+            return true;
+          }
+          case cpp_expr::kind_call:
+          {
+            return compile_call( expr, result );
+          }
+          case cpp_expr::kind_comma:
+          {
+            operand discard;
+            return compile_expr( expr->getKid( 0 ), discard ) && compile_expr( expr->getKid( 1 ), result );
+          }
+          case cpp_expr::kind_question:
+          {
+            // both sides are evaluated and the results selected in each lane.
+            operand cond, lhs, rhs;
+            if(
+              !compile_expr( expr->getKid( 0 ), cond ) || !compile_expr( expr->getKid( 1 ), lhs ) || !compile_expr( expr->getKid( 2 ), rhs ) ||
+              !cast( lhs, expr->getType() ) || !cast( rhs, expr->getType() )
+            )
+            {
+              return false;
+            }
+            convert( cond, base_bool );
+            if( !resize( cond, lhs.dim ) )
+            {
+              return false;
+            }
+            result = lhs;
+            for( unsigned i = 0; i != lhs.dim; ++i )
+            {
+              result.slots[ i ] = emit( op_select, cond.slots[ i ], lhs.slots[ i ], rhs.slots[ i ] );
+            }
+            return true;
+          }
+          case cpp_expr::kind_equals:
+          {
+            operand lvalue, value;
+            if( !compile_lvalue( expr->getKid( 0 ), lvalue ) || !compile_expr( expr->getKid( 1 ), value ) || !cast( value, expr->getKid( 0 )->getType() ) )
+            {
+              return false;
+            }
+            store( lvalue, value );
+            result = lvalue;
+            return true;
+          }
+          case cpp_expr::kind_times_equals:
+          case cpp_expr::kind_divide_equals:
+          case cpp_expr::kind_mod_equals:
+          case cpp_expr::kind_plus_equals:
+          case cpp_expr::kind_minus_equals:
+          case cpp_expr::kind_shift_left_equals:
+          case cpp_expr::kind_shift_right_equals:
+          case cpp_expr::kind_and_equals:
+          case cpp_expr::kind_xor_equals:
+          case cpp_expr::kind_or_equals:
+          {
+            operand lvalue, value, rhs;
+            if( !compile_lvalue( expr->getKid( 0 ), lvalue ) || !compile_expr( expr->getKid( 1 ), rhs ) || !cast( rhs, expr->getKid( 0 )->getType() ) )
+            {
+              return false;
+            }
+            if( !binary( get_assignment_op( kind ), lvalue, rhs, value ) )
+            {
+              return false;
+            }
+            convert( value, lvalue.base );
+            store( lvalue, value );
+            result = lvalue;
+            return true;
+          }
+          case cpp_expr::kind_or:
+          case cpp_expr::kind_and:
+          case cpp_expr::kind_xor:
+          case cpp_expr::kind_lt:
+          case cpp_expr::kind_gt:
+          case cpp_expr::kind_le:
+          case cpp_expr::kind_ge:
+          case cpp_expr::kind_eq:
+          case cpp_expr::kind_ne:
+          case cpp_expr::kind_shift_left:
+          case cpp_expr::kind_shift_right:
+          case cpp_expr::kind_plus:
+          case cpp_expr::kind_minus:
+          case cpp_expr::kind_star:
+          case cpp_expr::kind_divide:
+          case cpp_expr::kind_mod:
+          case cpp_expr::kind_or_or:
+          case cpp_expr::kind_and_and:
+          {
+            operand lhs, rhs;
+            if( !compile_expr( expr->getKid( 0 ), lhs ) || !compile_expr( expr->getKid( 1 ), rhs ) )
+            {
+              return false;
+            }
+            return binary( kind, lhs, rhs, result ) && cast( result, expr->getType() );
+          }
+          default:
+          {
+            return fail( "%s is not supported", cpp_expr::kindName( kind ) );
+          }
+        }
+      }
+
+      // apply an operator to each component of the arguments.
+      void componentwise( unsigned op, dynarray< operand > &args, operand &result )
+      {
+        result = args[ 0 ];
+        for( unsigned i = 0; i != result.dim; ++i )
+        {
+          unsigned b = args.size() > 1 ? args[ 1 ].slots[ i ] : 0;
+          unsigned c = args.size() > 2 ? args[ 2 ].slots[ i ] : 0;
+          result.slots[ i ] = emit( op, args[ 0 ].slots[ i ], b, c );
+        }
+      }
+
+      unsigned dot( const operand &lhs, const operand &rhs )
+      {
+        unsigned sum = emit( op_fmul, lhs.slots[ 0 ], rhs.slots[ 0 ] );
+        for( unsigned i = 1; i != lhs.dim; ++i )
+        {
+          sum = emit( op_fmad, lhs.slots[ i ], rhs.slots[ i ], sum );
+        }
+        return sum;
+      }
+
+      // functions declared by cpp_parser::addIntrinsics. The arguments have been cast to the parameter types.
+      bool compile_intrinsic( const char *name, dynarray< operand > &args, operand &result )
+      {
+        static const struct { const char *name; unsigned char num_args; unsigned char op; } simple[] = {
+          { "abs", 1, op_fabs }, { "sign", 1, op_fsign }, { "floor", 1, op_ffloor }, { "ceil", 1, op_fceil },
+          { "frac", 1, op_ffrac }, { "fract", 1, op_ffrac }, { "sqrt", 1, op_fsqrt }, { "rsqrt", 1, op_frsqrt },
+          { "inversesqrt", 1, op_frsqrt }, { "exp", 1, op_fexp }, { "exp2", 1, op_fexp2 }, { "log", 1, op_flog },
+          { "log2", 1, op_flog2 }, { "sin", 1, op_fsin }, { "cos", 1, op_fcos }, { "tan", 1, op_ftan },
+          { "asin", 1, op_fasin }, { "acos", 1, op_facos }, { "atan", 1, op_fatan }, { "atan", 2, op_fatan2 },
+          { "atan2", 2, op_fatan2 }, { "pow", 2, op_fpow }, { "min", 2, op_fmin }, { "max", 2, op_fmax },
+          { "fmod", 2, op_fmod },
+        };
+
+        for( size_t i = 0; i != sizeof( simple ) / sizeof( simple[ 0 ] ); ++i )
+        {
+          if( !strcmp( name, simple[ i ].name ) && args.size() == simple[ i ].num_args )
+          {
+            componentwise( simple[ i ].op, args, result );
+            return true;
+          }
+        }
+
+        operand &a = args[ 0 ];
+        result = a;
+        if( !strcmp( name, "radians" ) || !strcmp( name, "degrees" ) )
+        {
+          unsigned scale = float_constant( !strcmp( name, "radians" ) ? 3.14159265f / 180 : 180 / 3.14159265f );
+          for( unsigned i = 0; i != a.dim; ++i )
+          {
+            result.slots[ i ] = emit( op_fmul, a.slots[ i ], scale );
+          }
+        } else if( !strcmp( name, "saturate" ) )
+        {
+          for( unsigned i = 0; i != a.dim; ++i )
+          {
+            result.slots[ i ] = emit( op_fmin, emit( op_fmax, a.slots[ i ], float_constant( 0 ) ), float_constant( 1 ) );
+          }
+        } else if( !strcmp( name, "step" ) )
+        {
+          // step( edge, x ) is x >= edge ? 1 : 0
+          for( unsigned i = 0; i != a.dim; ++i )
+          {
+            result.slots[ i ] = emit( op_iand, emit( op_fle, a.slots[ i ], args[ 1 ].slots[ i ] ), float_constant( 1 ) );
+          }
+        } else if( !strcmp( name, "mod" ) )
+        {
+          // x - y * floor( x / y ), which is not the same as fmod for negative numbers.
+          for( unsigned i = 0; i != a.dim; ++i )
+          {
+            unsigned y = args[ 1 ].slots[ i ];
+            unsigned q = emit( op_ffloor, emit( op_fdiv, a.slots[ i ], y ) );
+            result.slots[ i ] = emit( op_fsub, a.slots[ i ], emit( op_fmul, y, q ) );
+          }
+        } else if( !strcmp( name, "clamp" ) )
+        {
+          for( unsigned i = 0; i != a.dim; ++i )
+          {
+            result.slots[ i ] = emit( op_fmin, emit( op_fmax, a.slots[ i ], args[ 1 ].slots[ i ] ), args[ 2 ].slots[ i ] );
+          }
+        } else if( !strcmp( name, "lerp" ) || !strcmp( name, "mix" ) )
+        {
+          for( unsigned i = 0; i != a.dim; ++i )
+          {
+            unsigned delta = emit( op_fsub, args[ 1 ].slots[ i ], a.slots[ i ] );
+            result.slots[ i ] = emit( op_fmad, delta, args[ 2 ].slots[ i ], a.slots[ i ] );
+          }
+        } else if( !strcmp( name, "smoothstep" ) )
+        {
+          for( unsigned i = 0; i != a.dim; ++i )
+          {
+            unsigned e0 = a.slots[ i ], e1 = args[ 1 ].slots[ i ], x = args[ 2 ].slots[ i ];
+            unsigned t = emit( op_fdiv, emit( op_fsub, x, e0 ), emit( op_fsub, e1, e0 ) );
+            t = emit( op_fmin, emit( op_fmax, t, float_constant( 0 ) ), float_constant( 1 ) );
+            unsigned poly = emit( op_fmad, t, float_constant( -2 ), float_constant( 3 ) );
+            result.slots[ i ] = emit( op_fmul, emit( op_fmul, t, t ), poly );
+          }
+        } else if( !strcmp( name, "dot" ) )
+        {
+          result.dim = 1;
+          result.slots[ 0 ] = dot( a, args[ 1 ] );
+        } else if( !strcmp( name, "length" ) )
+        {
+          result.dim = 1;
+          result.slots[ 0 ] = emit( op_fsqrt, dot( a, a ) );
+        } else if( !strcmp( name, "distance" ) )
+        {
+          operand delta = a;
+          for( unsigned i = 0; i != a.dim; ++i )
+          {
+            delta.slots[ i ] = emit( op_fsub, a.slots[ i ], args[ 1 ].slots[ i ] );
+          }
+          result.dim = 1;
+          result.slots[ 0 ] = emit( op_fsqrt, dot( delta, delta ) );
+        } else if( !strcmp( name, "normalize" ) )
+        {
+          unsigned scale = emit( op_frsqrt, dot( a, a ) );
+          for( unsigned i = 0; i != a.dim; ++i )
+          {
+            result.slots[ i ] = emit( op_fmul, a.slots[ i ], scale );
+          }
+        } else if( !strcmp( name, "cross" ) )
+        {
+          const operand &b = args[ 1 ];
+          for( unsigned i = 0; i != 3; ++i )
+          {
+            unsigned j = ( i + 1 ) % 3, k = ( i + 2 ) % 3;
+            result.slots[ i ] = emit( op_fsub, emit( op_fmul, a.slots[ j ], b.slots[ k ] ), emit( op_fmul, a.slots[ k ], b.slots[ j ] ) );
+          }
+        } else if( !strcmp( name, "reflect" ) )
+        {
+          // i - 2 * dot( n, i ) * n
+          const operand &n = args[ 1 ];
+          unsigned scale = emit( op_fmul, dot( n, a ), float_constant( 2 ) );
+          for( unsigned i = 0; i != a.dim; ++i )
+          {
+            result.slots[ i ] = emit( op_fsub, a.slots[ i ], emit( op_fmul, scale, n.slots[ i ] ) );
+          }
+        } else
+        {
+          return fail( "function '%s' has no body", name );
+        }
+        return true;
+      }
+
+      // does a function return from inside an if or a loop?
+      static bool has_nested_return( cpp_statement *statement, bool nested )
+      {
+        for( ; statement != NULL; statement = statement->getNext() )
+        {
+          switch( statement->getKind() )
+          {
+            case cpp_statement::kind_return:
+            case cpp_statement::kind_discard:
+            {
+              if( nested ) return true;
+            } break;
+            case cpp_statement::kind_compound:
+            {
+              if( has_nested_return( statement->getStatements(), nested ) ) return true;
+            } break;
+            case cpp_statement::kind_if:
+            case cpp_statement::kind_for:
+            case cpp_statement::kind_while:
+            case cpp_statement::kind_dowhile:
+            {
+              if( has_nested_return( statement->getStatements(), true ) || has_nested_return( statement->getElse(), true ) ) return true;
+            } break;
+            default:
+            {
+            } break;
+          }
+        }
+        return false;
+      }
+
+      // compile a function body with a frame that already has its parameters and result.
+      bool compile_body( frame &callee, cpp_statement *body )
+      {
+        if( !folded.contains( callee.function ) )
+        {
+          folder.fold( body );
+          folded[ callee.function ] = 1;
+        }
+
+        // if some lanes may return early, the rest of the function runs with a mask of the lanes still going.
+        bool alive = has_nested_return( body, false );
+        unsigned mask = 0;
+        callee.first_mask = masks.size();
+        if( alive )
+        {
+          mask = alloc_mask();
+          emit_to( op_move, mask, masks.size() ? cur_mask() : all_ones );
+          masks.push_back( mask );
+        }
+        callee.top_masks = masks.size();
+        callee.returned = false;
+
+        frame *saved = cur_frame;
+        cur_frame = &callee;
+        bool ok = compile_statements( body );
+        cur_frame = saved;
+
+        if( alive )
+        {
+          masks.pop_back();
+          free_masks.push_back( mask );
+        }
+        return ok;
+      }
+
+      bool compile_call( cpp_expr *expr, operand &result )
+      {
+        cpp_value *function = expr->getKid( 0 )->getValue();
+        cpp_type *type = function->getType();
+        cpp_scope *params = type->getScope();
+
+        dynarray< cpp_expr * > actuals;
+        if( expr->getKid( 1 ) )
+        {
+          expr->getKid( 1 )->getCommaList( actuals );
+        }
+        if( actuals.size() != params->size() )
+        {
+          return fail( "wrong number of parameters for '%s'", function->getName() );
+        }
+
+        cpp_expr *init = function->getInit();
+        if( init == NULL || init->getKind() != cpp_expr::kind_statement )
+        {
+          dynarray< operand > args;
+          cpp_scope::iterator param = params->begin();
+          for( unsigned i = 0; i != actuals.size(); ++i, ++param )
+          {
+            operand arg;
+            if( !compile_expr( actuals[ i ], arg ) || !cast( arg, (*param)->getType() ) )
+            {
+              return false;
+            }
+            args.push_back( arg );
+          }
+          return compile_intrinsic( function->getName(), args, result ) && cast( result, type->getSubType() );
+        }
+
+        for( frame *f = cur_frame; f != NULL; f = f->parent )
+        {
+          if( f->function == function )
+          {
+            return fail( "'%s' is recursive", function->getName() );
+          }
+        }
+        if( type->getIsReturnByValue() || ++call_depth > max_call_depth )
+        {
+          return fail( "'%s' can't be called", function->getName() );
+        }
+
+        frame callee;
+        callee.parent = cur_frame;
+        callee.function = function;
+        callee.return_type = type->getSubType();
+        if( !make_variable( callee.return_type, callee.result ) )
+        {
+          return false;
+        }
+
+        // parameters are copies of the arguments. out parameters are copied back after the call.
+        dynarray< operand > out_params;
+        dynarray< operand > out_targets;
+        dynarray< cpp_type * > out_types;
+        cpp_scope::iterator param = params->begin();
+        for( unsigned i = 0; i != actuals.size(); ++i, ++param )
+        {
+          cpp_type *param_type = (*param)->getType();
+          operand slots;
+          if( !make_variable( param_type, slots ) )
+          {
+            return false;
+          }
+          callee.variables[ *param ] = slots;
+
+          if( param_type->getIsOut() )
+          {
+            operand target;
+            if( !compile_lvalue( actuals[ i ], target ) )
+            {
+              return false;
+            }
+            out_params.push_back( slots );
+            out_targets.push_back( target );
+            out_types.push_back( actuals[ i ]->getType() );
+          }
+
+          if( !param_type->getIsOut() || param_type->getIsIn() )
+          {
+            operand arg;
+            if( !compile_expr( actuals[ i ], arg ) || !cast( arg, param_type ) )
+            {
+              return false;
+            }
+            copy( slots, arg );
+          }
+        }
+
+        if( !compile_body( callee, init->getStatement() ) )
+        {
+          return false;
+        }
+        call_depth--;
+
+        for( unsigned i = 0; i != out_params.size(); ++i )
+        {
+          operand value = out_params[ i ];
+          if( !cast( value, out_types[ i ] ) )
+          {
+            return false;
+          }
+          store( out_targets[ i ], value );
+        }
+
+        result = callee.result;
+        return true;
+      }
+
+      ////////////////////////////////////////
+      //
+      // statements
+      //
+
+      // an expression and the temps it needs.
+      bool compile_expression_statement( cpp_expr *expr )
+      {
+        if( expr == NULL )
+        {
+          return true;
+        }
+        unsigned mark = temps.size();
+        operand discard;
+        bool ok = compile_expr( expr, discard );
+        release_temps( mark );
+        return ok;
+      }
+
+      // a scalar bool for an if or a loop.
+      bool compile_condition( cpp_expr *expr, unsigned &slot )
+      {
+        operand cond;
+        if( !compile_expr( expr, cond ) )
+        {
+          return false;
+        }
+        if( cond.dim == 0 )
+        {
+          return fail( "condition is void" );
+        }
+        convert( cond, base_bool );
+        slot = cond.slots[ 0 ];
+        return true;
+      }
+
+      bool compile_return( cpp_statement *statement )
+      {
+        frame *f = cur_frame;
+        if( statement->getExpression() )
+        {
+          unsigned mark = temps.size();
+          operand value;
+          if( !compile_expr( statement->getExpression(), value ) || !cast( value, f->return_type ) )
+          {
+            return false;
+          }
+          store( f->result, value );
+          release_temps( mark );
+        }
+
+        if( masks.size() == f->top_masks )
+        {
+          f->returned = true;
+        } else
+        {
+          // these lanes have finished. Take them out of the masks for this function, innermost last.
+          unsigned mask = cur_mask();
+          for( unsigned i = f->first_mask; i != masks.size(); ++i )
+          {
+            emit_to( op_iandn, masks[ i ], masks[ i ], mask );
+          }
+        }
+        return true;
+      }
+
+      bool compile_if( cpp_statement *statement )
+      {
+        unsigned cond = 0;
+        unsigned mark = temps.size();
+        if( !compile_condition( statement->getExpression(), cond ) )
+        {
+          return false;
+        }
+
+        // if( NUM_LIGHTS > 2 ) only compiles one side.
+        if( is_constant( cond ) )
+        {
+          release_temps( mark );
+          return compile_statements( slots[ cond ].bits ? statement->getStatements() : statement->getElse() );
+        }
+
+        unsigned parent = cur_mask();
+        unsigned then_mask = alloc_mask();
+        emit_to( parent == no_mask ? op_move : op_iand, then_mask, parent == no_mask ? cond : parent, cond );
+        unsigned else_mask = 0;
+        if( statement->getElse() )
+        {
+          else_mask = alloc_mask();
+          emit_to( op_iandn, else_mask, parent == no_mask ? all_ones : parent, cond );
+        }
+        release_temps( mark );
+
+        bool ok = true;
+        unsigned skip = emit_jump( op_jump_if_none, then_mask );
+        masks.push_back( then_mask );
+        ok = compile_statements( statement->getStatements() );
+        masks.pop_back();
+        patch( skip );
+
+        if( ok && statement->getElse() )
+        {
+          skip = emit_jump( op_jump_if_none, else_mask );
+          masks.push_back( else_mask );
+          ok = compile_statements( statement->getElse() );
+          masks.pop_back();
+          patch( skip );
+          free_masks.push_back( else_mask );
+        }
+        free_masks.push_back( then_mask );
+        return ok;
+      }
+
+      bool compile_loop( cpp_statement *statement )
+      {
+        cpp_statement::kind_enum kind = statement->getKind();
+        cpp_expr *cond = statement->getExpression();
+        cpp_expr *step = NULL;
+        if( kind == cpp_statement::kind_for )
+        {
+          if( !compile_expression_statement( cond->getKid( 0 ) ) )
+          {
+            return false;
+          }
+          step = cond->getKid( 2 );
+          cond = cond->getKid( 1 );
+        }
+
+        // lanes leave the loop mask when their condition fails or they return.
+        unsigned parent = cur_mask();
+        unsigned loop_mask = alloc_mask();
+        emit_to( op_move, loop_mask, parent == no_mask ? all_ones : parent );
+        masks.push_back( loop_mask );
+
+        unsigned top = code.size();
+        unsigned exit = 0;
+        bool ok = true;
+        if( kind == cpp_statement::kind_dowhile )
+        {
+          ok = compile_statements( statement->getStatements() );
+        }
+
+        if( ok && cond )
+        {
+          unsigned mark = temps.size();
+          unsigned slot = 0;
+          ok = compile_condition( cond, slot );
+          if( ok )
+          {
+            emit_to( op_iand, loop_mask, loop_mask, slot );
+          }
+          release_temps( mark );
+        }
+
+        if( ok && kind != cpp_statement::kind_dowhile )
+        {
+          exit = emit_jump( op_jump_if_none, loop_mask );
+          ok = compile_statements( statement->getStatements() ) && compile_expression_statement( step );
+          emit_to( op_jump, 0, top );
+          patch( exit );
+        } else if( ok )
+        {
+          emit_to( op_jump_if_any, 0, top, loop_mask );
+        }
+
+        masks.pop_back();
+        free_masks.push_back( loop_mask );
+        return ok;
+      }
+
+      bool compile_statement( cpp_statement *statement )
+      {
+        switch( statement->getKind() )
+        {
+          case cpp_statement::kind_compound:
+          {
+            return compile_statements( statement->getStatements() );
+          }
+          case cpp_statement::kind_expression:
+          case cpp_statement::kind_declaration:
+          {
+            return compile_expression_statement( statement->getExpression() );
+          }
+          case cpp_statement::kind_return:
+          case cpp_statement::kind_discard:
+          {
+            return compile_return( statement );
+          }
+          case cpp_statement::kind_if:
+          {
+            return compile_if( statement );
+          }
+          case cpp_statement::kind_for:
+          case cpp_statement::kind_while:
+          case cpp_statement::kind_dowhile:
+          {
+            return compile_loop( statement );
+          }
+          default:
+          {
+            return fail( "unknown statement" );
+          }
+        }
+      }
+
+      bool compile_statements( cpp_statement *statement )
+      {
+        for( ; statement != NULL && !cur_frame->returned; statement = statement->getNext() )
+        {
+          if( !compile_statement( statement ) )
+          {
+            return false;
+          }
+        }
+        return true;
+      }
+
+      // global variables are uniforms unless they have an initialiser.
+      bool compile_globals()
+      {
+        for( cpp_scope::iterator i = global_scope->begin(); i != global_scope->end(); ++i )
+        {
+          cpp_value *value = *i;
+          cpp_type *type = value->getType();
+          operand slots;
+          if( type->getKind() == cpp_type::kind_function || !get_type( type, slots.base, slots.dim ) || slots.base == base_void )
+          {
+            continue;
+          }
+
+          if( type->getIsUniform() || value->getInit() == NULL )
+          {
+            for( unsigned j = 0; j != slots.dim; ++j )
+            {
+              slots.slots[ j ] = new_slot( slot_uniform );
+            }
+            uniforms_by_name[ value->getName() ] = uniforms.size();
+            uniforms.push_back( slots );
+          } else
+          {
+            operand init;
+            value->setInit( folder.fold( value->getInit() ) );
+            unsigned mark = temps.size();
+            if( !compile_expr( value->getInit(), init ) || !cast( init, type ) )
+            {
+              return false;
+            }
+            bool constant = type->getIsConst();
+            for( unsigned j = 0; j != init.dim; ++j )
+            {
+              constant = constant && is_constant( init.slots[ j ] );
+            }
+            if( constant )
+            {
+              slots = init;
+            } else
+            {
+              make_variable( type, slots );
+              copy( slots, init );
+            }
+            release_temps( mark );
+          }
+          globals[ value ] = slots;
+        }
+        return true;
+      }
+
+      bool compile_entry( cpp_value *function )
+      {
+        cpp_type *type = function->getType();
+        if( type->getIsReturnByValue() )
+        {
+          return fail( "'%s' returns a type that is not supported", function->getName() );
+        }
+
+        frame entry;
+        entry.parent = NULL;
+        entry.function = function;
+        entry.return_type = type->getSubType();
+        entry.first_mask = entry.top_masks = 0;
+        entry.returned = false;
+        cur_frame = &entry;
+
+        if( !compile_globals() || !make_variable( entry.return_type, entry.result ) )
+        {
+          return false;
+        }
+
+        // lanes that don't return anything give zeros.
+        for( unsigned i = 0; i != entry.result.dim; ++i )
+        {
+          io_slot output = { entry.result.slots[ i ], entry.result.base };
+          outputs.push_back( output );
+          emit_to( op_move, entry.result.slots[ i ], int_constant( 0 ) );
+        }
+
+        cpp_scope *params = type->getScope();
+        for( cpp_scope::iterator i = params->begin(); i != params->end(); ++i )
+        {
+          cpp_type *param_type = (*i)->getType();
+          operand slots;
+          if( !make_variable( param_type, slots ) )
+          {
+            return false;
+          }
+          entry.variables[ *i ] = slots;
+          bool is_input = !param_type->getIsOut() || param_type->getIsIn();
+          for( unsigned j = 0; j != slots.dim; ++j )
+          {
+            io_slot io = { slots.slots[ j ], slots.base };
+            if( is_input )
+            {
+              inputs.push_back( io );
+            } else
+            {
+              emit_to( op_move, slots.slots[ j ], int_constant( 0 ) );
+            }
+          }
+        }
+
+        for( cpp_scope::iterator i = params->begin(); i != params->end(); ++i )
+        {
+          if( (*i)->getType()->getIsOut() )
+          {
+            operand slots = entry.variables[ *i ];
+            for( unsigned j = 0; j != slots.dim; ++j )
+            {
+              io_slot output = { slots.slots[ j ], slots.base };
+              outputs.push_back( output );
+            }
+          }
+        }
+
+        bool ok = compile_body( entry, function->getInit()->getStatement() );
+        cur_frame = NULL;
+        return ok;
+      }
+
+    public:
+      cpp_interpreter()
+      {
+        reset();
+      }
+
+      /// forget the program
+      void reset()
+      {
+        code.reset();
+        slots.reset();
+        inputs.reset();
+        outputs.reset();
+        uniforms.reset();
+        uniforms_by_name.reset();
+        registers.reset();
+        error = "";
+        global_scope = NULL;
+        cur_frame = NULL;
+        call_depth = 0;
+      }
+
+      /// compile a function from the last cpp_parser::parse().
+      /// Returns false and sets get_error() if the function uses something that is not supported.
+      bool compile( cpp_parser &parser, const char *function_name )
+      {
+        reset();
+        global_scope = parser.getGlobalScope();
+
+        cpp_value *function = global_scope->lookup( function_name );
+        while( function && ( function->getInit() == NULL || function->getInit()->getKind() != cpp_expr::kind_statement ) )
+        {
+          function = function->getNextPolymorphic();
+        }
+
+        all_ones = int_constant( -1 );
+        bool ok = function != NULL ? compile_entry( function ) : fail( "function '%s' not found", function_name );
+        if( ok && ( slots.size() > max_slots || code.size() > max_instructions ) )
+        {
+          ok = fail( "'%s' is too big", function_name );
+        }
+
+        // compile time state
+        globals.clear();
+        folded.clear();
+        constants.clear();
+        masks.reset();
+        free_masks.reset();
+        temps.reset();
+        free_temps.reset();
+        global_scope = NULL;
+
+        if( !ok )
+        {
+          string saved = error;
+          reset();
+          error = saved;
+          return false;
+        }
+
+        // constants are never written, so they can be set up now.
+        registers.resize( slots.size() * lanes );
+        for( unsigned i = 0; i != slots.size(); ++i )
+        {
+          for( unsigned j = 0; j != lanes; ++j )
+          {
+            registers[ i * lanes + j ].i = (int32_t)slots[ i ].bits;
+          }
+        }
+        return true;
+      }
+
+      /// set a uniform or a global variable without an initialiser.
+      bool set_uniform( const char *name, const float *values, unsigned num_values )
+      {
+        int index = uniforms_by_name.get_index( name );
+        if( index == -1 )
+        {
+          return false;
+        }
+        const operand &uniform = uniforms[ uniforms_by_name.get_value( index ) ];
+        for( unsigned i = 0; i != uniform.dim && i != num_values; ++i )
+        {
+          lane_value value;
+          if( uniform.base == base_float )
+          {
+            value.f = values[ i ];
+          } else
+          {
+            value.i = uniform.base == base_int ? (int32_t)values[ i ] : -( values[ i ] != 0 );
+          }
+          for( unsigned j = 0; j != lanes; ++j )
+          {
+            registers[ uniform.slots[ i ] * lanes + j ] = value;
+          }
+        }
+        return true;
+      }
+
+      /// run the function count times. inputs has an array of count floats for each input component
+      /// and outputs an array for each output component.
+      void run( const float *const *input_arrays, float *const *output_arrays, unsigned count )
+      {
+        lane_value *regs = registers.data();
+        for( unsigned first = 0; first < count; first += lanes )
+        {
+          unsigned n = count - first < lanes ? count - first : lanes;
+          for( unsigned k = 0; k != inputs.size(); ++k )
+          {
+            lane_value *dest = regs + inputs[ k ].slot * lanes;
+            const float *src = input_arrays[ k ] + first;
+            switch( inputs[ k ].base )
+            {
+              case base_float: for( unsigned i = 0; i != n; ++i ) dest[ i ].f = src[ i ]; break;
+              case base_int: for( unsigned i = 0; i != n; ++i ) dest[ i ].i = (int32_t)src[ i ]; break;
+              default: for( unsigned i = 0; i != n; ++i ) dest[ i ].i = -( src[ i ] != 0 ); break;
+            }
+
+            // unused lanes copy the first one, so that they finish loops when it does.
+            for( unsigned i = n; i != lanes; ++i )
+            {
+              dest[ i ] = dest[ 0 ];
+            }
+          }
+
+          execute< lanes >( code.data(), code.size(), regs );
+
+          for( unsigned k = 0; k != outputs.size(); ++k )
+          {
+            const lane_value *src = regs + outputs[ k ].slot * lanes;
+            float *dest = output_arrays[ k ] + first;
+            switch( outputs[ k ].base )
+            {
+              case base_float: for( unsigned i = 0; i != n; ++i ) dest[ i ] = src[ i ].f; break;
+              case base_int: for( unsigned i = 0; i != n; ++i ) dest[ i ] = (float)src[ i ].i; break;
+              default: for( unsigned i = 0; i != n; ++i ) dest[ i ] = src[ i ].i ? 1.0f : 0.0f; break;
+            }
+          }
+        }
+      }
+
+      /// number of float arrays that run() reads
+      unsigned get_num_inputs() const
+      {
+        return inputs.size();
+      }
+
+      /// number of float arrays that run() writes
+      unsigned get_num_outputs() const
+      {
+        return outputs.size();
+      }
+
+      /// number of bytecode instructions
+      unsigned get_num_instructions() const
+      {
+        return code.size();
+      }
+
+      /// number of registers, each with one value for every lane.
+      unsigned get_num_slots() const
+      {
+        return slots.size();
+      }
+
+      /// number of expression nodes replaced by constants by the last compile.
+      unsigned get_num_folded() const
+      {
+        return folder.get_num_folded();
+      }
+
+      /// the reason the last compile failed.
+      const char *get_error() const
+      {
+        return error.c_str();
+      }
+    };
+  }
+}
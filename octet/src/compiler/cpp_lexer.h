@@ -93,6 +93,7 @@ namespace octet
               src++;
             }
             if( *src != '.' ) {
+              value_ = value;
               goto after_int;
             }
           }
@@ -142,6 +143,7 @@ namespace octet
             }
           }
           if( *src == 'u' || *src == 'U' ) {
+            src++;
             type_ = type_ == tok_int_constant ? tok_uint_constant : tok_uint64_constant;
           }
         }
@@ -240,7 +242,7 @@ namespace octet
             
               is_punct('*') ? tok_dot_star :
               ( src_[0] == '.' && src_[1] == '.' ) ? ( src_ += 2, tok_ellipsis ) :
-              tok_star
+              tok_dot
             ;
             break;
           case '/': type_ = is_punct('=') ? tok_divide_equals : tok_divide; break;
@@ -275,7 +277,7 @@ namespace octet
       // identifiers, numbers, strings etc.
       void lex_complex_token() {
         char_type chr = *src_;
-        if( punctuation_start_[ chr ] ) {
+        if( punctuation_start_[ (unsigned char)chr ] ) {
           // larger, called punctuation lexer
           lex_punctuation();
         } else if( is_digit( chr ) ) {
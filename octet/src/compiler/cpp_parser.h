@@ -93,69 +93,55 @@ namespace octet
     #endif
 
     // type equivalence
+    // Types come from a cpp_type_table, so equal types have the same unqualified type.
+    // Functions are unique to their declarations and are compared by signature.
     bool operator == ( cpp_type &lhs, cpp_type &rhs ) {
-      if( &lhs == &rhs ) {
+      cpp_type *l = lhs.getUnqualified();
+      cpp_type *r = rhs.getUnqualified();
+      if( l == r ) {
         return true;
       }
-      if( lhs.getKind() != rhs.getKind() ) {
+      if( l->getKind() != cpp_type::kind_function || r->getKind() != cpp_type::kind_function ) {
         return false;
       }
 
-      cpp_scope *lscope = lhs.getScope();
-      cpp_scope *rscope = rhs.getScope();
-      cpp_type *lsub = lhs.getSubType();
-      cpp_type *rsub = rhs.getSubType();
-      if( lhs.getKind() == cpp_type::kind_array ) {
-        if( lhs.getDimension() != rhs.getDimension() ) {
-          return false;
-        }
-        if( lsub->getIsPacked() != rsub->getIsPacked() ) {
-          return false;
-        }
-      } else if( lscope != NULL || rscope != NULL ) {
-        if( lscope == NULL || rscope == NULL || lscope->size() != rscope->size() ) {
-          return false;
-        }
-        if( lhs.getKind() == cpp_type::kind_struct ) {
-          if( lscope != rscope ) {
-            return false;
-          }
-          if( lhs.getIsPacked() != rhs.getIsPacked() ) {
-            return false;
-          }
-        } else {
-          // check all the types in the scope. ie. function params
-          cpp_scope::iterator l = lscope->begin();
-          cpp_scope::iterator r = rscope->begin();
-          while( l != lscope->end() ) {
-            if( !( (*l)->getType() == (*r)->getType() ) ) {
-              return false;
-            }
-            ++l;
-            ++r;
-          }
-        }
+      cpp_scope *lscope = l->getScope();
+      cpp_scope *rscope = r->getScope();
+      if( l->getSubType() != r->getSubType() || lscope->size() != rscope->size() ) {
+        return false;
       }
 
-      if( lsub != NULL || rsub != NULL ) {
-        if( lsub == NULL || rsub == NULL ) {
-          return false;
-        }
-        if( !( *lsub == *rsub ) ) {
+      // check all the types in the scope. ie. function params
+      cpp_scope::iterator li = lscope->begin();
+      cpp_scope::iterator ri = rscope->begin();
+      while( li != lscope->end() ) {
+        if( (*li)->getType() != (*ri)->getType() ) {
           return false;
         }
+        ++li;
+        ++ri;
       }
-    
       return true;
     }
   
-    // can cast rhs to lhs?
-    bool canCastTo( cpp_type *lhs, cpp_type *rhs ) {
+    // how well does rhs convert to lhs? 3 for the same type, 2 for a conversion between scalars
+    // or between vectors of the same size, 1 for a scalar that is copied into a vector, 0 for no.
+    unsigned castRank( cpp_type *lhs, cpp_type *rhs ) {
       if( *lhs == *rhs ) {
-        return true;
+        return 3;
       }
-    
-      return lhs->getIsScalar() && rhs->getIsScalar();
+      if( lhs->getIsScalar() && rhs->getIsScalar() ) {
+        return 2;
+      }
+      if( lhs->getIsVector() && rhs->getIsVector() && lhs->getDimension() == rhs->getDimension() ) {
+        return 2;
+      }
+      return lhs->getIsVector() && rhs->getIsScalar() ? 1 : 0;
+    }
+
+    // can cast rhs to lhs?
+    bool canCastTo( cpp_type *lhs, cpp_type *rhs ) {
+      return castRank( lhs, rhs ) != 0;
     }
 
     #if 0
@@ -233,6 +219,7 @@ namespace octet
     }
     #endif
 
+    // score a function for a call. 0 if the parameters don't match, higher for fewer conversions.
     unsigned doParametersMatch( dynarray< cpp_type * > &actualTypes, cpp_value *search ) {
       cpp_type *searchType = search->getType();
       assert( searchType->getKind() == cpp_type::kind_function );
@@ -245,22 +232,24 @@ namespace octet
       //cpp_log("num params ok\n";
       dynarray< cpp_type * >::iterator actualType = actualTypes.begin();
     
-      size_t numExact = 0;
-      size_t numPartial = 0;
+      unsigned score = 1;
       for( cpp_scope::iterator formal = scope->begin(); formal != scope->end(); ++formal, ++actualType ) {
         cpp_type *formalType = (*formal)->getType();
         //cpp_log(*formalType << " vs " << **actualType << "\n";
-        if( *formalType == **actualType ) { 
-          numExact++;
-        } else if( canCastTo( formalType, *actualType ) ) {
-          numPartial++;
+        unsigned rank = castRank( formalType, *actualType );
+        if( rank == 0 ) {
+          return 0;
         }
+        score += rank;
       }
-      //cpp_log(numExact << " exact    " << numPartial << "partial\n";
-      return numExact == actualTypes.size() ? 2 : numPartial != 0 ? 1 : 0;
+      return score;
     }
 
     class cpp_parser : cpp_token_enum {
+      // owns everything made by the last parse()
+      cpp_arena arena;
+      cpp_type_table types;
+
       cpp_preprocessor preprocessor;
       cpp_lexer lexer;
       bool dontReadLine;
@@ -270,7 +259,6 @@ namespace octet
       cpp_scope *globalScope;
       cpp_scope *curScope;
       unsigned structNumber;
-      unsigned numTmpVars;
       unsigned numAbstract;
 
       cpp_type *voidType;
@@ -290,7 +278,8 @@ namespace octet
       cpp_type *halfTypes1D[ 4 ];
       cpp_type *halfTypes2D[ 4 ][ 4 ];
 
-      enum { debug = 1, trace_parse = 1 };
+      enum { debug = 0, trace_parse = 0 };
+      enum { max_dimensions = 8 };
 
       enum toks  { tok_asm = cpp_tokens::tok_last, tok_asm_fragment, tok_auto,tok_bool,tok_break,tok_case,tok_catch,tok_char,tok_class,tok_column,tok_major,tok_compile,tok_const,tok_const_cast,tok_continue,tok_decl,tok_default,tok_delete,tok_discard,tok_do,tok_double,tok_dword,tok_dynamic_cast,tok_else,tok_emit,tok_enum,tok_explicit,tok_extern,tok_false,tok_fixed,tok_float,tok_for,tok_friend,tok_get,tok_goto,tok_half,tok_if,tok_in,tok_inline,tok_inout,tok_int,tok_interface,tok_long,tok_matrix,tok_mutable,tok_namespace,tok_new,tok_operator,tok_out,tok_packed,tok_pass,tok_pixelfragment,tok_pixelshader,tok_private,tok_protected,tok_public,tok_register,tok_reinterpret_cast,tok_return,tok_row,tok_sampler,tok_sampler_state,tok_sampler1D,tok_sampler2D,tok_sampler3D,tok_samplerCUBE,tok_samplerRECT,tok_shared,tok_short,tok_signed,tok_sizeof,tok_static,tok_static_cast,tok_string,tok_struct,tok_switch,tok_technique,tok_template,tok_texture,tok_texture1D,tok_texture2D,tok_texture3D,tok_textureCUBE,tok_textureRECT,tok_this,tok_throw,tok_true,tok_try,tok_typedef,tok_typeid,tok_typename,tok_uniform,tok_union,tok_unsigned,tok_using,tok_vector,tok_vertexfragment,tok_vertexshader,tok_virtual,tok_void,tok_volatile,tok_while, tok_lastlast };
 
@@ -343,6 +332,54 @@ namespace octet
         char name[ 16 ];
         const char *params;
       };
+
+      // built in functions, declared in the invariant scope without bodies.
+      // params has the return type, then the parameter types:
+      //   g = float, float2, float3 or float4 (one overload for each)   f = float   3 = float3
+      void addIntrinsics() {
+        static const intrinsic_t intrinsics[] = {
+          { "abs", "gg" }, { "sign", "gg" }, { "floor", "gg" }, { "ceil", "gg" }, { "frac", "gg" }, { "fract", "gg" },
+          { "sqrt", "gg" }, { "rsqrt", "gg" }, { "inversesqrt", "gg" }, { "exp", "gg" }, { "exp2", "gg" }, { "log", "gg" }, { "log2", "gg" },
+          { "sin", "gg" }, { "cos", "gg" }, { "tan", "gg" }, { "asin", "gg" }, { "acos", "gg" }, { "atan", "gg" },
+          { "radians", "gg" }, { "degrees", "gg" }, { "saturate", "gg" }, { "normalize", "gg" },
+          { "pow", "ggg" }, { "min", "ggg" }, { "max", "ggg" }, { "step", "ggg" }, { "atan", "ggg" }, { "atan2", "ggg" },
+          { "fmod", "ggg" }, { "mod", "ggg" }, { "reflect", "ggg" },
+          { "clamp", "gggg" }, { "lerp", "gggg" }, { "mix", "gggg" }, { "smoothstep", "gggg" },
+          { "dot", "fgg" }, { "distance", "fgg" }, { "length", "fg" }, { "cross", "333" },
+        };
+        static const char *paramNames[] = { "a", "b", "c" };
+
+        for( size_t i = 0; i != sizeof( intrinsics ) / sizeof( intrinsics[ 0 ] ); ++i ) {
+          const intrinsic_t &intrinsic = intrinsics[ i ];
+          unsigned maxDim = strchr( intrinsic.params, 'g' ) ? 4 : 1;
+          for( unsigned dim = 1; dim <= maxDim; ++dim ) {
+            cpp_scope *scope = make< cpp_scope >( invariantScope );
+            cpp_type *paramTypes[ 4 ];
+            for( unsigned j = 0; intrinsic.params[ j ]; ++j ) {
+              char code = intrinsic.params[ j ];
+              paramTypes[ j ] = code == '3' ? floatTypes1D[ 2 ] : code == 'g' && dim != 1 ? floatTypes1D[ dim-1 ] : floatType;
+            }
+
+            cpp_type *type = types.makeNominal( cpp_type::kind_function, paramTypes[ 0 ] );
+            type->setScope( scope );
+            for( unsigned j = 1; intrinsic.params[ j ]; ++j ) {
+              cpp_value *param = make< cpp_value >( paramTypes[ j ], paramNames[ j-1 ] );
+              param->setOffset( j-1 );
+              scope->addValue( param );
+            }
+
+            cpp_value *value = make< cpp_value >( type, intrinsic.name );
+            if( cpp_value *found = invariantScope->getExistingValue( value ) ) {
+              while( found->getNextPolymorphic() ) {
+                found = found->getNextPolymorphic();
+              }
+              found->setNextPolymorphic( value );
+            } else {
+              invariantScope->addValue( value );
+            }
+          }
+        }
+      }
     
       dictionary< cpp_value * > values;
       dictionary< cpp_type * > typedefs;
@@ -383,9 +420,14 @@ namespace octet
         return true;
       }
     
+      // make a node in the arena
+      template < class type, class... args_t > type *make( args_t&&... args ) {
+        return arena.make< type >( std::forward< args_t >( args )... );
+      }
+
       cpp_expr *makeIntType( cpp_expr *lhs ) {
         if( lhs->getType()->getKind() != cpp_type::kind_int ) {
-          return new cpp_expr( cpp_expr::kind_cast, intType, lhs );
+          return make< cpp_expr >( cpp_expr::kind_cast, intType, lhs );
         } else {
           return lhs;
         }
@@ -393,9 +435,9 @@ namespace octet
     
       cpp_expr *makeBoolType( cpp_expr *lhs ) {
         if( lhs->getType()->getKind() != cpp_type::kind_bool ) {
-          cpp_expr *zero = new cpp_expr( cpp_expr::kind_cast, intType, (long long)0 );
-          zero = new cpp_expr( cpp_expr::kind_cast, lhs->getType(), zero );
-          return new cpp_expr( cpp_expr::kind_ne, boolType, lhs, zero );
+          cpp_expr *zero = make< cpp_expr >( cpp_expr::kind_cast, intType, (long long)0 );
+          zero = make< cpp_expr >( cpp_expr::kind_cast, lhs->getType(), zero );
+          return make< cpp_expr >( cpp_expr::kind_ne, boolType, lhs, zero );
         } else {
           return lhs;
         }
@@ -404,9 +446,9 @@ namespace octet
       cpp_expr *makeVectorBoolType( cpp_expr *lhs ) {
         if( lhs->getType()->getIsPacked() ) {
           int dim = lhs->getType()->getDimension();
-          cpp_expr *zero = new cpp_expr( cpp_expr::kind_cast, intTypes1D[ dim-1 ], (long long)0 );
-          zero = new cpp_expr( cpp_expr::kind_cast, lhs->getType(), zero );
-          return new cpp_expr( cpp_expr::kind_ne, boolTypes1D[ dim-1 ], lhs, zero );
+          cpp_expr *zero = make< cpp_expr >( cpp_expr::kind_cast, intTypes1D[ dim-1 ], (long long)0 );
+          zero = make< cpp_expr >( cpp_expr::kind_cast, lhs->getType(), zero );
+          return make< cpp_expr >( cpp_expr::kind_ne, boolTypes1D[ dim-1 ], lhs, zero );
         } else {
           return makeBoolType( lhs );
         }
@@ -415,7 +457,7 @@ namespace octet
       // generate code to cast src to destType    
       cpp_expr *makeCast( cpp_expr *src, cpp_type *destType ) {
         //cpp_type *srcType = src->getType();
-        return new cpp_expr( cpp_expr::kind_cast, destType, src );
+        return make< cpp_expr >( cpp_expr::kind_cast, destType, src );
       }
 
       // called twice in the case of binary operators to convert the two types into a common type.
@@ -469,10 +511,12 @@ namespace octet
             if( isFunction && allowFunctionBodies ) {
               cpp_value *search = found;
               for(;;) {
-                string l, r;
-                cpp_log("checking %s == %s\n", search->getType()->toString(l), search->getType()->toString(r));
+                if( trace_parse ) {
+                  string l, r;
+                  cpp_log("checking %s == %s\n", search->getType()->toString(l), search->getType()->toString(r));
+                }
                 if( *search->getType() == *value->getType() ) {
-                  cpp_log("*** same function!\n");
+                  if( trace_parse ) cpp_log("*** same function!\n");
                   // get existing function, but update the function type (parameter names may differ)
                   search->setType( value->getType() );
                   break;
@@ -480,7 +524,7 @@ namespace octet
                 cpp_value *prev = search;
                 search = search->getNextPolymorphic();
                 if( search == NULL ) {
-                  cpp_log("*** new function!\n");
+                  if( trace_parse ) cpp_log("*** new function!\n");
                   // insert new function at end
                   prev->setNextPolymorphic( value );
                   break;
@@ -498,26 +542,28 @@ namespace octet
               cpp_log("error: '%s' has been redefined\n", value->getName());
               return NULL;
             }
-            cpp_expr *val = new cpp_expr( cpp_expr::kind_value, value );
+            cpp_expr *val = make< cpp_expr >( cpp_expr::kind_value, value );
             cpp_expr *rhs = makeCast( init, value->getType() );
-            cpp_expr *assign = new cpp_expr( cpp_expr::kind_equals, value->getType(), val, rhs );
-            expr = expr ? new cpp_expr( cpp_expr::kind_comma, assign->getType(), expr, assign ) : assign;
+            cpp_expr *assign = make< cpp_expr >( cpp_expr::kind_equals, value->getType(), val, rhs );
+            expr = expr ? make< cpp_expr >( cpp_expr::kind_comma, assign->getType(), expr, assign ) : assign;
           } else if( (int)curToken == tok_lbrace && isFunction ) {
             cpp_scope *saveScope = curScope;
             curScope = value->getType()->getScope();
-            string s;
-            cpp_log("parsing body %s\n", curScope->toString(s));
+            if( trace_parse ) {
+              string s;
+              cpp_log("parsing body %s\n", curScope->toString(s));
+            }
             cpp_statement *functionBody = parseStatement();
             curScope = saveScope;
             if( !functionBody ) {
               return NULL;
             }
 
-            cpp_log("[] done function %s\n", value->getName());
+            if( trace_parse ) cpp_log("[] done function %s\n", value->getName());
           
             //functionBody->end()
           
-            value->setInit( new cpp_expr( cpp_expr::kind_statement, functionBody ) );
+            value->setInit( make< cpp_expr >( cpp_expr::kind_statement, functionBody ) );
             finalToken = 0;
             break;
           }
@@ -535,7 +581,7 @@ namespace octet
         }
 
         if( expr == NULL ) {
-          expr = new cpp_expr( cpp_expr::kind_nop, voidType );
+          expr = make< cpp_expr >( cpp_expr::kind_nop, voidType );
         }
         return expr;
       }
@@ -574,55 +620,54 @@ namespace octet
         }
       
         // many arrays allowed in type
-        cpp_type *returned_type = type;
-        cpp_type *working_type = (cpp_type *)type;
-        bool first = true;
+        unsigned dimensions[ max_dimensions ];
+        unsigned numDimensions = 0;
         while( (int)curToken == tok_lbracket ) {
           getNext();
-          //cpp_expr *dim = parseExpression( 0 );
+
+          // int x[] has no dimension, otherwise we need a constant.
+          long long dimension = 0;
+          if( (int)curToken != tok_rbracket ) {
+            cpp_folder folder;
+            cpp_expr *dim = folder.fold( parseExpression( 0 ) );
+            if( dim == NULL || !cpp_folder::get_int_constant( dim, dimension ) || dimension < 0 ) {
+              cpp_log("error: expecting constant int in []\n");
+              return NULL;
+            }
+          }
+
           if( !expect( tok_rbracket ) ) {
             return NULL;
           }
           getNext();
-        
-          // translate immediately.
-          /*BasicBlock *bb = NULL;
-          Value *cexpr = dim->translate_rvalue( bb, *this, true );
-          if( cexpr == NULL || !isa< ConstantInt >( cexpr ) ) {
-            cpp_log("error: expecting constant int in []\n");
+
+          if( numDimensions == max_dimensions ) {
+            cpp_log("error: too many array dimensions\n");
             return NULL;
           }
-        
-          uint64_t dimension = cast< ConstantInt >( cexpr )->getValue().getLimitedValue();
-          */
-          uint64_t dimension = 0;
-
-          if( first ) {
-            cpp_type *new_type = new cpp_type( cpp_type::kind_array, type, (unsigned)dimension );
-            returned_type = working_type = new_type;
-            first = false;
-          } else {
-            cpp_type *new_type = new cpp_type( cpp_type::kind_array, type, (unsigned)dimension );
-            working_type->setSubType( new_type );
-            working_type = new_type;
-          }
+          dimensions[ numDimensions++ ] = (unsigned)dimension;
+        }
+
+        // int x[2][3] is an array of two arrays of three ints.
+        cpp_type *returned_type = type;
+        while( numDimensions ) {
+          returned_type = types.getArray( returned_type, dimensions[ --numDimensions ] );
         }
       
         // only one function allowed in type      
         if( (int)curToken == tok_lparen ) {
           cpp_scope *saveScope = curScope;
-          curScope = new cpp_scope( curScope );
+          curScope = make< cpp_scope >( curScope );
         
-          cpp_type *new_type = new cpp_type( cpp_type::kind_function );
+          cpp_type *new_type = types.makeNominal( cpp_type::kind_function );
           new_type->setScope( curScope );
           getNext();
         
           unsigned paramOffset = 0;
         
           if( returned_type->getIsPassByPtr() ) {
-            cpp_type *rtype = new cpp_type( *returned_type );
-            rtype->setIsOut( true );
-            cpp_value *value = new cpp_value( rtype, "$return" );
+            cpp_type *rtype = types.getQualified( returned_type, returned_type->getFlags() | cpp_type::flag_out );
+            cpp_value *value = make< cpp_value >( rtype, "$return" );
             value->setOffset( paramOffset++ );
             curScope->addValue( value );
             new_type->setSubType( voidType );
@@ -673,7 +718,7 @@ namespace octet
           return NULL;
         }
 
-        cpp_value *value = new cpp_value( returned_type, name );
+        cpp_value *value = make< cpp_value >( returned_type, arena.strdup( name ) );
 
         if( (int)curToken == tok_colon ) {
           getNext();
@@ -686,14 +731,14 @@ namespace octet
             if( !expect( tok_identifier ) ) {
               return NULL;
             }
-            value->setSemantic( lexer.id() );
+            value->setSemantic( arena.strdup( lexer.id() ) );
             getNext();
             if( !expect( tok_rparen ) ) {
               return NULL;
             }
             getNext();
           } else if( expect( tok_identifier ) ) {
-            value->setSemantic( lexer.id() );
+            value->setSemantic( arena.strdup( lexer.id() ) );
             getNext();
           } else {
             return NULL;
@@ -762,12 +807,11 @@ namespace octet
                 getNext();
               
                 if( cpp_type *tagType = findTag( structId ) ) {
-                  printf( "*** old tag %s\n", structId.c_str() );
+                  if( trace_parse ) cpp_log("*** old tag %s\n", structId.c_str());
                   thisType = tagType;
                 } else {
-                  printf( "*** new tag %s\n", structId.c_str() );
-                  thisType = new cpp_type( cpp_type::kind_struct );
-                  thisType->setScope( NULL );
+                  if( trace_parse ) cpp_log("*** new tag %s\n", structId.c_str());
+                  thisType = types.makeNominal( cpp_type::kind_struct );
                   makeTypedef( thisType, structId );
                   makeTag( thisType, structId );
                 }
@@ -775,8 +819,7 @@ namespace octet
                 char tmp[ 20 ];
                 sprintf( tmp, "__anon%d", structNumber++ );
                 string structId = tmp;
-                thisType = new cpp_type( cpp_type::kind_struct );
-                thisType->setScope( NULL );
+                thisType = types.makeNominal( cpp_type::kind_struct );
                 makeTypedef( thisType, structId );
                 makeTag( thisType, structId );
               }
@@ -788,7 +831,7 @@ namespace octet
                 }
                 getNext();
 
-                cpp_scope *scope = new cpp_scope( NULL );
+                cpp_scope *scope = make< cpp_scope >( (cpp_scope*)NULL );
                 thisType->setScope( scope );
                 unsigned structOffset = 0;
 
@@ -827,12 +870,12 @@ namespace octet
             case tok_int: newType = intType; goto typeCommon;
             case tok_float: newType = floatType; goto typeCommon;
             case tok_half: newType = floatType; goto typeCommon;
-            case tok_sampler: newType = new cpp_type( cpp_type::kind_sampler ); goto typeCommon;
-            case tok_sampler1D: newType = new cpp_type( cpp_type::kind_sampler1D ); goto typeCommon;
-            case tok_sampler2D: newType = new cpp_type( cpp_type::kind_sampler2D ); goto typeCommon;
-            case tok_sampler3D: newType = new cpp_type( cpp_type::kind_sampler3D ); goto typeCommon;
-            case tok_samplerRECT: newType = new cpp_type( cpp_type::kind_samplerRECT ); goto typeCommon;
-            case tok_samplerCUBE: newType = new cpp_type( cpp_type::kind_samplerCUBE ); goto typeCommon;
+            case tok_sampler: newType = types.get( cpp_type::kind_sampler ); goto typeCommon;
+            case tok_sampler1D: newType = types.get( cpp_type::kind_sampler1D ); goto typeCommon;
+            case tok_sampler2D: newType = types.get( cpp_type::kind_sampler2D ); goto typeCommon;
+            case tok_sampler3D: newType = types.get( cpp_type::kind_sampler3D ); goto typeCommon;
+            case tok_samplerRECT: newType = types.get( cpp_type::kind_samplerRECT ); goto typeCommon;
+            case tok_samplerCUBE: newType = types.get( cpp_type::kind_samplerCUBE ); goto typeCommon;
             typeCommon:
             {
               if( thisType ) {
@@ -886,11 +929,13 @@ namespace octet
             cpp_log("error: qualifier without type\n");
           }
         } else {
-          thisType->setIsConst( isConst );
-          thisType->setIsUniform( isUniform );
-          thisType->setIsIn( isIn );
-          thisType->setIsOut( isOut );
-          thisType->setIsPacked( isPacked );
+          // qualifiers make a variant of the type, the type itself is shared.
+          unsigned flags =
+            ( isConst ? cpp_type::flag_const : 0 ) | ( isUniform ? cpp_type::flag_uniform : 0 ) |
+            ( isIn ? cpp_type::flag_in : 0 ) | ( isOut ? cpp_type::flag_out : 0 ) | ( isPacked ? cpp_type::flag_packed : 0 ) |
+            ( thisType->getFlags() & cpp_type::flag_return_by_value )
+          ;
+          thisType = types.getQualified( thisType, flags );
         }
         return thisType;
       }
@@ -899,9 +944,9 @@ namespace octet
         cpp_statement *result = NULL;
         if( (int)curToken == tok_lbrace ) {
           cpp_scope *saveScope = curScope;
-          curScope = new cpp_scope( curScope );
+          curScope = make< cpp_scope >( curScope );
         
-          result = new cpp_statement( cpp_statement::kind_compound );
+          result = make< cpp_statement >( cpp_statement::kind_compound );
           result->setScope( curScope );
           getNext();
           cpp_statement **prev = result->getStatementsAddr();
@@ -929,10 +974,10 @@ namespace octet
             if( expr == NULL ) {
               return NULL;
             }
-            result = new cpp_statement( cpp_statement::kind_return );
+            result = make< cpp_statement >( cpp_statement::kind_return );
             result->setExpression( expr );
           } else {
-            result = new cpp_statement( cpp_statement::kind_return );
+            result = make< cpp_statement >( cpp_statement::kind_return );
           }
           if( !expect( tok_semicolon ) ) {
             return NULL;
@@ -940,7 +985,7 @@ namespace octet
           getNext();
         } else if( (int)curToken == tok_discard ) {
           getNext();
-          result = new cpp_statement( cpp_statement::kind_return );
+          result = make< cpp_statement >( cpp_statement::kind_return );
           if( !expect( tok_semicolon ) ) {
             return NULL;
           }
@@ -957,9 +1002,9 @@ namespace octet
           getNext();
 
           cpp_scope *saveScope = curScope;
-          curScope = new cpp_scope( curScope );
+          curScope = make< cpp_scope >( curScope );
 
-          result = new cpp_statement( isFor ? cpp_statement::kind_for : isIf ? cpp_statement::kind_if : cpp_statement::kind_while );
+          result = make< cpp_statement >( isFor ? cpp_statement::kind_for : isIf ? cpp_statement::kind_if : cpp_statement::kind_while );
           result->setScope( curScope );
         
           cpp_expr *expr = NULL;
@@ -986,7 +1031,7 @@ namespace octet
             }
             getNext();
             cpp_expr *expr3 = parseExpression();
-            expr = new cpp_expr( cpp_expr::kind_for, NULL, expr, expr2, expr3 );
+            expr = make< cpp_expr >( cpp_expr::kind_for, (cpp_type*)NULL, expr, expr2, expr3 );
           }
         
           result->setExpression( expr );
@@ -1008,7 +1053,7 @@ namespace octet
             if( else_stmt == NULL ) {
               return NULL;
             }
-            *result->getNextAddr() = else_stmt;
+            result->setElse( else_stmt );
           }
         
           curScope = saveScope;
@@ -1016,7 +1061,7 @@ namespace octet
         } else if( (int)curToken == tok_do ) {
           getNext();
 
-          result = new cpp_statement( cpp_statement::kind_dowhile );
+          result = make< cpp_statement >( cpp_statement::kind_dowhile );
 
           cpp_statement *stmt = parseStatement();
           if( stmt == NULL || !expect( tok_while ) ) {
@@ -1034,20 +1079,20 @@ namespace octet
             return NULL;
           }
           result->setExpression( expr );
-          /*if( !expect( tok_semicolon ) ) {
+          if( !expect( tok_semicolon ) ) {
             return NULL;
           }
-          getNext();*/
+          getNext();
           return result;
         } else if( cpp_type *type = parseDeclspec() ) {
-          result = new cpp_statement( cpp_statement::kind_declaration );
+          result = make< cpp_statement >( cpp_statement::kind_declaration );
           cpp_expr *init = parseDeclarators( type, false, tok_semicolon, false );
           if( init == NULL ) {
             return NULL;
           }
           result->setExpression( init );
         } else if( cpp_expr *expr = parseExpression() ) {
-          result = new cpp_statement( cpp_statement::kind_expression );
+          result = make< cpp_statement >( cpp_statement::kind_expression );
           result->setExpression( expr );
           if( !expect( tok_semicolon ) ) {
             return NULL;
@@ -1066,15 +1111,15 @@ namespace octet
           cpp_log("[+] expr\n");
         }
         if( (int)curToken == tok_minus || (int)curToken == tok_plus ) {
-          //unsigned op = curToken;
+          unsigned op = curToken;
           getNext();
           cpp_expr * rhs = parseExpression( 100 );
           if( rhs == NULL ) {
             return result;
           }
-          cpp_expr *zero = new cpp_expr( cpp_expr::kind_int_value, intType, (long long)0 );
-          zero = new cpp_expr( cpp_expr::kind_cast, rhs->getType(), zero );
-          result = new cpp_expr( (int)curToken == tok_minus ? cpp_expr::kind_minus : cpp_expr::kind_plus, rhs->getType(), zero, rhs );
+          cpp_expr *zero = make< cpp_expr >( cpp_expr::kind_int_value, intType, (long long)0 );
+          zero = make< cpp_expr >( cpp_expr::kind_cast, rhs->getType(), zero );
+          result = make< cpp_expr >( op == tok_minus ? cpp_expr::kind_minus : cpp_expr::kind_plus, rhs->getType(), zero, rhs );
         } else if( (int)curToken == tok_not ) {
           //unsigned op = curToken;
           getNext();
@@ -1083,9 +1128,9 @@ namespace octet
             return result;
           }
           rhs = makeBoolType( rhs );
-          cpp_expr *one = new cpp_expr( cpp_expr::kind_int_value, intType, (long long)1 );
-          one = new cpp_expr( cpp_expr::kind_cast, rhs->getType(), one );
-          result = new cpp_expr( cpp_expr::kind_xor, rhs->getType(), one, rhs );
+          cpp_expr *one = make< cpp_expr >( cpp_expr::kind_int_value, intType, (long long)1 );
+          one = make< cpp_expr >( cpp_expr::kind_cast, rhs->getType(), one );
+          result = make< cpp_expr >( cpp_expr::kind_xor, rhs->getType(), one, rhs );
         } else if( (int)curToken == tok_tilda ) {
           //unsigned op = curToken;
           getNext();
@@ -1094,19 +1139,19 @@ namespace octet
             return result;
           }
           rhs = makeIntType( rhs );
-          cpp_expr *one = new cpp_expr( cpp_expr::kind_int_value, intType, (long long)-1 );
-          one = new cpp_expr( cpp_expr::kind_cast, rhs->getType(), one );
-          result = new cpp_expr( cpp_expr::kind_xor, rhs->getType(), one, rhs );
+          cpp_expr *one = make< cpp_expr >( cpp_expr::kind_int_value, intType, (long long)-1 );
+          one = make< cpp_expr >( cpp_expr::kind_cast, rhs->getType(), one );
+          result = make< cpp_expr >( cpp_expr::kind_xor, rhs->getType(), one, rhs );
         } else if( (int)curToken == tok_plus_plus || (int)curToken == tok_minus_minus ) {
-          //unsigned op = curToken;
+          unsigned op = curToken;
           getNext();
           cpp_expr *rhs = parseExpression( 100 );
           if( rhs == NULL ) {
             return result;
           }
-          cpp_expr *inc = new cpp_expr( cpp_expr::kind_int_value, intType, (long long)1 );
-          inc = new cpp_expr( cpp_expr::kind_cast, rhs->getType(), inc );
-          result = new cpp_expr( (int)curToken == tok_plus_plus ? cpp_expr::kind_plus_equals : cpp_expr::kind_minus_equals, rhs->getType(), rhs, inc );
+          cpp_expr *inc = make< cpp_expr >( cpp_expr::kind_int_value, intType, (long long)1 );
+          inc = make< cpp_expr >( cpp_expr::kind_cast, rhs->getType(), inc );
+          result = make< cpp_expr >( op == tok_plus_plus ? cpp_expr::kind_plus_equals : cpp_expr::kind_minus_equals, rhs->getType(), rhs, inc );
         } else if( (int)curToken == tok_identifier ) {
           string name( lexer.id() );
           cpp_type *type = findTypedef( name );
@@ -1116,7 +1161,7 @@ namespace octet
               return NULL;
             }
             cpp_expr *init = parseExpression( 100 );
-            result = new cpp_expr( cpp_expr::kind_init, type, init );
+            result = make< cpp_expr >( cpp_expr::kind_init, type, init );
           } else {
             cpp_value *value = curScope->lookup( name );
             /*if( value == NULL && buildIntrinsic( name.c_str() ) ) {
@@ -1127,16 +1172,19 @@ namespace octet
               return NULL;
             }
             getNext();
-            result = new cpp_expr( cpp_expr::kind_value, value );
+            result = make< cpp_expr >( cpp_expr::kind_value, value );
           }
         } else if( (int)curToken == tok_int_constant || (int)curToken == tok_int64_constant || (int)curToken == tok_uint_constant || (int)curToken == tok_uint64_constant ) {
           //result = (int64_type)lexer_.value();
-          result = new cpp_expr( cpp_expr::kind_int_value, cintType, (long long)lexer.value() );
+          result = make< cpp_expr >( cpp_expr::kind_int_value, cintType, (long long)lexer.value() );
           getNext();
         } else if( (int)curToken == tok_float_constant || (int)curToken == tok_double_constant ) {
-          result = new cpp_expr( cpp_expr::kind_double_value, cfloatType, lexer.double_value() );
+          result = make< cpp_expr >( cpp_expr::kind_double_value, cfloatType, lexer.double_value() );
           //result = (int64_type)lexer_.value();
-          getNext();  
+          getNext();
+        } else if( (int)curToken == tok_true || (int)curToken == tok_false ) {
+          result = make< cpp_expr >( cpp_expr::kind_int_value, boolType, (long long)( (int)curToken == tok_true ) );
+          getNext();
         } else if( (int)curToken == tok_lparen ) {
           getNext();
           cpp_type *type = parseDeclspec();
@@ -1146,7 +1194,7 @@ namespace octet
             }
             getNext();
             cpp_expr * rhs = parseExpression( 100 );
-            result = new cpp_expr( cpp_expr::kind_cast, type, rhs );
+            result = make< cpp_expr >( cpp_expr::kind_cast, type, rhs );
           } else {
             result = parseExpression();
             expect( tok_rparen );
@@ -1169,8 +1217,8 @@ namespace octet
               return NULL;
             }
             if( result->getType()->getIsVector() ) {
-              cpp_type *newType = new cpp_type( *result->getType() );
-              cpp_expr *newExpr = new cpp_expr( cpp_expr::kind_swiz, newType, result );
+              cpp_type *vectorType = result->getType();
+              cpp_expr *newExpr = make< cpp_expr >( cpp_expr::kind_swiz, vectorType, result );
               unsigned char *swiz = newExpr->getSwiz();
               unsigned numSwiz = 0;
               bool bad = false;
@@ -1189,14 +1237,11 @@ namespace octet
               }
             
               // single swizzles make scalars
-              string s;
-              cpp_log("%s\n", newType->toString(s));
               if( numSwiz == 1 ) {
-                *newType = *newType->getSubType();
+                newExpr->setType( vectorType->getSubType() );
               } else {
-                newType->setDimension( numSwiz );
+                newExpr->setType( types.get( cpp_type::kind_array, vectorType->getSubType(), numSwiz, vectorType->getFlags() ) );
               }
-              cpp_log("..%s\n", newType->toString(s));
               getNext();
               result = newExpr;
             } else if( result->getType()->getKind() != cpp_type::kind_struct ) {
@@ -1210,7 +1255,7 @@ namespace octet
                 cpp_log("error: structure does not have a member '%s'.\n", name.c_str());
                 return NULL;
               }
-              result = new cpp_expr( cpp_expr::kind_dot, result, value );
+              result = make< cpp_expr >( cpp_expr::kind_dot, result, value );
             }
           } else if( (int)curToken == tok_lparen ) {
             getNext();
@@ -1221,53 +1266,56 @@ namespace octet
                 return NULL;
               }
               getNext();
-              result = new cpp_expr( cpp_expr::kind_int_value, cintType, (long long )0 );
+              result = make< cpp_expr >( cpp_expr::kind_int_value, cintType, (long long )0 );
             } else {
               if( result->getKind() != cpp_expr::kind_value || result->getType()->getKind() != cpp_type::kind_function ) {
                 cpp_log("error: calling something that is not a function.");
                 return NULL;
               }
-              cpp_expr *rhs = parseExpression( 0 );
+              // f() has no parameters
+              cpp_expr *rhs = NULL;
+              if( (int)curToken != tok_rparen ) {
+                rhs = parseExpression( 0 );
+                if( rhs == NULL ) {
+                  return NULL;
+                }
+              }
 
               if( !expect( tok_rparen ) ) {
                 return NULL;
               }
               getNext();
 
+              dynarray< cpp_expr * > actuals;
+              if( rhs != NULL ) {
+                rhs->getCommaList( actuals );
+              }
               dynarray< cpp_type * > actualTypes;
-              if( rhs->getKind() != cpp_expr::kind_comma ) {
-                actualTypes.push_back( rhs->getType() );
-              } else {
-                for( cpp_expr *expr = rhs; ; expr = expr->getKid( 0 ) ) {
-                  if( expr->getKind() == cpp_expr::kind_comma ) {
-                    actualTypes.push_back( expr->getKid( 1 )->getType() );
-                  } else {
-                    actualTypes.push_back( expr->getType() );
-                    break;
-                  }
-                }
+              for( unsigned i = 0; i != actuals.size(); ++i ) {
+                actualTypes.push_back( actuals[ i ]->getType() );
               }
 
+              // pick the function that needs the fewest conversions.
               cpp_value *value = NULL;
               cpp_value *firstValue = result->getValue();
+              unsigned bestScore = 0;
+              bool ambiguous = false;
               for( cpp_value *search = firstValue; search != NULL; search = search->getNextPolymorphic() ) {
                 unsigned score = doParametersMatch( actualTypes, search );
-                if( score == 2 ) {
-                  // exact match. ignore any others.
-                  value = search;
-                  break;
-                }
-                if( score == 1 ) {
-                  // partial match, will need casts.
-                  if( value != NULL ) {
-                    cpp_log("error: more than one function matches parameters\n");
-                    result = NULL;
-                    break;
-                  }
+                if( score != 0 && score == bestScore ) {
+                  ambiguous = true;
+                } else if( score > bestScore ) {
                   value = search;
+                  bestScore = score;
+                  ambiguous = false;
                 }
               }
 
+              if( ambiguous ) {
+                cpp_log("error: more than one function matches parameters\n");
+                result = NULL;
+              }
+
               if( result != NULL ) {
                 if( value == NULL ) {
                   //error( "", 0, "no matching function found\n" );
@@ -1286,7 +1334,7 @@ namespace octet
                 } else {
                   result->setType( value->getType() );
                   result->setValue( value );
-                  result = new cpp_expr( cpp_expr::kind_call, result->getType()->getSubType(), result, rhs );
+                  result = make< cpp_expr >( cpp_expr::kind_call, result->getType()->getSubType(), result, rhs );
                 }
               }
             }
@@ -1299,18 +1347,17 @@ namespace octet
               cpp_log("error: trying to use [] on non-array");
               return NULL;
             }
-            result = new cpp_expr( cpp_expr::kind_index, result->getType()->getSubType(), result, rhs );
+            result = make< cpp_expr >( cpp_expr::kind_index, result->getType()->getSubType(), result, rhs );
           } else if( (int)curToken == tok_plus_plus || (int)curToken == tok_minus_minus ) {
+            // x++ is ( x += 1 ) - 1
+            bool isPlus = (int)curToken == tok_plus_plus;
             getNext();
-            char name[ 32 ];
-            sprintf( name, "$tmp%d", numTmpVars++ );
-            cpp_value *tmp = new cpp_value( result->getType(), name );
-            cpp_expr *inc = new cpp_expr( cpp_expr::kind_int_value, intType, (long long)1 );
-            inc = new cpp_expr( cpp_expr::kind_cast, result->getType(), inc );
-            inc = new cpp_expr( (int)curToken == tok_plus_plus ? cpp_expr::kind_plus_equals : cpp_expr::kind_minus_equals, result->getType(), result, inc );
-            cpp_expr *tmpExpr = new cpp_expr( cpp_expr::kind_value, tmp );
-            //cpp_expr *tmpAssign = new cpp_expr( cpp_expr::kind_equals, result->getType(), tmpExpr, result );
-            result = new cpp_expr( cpp_expr::kind_comma, result->getType(), inc, tmpExpr );
+            cpp_expr *inc = make< cpp_expr >( cpp_expr::kind_int_value, intType, (long long)1 );
+            inc = make< cpp_expr >( cpp_expr::kind_cast, result->getType(), inc );
+            cpp_expr *dec = make< cpp_expr >( cpp_expr::kind_int_value, intType, (long long)1 );
+            dec = make< cpp_expr >( cpp_expr::kind_cast, result->getType(), dec );
+            inc = make< cpp_expr >( isPlus ? cpp_expr::kind_plus_equals : cpp_expr::kind_minus_equals, result->getType(), result, inc );
+            result = make< cpp_expr >( isPlus ? cpp_expr::kind_minus : cpp_expr::kind_plus, result->getType(), inc, dec );
           } else {
             break;
           }
@@ -1327,7 +1374,7 @@ namespace octet
 
           // left grouping operators will parse like ( ( a + b ) + c ) + d    so rhs will accept fewer tokens
           // right grouping operators will parse like a = ( b = ( c = d ) )   so rhs will accept more tokens
-          cpp_expr *rhs = parseExpression( tokenToPrecidence[ op ] - tokenIsRightGrouping[ curToken ] );
+          cpp_expr *rhs = parseExpression( tokenToPrecidence[ op ] - tokenIsRightGrouping[ op ] );
           if( rhs == NULL ) {
             return NULL;
           }
@@ -1336,7 +1383,7 @@ namespace octet
 
             case tok_comma:
             {
-              result = new cpp_expr( cpp_expr::kind_comma, rhs->getType(), result, rhs );
+              result = make< cpp_expr >( cpp_expr::kind_comma, rhs->getType(), result, rhs );
             } break;
             case tok_question:
             {
@@ -1344,7 +1391,7 @@ namespace octet
                 return NULL;
               }
                getNext();
-              cpp_expr *rhs2 = parseExpression( tokenToPrecidence[ op ] - tokenIsRightGrouping[ curToken ] );
+              cpp_expr *rhs2 = parseExpression( tokenToPrecidence[ op ] - tokenIsRightGrouping[ op ] );
             
               rhs = makeSameType( rhs, rhs2 );
               if( result == NULL ) {
@@ -1357,7 +1404,7 @@ namespace octet
                 return NULL;
               }
 
-              result = new cpp_expr( cpp_expr::kind_question, rhs->getType(), makeVectorBoolType( result ), rhs, rhs2 );
+              result = make< cpp_expr >( cpp_expr::kind_question, rhs->getType(), makeVectorBoolType( result ), rhs, rhs2 );
             } break;
             case tok_or: kind = cpp_expr::kind_or; goto binop;
             case tok_and: kind = cpp_expr::kind_and; goto binop;
@@ -1383,7 +1430,7 @@ namespace octet
                 cpp_log("error: unable to convert types\n");
                 return NULL;
               }
-              result = new cpp_expr( kind, rhs->getType(), result, rhs );
+              result = make< cpp_expr >( kind, rhs->getType(), result, rhs );
             } break;
 
             case tok_lt: kind = cpp_expr::kind_lt; goto relop;
@@ -1404,13 +1451,15 @@ namespace octet
                 cpp_log("error: unable to convert types\n");
                 return NULL;
               }
-              result = new cpp_expr( kind, boolType, result, rhs );
+              // comparing vectors makes a vector of bools
+              cpp_type *type = rhs->getType()->getIsVector() ? boolTypes1D[ rhs->getType()->getDimension()-1 ] : boolType;
+              result = make< cpp_expr >( kind, type, result, rhs );
             } break;
 
             case tok_equals:
             {
               rhs = makeCast( rhs, result->getType() );
-              result = new cpp_expr( cpp_expr::kind_equals, rhs->getType(), result, rhs );
+              result = make< cpp_expr >( cpp_expr::kind_equals, rhs->getType(), result, rhs );
             } break;
             case tok_divide_equals: kind = cpp_expr::kind_divide_equals; goto assignop;
             case tok_mod_equals: kind = cpp_expr::kind_mod_equals; goto assignop;
@@ -1425,7 +1474,7 @@ namespace octet
             assignop:
             {
               rhs = makeCast( rhs, result->getType() );
-              result = new cpp_expr( cpp_expr::kind_equals, rhs->getType(), result, new cpp_expr( kind, rhs->getType(), result, rhs ) );
+              result = make< cpp_expr >( kind, rhs->getType(), result, rhs );
             } break;
             default:
             {
@@ -1484,7 +1533,7 @@ namespace octet
       }
 
     public:
-      cpp_parser() {
+      cpp_parser() : types( arena ) {
         for (int i = tok_last; i != tok_lastlast; ++i) {
           lexer.add_identifier(getTokenName(i), i);
         }
@@ -1508,44 +1557,55 @@ namespace octet
         tokenToPrecidence[ tok_lparen ] = 13;
         tokenToPrecidence[ tok_lbracket ] = 13;
       
+        // a, b, c groups to the left like ( a, b ), c
         memset( tokenIsRightGrouping, 0, sizeof( tokenIsRightGrouping ) );
-        tokenIsRightGrouping[ tok_comma ] = 1;
         tokenIsRightGrouping[ tok_equals ] = tokenIsRightGrouping[ tok_times_equals ] = tokenIsRightGrouping[ tok_divide_equals ] = tokenIsRightGrouping[ tok_mod_equals ] = tokenIsRightGrouping[ tok_plus_equals ] = 1;
         tokenIsRightGrouping[ tok_minus_equals ] = tokenIsRightGrouping[ tok_shift_left_equals ] = 1;
         tokenIsRightGrouping[ tok_shift_right_equals ] = tokenIsRightGrouping[ tok_and_equals ] = tokenIsRightGrouping[ tok_xor_equals ] = tokenIsRightGrouping[ tok_or_equals ] = 1;
         tokenIsRightGrouping[ tok_question ] = 1;
 
-        invariantScope = new cpp_scope( NULL );
-        curScope = globalScope = new cpp_scope( invariantScope );
+        reset();
+      }
+
+      /// free everything made by the last parse and start again with the built in types.
+      void reset() {
+        arena.reset();
+        types.reset();
+        values.reset();
+        typedefs.reset();
+        tags.reset();
+
+        invariantScope = make< cpp_scope >( (cpp_scope*)NULL );
+        curScope = globalScope = make< cpp_scope >( invariantScope );
       
         dontReadLine = false;
       
-        voidType = makeTypedef( new cpp_type( cpp_type::kind_void ), "void" );
-        intType = makeTypedef( new cpp_type( cpp_type::kind_int ), "int" );
-        floatType = makeTypedef( new cpp_type( cpp_type::kind_float ), "float" );
-        doubleType = makeTypedef( new cpp_type( cpp_type::kind_float ), "double" );
-        halfType = makeTypedef( new cpp_type( cpp_type::kind_half ), "half" );
-        boolType = makeTypedef( new cpp_type( cpp_type::kind_bool ), "bool" );
-        cintType = new cpp_type( cpp_type::kind_cint );
-        cfloatType = new cpp_type( cpp_type::kind_cfloat );
+        voidType = makeTypedef( types.get( cpp_type::kind_void ), "void" );
+        intType = makeTypedef( types.get( cpp_type::kind_int ), "int" );
+        floatType = makeTypedef( types.get( cpp_type::kind_float ), "float" );
+        doubleType = makeTypedef( types.get( cpp_type::kind_float ), "double" );
+        halfType = makeTypedef( types.get( cpp_type::kind_half ), "half" );
+        boolType = makeTypedef( types.get( cpp_type::kind_bool ), "bool" );
+        cintType = types.get( cpp_type::kind_cint );
+        cfloatType = types.get( cpp_type::kind_cfloat );
       
         for( unsigned i = 1; i <= 4; ++i ) {
           char tmp[ 10 ];
 
           sprintf( tmp, "bool%d", i );
-          cpp_type *bool_type = new cpp_type( cpp_type::kind_bool, i, true );
+          cpp_type *bool_type = types.getVector( cpp_type::kind_bool, i );
           makeTypedef( bool_type, tmp );
 
           sprintf( tmp, "int%d", i );
-          cpp_type *int_type = new cpp_type( cpp_type::kind_int, i, true );
+          cpp_type *int_type = types.getVector( cpp_type::kind_int, i );
           makeTypedef( int_type, tmp );
 
           sprintf( tmp, "float%d", i );
-          cpp_type *float_type = new cpp_type( cpp_type::kind_float, i, true );
+          cpp_type *float_type = types.getVector( cpp_type::kind_float, i );
           makeTypedef( float_type, tmp );
 
           sprintf( tmp, "half%d", i );
-          cpp_type *half_type = new cpp_type( cpp_type::kind_half, i, true );
+          cpp_type *half_type = types.getVector( cpp_type::kind_half, i );
           makeTypedef( half_type, tmp );
         
           boolTypes1D[ i-1 ] = bool_type;
@@ -1557,34 +1617,37 @@ namespace octet
             char tmp[ 10 ];
             cpp_type *type;
             sprintf( tmp, "bool%dx%d", i, j );
-            type = new cpp_type( cpp_type::kind_array, bool_type, j );
+            type = types.getArray( bool_type, j );
             makeTypedef( type, tmp );
             boolTypes2D[ i-1 ][ j-1 ] = type;
 
             sprintf( tmp, "int%dx%d", i, j );
-            type = new cpp_type( cpp_type::kind_array, int_type, j );
+            type = types.getArray( int_type, j );
             makeTypedef( type, tmp );
             intTypes2D[ i-1 ][ j-1 ] = type;
 
             sprintf( tmp, "float%dx%d", i, j );
-            type = new cpp_type( cpp_type::kind_array, float_type, j );
+            type = types.getArray( float_type, j );
             makeTypedef( type, tmp );
             floatTypes2D[ i-1 ][ j-1 ] = type;
 
             sprintf( tmp, "half%dx%d", i, j );
-            type = new cpp_type( cpp_type::kind_array, half_type, j );
+            type = types.getArray( half_type, j );
             makeTypedef( type, tmp );
             halfTypes2D[ i-1 ][ j-1 ] = type;
           }
         }
       
+        addIntrinsics();
+
         // initialise anaonymous structure index
         structNumber = 0;
         numAbstract = 0;
-        numTmpVars = 0;
       }
 
+      /// parse a translation unit. Nodes from the previous parse are freed.
       void parse(const char *src) {
+        reset();
         preprocessor.begin(src);
         lexer.start(preprocessor.cur_line());
         dontReadLine = false;
@@ -1598,6 +1661,21 @@ namespace octet
         }
       }
 
+      /// functions and variables declared by the last parse
+      cpp_scope *getGlobalScope() {
+        return globalScope;
+      }
+
+      /// types made by the last parse
+      cpp_type_table &getTypes() {
+        return types;
+      }
+
+      /// memory used by the last parse
+      const cpp_arena &getArena() const {
+        return arena;
+      }
+
     };
   }
 }
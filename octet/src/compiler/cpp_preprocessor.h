@@ -7,6 +7,10 @@
 // C/C++ language subset preprocessor
 // This was tested against GCC on a set of header files
 //
+// Source files are split into lines once and kept in a cache shared by all preprocessors,
+// so headers included by many shaders are only read and scanned the first time.
+// Headers with an include guard or #pragma once are skipped when included again.
+//
 
 namespace octet
 {
@@ -35,15 +39,17 @@ namespace octet
         stringise_escape = 253,
         param_escape = 254,
         stringise_param_escape = 255,
+
+        // bits of the identifier hash used to find lines with no macros in them.
+        define_bits_size_ = 0x10000,
       };
-    
+
+      struct source_file;
+
       struct include_stack_entry_ {
-        const char *current_;
-        const char *end_;
+        const source_file *file_;
+        unsigned line_;
         const char *file_name_;
-        string currentPath;
-        unsigned line_number_;
-        bool is_wchar_;
       };
     
       struct if_stack_entry_ {
@@ -60,15 +66,296 @@ namespace octet
         const char_type *text_;
       };
 
-      struct map_file_result {
-        string filename_;
-        const char *source_;
-        const char *source_end_;
+      /// A source file split into logical lines: comments become spaces, escaped newlines
+      /// join lines and carriage returns are dropped. Text lines also record the hashes of
+      /// their identifiers so that lines without macros can be output without lexing.
+      struct source_file {
+        enum line_kind { kind_blank, kind_directive, kind_text };
+
+        struct line_type {
+          unsigned offset_;       // in text_
+          unsigned line_number_;  // of the first line
+          unsigned first_id_;     // in id_hashes_
+          unsigned num_ids_;
+          line_kind kind_;
+        };
+
+        string path_;
+        string dir_;              // for includes relative to this file
+        int64_t mtime_;
+        int64_t size_;
+        dynarray<char_type> text_;
+        dynarray<line_type> lines_;
+        dynarray<unsigned> id_hashes_;
+        string guard_;            // name of the include guard macro, if there is one
+
+        source_file(const char *path) : mtime_(0), size_(0) {
+          path_ = path;
+          dir_ = path;
+          dir_.truncate(dir_.filename_pos());
+        }
+
+        /// split the text into lines.
+        void split(const char *current, const char *end) {
+          dynarray<char_type> buf(max_chars_);
+          char_type *dest_max = buf.data() + max_chars_ - 1;
+          unsigned line_num = 1;
+          while (current != end) {
+            unsigned first_line = line_num;
+            char_type *dest = buf.data();
+            while( current != end ) {
+              char_type chr = *current++;
+              if( chr == '\n' ) {
+                // newline
+                line_num++;
+                break;
+              } else if( chr == '/' ) {
+                if( current != end && *current == '/' ) {
+                  // c++ comment
+                  current++;
+                  while( current != end && ( current[ 0 ] != '\n' || current[ -1 ] == '\\' ) ) {
+                    line_num += current[ 0 ] == '\n';
+                    current++;
+                  }
+                  if( current != end ) {
+                    current++;
+                    line_num++;
+                  }
+                  break;
+                } else if( current != end && *current == '*' ) {
+                  // c comment
+                  current++;
+                  while( current != end && ( current[ 0 ] != '/' || current[ -1 ] != '*' ) ) {
+                    line_num += current[ 0 ] == '\n';
+                    current++;
+                  }
+                  if( current == end ) {
+                    cpp_log("error: unterminated comment\n");
+                    break;
+                  }
+
+                  current++;
+                  *dest = ' ';
+                  dest += dest != dest_max;
+                } else {
+                  *dest = chr;
+                  dest += dest != dest_max;
+                }
+              } else if( chr == '\\' ) {
+                // \ escape
+                if( current != end && *current == '\n' ) {
+                  current++;
+                  line_num++;
+                } else {
+                  *dest = chr;
+                  dest += dest != dest_max;
+                }
+              } else if( chr != '\r' ) {
+                *dest = chr;
+                dest += dest != dest_max;
+              }
+            }
+
+            if( dest == dest_max ) {
+              cpp_log("error: line too long\n");
+            }
+            *dest = 0;
+            add_line(buf.data(), first_line);
+          }
+          find_guard();
+        }
+
+        /// load and split a file. returns false if it can not be read.
+        bool load() {
+          FILE *file = fopen(path_, "rb");
+          if (!file) return false;
+          dynarray<char> bytes;
+          fseek(file, 0, SEEK_END);
+          bytes.resize((unsigned)ftell(file));
+          fseek(file, 0, SEEK_SET);
+          size_t size = fread(bytes.data(), 1, bytes.size(), file);
+          fclose(file);
+          split(bytes.data(), bytes.data() + size);
+          return true;
+        }
+
+        const char_type *get_text(const line_type &line) const {
+          return text_.data() + line.offset_;
+        }
+
+      private:
+        static bool is_space(char_type chr) {
+          return chr > 0 && chr <= ' ';
+        }
+
+        static bool is_id_start(char_type chr) {
+          return ( chr >= 'a' && chr <= 'z' ) || ( chr >= 'A' && chr <= 'Z' ) || chr == '_';
+        }
+
+        static bool is_id_middle(char_type chr) {
+          return is_id_start( chr ) || ( chr >= '0' && chr <= '9' );
+        }
+
+        void add_line(const char_type *src, unsigned line_number) {
+          line_type line;
+          line.offset_ = text_.size();
+          line.line_number_ = line_number;
+          line.first_id_ = id_hashes_.size();
+          line.num_ids_ = 0;
+
+          const char_type *p = src;
+          while (is_space(*p)) ++p;
+          line.kind_ = *p == 0 ? kind_blank : *p == '#' ? kind_directive : kind_text;
+
+          if (line.kind_ == kind_text) {
+            // identifiers outside strings and numbers.
+            while (*p) {
+              char_type chr = *p;
+              if (is_id_start(chr)) {
+                const char_type *id = p;
+                while (is_id_middle(*p)) ++p;
+                id_hashes_.push_back(interned_string::calc_hash(id, p - id));
+              } else if ((chr >= '0' && chr <= '9') || (chr == '.' && p[1] >= '0' && p[1] <= '9')) {
+                ++p;
+                while (is_id_middle(*p) || *p == '.') ++p;
+              } else if (chr == '"' || chr == '\'') {
+                ++p;
+                while (*p && *p != chr) p += p[0] == '\\' && p[1] ? 2 : 1;
+                p += *p != 0;
+              } else {
+                ++p;
+              }
+            }
+            line.num_ids_ = id_hashes_.size() - line.first_id_;
+          }
+
+          size_t len = strlen(src) + 1;
+          unsigned offset = text_.size();
+          text_.resize(offset + (unsigned)len);
+          memcpy(text_.data() + offset, src, len);
+          lines_.push_back(line);
+        }
+
+        // if the line is "# word", return the text after the word.
+        const char_type *directive(unsigned index, const char *word) const {
+          const char_type *p = get_text(lines_[index]);
+          while (is_space(*p)) ++p;
+          if (*p++ != '#') return NULL;
+          while (is_space(*p)) ++p;
+          size_t len = strlen(word);
+          if (strncmp(p, word, len) || is_id_middle(p[len])) return NULL;
+          p += len;
+          while (is_space(*p)) ++p;
+          return p;
+        }
+
+        // copy an identifier, returning false if there isn't one.
+        static bool get_id(string &result, const char_type *p) {
+          const char_type *id = p;
+          while (is_id_middle(*p)) ++p;
+          if (p == id || !is_id_start(*id)) return false;
+          result.set(id, (unsigned)(p - id));
+          return true;
+        }
+
+        // A guarded file is #ifndef X (or #if !defined(X)) then #define X, ending with
+        // the #endif for the #ifndef. Including it again adds nothing while X is defined.
+        void find_guard() {
+          unsigned first = 0, last = lines_.size();
+          while (first != last && lines_[first].kind_ == kind_blank) ++first;
+          while (last != first && lines_[last-1].kind_ == kind_blank) --last;
+          if (last - first < 3) return;
+
+          string name;
+          const char_type *p = directive(first, "ifndef");
+          if (p) {
+            if (!get_id(name, p)) return;
+          } else if ((p = directive(first, "if")) != NULL) {
+            if (*p++ != '!') return;
+            while (is_space(*p)) ++p;
+            if (strncmp(p, "defined", 7)) return;
+            p += 7;
+            while (is_space(*p)) ++p;
+            bool paren = *p == '(';
+            p += paren;
+            while (is_space(*p)) ++p;
+            if (!get_id(name, p)) return;
+          } else {
+            return;
+          }
+
+          unsigned second = first + 1;
+          while (lines_[second].kind_ == kind_blank) ++second;
+          string defined;
+          p = directive(second, "define");
+          if (!p || !get_id(defined, p) || defined != name.c_str()) return;
+
+          // the #endif of the #ifndef must be the last line.
+          int depth = 0;
+          for (unsigned i = first; i != last; ++i) {
+            if (lines_[i].kind_ != kind_directive) continue;
+            if (directive(i, "if") || directive(i, "ifdef") || directive(i, "ifndef")) {
+              depth++;
+            } else if (directive(i, "endif")) {
+              if (--depth == 0 && i != last - 1) return;
+            }
+          }
+          if (depth == 0) {
+            guard_ = name;
+          }
+        }
       };
-    
+
+      // source files shared by all preprocessors, by path.
+      struct file_cache {
+        std::mutex mutex_;
+        dictionary<source_file*> files_;
+        // older versions of changed files, which may still be in use.
+        dynarray<source_file*> retired_;
+      };
+
+      static file_cache &cache() {
+        static file_cache instance;
+        return instance;
+      }
+
+      // Get a file from the cache, reading it if it is new or has changed on disk.
+      static const source_file *get_cached_file(const char *path) {
+        struct stat st;
+        if (stat(path, &st) != 0 || (st.st_mode & S_IFMT) != S_IFREG) {
+          return NULL;
+        }
+
+        file_cache &c = cache();
+        std::lock_guard<std::mutex> lock(c.mutex_);
+        source_file *&file = c.files_[path];
+        if (file && file->mtime_ == (int64_t)st.st_mtime && file->size_ == (int64_t)st.st_size) {
+          return file;
+        }
+        if (file) {
+          c.retired_.push_back(file);
+        }
+
+        file = new source_file(path);
+        file->mtime_ = (int64_t)st.st_mtime;
+        file->size_ = (int64_t)st.st_size;
+        if (!file->load()) {
+          delete file;
+          file = NULL;
+        }
+        return file;
+      }
+
       struct define_type {
         string text_;
         bool has_params_; // check for ()
+        bool has_ids_;    // false if the text can be output without expanding it again
+      };
+
+      // function-like macro expansions for the current line.
+      struct expansion_type {
+        char_type *text_;
+        size_t size_;
       };
 
       struct define_expansion_type {
@@ -76,7 +363,25 @@ namespace octet
         const char_type *src_;          // saved value of previous lexer_.get_src()
       };
 
-      dictionary< define_type > defines_;
+      // NULL after #undef
+      dictionary< define_type* > defines_;
+
+      // set for the hash of every name that has been defined.
+      bitset< define_bits_size_ > define_bits_;
+
+      // files included in this run, by the name in the #include. NULL if not found.
+      dictionary< const source_file* > run_files_;
+
+      // files that have had #pragma once in this run.
+      hash_map< void*, bool > once_files_;
+
+      // the file passed to begin()
+      source_file *root_file_;
+
+      dynarray<expansion_type> expansions_;
+
+      unsigned num_lines_;
+      unsigned num_skipped_includes_;
 
       const char_type *cur_line_;
       if_stack_entry_ *if_stack_ptr_;
@@ -122,10 +427,50 @@ namespace octet
         return include_stack_.back();
       }
 
-      bool map_file(map_file_result &result, const char *filename, const char *first_path) {
-        result.filename_.format("%s%s", first_path, filename);
-        result.source_ = result.source_end_ = 0;
-        return true;
+      // find an included file, first next to the file including it.
+      const source_file *find_include(const char *filename) {
+        const char *dir = include().file_->dir_.c_str();
+        string path;
+        path.format("%s%s", dir, filename);
+
+        int index = run_files_.get_index(path.c_str());
+        if (index != -1) {
+          return run_files_.get_value(index);
+        }
+
+        const source_file *result = get_cached_file(path.c_str());
+        if (!result && dir[0]) {
+          result = get_cached_file(filename);
+        }
+        run_files_[path.c_str()] = result;
+        return result;
+      }
+
+      define_type *find_define(const char *name) {
+        int index = defines_.get_index(name);
+        return index == -1 ? NULL : defines_.get_value(index);
+      }
+
+      // false if no identifier in the line has been defined, so it does not need expanding.
+      bool may_expand(const source_file *file, const typename source_file::line_type &line) {
+        const unsigned *hashes = file->id_hashes_.data() + line.first_id_;
+        for (unsigned i = 0; i != line.num_ids_; ++i) {
+          if (define_bits_[hashes[i] & (define_bits_size_ - 1)]) {
+            return true;
+          }
+        }
+        return false;
+      }
+
+      void release_expansions() {
+        for (unsigned i = 0; i != expansions_.size(); ++i) {
+          allocator::free(expansions_[i].text_, expansions_[i].size_);
+        }
+        expansions_.resize(0);
+      }
+
+      bool at_end() {
+        return include().line_ == include().file_->lines_.size();
       }
   
       unsigned line_number() {
@@ -144,21 +489,12 @@ namespace octet
         return *s1 != 0 || *s2 != 0;
       }
     
-      void push_include( const char *current, const char *end, const char *file_name, unsigned line_number ) {
-        //size_t length = strlen( file_name );
-        string currentPath = file_name;
-        int pos = currentPath.filename_pos();
-        currentPath.truncate(pos);
-      
-        {
-          include_stack_.resize(include_stack_.size() + 1);
-          include_stack_entry_ &entry = include();
-          entry.current_ = current;
-          entry.end_ = end;
-          entry.file_name_ = file_name;
-          entry.line_number_ = line_number;
-          entry.currentPath = currentPath;
-        }
+      void push_include( const source_file *file ) {
+        include_stack_.resize(include_stack_.size() + 1);
+        include_stack_entry_ &entry = include();
+        entry.file_ = file;
+        entry.line_ = 0;
+        entry.file_name_ = file->path_.c_str();
       }
     
       void push_if( bool is_true ) {
@@ -215,8 +551,7 @@ namespace octet
         return is_id_start( chr ) || is_digit( chr );
       }
     
-      char_type *define_expansion( int index ) {
-        define_type &define = defines_.get_value(index);
+      char_type *define_expansion( define_type &define ) {
         if( define.has_params_ ) {
           unsigned num_params = 0;
           char_type *dest = params_;
@@ -255,7 +590,7 @@ namespace octet
                   }
                   do
                   {
-                    if( include().current_ == include().end_ ) {
+                    if( at_end() ) {
                       cpp_log("error: end of file in define expansion\n");
                       fail = true;
                       break;
@@ -343,12 +678,17 @@ namespace octet
             }
           }
         
-          char_type *text = (char_type *)allocator::malloc( ( dest - expand_line_ + 1 ) * sizeof( char_type ) );
+          size_t size = ( dest - expand_line_ + 1 ) * sizeof( char_type );
+          char_type *text = (char_type *)allocator::malloc( size );
           char_type *text_dest = text;
           for( src = expand_line_; src != dest; ++src ) {
             *text_dest++ = *src;
           }
           *text_dest = 0;
+
+          // freed at the start of the next line
+          expansion_type exp = { text, size };
+          expansions_.push_back(exp);
           //context_.debug( "result: %s\n\n", text );
           return text;
         } else {
@@ -403,16 +743,16 @@ namespace octet
             //string name( lexer_.id() );
             //context_.debug( "\nexpand: [%s] %s\n", lexer_.id(), lexer_.get_src() );
             const char *name = (const char*)lexer_.id();
-            int index = defines_.get_index( name );
+            define_type *define = find_define( name );
 
             for( unsigned i = 0; i != def_exp_stack_depth_; ++i ) {
-              if( def_exp_stack_[ i ].name_ != name ) {
-                index = -1; // already expanding this define
+              if( def_exp_stack_[ i ].name_ == name ) {
+                define = NULL; // already expanding this define
                 break;
               }
             }
 
-            if( index != -1 ) {
+            if( define ) {
               if( def_exp_stack_depth_ ) {
                 while( src != prev ) {
                   if( (*src & 255) == stringise_escape ) {
@@ -435,9 +775,18 @@ namespace octet
                 *dest = ' ';
                 dest += dest != dest_max;
               }*/
-            
 
-              const char_type *expansion = define_expansion( index );
+              if( !define->has_ids_ ) {
+                // constants like "#define N 10" need no further expansion.
+                for( const char_type *text = define->text_.c_str(); *text; ++text ) {
+                  *dest = *text;
+                  dest += dest != dest_max;
+                }
+                src = lexer_.get_src();
+                continue;
+              }
+
+              const char_type *expansion = define_expansion( *define );
 
               define_expansion_type &exp = def_exp_stack_[ def_exp_stack_depth_ ];
               exp.src_ = lexer_.get_src();
@@ -481,17 +830,17 @@ namespace octet
           }
 
           const char *name = (const char*)lexer_.id();
-          int index = defines_.get_index(name);
+          define_type *define = find_define(name);
 
           for( unsigned i = 0; i != def_exp_stack_depth_; ++i ) {
             if( def_exp_stack_[ i ].name_ == name ) {
-              index = -1; // already expanding this define
+              define = NULL; // already expanding this define
               break;
             }
           }
 
-          if( index != -1 ) {
-            char_type *expansion = define_expansion( index );
+          if( define ) {
+            char_type *expansion = define_expansion( *define );
             define_expansion_type &exp = def_exp_stack_[ def_exp_stack_depth_ ];
             exp.src_ = lexer_.get_src();
             exp.name_ = name;
@@ -549,7 +898,7 @@ namespace octet
               name = (const char*)lexer_.id();
               next_raw();
             }
-            result = defines_.get_index( name ) != -1;
+            result = find_define( name ) != NULL;
           } else {
             // unknown define, return 0
             next();
@@ -619,7 +968,13 @@ namespace octet
           return;
         }
 
-        define_type &define = defines_[(const char*)lexer_.id()];
+        const char *name = (const char*)lexer_.id();
+        define_type *&slot = defines_[name];
+        if( !slot ) {
+          slot = new define_type();
+        }
+        define_type &define = *slot;
+        define_bits_.setbit( interned_string::calc_hash( name, strlen( name ) ) & ( define_bits_size_ - 1 ) );
 
         name_type params[ max_define_params_ ];
         unsigned num_define_params = 0;
@@ -663,8 +1018,10 @@ namespace octet
         }
 
         bool hash = false;
+        bool has_ids = false;
         while( lexer_.type() != tok_newline ) {
           unsigned param;
+          has_ids |= lexer_.type() == tok_identifier;
           if( lexer_.type() == tok_identifier && find_param( params, num_define_params, &param ) ) {
             *dest++ = hash ? stringise_param_escape : param_escape;
             *dest++ = param + '0';
@@ -693,6 +1050,7 @@ namespace octet
         unsigned num_chars = (unsigned)( dest - write_line_ + 1 );
         define.text_.set((const char*)write_line_, num_chars);
         define.has_params_ = has_params;
+        define.has_ids_ = has_ids || has_params;
         //context_.debug( "#define %s [%s] %d\n", name.text(), define.text_, define.has_params_ );
       
         //context_.debug( "index=%d\n", defines_.index( name ) );
@@ -723,7 +1081,7 @@ namespace octet
               if( lexer_.type() != tok_identifier ) {
                 expect( tok_identifier );
               } else {
-                result = defines_.get_index((const char *)lexer_.id()) != -1;
+                result = find_define((const char *)lexer_.id()) != NULL;
                 if( name == 0x69666e646566ll ) // #ifdef
                 {
                   result = !result;
@@ -812,34 +1170,41 @@ namespace octet
                 cpp_log("error: sytnax error in #include");
               }
   
-              map_file_result file;
-              if (!map_file( file, filename, include().currentPath.c_str() )) {
-                cpp_log("error: include file %s not found", filename);
+              const source_file *file = find_include( filename );
+              if( !file ) {
+                cpp_log("error: include file %s not found\n", filename);
+                return;
+              }
+
+              // a guarded file adds nothing the second time.
+              if( ( file->guard_.c_str()[ 0 ] && find_define( file->guard_.c_str() ) ) || once_files_.contains( (void*)file ) ) {
+                num_skipped_includes_++;
+                return;
+              }
+
+              if( include_stack_.size() == max_stack_depth_ ) {
+                cpp_log("error: #include nested too deeply\n");
                 return;
               }
 
               output( 0x0c, line_number(), file_name(), 0 );
 
-              push_include( file.source_, file.source_end_, file.filename_, 1 );
+              push_include( file );
 
-              output( 0x0d, 1, file.filename_, 0 );
+              output( 0x0d, 1, file->path_.c_str(), 0 );
 
               push_if( true );
               if_.bottom_level_ = true;
-  
-              while( is_whitespace( *src ) ) {
-                ++src;
-              }
-    
-              if( *src != 0 ) {
-                cpp_log("error: syntax error in #include\n");
-              }
             }
           } else if( name == 0x6572726f72ll ) { // error
             if( if_.is_true_ ) {
             }
           } else if( name == 0x707261676d61ll ) { // pragma
             if( if_.is_true_ ) {
+              next_raw();
+              if( lexer_.type() == tok_identifier && !strcmp( lexer_.id(), (char*)"once" ) ) {
+                once_files_[ (void*)include().file_ ] = true;
+              }
             }
           }
           else if( name == 0x7761726e696e67ll ) // warning
@@ -863,7 +1228,8 @@ namespace octet
               } else {
                 int index = defines_.get_index( (const char*)lexer_.id() );
                 if( index != -1 ) {
-                  defines_[(const char*)lexer_.id()].text_ = "";
+                  delete defines_.get_value( index );
+                  defines_.get_value( index ) = NULL;
                 }
               }
             }
@@ -873,91 +1239,21 @@ namespace octet
         }
       }
     
+      // copy the next line of the current file to read_line_
       void read_some_text() {
-        char_type *dest = read_line_;
-        char_type *dest_max = read_line_ + max_chars_ - 1;
-        const char *current = include().current_;
-        const char *end = include().end_;
-        unsigned line_num = include().line_number_;
-
-        //context_.debug( "%s line %d %d\n", include().file_name_, line_num, end - current );
-        while( current != end ) {
-          char_type chr = *current++;
-          if( chr == '\n' ) {
-            // newline
-            line_num++;
-            break;
-          } else if( chr == '/' ) {
-            if( current != end && *current == '/' ) {
-              // c++ comment
-              current++;
-              while( (current != end && current[ 0 ] != '\n') || current[ -1 ] == '\\' ) {
-                line_num += current[ 0 ] == '\n';
-                current++;
-              }
-              break;
-            } else if( current != end && *current == '*' ) {
-              // c comment
-              current++;
-              while( current != end && ( current[ 0 ] != '/' || current[ -1 ] != '*' ) ) {
-                line_num += current[ 0 ] == '\n';
-                current++;
-              }
-              if( current == end ) {
-                cpp_log("error: unterminated comment\n");
-                break;
-              }
-
-              current++;
-              chr = ' ';
-              *dest = chr;
-              dest += dest != dest_max;
-            } else {
-              *dest = chr;
-              dest += dest != dest_max;
-            }
-          } else if( chr == '\\' ) {
-            // \ escape
-            if( current == end ) {
-              *dest = chr;
-              dest += dest != dest_max;
-            } else {
-              if( *current == '\n' ) {
-                current++;
-                line_num++;
-              } else {
-                *dest = chr;
-                dest += dest != dest_max;
-              }
-            }
-          } else if( chr != '\r' ) {
-            *dest = chr;
-            dest += dest != dest_max;
-          }
-        }
-
-        if( dest == dest_max ) {
-          cpp_log("error: line too long\n");
-          cur_line_ = 0;
-          return;
-        }
-        *dest++ = 0;
-
-        include().current_ = current;
-        include().line_number_ = line_num;
-      
-        if( current == end ) {
-          //context_.debug( "%s END! line %d %d\n", include().file_name_, line_num, end - current );
-        }
-        //context_.debug( "[%s]\n", read_line_ );
+        include_stack_entry_ &entry = include();
+        const typename source_file::line_type &line = entry.file_->lines_[ entry.line_++ ];
+        strcpy( read_line_, entry.file_->get_text( line ) );
       }
-    
+
       void read_line() {
         //context_.debug( "read_line() qi=%d qo=%d\n", queue_in_, queue_out_ );
         while( queue_in_ == queue_out_ ) {
-          if( include().current_ == include().end_ ) {
+          release_expansions();
+
+          if( at_end() ) {
             //context_.debug( "read_line() qi=%d qo=%d END!\n", queue_in_, queue_out_ );
-            if( include_stack_.size() == 0 ) {
+            if( include_stack_.size() == 1 ) {
               cur_line_ = 0;
               return;
             } else {
@@ -978,28 +1274,38 @@ namespace octet
             }
           }
 
-          read_line_number_ = include().line_number_;
-          read_file_name_ = include().file_name_;
-          read_some_text();
- 
-          char_type *src = read_line_;
+          include_stack_entry_ &entry = include();
+          const source_file *file = entry.file_;
+          const typename source_file::line_type &line = file->lines_[ entry.line_ ];
+          read_line_number_ = line.line_number_;
+          read_file_name_ = entry.file_name_;
           def_exp_stack_depth_ = 0;
-        
-          while( is_whitespace( *src ) ) {
-            ++src;
-          }
-        
-          if( *src == '#' ) {
+          num_lines_++;
+
+          if( line.kind_ == source_file::kind_directive ) {
+            read_some_text();
+            const char_type *src = read_line_;
+            while( is_whitespace( *src ) ) {
+              ++src;
+            }
             hash_directive( src + 1 );
             num_skipped_++;
-          } else if( *src == 0 || !if_.is_true_ ) {
+          } else if( line.kind_ == source_file::kind_blank || !if_.is_true_ ) {
+            entry.line_++;
             num_skipped_++;
-          } else if( if_.is_true_ ) {
+          } else {
             if( num_skipped_ >= 8 ) {
               // avoid too many blank lines
               output( 0x0e, line_number(), file_name(), 0 );
-            } 
-            expand_defines();
+            }
+            if( may_expand( file, line ) ) {
+              read_some_text();
+              expand_defines();
+            } else {
+              // nothing to expand: the cached text is the output.
+              entry.line_++;
+              output( 0x00, line_number(), file_name(), file->get_text( line ) );
+            }
             num_skipped_ = 0;
           }
         }
@@ -1047,13 +1353,64 @@ namespace octet
       
         static short const unary_ops[] = { tok_minus, tok_plus, tok_and, tok_star, tok_not, tok_tilda, tok_plus_plus, tok_minus_minus, -1 };
         unary_op_ = unary_ops;
+
+        define_bits_.clear();
+        root_file_ = 0;
+        num_lines_ = 0;
+        num_skipped_includes_ = 0;
       }
 
-      void begin( const char *source ) {
-        const char *end = source;
-        while( *end ) {
-          end++;
+      ~cpp_preprocessor() {
+        release_expansions();
+        delete root_file_;
+        for( unsigned i = 0; i != defines_.get_num_indices(); ++i ) {
+          if( defines_.get_key( i ) ) {
+            delete defines_.get_value( i );
+          }
         }
+      }
+
+      /// Define a macro before begin(), as with -D on the command line.
+      /// For example define( "MAX_LIGHTS", "4" ) or define( "SQUARE(x)", "((x)*(x))" ).
+      void define( const char *name, const char *value = "1" ) {
+        sprintf( read_line_, "%s %s", name, value );
+        lexer_.start( read_line_ );
+        hash_define();
+      }
+
+      /// Forget all cached source files, for example when shaders are being edited.
+      /// Files that have changed on disk are reloaded anyway.
+      static void clear_file_cache() {
+        file_cache &c = cache();
+        std::lock_guard<std::mutex> lock(c.mutex_);
+        for( unsigned i = 0; i != c.files_.get_num_indices(); ++i ) {
+          if( c.files_.get_key( i ) && c.files_.get_value( i ) ) {
+            c.retired_.push_back( c.files_.get_value( i ) );
+          }
+        }
+        c.files_.reset();
+      }
+
+      /// Number of source lines read, including those in included files.
+      unsigned get_num_lines() const {
+        return num_lines_;
+      }
+
+      /// Number of #includes skipped because of an include guard or #pragma once.
+      unsigned get_num_skipped_includes() const {
+        return num_skipped_includes_;
+      }
+
+      void begin( const char *source ) {
+        delete root_file_;
+        root_file_ = new source_file( "?" );
+        root_file_->split( source, source + strlen( source ) );
+
+        release_expansions();
+        run_files_.reset();
+        once_files_.clear();
+        num_lines_ = 0;
+        num_skipped_includes_ = 0;
 
         include_stack_.reset();
         include_stack_.reserve(32);
@@ -1073,7 +1430,7 @@ namespace octet
         // output( 0x00, 1, "<command line>", 0 );
         // output( 0x00, 1, "test.c", 0 );
 
-        push_include( source, end, "?", 1 );
+        push_include( root_file_ );
 
         if_.bottom_level_ = true;
         if_.is_true_ = true;
@@ -59,8 +59,8 @@ namespace octet
       {
         for( cpp_scope *scope = this; scope != NULL; scope = scope->parent )
         {
-          int index = valuesByName.get_index(name);
-          if (index != -1) return valuesByName.get_value(index);
+          int index = scope->valuesByName.get_index(name);
+          if (index != -1) return scope->valuesByName.get_value(index);
         }
         return NULL;
       }
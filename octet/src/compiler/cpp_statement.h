@@ -28,17 +28,27 @@ namespace octet
       };
     private:
       kind_enum kind;
-      union
-      {
-        cpp_statement *statements;
-        cpp_expr *expression;
-      };
+
+      // compound statements have a list of statements, if, for and while have one.
+      cpp_statement *statements;
+
+      // the expression, return value or condition. for loops have a kind_for expression.
+      cpp_expr *expression;
+
+      // the else part of an if.
+      cpp_statement *elseStatement;
+
       cpp_statement *next;
       cpp_scope *scope;
     public:
-      cpp_statement( kind_enum kind_ ) : kind( kind_ ), statements( NULL ), next( NULL )
+      cpp_statement( kind_enum kind_ ) : kind( kind_ ), statements( NULL ), expression( NULL ), elseStatement( NULL ), next( NULL ), scope( NULL )
       {
       }
+
+      kind_enum getKind()
+      {
+        return kind;
+      }
     
       cpp_statement **getStatementsAddr()
       {
@@ -60,6 +70,16 @@ namespace octet
         expression = expr;
       }
     
+      cpp_statement *getElse()
+      {
+        return elseStatement;
+      }
+
+      void setElse( cpp_statement *statement )
+      {
+        elseStatement = statement;
+      }
+
       cpp_statement **getNextAddr()
       {
         return &next;
@@ -11,8 +11,12 @@ namespace octet
 {
   namespace compiler
   {
+    /// Types are owned by a cpp_type_table, which makes sure that there is only
+    /// one object for each structural type. Structs and functions are unique
+    /// to their declaration and can be filled in after they are made.
     class cpp_type
     {
+      friend class cpp_type_table;
     public:
       enum kind_enum
       {
@@ -62,6 +66,17 @@ namespace octet
         }
       }
     
+      /// qualifiers, as returned by getFlags()
+      enum flag_enum
+      {
+        flag_in = 1,
+        flag_out = 2,
+        flag_uniform = 4,
+        flag_const = 8,
+        flag_packed = 16,
+        flag_return_by_value = 32,
+      };
+
       //typedef dynarray< cpp_value * > value_array;
       //typedef dynarray< cpp_value * >::iterator value_iterator;
 
@@ -71,6 +86,12 @@ namespace octet
       cpp_type *subType;
       cpp_scope *scope;
 
+      // this type without qualifiers. Equal types have the same unqualified type.
+      cpp_type *unqualified;
+
+      // next type in the same cpp_type_table bucket
+      cpp_type *nextInterned;
+
       kind_enum kind : 8;
       bool isIn : 1;
       bool isOut : 1;
@@ -93,21 +114,25 @@ namespace octet
         //llvmType = NULL;
         subType = NULL;
         scope = NULL;
+        unqualified = NULL;
+        nextInterned = NULL;
       }
 
-    public:
-      cpp_type( cpp_type::kind_enum kind_, cpp_type *subType_ = NULL ) : kind( kind_ )
+      void setFlags( unsigned flags )
       {
-        clear();
-        subType = subType_;
+        isIn = ( flags & flag_in ) != 0;
+        isOut = ( flags & flag_out ) != 0;
+        isUniform = ( flags & flag_uniform ) != 0;
+        isConst = ( flags & flag_const ) != 0;
+        isPacked = ( flags & flag_packed ) != 0;
+        isReturnByValue = ( flags & flag_return_by_value ) != 0;
       }
 
-      cpp_type( cpp_type::kind_enum kind_, unsigned dim, bool isPacked_=false ) : kind( kind_array )
+    public:
+      cpp_type( cpp_type::kind_enum kind_, cpp_type *subType_ = NULL ) : kind( kind_ )
       {
         clear();
-        subType = new cpp_type( kind_ );
-        dimension = dim;
-        subType->isPacked = isPacked_;
+        subType = subType_;
       }
 
       cpp_type( cpp_type::kind_enum kind_, cpp_type *subType_, unsigned dim ) : kind( kind_ )
@@ -129,7 +154,21 @@ namespace octet
 
       cpp_scope *getScope() const
       {
-        return scope;
+        // qualified structs share the scope of the struct, which may be defined later.
+        return unqualified ? unqualified->scope : scope;
+      }
+
+      cpp_type *getUnqualified()
+      {
+        return unqualified;
+      }
+
+      unsigned getFlags() const
+      {
+        return
+          ( isIn ? flag_in : 0 ) | ( isOut ? flag_out : 0 ) | ( isUniform ? flag_uniform : 0 ) |
+          ( isConst ? flag_const : 0 ) | ( isPacked ? flag_packed : 0 ) | ( isReturnByValue ? flag_return_by_value : 0 )
+        ;
       }
 
       void setScope( cpp_scope *scope_ )
@@ -291,5 +330,134 @@ namespace octet
       }
     
     };
+
+    /// Makes types in a cpp_arena, sharing one object between identical types
+    /// so that type equality is a pointer comparison.
+    ///
+    ///     cpp_type *float4 = types.getVector( cpp_type::kind_float, 4 );
+    ///     assert( types.getVector( cpp_type::kind_float, 4 ) == float4 );
+    class cpp_type_table
+    {
+      cpp_arena &arena;
+
+      // types by structural hash. Types with the same hash are chained through nextInterned.
+      hash_map< uint64_t, cpp_type * > types;
+      unsigned numTypes;
+
+      static bool isNominal( cpp_type::kind_enum kind )
+      {
+        return kind == cpp_type::kind_struct || kind == cpp_type::kind_function;
+      }
+
+      static uint64_t mix( uint64_t hash, uint64_t value )
+      {
+        return ( hash ^ value ) * 0x100000001b3ull;
+      }
+
+      // base is the unqualified type for qualified structs and functions.
+      static uint64_t calcHash( const cpp_type &proto, unsigned flags, cpp_type *base )
+      {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        hash = mix( hash, proto.kind );
+        hash = mix( hash, flags );
+        hash = mix( hash, proto.dimension );
+        hash = mix( hash, (uint64_t)(uintptr_t)proto.subType );
+        hash = mix( hash, (uint64_t)(uintptr_t)proto.scope );
+        hash = mix( hash, (uint64_t)(uintptr_t)base );
+        return hash ? hash : 1; // zero is an empty key
+      }
+
+      cpp_type *intern( cpp_type::kind_enum kind, cpp_type *subType, unsigned dimension, cpp_scope *scope, unsigned flags, cpp_type *base )
+      {
+        cpp_type proto( kind, subType, dimension );
+        proto.scope = scope;
+        uint64_t hash = calcHash( proto, flags, base );
+        int index = types.get_index( hash );
+        cpp_type *first = index == -1 ? NULL : types.get_value( index );
+        for( cpp_type *type = first; type != NULL; type = type->nextInterned )
+        {
+          if(
+            type->kind == kind && type->getFlags() == flags && type->dimension == dimension &&
+            type->subType == subType && type->scope == scope && ( base == NULL || type->unqualified == base )
+          ) {
+            return type;
+          }
+        }
+
+        if( base == NULL && flags != 0 )
+        {
+          base = intern( kind, subType, dimension, scope, 0, NULL );
+        }
+
+        cpp_type *type = arena.make< cpp_type >( kind, subType, dimension );
+        type->scope = scope;
+        type->setFlags( flags );
+        type->unqualified = base ? base : type;
+        type->nextInterned = first;
+        types[ hash ] = type;
+        numTypes++;
+        return type;
+      }
+
+    public:
+      cpp_type_table( cpp_arena &arena_ ) : arena( arena_ ), numTypes( 0 )
+      {
+      }
+
+      /// the type of this kind with these qualifiers and sub type. eg. get( kind_ptr, floatType )
+      cpp_type *get( cpp_type::kind_enum kind, cpp_type *subType = NULL, unsigned dimension = 0, unsigned flags = 0 )
+      {
+        return intern( kind, subType, dimension, NULL, flags, NULL );
+      }
+
+      /// an array of dimension elements
+      cpp_type *getArray( cpp_type *subType, unsigned dimension )
+      {
+        return get( cpp_type::kind_array, subType, dimension );
+      }
+
+      /// a packed vector, like float4
+      cpp_type *getVector( cpp_type::kind_enum kind, unsigned dimension )
+      {
+        return getArray( get( kind, NULL, 0, cpp_type::flag_packed ), dimension );
+      }
+
+      /// the same type with different qualifiers, eg. getQualified( intType, cpp_type::flag_const )
+      cpp_type *getQualified( cpp_type *type, unsigned flags )
+      {
+        if( type->getFlags() == flags )
+        {
+          return type;
+        }
+        cpp_type *base = type->unqualified;
+        if( isNominal( type->kind ) )
+        {
+          return flags == 0 ? base : intern( type->kind, base->subType, base->dimension, NULL, flags, base );
+        }
+        return intern( type->kind, type->subType, type->dimension, type->scope, flags, NULL );
+      }
+
+      /// a new struct or function type. These are not shared and are filled in by the parser.
+      cpp_type *makeNominal( cpp_type::kind_enum kind, cpp_type *subType = NULL )
+      {
+        cpp_type *type = arena.make< cpp_type >( kind, subType );
+        type->unqualified = type;
+        numTypes++;
+        return type;
+      }
+
+      /// forget all types. Call when the arena is reset.
+      void reset()
+      {
+        types.clear();
+        numTypes = 0;
+      }
+
+      /// number of type objects made since the last reset.
+      unsigned getNumTypes() const
+      {
+        return numTypes;
+      }
+    };
   }
 }
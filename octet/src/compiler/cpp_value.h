@@ -17,11 +17,13 @@ namespace octet
     class cpp_statement;
     class cpp_value;
 
+    /// A named variable, parameter or function.
+    /// The name and semantic are not copied and must live as long as the value (see cpp_arena::strdup).
     class cpp_value
     {
       cpp_type *valueType;
-      string name;
-      string semantic;
+      const char *name;
+      const char *semantic;
       unsigned offset;
       cpp_expr *init;
       //Value *llvmValue;
@@ -32,6 +34,7 @@ namespace octet
     public:
       cpp_value( cpp_type *valueType_, const char *name_ ) : valueType( valueType_ ), name( name_ )
       {
+        semantic = "";
         init = NULL;
         offset = 0;
         //llvmValue = NULL;
@@ -50,7 +53,7 @@ namespace octet
 
       const char *getName() const
       {
-        return name.c_str();
+        return name;
       }
 
       void setSemantic( const char *name_ )
@@ -60,7 +63,7 @@ namespace octet
     
       const char *getSemantic()
       {
-        return name;
+        return semantic;
       }
     
       cpp_type *getType() const
@@ -49,10 +49,105 @@ void operator delete(void *ptr, void *place, dynarray_dummy_t x) {}
 
 
 namespace octet { namespace containers {
+  /// Statistics kept by each allocator backend. Fetch with, for example, pool_allocator::get_stats().
+  struct allocator_stats {
+    /// bytes currently allocated by users of the backend
+    size_t live_bytes;
+
+    /// highest value of live_bytes
+    size_t peak_bytes;
+
+    /// total number of calls to malloc (and realloc with a null pointer)
+    size_t num_allocs;
+
+    /// total number of calls to free
+    size_t num_frees;
+
+    /// bytes the backend has taken from the system to satisfy these requests
+    size_t reserved_bytes;
+
+    allocator_stats() {
+      memset(this, 0, sizeof(*this));
+    }
+
+    /// fraction of reserved memory that is not in use (0 = none wasted)
+    float fragmentation() const {
+      return reserved_bytes && live_bytes < reserved_bytes ? 1.0f - (float)live_bytes / reserved_bytes : 0.0f;
+    }
+
+    /// get a human readable version of the stats
+    const char *toString(char *dest, size_t len) const {
+      snprintf(
+        dest, len, "live=%u peak=%u allocs=%u frees=%u reserved=%u frag=%.2f",
+        (unsigned)live_bytes, (unsigned)peak_bytes, (unsigned)num_allocs, (unsigned)num_frees,
+        (unsigned)reserved_bytes, fragmentation()
+      );
+      return dest;
+    }
+  };
+
+  /// Thread safe counters shared by the allocator backends.
+  class allocator_counters {
+    std::atomic<size_t> live_bytes;
+    std::atomic<size_t> peak_bytes;
+    std::atomic<size_t> num_allocs;
+    std::atomic<size_t> num_frees;
+    std::atomic<size_t> reserved_bytes;
+  public:
+    allocator_counters() : live_bytes(0), peak_bytes(0), num_allocs(0), num_frees(0), reserved_bytes(0) {
+    }
+
+    void on_alloc(size_t size) {
+      size_t live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+      size_t peak = peak_bytes.load(std::memory_order_relaxed);
+      while (live > peak && !peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+      }
+      num_allocs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void on_free(size_t size) {
+      live_bytes.fetch_sub(size, std::memory_order_relaxed);
+      num_frees.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void on_resize(size_t old_size, size_t size) {
+      if (size >= old_size) {
+        size_t live = live_bytes.fetch_add(size - old_size, std::memory_order_relaxed) + size - old_size;
+        size_t peak = peak_bytes.load(std::memory_order_relaxed);
+        while (live > peak && !peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+        }
+      } else {
+        live_bytes.fetch_sub(old_size - size, std::memory_order_relaxed);
+      }
+    }
+
+    void on_reserve(size_t size) {
+      reserved_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    void on_release(size_t size) {
+      reserved_bytes.fetch_sub(size, std::memory_order_relaxed);
+    }
+
+    void get(allocator_stats &stats) const {
+      stats.live_bytes = live_bytes.load(std::memory_order_relaxed);
+      stats.peak_bytes = peak_bytes.load(std::memory_order_relaxed);
+      stats.num_allocs = num_allocs.load(std::memory_order_relaxed);
+      stats.num_frees = num_frees.load(std::memory_order_relaxed);
+      stats.reserved_bytes = reserved_bytes.load(std::memory_order_relaxed);
+    }
+  };
+
+  /// The default allocator: a thin layer over the system heap.
+  ///
+  /// All backends have the same static interface (malloc, free, realloc, get_stats)
+  /// so that they can be passed as the allocator_t parameter of dynarray, hash_map and dictionary.
+  ///
+  ///     dynarray<int, pool_allocator> ints;
   class allocator {
     // singleton state, a bit like an old-world global variable
     struct state_t {
-      size_t num_bytes;
+      allocator_counters counters;
     };
 
     static state_t &state() {
@@ -61,9 +156,38 @@ namespace octet { namespace containers {
     }
 
   public:
-    // todo: implement this from scratch using a pool allocator
+    /// allocate size bytes from the system heap (16 byte aligned where the platform supports it)
     static void *malloc(size_t size) {
-      state().num_bytes += size;
+      state().counters.on_alloc(size);
+      state().counters.on_reserve(size);
+      return sys_malloc(size);
+    }
+
+    /// free a block of size bytes
+    static void free(void *ptr, size_t size) {
+      state().counters.on_free(size);
+      state().counters.on_release(size);
+      sys_free(ptr);
+    }
+
+    /// resize a block from old_size to size bytes
+    static void *realloc(void *ptr, size_t old_size, size_t size) {
+      state().counters.on_resize(old_size, size);
+      if (size >= old_size) {
+        state().counters.on_reserve(size - old_size);
+      } else {
+        state().counters.on_release(old_size - size);
+      }
+      return sys_realloc(ptr, size);
+    }
+
+    /// get the statistics for the heap backend
+    static void get_stats(allocator_stats &stats) {
+      state().counters.get(stats);
+    }
+
+    /// raw system heap allocation used by all the backends.
+    static void *sys_malloc(size_t size) {
       #if OCTET_MAC
         void *res = 0;
         posix_memalign(&res, 16, size);
@@ -74,13 +198,13 @@ namespace octet { namespace containers {
       #else
         void *res = ::malloc(size);
       #endif
-      //printf("malloc %p[%d] -> %d\n", res, size, state().num_bytes);
+      //printf("malloc %p[%d]\n", res, size);
       return res;
     }
 
-    static void free(void *ptr, size_t size) {
-      state().num_bytes -= size;
-      //printf("free %p[%d] -> %d\n", ptr, size, state().num_bytes);
+    /// raw system heap free
+    static void sys_free(void *ptr) {
+      //printf("free %p\n", ptr);
       #if OCTET_MAC
         return ::free(ptr);
       #elif OCTET_SSE
@@ -90,8 +214,8 @@ namespace octet { namespace containers {
       #endif
     }
 
-    static void *realloc(void *ptr, size_t old_size, size_t size) {
-      state().num_bytes += size - old_size;
+    /// raw system heap realloc
+    static void *sys_realloc(void *ptr, size_t size) {
       #if OCTET_MAC
         void *res = ::realloc(ptr, size);
       #elif OCTET_SSE
@@ -99,7 +223,7 @@ namespace octet { namespace containers {
       #else
         void *res = ::realloc(ptr, size);
       #endif
-      //printf("realloc %p[%d] -> %p[%d] %d\n", ptr, old_size, res, size, state().num_bytes);
+      //printf("realloc %p -> %p[%d]\n", ptr, res, size);
       return res;
     }
 
@@ -110,5 +234,475 @@ namespace octet { namespace containers {
       ::free(::malloc(32));
     }
   };
-} }
 
+  /// Size class pool allocator.
+  ///
+  /// Small blocks (up to max_pooled bytes) are rounded up to one of a set of size classes
+  /// and carved out of large chunks. Freed blocks go on a free list for their class
+  /// so that repeated allocation of similar sizes never touches the system heap.
+  /// Because free() is given the size of the block, no header is needed.
+  /// Larger blocks go to the system heap.
+  ///
+  /// Chunks are never returned to the system.
+  class pool_allocator {
+  public:
+    enum {
+      num_classes = 16,
+      max_pooled = 4096,
+      chunk_size = 64 * 1024,
+      granularity = 16,
+    };
+
+  private:
+    struct free_block {
+      free_block *next;
+    };
+
+    struct state_t {
+      std::mutex mutex;
+      free_block *free_lists[num_classes];
+      uint8_t *chunk_pos;
+      uint8_t *chunk_end;
+      uint8_t size_to_class[max_pooled / granularity + 1];
+      allocator_counters counters;
+
+      state_t() {
+        memset(free_lists, 0, sizeof(free_lists));
+        chunk_pos = chunk_end = 0;
+        unsigned cls = 0;
+        for (unsigned i = 0; i <= max_pooled / granularity; ++i) {
+          while (class_size(cls) < i * granularity) ++cls;
+          size_to_class[i] = (uint8_t)cls;
+        }
+      }
+    };
+
+    // never destroyed, as strings in static objects can be freed during exit.
+    static state_t &state() {
+      static state_t *instance = new state_t();
+      return *instance;
+    }
+
+    // carve a new block of a class from the current chunk. Call with the mutex held.
+    static void *carve(state_t &s, size_t bytes) {
+      if (s.chunk_pos + bytes > s.chunk_end) {
+        // the tail of the old chunk is lost; it is counted as fragmentation.
+        s.chunk_pos = (uint8_t*)allocator::sys_malloc(chunk_size);
+        s.chunk_end = s.chunk_pos + chunk_size;
+        s.counters.on_reserve(chunk_size);
+      }
+      void *res = s.chunk_pos;
+      s.chunk_pos += bytes;
+      return res;
+    }
+
+  public:
+    /// size in bytes of blocks of class cls: 16, 32, 48, 64, 96, 128 ... 3072, 4096
+    static size_t class_size(unsigned cls) {
+      return cls < 2 ? (cls + 1) * 16 : (cls & 1) ? (size_t)2 << ((cls + 1) / 2 + 3) : (size_t)3 << (cls / 2 + 3);
+    }
+
+    /// which size class serves a block of this size? (size must be <= max_pooled)
+    static unsigned size_class(size_t size) {
+      return state().size_to_class[(size + granularity - 1) / granularity];
+    }
+
+    /// allocate a block from the size class pools
+    static void *malloc(size_t size) {
+      if (size > max_pooled) {
+        state().counters.on_alloc(size);
+        state().counters.on_reserve(size);
+        return allocator::sys_malloc(size);
+      }
+      state_t &s = state();
+      unsigned cls = size_class(size);
+      s.counters.on_alloc(size);
+      std::lock_guard<std::mutex> lock(s.mutex);
+      free_block *blk = s.free_lists[cls];
+      if (blk) {
+        s.free_lists[cls] = blk->next;
+        return blk;
+      }
+      return carve(s, class_size(cls));
+    }
+
+    /// return a block to its pool
+    static void free(void *ptr, size_t size) {
+      if (!ptr) return;
+      state_t &s = state();
+      s.counters.on_free(size);
+      if (size > max_pooled) {
+        s.counters.on_release(size);
+        allocator::sys_free(ptr);
+        return;
+      }
+      unsigned cls = size_class(size);
+      std::lock_guard<std::mutex> lock(s.mutex);
+      free_block *blk = (free_block*)ptr;
+      blk->next = s.free_lists[cls];
+      s.free_lists[cls] = blk;
+    }
+
+    /// resize a block. Stays in place if the size class does not change.
+    static void *realloc(void *ptr, size_t old_size, size_t size) {
+      if (!ptr) return malloc(size);
+      if (old_size <= max_pooled && size <= max_pooled && size_class(old_size) == size_class(size)) {
+        state().counters.on_resize(old_size, size);
+        return ptr;
+      }
+      if (old_size > max_pooled && size > max_pooled) {
+        state().counters.on_resize(old_size, size);
+        state().counters.on_reserve(size);
+        state().counters.on_release(old_size);
+        return allocator::sys_realloc(ptr, size);
+      }
+      void *res = malloc(size);
+      memcpy(res, ptr, old_size < size ? old_size : size);
+      free(ptr, old_size);
+      return res;
+    }
+
+    /// get the statistics for the pool backend
+    static void get_stats(allocator_stats &stats) {
+      state().counters.get(stats);
+    }
+  };
+
+  /// Per-frame bump allocator.
+  ///
+  /// Allocation is a pointer increment. free() does nothing except for the most
+  /// recent block, which lets a growing array extend in place.
+  /// All memory is recycled when reset() is called at the end of each frame (see app_common::end_frame)
+  /// so containers using this backend must not outlive the frame.
+  /// A frame's chunks are not reused until the frame after next, so a block freed
+  /// a frame late (by a destructor that runs after end_frame, say) is recognised
+  /// by its address and changes neither the arena nor the statistics.
+  ///
+  ///     dynarray<vec3, frame_allocator> temp_vertices;
+  class frame_allocator {
+  public:
+    enum {
+      chunk_size = 256 * 1024,
+      alignment = 16,
+    };
+
+  private:
+    struct chunk {
+      chunk *next;
+      size_t size;
+    };
+
+    struct state_t {
+      std::mutex mutex;
+      chunk *chunks;     // chunks in use this frame, most recent first
+      chunk *previous;   // chunks used in the previous frame
+      chunk *spare;      // chunks free for reuse
+      uint8_t *pos;
+      uint8_t *end;
+      uint8_t *last;     // most recent allocation
+      allocator_counters counters;
+
+      state_t() {
+        chunks = previous = spare = 0;
+        pos = end = last = 0;
+      }
+    };
+
+    // never destroyed, so that blocks can still be freed during exit.
+    static state_t &state() {
+      static state_t *instance = new state_t();
+      return *instance;
+    }
+
+    // was ptr allocated this frame? Call with the mutex held.
+    static bool this_frame(const state_t &s, const void *ptr) {
+      for (chunk *c = s.chunks; c; c = c->next) {
+        if ((const uint8_t*)ptr >= (uint8_t*)c && (const uint8_t*)ptr < (uint8_t*)c + c->size) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    static size_t round_up(size_t size) {
+      return (size + alignment - 1) & ~(size_t)(alignment - 1);
+    }
+
+    // header size, keeping the payload aligned
+    static size_t header_size() {
+      return round_up(sizeof(chunk));
+    }
+
+    // get a chunk with at least "bytes" of space. Call with the mutex held.
+    static void new_chunk(state_t &s, size_t bytes) {
+      chunk **prev = &s.spare;
+      while (*prev && (*prev)->size - header_size() < bytes) {
+        prev = &(*prev)->next;
+      }
+      chunk *c = *prev;
+      if (c) {
+        *prev = c->next;
+      } else {
+        size_t size = bytes + header_size() > chunk_size ? bytes + header_size() : chunk_size;
+        c = (chunk*)allocator::sys_malloc(size);
+        c->size = size;
+        s.counters.on_reserve(size);
+      }
+      c->next = s.chunks;
+      s.chunks = c;
+      s.pos = (uint8_t*)c + header_size();
+      s.end = (uint8_t*)c + c->size;
+    }
+
+  public:
+    /// allocate from the current frame
+    static void *malloc(size_t size) {
+      state_t &s = state();
+      size_t bytes = round_up(size ? size : 1);
+      s.counters.on_alloc(size);
+      std::lock_guard<std::mutex> lock(s.mutex);
+      if (s.pos + bytes > s.end) {
+        new_chunk(s, bytes);
+      }
+      s.last = s.pos;
+      s.pos += bytes;
+      return s.last;
+    }
+
+    /// free is only effective for the most recent allocation.
+    /// Blocks from the previous frame are ignored.
+    static void free(void *ptr, size_t size) {
+      if (!ptr) return;
+      state_t &s = state();
+      std::lock_guard<std::mutex> lock(s.mutex);
+      if (!this_frame(s, ptr)) return;
+      s.counters.on_free(size);
+      if (ptr == s.last) {
+        s.pos = s.last;
+        s.last = 0;
+      }
+    }
+
+    /// resize, in place if this is the most recent allocation.
+    static void *realloc(void *ptr, size_t old_size, size_t size) {
+      if (!ptr) return malloc(size);
+      state_t &s = state();
+      {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (ptr == s.last && s.last + round_up(size) <= s.end) {
+          s.pos = s.last + round_up(size);
+          s.counters.on_resize(old_size, size);
+          return ptr;
+        }
+      }
+      void *res = malloc(size);
+      memcpy(res, ptr, old_size < size ? old_size : size);
+      free(ptr, old_size);
+      return res;
+    }
+
+    /// recycle all memory allocated this frame.
+    static void reset() {
+      state_t &s = state();
+      std::lock_guard<std::mutex> lock(s.mutex);
+      // the previous frame's chunks can be reused; this frame's wait a frame
+      // in case any of its blocks are freed late.
+      while (s.previous) {
+        chunk *c = s.previous;
+        s.previous = c->next;
+        c->next = s.spare;
+        s.spare = c;
+      }
+      s.previous = s.chunks;
+      s.chunks = 0;
+      s.pos = s.end = s.last = 0;
+      allocator_stats stats;
+      s.counters.get(stats);
+      s.counters.on_resize(stats.live_bytes, 0);
+    }
+
+    /// get the statistics for the frame backend
+    static void get_stats(allocator_stats &stats) {
+      state().counters.get(stats);
+    }
+  };
+
+  /// Thread local cache in front of the pool allocator.
+  ///
+  /// Each thread keeps a short free list per size class, so most allocations
+  /// and frees take no lock at all. When a thread's list for a class is full,
+  /// half of it is returned to the pool. Blocks may be freed on any thread.
+  ///
+  /// The caches are never destroyed. When a thread ends, its blocks go back to
+  /// the pool and the cache is kept for the next thread. Frees that come after that,
+  /// from static objects for example, go straight to the pool.
+  class thread_cache_allocator {
+  public:
+    enum {
+      max_cached = 64,
+    };
+
+  private:
+    struct free_block {
+      free_block *next;
+    };
+
+    struct cache_t {
+      free_block *lists[pool_allocator::num_classes];
+      unsigned counts[pool_allocator::num_classes];
+      cache_t *next_spare;
+
+      cache_t() {
+        memset(lists, 0, sizeof(lists));
+        memset(counts, 0, sizeof(counts));
+        next_spare = 0;
+      }
+
+      void flush(unsigned cls, unsigned num) {
+        size_t size = pool_allocator::class_size(cls);
+        for (unsigned i = 0; i != num; ++i) {
+          free_block *blk = lists[cls];
+          lists[cls] = blk->next;
+          pool_allocator::free(blk, size);
+        }
+        counts[cls] -= num;
+        counters().on_release(size * num);
+      }
+
+      void flush_all() {
+        for (unsigned cls = 0; cls != pool_allocator::num_classes; ++cls) {
+          flush(cls, counts[cls]);
+        }
+      }
+    };
+
+    // caches of threads that have ended, and the counters. Never destroyed.
+    struct state_t {
+      std::mutex mutex;
+      cache_t *spare;
+      allocator_counters counters;
+
+      state_t() {
+        spare = 0;
+      }
+    };
+
+    static state_t &state() {
+      static state_t *instance = new state_t();
+      return *instance;
+    }
+
+    static allocator_counters &counters() {
+      return state().counters;
+    }
+
+    // the calling thread's cache. Plain pointers, so they are still valid while the thread ends.
+    static cache_t *&thread_cache() {
+      static thread_local cache_t *instance = 0;
+      return instance;
+    }
+
+    static bool &thread_ended() {
+      static thread_local bool instance = false;
+      return instance;
+    }
+
+    // hands the cache back when the thread ends.
+    struct thread_exit {
+      ~thread_exit() {
+        cache_t *c = thread_cache();
+        thread_cache() = 0;
+        thread_ended() = true;
+        c->flush_all();
+        state_t &s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        c->next_spare = s.spare;
+        s.spare = c;
+      }
+    };
+
+    // get this thread's cache, or NULL once the thread is ending.
+    static cache_t *cache() {
+      cache_t *c = thread_cache();
+      if (c || thread_ended()) return c;
+
+      static thread_local thread_exit on_exit;
+      (void)on_exit;
+
+      state_t &s = state();
+      {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        c = s.spare;
+        if (c) s.spare = c->next_spare;
+      }
+      if (!c) c = new cache_t();
+      thread_cache() = c;
+      return c;
+    }
+
+  public:
+    /// allocate from this thread's cache, falling back to the pool.
+    static void *malloc(size_t size) {
+      counters().on_alloc(size);
+      if (size > pool_allocator::max_pooled) {
+        counters().on_reserve(size);
+        return pool_allocator::malloc(size);
+      }
+      unsigned cls = pool_allocator::size_class(size);
+      cache_t *c = cache();
+      free_block *blk = c ? c->lists[cls] : 0;
+      if (blk) {
+        c->lists[cls] = blk->next;
+        c->counts[cls]--;
+        return blk;
+      }
+      // blocks are always whole size classes so that any thread can cache them.
+      counters().on_reserve(pool_allocator::class_size(cls));
+      return pool_allocator::malloc(pool_allocator::class_size(cls));
+    }
+
+    /// free to this thread's cache.
+    static void free(void *ptr, size_t size) {
+      if (!ptr) return;
+      counters().on_free(size);
+      if (size > pool_allocator::max_pooled) {
+        counters().on_release(size);
+        pool_allocator::free(ptr, size);
+        return;
+      }
+      unsigned cls = pool_allocator::size_class(size);
+      cache_t *c = cache();
+      if (!c) {
+        counters().on_release(pool_allocator::class_size(cls));
+        pool_allocator::free(ptr, pool_allocator::class_size(cls));
+        return;
+      }
+      if (c->counts[cls] == max_cached) {
+        c->flush(cls, max_cached / 2);
+      }
+      free_block *blk = (free_block*)ptr;
+      blk->next = c->lists[cls];
+      c->lists[cls] = blk;
+      c->counts[cls]++;
+    }
+
+    /// resize a block. Stays in place if the size class does not change.
+    static void *realloc(void *ptr, size_t old_size, size_t size) {
+      if (!ptr) return malloc(size);
+      if (old_size <= pool_allocator::max_pooled && size <= pool_allocator::max_pooled && pool_allocator::size_class(old_size) == pool_allocator::size_class(size)) {
+        counters().on_resize(old_size, size);
+        return ptr;
+      }
+      void *res = malloc(size);
+      memcpy(res, ptr, old_size < size ? old_size : size);
+      free(ptr, old_size);
+      return res;
+    }
+
+    /// get the statistics for the thread cache backend.
+    /// reserved_bytes includes blocks sitting in the thread caches.
+    static void get_stats(allocator_stats &stats) {
+      counters().get(stats);
+    }
+  };
+} }
@@ -26,10 +26,12 @@
 #define OCTET_CONTAINERS_INCLUDED
 
 #include "../containers/allocator.h"
+#include "../containers/interned_string.h"
 #include "../containers/dictionary.h"
-#include "../containers/hash_map.h"
 #include "../containers/double_list.h"
 #include "../containers/dynarray.h"
+#include "../containers/small_dynarray.h"
+#include "../containers/hash_map.h"
 #include "../containers/string.h"
 #include "../containers/ref.h"
 #include "../containers/bitset.h"
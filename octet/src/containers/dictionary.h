@@ -20,20 +20,21 @@ namespace octet { namespace containers {
   ///
   ///     int annes_age = my_dict["anne"];
   ///
+  /// Keys can also be interned strings, which are found with one hash probe and a pointer compare.
+  ///
+  ///     static const interned_string anne("anne");
+  ///     int annes_age = my_dict[anne];
+  ///
   template <class value_t, class allocator_t=allocator> class dictionary {
-    struct entry_t { const char *key; unsigned hash; value_t value; };
+    // interned keys belong to the string table, other keys are copies owned by the dictionary.
+    struct entry_t { const char *key; unsigned hash; bool interned; value_t value; };
     entry_t *entries;
     unsigned num_entries;
     unsigned max_entries;
   
-    // hash is a compromise between fewer collisions and
-    // faster hash calculation.
-    unsigned calc_hash( const char *key ) {
-      unsigned hash = 0;
-      for (int i = 0; key[i]; ++i) {
-        hash = ( hash << 5 ) ^ ( hash << 3 ) ^ (key[i] & 0xff);
-      }
-      return hash;
+    // the same hash as interned_string so that both kinds of key can share a table.
+    static unsigned calc_hash( const char *key ) {
+      return interned_string::calc_hash(key);
     }
   
     // internal method to find an entry for a key
@@ -50,7 +51,24 @@ namespace octet { namespace containers {
       }
       return 0;
     }
-  
+
+    // internal method to find an entry for an interned key.
+    // keys added as interned strings match by pointer; other keys need a strcmp.
+    entry_t *find( const interned_string &key ) {
+      unsigned hash = key.get_hash();
+      unsigned mask = max_entries - 1;
+      for (unsigned i = 0; i != max_entries; ++i) {
+        entry_t *entry = &entries[ ( i + hash ) & mask ];
+        if (!entry->key || entry->key == key.c_str()) {
+          return entry;
+        }
+        if (entry->hash == hash && !entry->interned && !strcmp(entry->key, key.c_str())) {
+          return entry;
+        }
+      }
+      return 0;
+    }
+
     // grow the dictionary when needed
     void expand() {
       entry_t *old_entries = entries;
@@ -71,7 +89,7 @@ namespace octet { namespace containers {
     void release() {
       for (unsigned i = 0; i != max_entries; ++i) {
         entry_t *entry = &entries[i];
-        if (entry->key ) {
+        if (entry->key && !entry->interned) {
           allocator_t::free((void*)entry->key, strlen(entry->key)+1);
         }
       }
@@ -110,11 +128,29 @@ namespace octet { namespace containers {
         size_t bytes = strlen(key) + 1;
         entry->key = (char *)allocator_t::malloc(bytes);
         entry->hash = hash;
+        entry->interned = false;
         memcpy((void*)entry->key, key, bytes);
       }
       return entry->value;
     }
 
+    /// Access an element by interned name, creating it if it does not exist.
+    /// The dictionary does not need to copy the key.
+    value_t &operator[]( const interned_string &key ) {
+      entry_t *entry = find( key );
+      if (!entry || !entry->key) {
+        if (num_entries > max_entries * 3 / 4) {
+          expand();
+          entry = find(key);
+        }
+        num_entries++;
+        entry->key = key.c_str();
+        entry->hash = key.get_hash();
+        entry->interned = true;
+      }
+      return entry->value;
+    }
+
     /// Return true if the dictionary contains key.
     bool contains(const char *key) {
       unsigned hash = calc_hash( key );
@@ -122,6 +158,12 @@ namespace octet { namespace containers {
       return entry && entry->key;
     }
 
+    /// Return true if the dictionary contains an interned key.
+    bool contains(const interned_string &key) {
+      entry_t *entry = find( key );
+      return entry && entry->key;
+    }
+
     /// Return the number of entries stored in the dictionary.
     unsigned get_size() const {
       return num_entries;
@@ -151,6 +193,12 @@ namespace octet { namespace containers {
       return entry && entry->key ? (int)(entry - entries) : -1;
     }
 
+    /// Get the index for an interned key, or -1 if the key is not found.
+    int get_index(const interned_string &key) {
+      entry_t *entry = find( key );
+      return entry && entry->key ? (int)(entry - entries) : -1;
+    }
+
     /// Reset the dictionary to empty and free up the resources.
     void reset() {
       release();
@@ -159,7 +207,7 @@ namespace octet { namespace containers {
   
     /// Bye bye dictionary. Use the allocator to free up memory.
     ~dictionary() {
-      reset();
+      release();
     }
   };
 } }
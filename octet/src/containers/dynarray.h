@@ -7,6 +7,28 @@
 
 
 namespace octet { namespace containers {
+  /// Can objects of this type be moved around in memory with memcpy?
+  ///
+  /// True for plain data. Classes that only hold pointers to things they own,
+  /// such as ref, string and dynarray, specialize this to say that they are too.
+  template <class item_t> struct is_relocatable {
+    enum { value = std::is_trivially_copyable<item_t>::value };
+  };
+
+  /// Move "num" items from src to uninitialised memory at dest, leaving src uninitialised.
+  /// The ranges must not overlap.
+  template <class item_t> void relocate_items(item_t *dest, item_t *src, unsigned num) {
+    if (is_relocatable<item_t>::value) {
+      if (num) memcpy((void*)dest, (const void*)src, num * sizeof(item_t));
+    } else {
+      dynarray_dummy_t x;
+      for (unsigned i = 0; i != num; ++i) {
+        new (dest + i, x) item_t(std::move(src[i]));
+        src[i].~item_t();
+      }
+    }
+  }
+
   /// Dynamic array class similar to std::vector.
   ///
   /// Example
@@ -33,6 +55,46 @@ namespace octet { namespace containers {
     int_size_t capacity_;
     enum { min_capacity = 8 };
 
+    // can we use memcpy and memmove instead of constructors?
+    enum { relocatable = !use_new_delete || is_relocatable<item_t>::value };
+
+    // make room for at least min_size elements, doubling the capacity.
+    void grow(int_size_t min_size) {
+      int_size_t new_capacity = capacity_ == 0 ? min_capacity : capacity_ * 2;
+      reserve(new_capacity < min_size ? min_size : new_capacity);
+    }
+
+    // open a gap of one uninitialised element at elem.
+    void open_gap(int_size_t elem) {
+      if (size_ == capacity_) grow(size_ + 1);
+      if (relocatable) {
+        memmove((void*)(data_ + elem + 1), (const void*)(data_ + elem), (size_ - elem) * sizeof(item_t));
+      } else if (elem != size_) {
+        dynarray_dummy_t x;
+        new (data_ + size_, x) item_t(std::move(data_[size_-1]));
+        for (int_size_t i = size_ - 1; i != elem; --i) {
+          data_[i] = std::move(data_[i-1]);
+        }
+        data_[elem].~item_t();
+      }
+      size_++;
+    }
+
+    // destroy the element at elem and close the gap.
+    void close_gap(int_size_t elem) {
+      assert(elem < size_);
+      if (relocatable) {
+        if (use_new_delete) data_[elem].~item_t();
+        memmove((void*)(data_ + elem), (const void*)(data_ + elem + 1), (size_ - elem - 1) * sizeof(item_t));
+      } else {
+        for (int_size_t i = elem; i < size_-1; ++i) {
+          data_[i] = std::move(data_[i+1]);
+        }
+        data_[size_-1].~item_t();
+      }
+      size_--;
+    }
+
   public:
     /// Create a new, empty, dynamic array
     dynarray() {
@@ -43,7 +105,7 @@ namespace octet { namespace containers {
 
     /// Create a new dynamic array of a certain size.
     dynarray(int_size_t size) {
-      data_ = (item_t*)allocator::malloc(size * sizeof(item_t));
+      data_ = (item_t*)allocator_t::malloc(size * sizeof(item_t));
       size_ = capacity_ = size;
       if (use_new_delete) {
         dynarray_dummy_t x;
@@ -57,7 +119,7 @@ namespace octet { namespace containers {
     ///
     /// Note: this is very slow and will happen frequently in naive code.
     dynarray(const dynarray &rhs) {
-      data_ = (item_t*)allocator::malloc(rhs.size_ * sizeof(item_t));
+      data_ = (item_t*)allocator_t::malloc(rhs.size_ * sizeof(item_t));
       size_ = capacity_ = rhs.size_;
       if (use_new_delete) {
         dynarray_dummy_t x;
@@ -69,6 +131,48 @@ namespace octet { namespace containers {
       }
     }
 
+    /// Take the contents of another array. This is fast; the other array is left empty.
+    dynarray(dynarray &&rhs) {
+      data_ = rhs.data_;
+      size_ = rhs.size_;
+      capacity_ = rhs.capacity_;
+      rhs.data_ = 0;
+      rhs.size_ = 0;
+      rhs.capacity_ = 0;
+    }
+
+    /// Copy another array into this one.
+    dynarray &operator=(const dynarray &rhs) {
+      if (this != &rhs) {
+        resize(0);
+        reserve(rhs.size_);
+        if (use_new_delete) {
+          dynarray_dummy_t x;
+          for (int_size_t i = 0; i != rhs.size_; ++i) {
+            new (data_ + i, x)item_t(rhs.data_[i]);
+          }
+        } else {
+          memcpy(data_, rhs.data_, rhs.size_ * sizeof(item_t));
+        }
+        size_ = rhs.size_;
+      }
+      return *this;
+    }
+
+    /// Take the contents of another array, freeing our old contents.
+    dynarray &operator=(dynarray &&rhs) {
+      if (this != &rhs) {
+        reset();
+        data_ = rhs.data_;
+        size_ = rhs.size_;
+        capacity_ = rhs.capacity_;
+        rhs.data_ = 0;
+        rhs.size_ = 0;
+        rhs.capacity_ = 0;
+      }
+      return *this;
+    }
+
     /// Destroy the array and its contents.
     ~dynarray() {
       reset();
@@ -108,37 +212,76 @@ namespace octet { namespace containers {
   
     /// iterator insert for STL compatibility
     iterator insert(iterator it, const item_t &new_item) {
-      int_size_t old_length = size_;
-      resize(size_+1);
-      for (int_size_t i = old_length; i != it.elem; --i) {
-        data_[i] = data_[i-1];
-      }
-      data_[it.elem] = new_item;
+      return emplace(it, new_item);
+    }
+
+    /// iterator insert for STL compatibility
+    iterator insert(iterator it, item_t &&new_item) {
+      return emplace(it, std::move(new_item));
+    }
+
+    /// Construct a new item in place before "it".
+    template <class... args_t> iterator emplace(iterator it, args_t&&... args) {
+      // build the item first in case args refer to elements of this array.
+      item_t new_item(std::forward<args_t>(args)...);
+      open_gap(it.elem);
+      dynarray_dummy_t x;
+      new (data_ + it.elem, x) item_t(std::move(new_item));
       return it;
     }
 
     /// iterator erase for STL compatibility
     iterator erase(iterator it) {
-      for (int_size_t i = it.elem; i < size_-1; ++i) {
-        data_[i] = data_[i+1];
-      }
-      resize(size_-1);
+      close_gap(it.elem);
       return it;
     }
   
     /// Erase an item; move subsequent items down to fill the gap.
     void erase(unsigned elem) {
-      for (int_size_t i = elem; i < size_-1; ++i) {
-        data_[i] = data_[i+1];
-      }
-      resize(size_-1);
+      close_gap(elem);
     }
 
     /// Add an item at the back of the array.
     void push_back(const item_t &new_item) {
-      int_size_t old_length = size_;
-      resize(size_+1);
-      data_[old_length] = new_item;
+      dynarray_dummy_t x;
+      if (size_ == capacity_) {
+        // new_item may be in the array we are about to free.
+        item_t tmp(new_item);
+        grow(size_ + 1);
+        new (data_ + size_, x) item_t(std::move(tmp));
+      } else {
+        new (data_ + size_, x) item_t(new_item);
+      }
+      size_++;
+    }
+
+    /// Move an item on to the back of the array.
+    void push_back(item_t &&new_item) {
+      dynarray_dummy_t x;
+      if (size_ == capacity_) {
+        item_t tmp(std::move(new_item));
+        grow(size_ + 1);
+        new (data_ + size_, x) item_t(std::move(tmp));
+      } else {
+        new (data_ + size_, x) item_t(std::move(new_item));
+      }
+      size_++;
+    }
+
+    /// Construct an item in place at the back of the array.
+    ///
+    ///     dynarray<string> names;
+    ///     names.emplace_back("fred");
+    template <class... args_t> item_t &emplace_back(args_t&&... args) {
+      dynarray_dummy_t x;
+      if (size_ == capacity_) {
+        item_t tmp(std::forward<args_t>(args)...);
+        grow(size_ + 1);
+        new (data_ + size_, x) item_t(std::move(tmp));
+      } else {
+        new (data_ + size_, x) item_t(std::forward<args_t>(args)...);
+      }
+      return data_[size_++];
     }
 
     /// Get the last element in the array.
@@ -186,15 +329,9 @@ namespace octet { namespace containers {
         size_ = (int_size_t)new_length;
       } else if (new_length > capacity_) {
         if (trace) printf("case 2: growing dynarray beyond capacity_\n");
-        int_size_t new_capacity = ((int_size_t)new_length < size_ ? size_ : (int_size_t)new_length);
 
-        if (new_length == size_ + 1) {
-          // growing array by 1: round up to power of two.
-          new_capacity = capacity_ == 0 ? min_capacity : capacity_ * 2;
-          while (new_capacity < new_length) new_capacity *= 2;
-        }
-
-        reserve(new_capacity);
+        // grow geometrically so that repeated small resizes are amortised.
+        grow((int_size_t)new_length);
 
         if (use_new_delete) {
           // initialize the rest to default
@@ -222,24 +359,21 @@ namespace octet { namespace containers {
     /// Reserve an amount of memory to use with this array.
     /// Use this before you start a loop with push_back calls, for example.
     void reserve(int_size_t new_capacity) {
-      if (new_capacity >= size_) {
-        dynarray_dummy_t x;
-        item_t *new_data = (item_t *)allocator_t::malloc(sizeof(item_t) * new_capacity);
-      
-        if (use_new_delete) {
-          // initialize new data_ elements from old ones
-          for (int_size_t i = 0; i != size_; ++i) {
-            new (new_data + i, x) item_t(data_[i]);
-            data_[i].~item_t();
+      if (new_capacity >= size_ && new_capacity != capacity_) {
+        if (relocatable && data_) {
+          // the allocator may be able to grow the block in place.
+          data_ = (item_t *)allocator_t::realloc(data_, capacity_ * sizeof(item_t), sizeof(item_t) * new_capacity);
+        } else {
+          item_t *new_data = (item_t *)allocator_t::malloc(sizeof(item_t) * new_capacity);
+          relocate_items(new_data, data_, size_);
+
+          // free up data_
+          if (data_) {
+            allocator_t::free(data_, capacity_ * sizeof(item_t));
           }
-        }
 
-        // free up data_
-        if (data_) {
-          allocator_t::free(data_, capacity_ * sizeof(item_t));
+          data_ = new_data;
         }
-
-        data_ = new_data;
         capacity_ = new_capacity;
       }
     }
@@ -248,6 +382,9 @@ namespace octet { namespace containers {
     void pop_back() {
       assert(size_ != 0);
       size_--;
+      if (use_new_delete) {
+        data_[size_].~item_t();
+      }
     }
 
     /// Reset the array to zero size, freeing up the data.
@@ -267,6 +404,11 @@ namespace octet { namespace containers {
     }
   };
 
+  /// dynarrays own their data through a pointer, so they can be moved with memcpy.
+  template <class item_t, class allocator_t, bool use_new_delete> struct is_relocatable<dynarray<item_t, allocator_t, use_new_delete> > {
+    enum { value = 1 };
+  };
+
   inline void vformat(dynarray <char> &ary, const char *fmt, va_list v) {
     unsigned old_size = ary.size();
     #ifdef WIN32
@@ -11,16 +11,36 @@
 namespace octet { namespace containers {
 
   /// A support class for hash_map that is used to implement different kinds of key.
+  ///
+  /// Derive from this class to hash other kinds of key: provide a static get_hash(key).
   class hash_map_cmp {
   public:
-    // mix in some bits from higher positions to lower positions
-    static unsigned fuzz_hash(unsigned hash) { return hash ^ (hash >> 3) ^ (hash >> 5); }
+    /// mix the bits of a 32 bit hash so that every input bit affects every output bit (murmur3 finaliser)
+    static unsigned fuzz_hash(unsigned hash) {
+      hash ^= hash >> 16;
+      hash *= 0x85ebca6b;
+      hash ^= hash >> 13;
+      hash *= 0xc2b2ae35;
+      hash ^= hash >> 16;
+      return hash;
+    }
 
-    static unsigned get_hash(void *key) { return fuzz_hash((unsigned)(intptr_t)key); }
+    /// mix a 64 bit value down to a 32 bit hash (murmur3 64 bit finaliser)
+    static unsigned fuzz_hash64(uint64_t key) {
+      key ^= key >> 33;
+      key *= 0xff51afd7ed558ccdull;
+      key ^= key >> 33;
+      key *= 0xc4ceb9fe1a85ec53ull;
+      key ^= key >> 33;
+      return (unsigned)key;
+    }
+
+    static unsigned get_hash(void *key) { return fuzz_hash64((uint64_t)(uintptr_t)key); }
     static unsigned get_hash(int key) { return fuzz_hash((unsigned)key); }
     static unsigned get_hash(unsigned key) { return fuzz_hash((unsigned)key); }
-    static unsigned get_hash(uint64_t key) { return fuzz_hash((unsigned)(key ^ (key >> 32))); }
+    static unsigned get_hash(uint64_t key) { return fuzz_hash64(key); }
 
+    // no longer used by hash_map, which can now store any key. kept for derived classes.
     static bool is_empty(void *key) { return !key; }
     static bool is_empty(int key) { return !key; }
     static bool is_empty(unsigned key) { return !key; }
@@ -42,135 +62,294 @@ namespace octet { namespace containers {
   ///     int_to_int[9] = 11;
   ///     printf("[5]=%d [9]=%d\n", int_to_int[5], int_to_int[9]);
   ///
-  ///     for (unsigned i = 0; i != int_to_int.size(); ++i) {
-  ///       printf("key=d value=%d\n", int_to_int.get_key(i), int_to_int.get_value(i));
+  ///     for (unsigned i = 0; i != int_to_int.capacity(); ++i) {
+  ///       if (int_to_int.is_used(i)) {
+  ///         printf("key=%d value=%d\n", int_to_int.get_key(i), int_to_int.get_value(i));
+  ///       }
   ///     }
+  ///
+  /// The table is open addressed with linear probing. Each slot has a control byte
+  /// that is either empty or holds seven bits of the hash, so sixteen slots
+  /// are checked at a time with one SSE2 compare and the keys are only
+  /// compared for likely matches. Erase shifts later entries back to fill the gap,
+  /// so there are no tombstones and lookups never slow down after erasing.
   template <typename key_t, typename value_t, class cmp_t=hash_map_cmp, class allocator_t=allocator> class hash_map {
     // internal gubbins to implement the hash map
     struct entry_t { key_t key; unsigned hash; value_t value; };
 
+    enum {
+      group_size = 16,
+      min_capacity = 16,
+      ctrl_empty = 0x80,
+    };
+
+    // control bytes: ctrl_empty or the top seven bits of the hash.
+    // the first group_size-1 bytes are repeated at the end so that a group can be read at any slot.
+    uint8_t *ctrl;
     entry_t *entries;
     unsigned num_entries;
     unsigned max_entries;
 
-    // internal method to find an existing key in the map
-    entry_t *find( const key_t &key, unsigned hash ) {
+    static uint8_t hash_bits(unsigned hash) {
+      return (uint8_t)(hash >> 25);
+    }
+
+    static unsigned lowest_bit(unsigned mask) {
+      #if defined(_MSC_VER)
+        unsigned long result;
+        _BitScanForward(&result, mask);
+        return (unsigned)result;
+      #else
+        return (unsigned)__builtin_ctz(mask);
+      #endif
+    }
+
+    // compare sixteen control bytes with the hash bits and with ctrl_empty.
+    static void match_group(const uint8_t *group, uint8_t bits, unsigned &matches, unsigned &empties) {
+      #if OCTET_SSE2
+        __m128i ctrl_bytes = _mm_loadu_si128((const __m128i*)group);
+        matches = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl_bytes, _mm_set1_epi8((char)bits)));
+        empties = (unsigned)_mm_movemask_epi8(ctrl_bytes);
+      #else
+        matches = empties = 0;
+        for (unsigned i = 0; i != group_size; ++i) {
+          matches |= (group[i] == bits) << i;
+          empties |= (group[i] == ctrl_empty) << i;
+        }
+      #endif
+    }
+
+    void set_ctrl(unsigned index, uint8_t value) {
+      ctrl[index] = value;
+      if (index < group_size - 1) {
+        ctrl[index + max_entries] = value;
+      }
+    }
+
+    // find the index of a key in the map, or the empty slot where it would go.
+    unsigned find(const key_t &key, unsigned hash, bool &found) const {
       unsigned mask = max_entries - 1;
-      for (unsigned i = 0; i != max_entries; ++i) {
-        entry_t *entry = &entries[ ( i + hash ) & mask ];
-        if (cmp_t::is_empty(entry->key)) {
-          return entry;
+      unsigned pos = hash & mask;
+      uint8_t bits = hash_bits(hash);
+      for (;;) {
+        unsigned matches, empties;
+        match_group(ctrl + pos, bits, matches, empties);
+
+        // only slots before the first empty slot can hold our key.
+        if (empties) matches &= (empties & (0 - empties)) - 1;
+
+        while (matches) {
+          unsigned index = (pos + lowest_bit(matches)) & mask;
+          const entry_t &entry = entries[index];
+          if (entry.hash == hash && entry.key == key) {
+            found = true;
+            return index;
+          }
+          matches &= matches - 1;
         }
-        if (entry->hash == hash && entry->key == key) {
-          return entry;
+
+        if (empties) {
+          found = false;
+          return (pos + lowest_bit(empties)) & mask;
         }
+        pos = (pos + group_size) & mask;
       }
-      assert(0 && "hash_map: all entries are used. expand() did not get called");
-      return 0;
     }
-  
+
+    // find an existing key, returns -1 if not found.
+    int find_index(const key_t &key) const {
+      if (num_entries == 0) return -1;
+      bool found;
+      unsigned index = find(key, cmp_t::get_hash(key), found);
+      return found ? (int)index : -1;
+    }
+
+    // set up empty tables of a certain size.
+    void allocate(unsigned new_max_entries) {
+      max_entries = new_max_entries;
+      ctrl = (uint8_t*)allocator_t::malloc(max_entries + group_size);
+      memset(ctrl, ctrl_empty, max_entries + group_size);
+      entries = (entry_t*)allocator_t::malloc(sizeof(entry_t) * max_entries);
+    }
+
     // increase the size of the map if we have run out of space
     void expand() {
+      uint8_t *old_ctrl = ctrl;
       entry_t *old_entries = entries;
       unsigned old_max_entries = max_entries;
-      entries = (entry_t *)allocator_t::malloc(sizeof(entry_t) * max_entries*2);
-      memset(entries, 0, sizeof(entry_t) * max_entries*2);
-      max_entries *= 2;
+      allocate(max_entries ? max_entries * 2 : min_capacity);
       for (unsigned i = 0; i != old_max_entries; ++i) {
-        entry_t *old_entry = &old_entries[i];
-        if (!cmp_t::is_empty(old_entry->key)) {
-          entry_t *new_entry = find(old_entry->key, old_entry->hash);
-          *new_entry = *old_entry;
+        if (old_ctrl[i] != ctrl_empty) {
+          entry_t *old_entry = &old_entries[i];
+          bool found;
+          unsigned index = find(old_entry->key, old_entry->hash, found);
+          relocate_items(&entries[index], old_entry, 1);
+          set_ctrl(index, hash_bits(old_entry->hash));
         }
       }
-      allocator_t::free(old_entries, sizeof(entry_t) * old_max_entries);
+      if (old_ctrl) {
+        allocator_t::free(old_ctrl, old_max_entries + group_size);
+        allocator_t::free(old_entries, sizeof(entry_t) * old_max_entries);
+      }
     }
 
     void release() {
-      allocator_t::free(entries, sizeof(entry_t) * max_entries);
+      if (ctrl) {
+        for (unsigned i = 0; i != max_entries; ++i) {
+          if (ctrl[i] != ctrl_empty) entries[i].~entry_t();
+        }
+        allocator_t::free(ctrl, max_entries + group_size);
+        allocator_t::free(entries, sizeof(entry_t) * max_entries);
+      }
+      init();
+    }
+
+    void init() {
+      ctrl = 0;
       entries = 0;
       num_entries = 0;
       max_entries = 0;
     }
 
-    void init() {
-      num_entries = 0;
-      max_entries = 4;
-      entries = (entry_t*)allocator_t::malloc(sizeof(entry_t) * max_entries);
-      memset(entries, 0, sizeof(entry_t) * max_entries);
+    // remove the entry at index, then shift following entries back into the gap
+    // if that brings them no further from their home slot.
+    void erase_index(unsigned index) {
+      unsigned mask = max_entries - 1;
+      entries[index].~entry_t();
+      for (unsigned next = (index + 1) & mask; ctrl[next] != ctrl_empty; next = (next + 1) & mask) {
+        unsigned home = entries[next].hash & mask;
+        if (((next - home) & mask) >= ((next - index) & mask)) {
+          relocate_items(&entries[index], &entries[next], 1);
+          set_ctrl(index, ctrl[next]);
+          index = next;
+        }
+      }
+      set_ctrl(index, ctrl_empty);
+      num_entries--;
     }
   public:
-    // Create an empty map.
+    // Create an empty map. No memory is used until the first key is added.
     hash_map() {
       init();
     }
 
+    /// Copy a map.
+    hash_map(const hash_map &rhs) {
+      init();
+      *this = rhs;
+    }
+
+    /// Copy another map into this one.
+    hash_map &operator=(const hash_map &rhs) {
+      if (this != &rhs) {
+        release();
+        if (rhs.num_entries) {
+          allocate(rhs.max_entries);
+          memcpy(ctrl, rhs.ctrl, max_entries + group_size);
+          dynarray_dummy_t x;
+          for (unsigned i = 0; i != max_entries; ++i) {
+            if (ctrl[i] != ctrl_empty) new (&entries[i], x) entry_t(rhs.entries[i]);
+          }
+          num_entries = rhs.num_entries;
+        }
+      }
+      return *this;
+    }
+
     /// Remove all keys and values from the hash map.
     void clear() {
       release();
-      init();
     }
   
-    /// Access the map by key
+    /// Access the map by key. New values are value-initialised (zero for numbers and pointers).
     value_t &operator[]( const key_t &key ) {
       unsigned hash = cmp_t::get_hash(key);
-      entry_t *entry = find( key, hash );
-      if (cmp_t::is_empty(entry->key)) {
+      bool found = false;
+      unsigned index = 0;
+      if (max_entries) {
+        index = find(key, hash, found);
+      }
+      if (!found) {
         // reducing this ratio decreases hot search time at the
         // expense of size (cold search time).
         if (num_entries >= max_entries * 3 / 4) {
           expand();
-          entry = find(key, hash);
+          index = find(key, hash, found);
         }
         num_entries++;
-        entry->key = key;
+        dynarray_dummy_t x;
+        entry_t *entry = &entries[index];
+        new (&entry->key, x) key_t(key);
         entry->hash = hash;
+        new (&entry->value, x) value_t();
+        set_ctrl(index, hash_bits(hash));
       }
-      return entry->value;
+      return entries[index].value;
     }
 
     /// Does the map have this key?
-    bool contains(const key_t &key) {
-      unsigned hash = cmp_t::get_hash(key);
-      entry_t *entry = find( key, hash );
-      return !cmp_t::is_empty(entry->key);
+    bool contains(const key_t &key) const {
+      return find_index(key) != -1;
+    }
+
+    /// Remove a key and its value from the map. Returns false if the key was not there.
+    ///
+    /// Note: this moves other entries, so indices from get_index() become invalid.
+    bool erase(const key_t &key) {
+      int index = find_index(key);
+      if (index == -1) return false;
+      erase_index((unsigned)index);
+      return true;
     }
 
     /// Get an integer that represents the position in the map of this key.
+    /// Returns -1 if the key is not in the map.
     ///
-    /// Note: only valid if the map does not change size.
-    int get_index(const key_t &key) {
-      unsigned hash = cmp_t::get_hash(key);
-      entry_t *entry = find( key, hash );
-      return entry ? (int)(entry - entries) : -1;
+    /// Note: only valid if the map does not change.
+    int get_index(const key_t &key) const {
+      return find_index(key);
+    }
+
+    /// Is there a key at this index?
+    ///
+    /// Used for iterating through the map.
+    bool is_used(int index) const {
+      assert((unsigned)index < max_entries);
+      return ctrl[index] != ctrl_empty;
     }
 
     /// For a specfic index, get the key.
     ///
     /// Used for iterating through the map or if using find()
     const key_t &get_key(int index) const {
-      assert((unsigned)index < max_entries);
+      assert((unsigned)index < max_entries && ctrl[index] != ctrl_empty);
       return entries[index].key;
     }
 
     /// For a specific index, get the value
     const value_t &get_value(int index) const {
-      assert((unsigned)index < max_entries);
+      assert((unsigned)index < max_entries && ctrl[index] != ctrl_empty);
+      return entries[index].value;
+    }
+
+    /// For a specific index, get a modifiable value
+    value_t &get_value(int index) {
+      assert((unsigned)index < max_entries && ctrl[index] != ctrl_empty);
       return entries[index].value;
     }
 
     /// bye bye hash map
     ~hash_map() {
-      allocator_t::free(entries, sizeof(entry_t) * max_entries);
-      entries = 0;
-      num_entries = 0;
-      max_entries = 0;
+      release();
     }
 
-    /// Get the maximum number of keys and values in the map.
+    /// Get the number of keys in the map.
+    unsigned size() const { return num_entries; }
+
+    /// Get the number of slots in the map.
     ///
-    /// Used for iteration.
-    unsigned size() { return max_entries; }
+    /// Used for iteration with is_used().
+    unsigned capacity() const { return max_entries; }
     
     //key_t key(unsigned i) { return entries[i].key; }
     //value_t value(unsigned i) { return entries[i].value; }
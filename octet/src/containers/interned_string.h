@@ -0,0 +1,197 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// global table of unique strings
+//
+
+namespace octet { namespace containers {
+  /// Handle to a string in the global string table.
+  ///
+  /// Each distinct text is stored once, so two handles are equal exactly when
+  /// their pointers are equal. The hash is computed once when the string is interned.
+  /// Use these for names that are looked up often, such as resource names.
+  ///
+  ///     static const interned_string name("default_material");
+  ///     material *mat = dict.get_material(name); // no hashing, no strcmp
+  ///
+  /// Interned strings are never freed, so do not intern text that is only used once.
+  class interned_string {
+    const char *str_;
+    unsigned hash_;
+
+    struct slot_t {
+      const char *str;
+      unsigned hash;
+    };
+
+    enum {
+      chunk_size = 16384,
+      min_slots = 1024,
+    };
+
+    // singleton state, a bit like an old-world global variable
+    struct state_t {
+      std::mutex mutex;
+      slot_t *slots;
+      unsigned num_slots;
+      unsigned num_strings;
+      size_t num_bytes;
+      char *chunk_pos;
+      char *chunk_end;
+
+      state_t() {
+        num_slots = min_slots;
+        slots = (slot_t*)allocator::malloc(sizeof(slot_t) * num_slots);
+        memset(slots, 0, sizeof(slot_t) * num_slots);
+        num_strings = 0;
+        num_bytes = 0;
+        chunk_pos = chunk_end = 0;
+      }
+    };
+
+    static state_t &state() {
+      static state_t instance;
+      return instance;
+    }
+
+    // copy the text into the string store. call with the mutex held.
+    static const char *store(state_t &s, const char *text, size_t len) {
+      if (s.chunk_pos + len + 1 > s.chunk_end) {
+        size_t size = len + 1 > chunk_size ? len + 1 : chunk_size;
+        s.chunk_pos = (char*)allocator::malloc(size);
+        s.chunk_end = s.chunk_pos + size;
+      }
+      char *result = s.chunk_pos;
+      memcpy(result, text, len);
+      result[len] = 0;
+      s.chunk_pos += len + 1;
+      s.num_bytes += len + 1;
+      return result;
+    }
+
+    // double the size of the table. call with the mutex held.
+    static void expand(state_t &s) {
+      slot_t *old_slots = s.slots;
+      unsigned old_num_slots = s.num_slots;
+      s.num_slots *= 2;
+      s.slots = (slot_t*)allocator::malloc(sizeof(slot_t) * s.num_slots);
+      memset(s.slots, 0, sizeof(slot_t) * s.num_slots);
+      unsigned mask = s.num_slots - 1;
+      for (unsigned i = 0; i != old_num_slots; ++i) {
+        if (old_slots[i].str) {
+          unsigned j = old_slots[i].hash & mask;
+          while (s.slots[j].str) j = (j + 1) & mask;
+          s.slots[j] = old_slots[i];
+        }
+      }
+      allocator::free(old_slots, sizeof(slot_t) * old_num_slots);
+    }
+
+    // find or add a string
+    static const char *intern(const char *text, size_t len, unsigned hash) {
+      state_t &s = state();
+      std::lock_guard<std::mutex> lock(s.mutex);
+      unsigned mask = s.num_slots - 1;
+      unsigned i = hash & mask;
+      for (; s.slots[i].str; i = (i + 1) & mask) {
+        const slot_t &slot = s.slots[i];
+        if (slot.hash == hash && !memcmp(slot.str, text, len) && slot.str[len] == 0) {
+          return slot.str;
+        }
+      }
+
+      if (s.num_strings >= s.num_slots * 3 / 4) {
+        expand(s);
+        mask = s.num_slots - 1;
+        for (i = hash & mask; s.slots[i].str; i = (i + 1) & mask) {
+        }
+      }
+
+      s.slots[i].str = store(s, text, len);
+      s.slots[i].hash = hash;
+      s.num_strings++;
+      return s.slots[i].str;
+    }
+
+    void init(const char *text, size_t len) {
+      hash_ = calc_hash(text, len);
+      str_ = intern(text, len, hash_);
+    }
+
+  public:
+    /// The empty string.
+    interned_string() {
+      init("", 0);
+    }
+
+    /// Find or add a string in the table.
+    explicit interned_string(const char *text) {
+      init(text ? text : "", text ? strlen(text) : 0);
+    }
+
+    /// Find or add the first len characters of text.
+    interned_string(const char *text, size_t len) {
+      init(text, len);
+    }
+
+    /// The text of the string. The pointer is valid for the life of the program.
+    const char *c_str() const {
+      return str_;
+    }
+
+    /// The precomputed hash of the text. This is the same as calc_hash(c_str()).
+    unsigned get_hash() const {
+      return hash_;
+    }
+
+    /// Return true if the string is empty.
+    bool empty() const {
+      return str_[0] == 0;
+    }
+
+    /// Handles are equal if the text is equal.
+    bool operator==(const interned_string &rhs) const {
+      return str_ == rhs.str_;
+    }
+
+    /// Handles are different if the text is different.
+    bool operator!=(const interned_string &rhs) const {
+      return str_ != rhs.str_;
+    }
+
+    /// The string hash used by the string table and by dictionary (FNV-1a).
+    static unsigned calc_hash(const char *text, size_t len) {
+      unsigned hash = 2166136261u;
+      for (size_t i = 0; i != len; ++i) {
+        hash = (hash ^ (uint8_t)text[i]) * 16777619u;
+      }
+      return hash;
+    }
+
+    /// The string hash of a zero-terminated string.
+    static unsigned calc_hash(const char *text) {
+      unsigned hash = 2166136261u;
+      for (; *text; ++text) {
+        hash = (hash ^ (uint8_t)*text) * 16777619u;
+      }
+      return hash;
+    }
+
+    /// How many strings are in the table?
+    static unsigned get_num_strings() {
+      state_t &s = state();
+      std::lock_guard<std::mutex> lock(s.mutex);
+      return s.num_strings;
+    }
+
+    /// How many bytes of text are in the table?
+    static size_t get_num_bytes() {
+      state_t &s = state();
+      std::lock_guard<std::mutex> lock(s.mutex);
+      return s.num_bytes;
+    }
+  };
+} }
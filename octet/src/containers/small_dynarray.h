@@ -0,0 +1,228 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Dynamic array with inline storage for short arrays
+//
+
+namespace octet { namespace containers {
+  /// Dynamic array that keeps its first num_inline elements inside the object.
+  ///
+  /// Use this for short temporary arrays, such as the corners of a polygon
+  /// or the parameters of a loader element, to avoid going to the heap at all.
+  /// If the array grows beyond num_inline elements, it moves to the allocator.
+  ///
+  ///     small_dynarray<unsigned, 8> indices;
+  ///     indices.push_back(1); // no allocation here
+  template <class item_t, unsigned num_inline, class allocator_t=allocator> class small_dynarray {
+    typedef unsigned int_size_t;
+
+    item_t *data_;
+    int_size_t size_;
+    int_size_t capacity_;
+    typename std::aligned_storage<sizeof(item_t) * num_inline, alignof(item_t)>::type buffer_;
+
+    item_t *inline_data() { return (item_t*)&buffer_; }
+
+    bool is_inline() const { return data_ == (const item_t*)&buffer_; }
+
+    void grow(int_size_t min_size) {
+      int_size_t new_capacity = capacity_ * 2;
+      reserve(new_capacity < min_size ? min_size : new_capacity);
+    }
+
+    void destroy_items() {
+      for (int_size_t i = 0; i != size_; ++i) {
+        data_[i].~item_t();
+      }
+    }
+
+    void free_data() {
+      if (!is_inline()) {
+        allocator_t::free(data_, capacity_ * sizeof(item_t));
+      }
+      data_ = inline_data();
+      capacity_ = num_inline;
+    }
+
+    // take the contents of rhs, leaving it empty.
+    void steal(small_dynarray &rhs) {
+      if (rhs.is_inline()) {
+        data_ = inline_data();
+        capacity_ = num_inline;
+        relocate_items(data_, rhs.data_, rhs.size_);
+      } else {
+        data_ = rhs.data_;
+        capacity_ = rhs.capacity_;
+        rhs.data_ = rhs.inline_data();
+        rhs.capacity_ = num_inline;
+      }
+      size_ = rhs.size_;
+      rhs.size_ = 0;
+    }
+
+  public:
+    /// Create a new, empty array using the inline storage.
+    small_dynarray() {
+      data_ = inline_data();
+      size_ = 0;
+      capacity_ = num_inline;
+    }
+
+    /// Copy an array.
+    small_dynarray(const small_dynarray &rhs) {
+      data_ = inline_data();
+      size_ = 0;
+      capacity_ = num_inline;
+      *this = rhs;
+    }
+
+    /// Take the contents of another array.
+    small_dynarray(small_dynarray &&rhs) {
+      steal(rhs);
+    }
+
+    /// Copy another array into this one.
+    small_dynarray &operator=(const small_dynarray &rhs) {
+      if (this != &rhs) {
+        resize(0);
+        reserve(rhs.size_);
+        dynarray_dummy_t x;
+        for (int_size_t i = 0; i != rhs.size_; ++i) {
+          new (data_ + i, x) item_t(rhs.data_[i]);
+        }
+        size_ = rhs.size_;
+      }
+      return *this;
+    }
+
+    /// Take the contents of another array, freeing our old contents.
+    small_dynarray &operator=(small_dynarray &&rhs) {
+      if (this != &rhs) {
+        reset();
+        steal(rhs);
+      }
+      return *this;
+    }
+
+    /// Destroy the array and its contents.
+    ~small_dynarray() {
+      reset();
+    }
+
+    /// Add an item at the back of the array.
+    void push_back(const item_t &new_item) {
+      emplace_back(new_item);
+    }
+
+    /// Move an item on to the back of the array.
+    void push_back(item_t &&new_item) {
+      emplace_back(std::move(new_item));
+    }
+
+    /// Construct an item in place at the back of the array.
+    template <class... args_t> item_t &emplace_back(args_t&&... args) {
+      dynarray_dummy_t x;
+      if (size_ == capacity_) {
+        // args may refer to elements we are about to move.
+        item_t tmp(std::forward<args_t>(args)...);
+        grow(size_ + 1);
+        new (data_ + size_, x) item_t(std::move(tmp));
+      } else {
+        new (data_ + size_, x) item_t(std::forward<args_t>(args)...);
+      }
+      return data_[size_++];
+    }
+
+    /// Shrink the size of the array by one.
+    void pop_back() {
+      assert(size_ != 0);
+      data_[--size_].~item_t();
+    }
+
+    /// Erase an item; move subsequent items down to fill the gap.
+    void erase(unsigned elem) {
+      assert(elem < size_);
+      if (is_relocatable<item_t>::value) {
+        data_[elem].~item_t();
+        memmove((void*)(data_ + elem), (const void*)(data_ + elem + 1), (size_ - elem - 1) * sizeof(item_t));
+        size_--;
+      } else {
+        for (int_size_t i = elem; i < size_-1; ++i) {
+          data_[i] = std::move(data_[i+1]);
+        }
+        pop_back();
+      }
+    }
+
+    /// Get the last element in the array.
+    item_t &back() const {
+      assert(size_);
+      return data_[size_-1];
+    }
+
+    /// Return true if the array is empty.
+    bool empty() const {
+      return size_ == 0;
+    }
+
+    /// Access an element in the array.
+    item_t &operator[](size_t elem) { return data_[elem]; }
+
+    /// Read an element in the array.
+    const item_t &operator[](size_t elem) const { return data_[elem]; }
+
+    /// Return number of elements in the array
+    int_size_t size() const { return size_; }
+
+    /// Return the number of elements in the array before we have to reallocate the memory
+    int_size_t capacity() const { return capacity_; }
+
+    /// Get a constant pointer to the first element of the array.
+    const item_t *data() const { return data_; }
+
+    /// Get a pointer to the first element of the array.
+    item_t *data() { return data_; }
+
+    /// pointer iterator start for range-based for
+    item_t *begin() { return data_; }
+
+    /// pointer iterator end for range-based for
+    item_t *end() { return data_ + size_; }
+
+    /// Resize the array to make it bigger or smaller.
+    void resize(size_t new_length) {
+      if (new_length > capacity_) {
+        grow((int_size_t)new_length);
+      }
+      dynarray_dummy_t x;
+      while (size_ < new_length) {
+        new (data_ + size_, x) item_t;
+        size_++;
+      }
+      while (size_ > new_length) {
+        data_[--size_].~item_t();
+      }
+    }
+
+    /// Make room for at least new_capacity elements.
+    void reserve(int_size_t new_capacity) {
+      if (new_capacity > capacity_) {
+        item_t *new_data = (item_t *)allocator_t::malloc(sizeof(item_t) * new_capacity);
+        relocate_items(new_data, data_, size_);
+        free_data();
+        data_ = new_data;
+        capacity_ = new_capacity;
+      }
+    }
+
+    /// Reset the array to zero size, returning to the inline storage.
+    void reset() {
+      destroy_items();
+      free_data();
+      size_ = 0;
+    }
+  };
+} }
@@ -13,6 +13,13 @@
 //
 
 namespace octet { namespace containers {
+  class string;
+
+  /// strings are a single pointer, so they can be moved with memcpy.
+  template <> struct is_relocatable<string> {
+    enum { value = 1 };
+  };
+
   /// The string class is used to hold persistant text strings.
   ///
   /// Only use this class as a data member in another class. Do not pass strings as parameters
@@ -21,6 +28,8 @@ namespace octet { namespace containers {
   /// This string class has the ability to perform a few common operations such as formatting
   /// and url encode/decode.
   ///
+  /// Text comes from the size class pools of pool_allocator, as most strings are short.
+  ///
   class string {
     char *data_;
 
@@ -28,7 +37,7 @@ namespace octet { namespace containers {
 
     void release() {
       if (data_ != null_string()) {
-        allocator::free((void*)data_, size() + 1);
+        pool_allocator::free((void*)data_, size() + 1);
         data_ = null_string();
       }
     }
@@ -191,10 +200,10 @@ namespace octet { namespace containers {
         int len = _vscprintf(fmt, v);
         if (len) {
           if (cur_len) {
-            data_ = (char*)allocator::realloc(data_, cur_len+1, cur_len + len + 1);
+            data_ = (char*)pool_allocator::realloc(data_, cur_len+1, cur_len + len + 1);
             vsprintf_s(data_ + cur_len, len+1, fmt, v);
           } else {
-            data_ = (char*)allocator::malloc(len+1);
+            data_ = (char*)pool_allocator::malloc(len+1);
             vsprintf_s(data_, len+1, fmt, v);
           }
         }
@@ -211,7 +220,7 @@ namespace octet { namespace containers {
       if (value) {
         unsigned size = urldecode_impl(0, value);
         if (size) {
-          data_ = (char*)allocator::malloc(size+1);
+          data_ = (char*)pool_allocator::malloc(size+1);
           urldecode_impl(data_, value);
         }
       }
@@ -224,7 +233,7 @@ namespace octet { namespace containers {
       if (value) {
         unsigned size = urlencode_impl(0, value);
         if (size) {
-          data_ = (char*)allocator::malloc(size+1);
+          data_ = (char*)pool_allocator::malloc(size+1);
           urlencode_impl(data_, value);
         }
       }
@@ -237,7 +246,7 @@ namespace octet { namespace containers {
       if (value) {
         size_t size = strlen(value);
         if (size) {
-          data_ = (char*)allocator::malloc(size+1);
+          data_ = (char*)pool_allocator::malloc(size+1);
           memcpy((char*)data_, value, size+1);
         }
       }
@@ -250,7 +259,7 @@ namespace octet { namespace containers {
       if (value) {
         unsigned size = utf16_to_utf8(0, value);
         if (size) {
-          data_ = (char*)allocator::malloc(size+1);
+          data_ = (char*)pool_allocator::malloc(size+1);
           utf16_to_utf8(data_, value);
         }
       }
@@ -265,7 +274,7 @@ namespace octet { namespace containers {
       release();
       if (value) {
         if (size) {
-          data_ = (char*)allocator::malloc(size+1);
+          data_ = (char*)pool_allocator::malloc(size+1);
           memcpy((char*)data_, value, size);
           data_[size] = 0;
         }
@@ -278,9 +287,9 @@ namespace octet { namespace containers {
       int size = (int)strlen(data_);
       if (new_len < size) {
         if (data_ == null_string()) {
-          data_ = (char*)allocator::malloc(new_len+1);
+          data_ = (char*)pool_allocator::malloc(new_len+1);
         } else {
-          data_ = (char*)allocator::realloc((void*)data_, size+1, new_len+1);
+          data_ = (char*)pool_allocator::realloc((void*)data_, size+1, new_len+1);
         }
         data_[new_len] = 0;
       }
@@ -302,9 +311,9 @@ namespace octet { namespace containers {
         size_t data_size = strlen(data_);
         size_t rhs_size = strlen(rhs);
         if (data_ == null_string()) {
-          data_ = (char*)allocator::malloc(data_size+rhs_size+1);
+          data_ = (char*)pool_allocator::malloc(data_size+rhs_size+1);
         } else {
-          data_ = (char*)allocator::realloc(data_, data_size + 1, data_size+rhs_size+1);
+          data_ = (char*)pool_allocator::realloc(data_, data_size + 1, data_size+rhs_size+1);
         }
         memcpy(data_ + data_size, rhs, rhs_size+1);
       }
@@ -316,7 +325,7 @@ namespace octet { namespace containers {
       if (rhs) {
         size_t data_size = strlen(data_);
         size_t rhs_size = strlen(rhs);
-        char *new_data = (char*)allocator::malloc(data_size+rhs_size+1);
+        char *new_data = (char*)pool_allocator::malloc(data_size+rhs_size+1);
         memcpy(new_data, data_, pos);
         memcpy(new_data + pos, rhs, rhs_size);
         memcpy(new_data + pos + rhs_size, data_, data_size - pos + 1);
@@ -0,0 +1,170 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+namespace octet {
+  /// Compresses generated transform animations and checks that every key still samples
+  /// to within the error bounds. Shows the memory used and the sampling speed before and after.
+  /// The "large" animation moves thousands of units, too far to quantise to 16 bits,
+  /// so its channels should stay as floats.
+  class example_animation_benchmark : public app {
+    enum {
+      // 255 steps divide 65535, so the key times are exact in 16 bits.
+      num_keys = 256,
+      num_samples = 10000,
+    };
+
+    struct motion {
+      const char *name;
+      float translate;  // distance moved
+      float turn;       // degrees turned
+      float grow;       // amount of extra scale
+    };
+
+    ref<text_overlay> overlay;
+    ref<mesh_text> results;
+    int num_channels;
+    bool all_ok;
+
+    static double now() {
+      return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+    }
+
+    static float key_time(unsigned key) {
+      return key * (1.0f / 30);
+    }
+
+    // a (transposed) matrix key for one channel, as the collada loader makes them.
+    static void make_key(float *dest, const motion &m, unsigned channel, unsigned key) {
+      float phase = key * 0.05f + channel * 0.7f;
+      float s = 1 + m.grow * (0.5f + 0.5f * sinf(phase * 0.5f));
+      mat4t mat;
+      mat.loadIdentity();
+      mat.translate(m.translate * sinf(phase), m.translate * 0.5f * cosf(phase * 1.3f), m.translate * 0.01f * key);
+      mat.rotateY(m.turn * sinf(phase * 0.7f));
+      mat.rotateX(m.turn * 0.3f * cosf(phase));
+      mat.scale(s, s, s);
+      for (int i = 0; i != 4; ++i) {
+        for (int j = 0; j != 4; ++j) {
+          dest[j * 4 + i] = mat[i][j];
+        }
+      }
+    }
+
+    void build(animation *anim, const motion &m) {
+      for (int ch = 0; ch != num_channels; ++ch) {
+        dynarray<float> times(num_keys), values(num_keys * 16);
+        for (unsigned k = 0; k != num_keys; ++k) {
+          times[k] = key_time(k);
+          make_key(&values[k * 16], m, ch, k);
+        }
+        anim->add_channel(NULL, atom_transform, atom_transform, atom_, times, values);
+      }
+    }
+
+    // time eval() over the whole animation, returning channel samples per second.
+    static double time_eval(animation *anim) {
+      animation_pose pose;
+      double t0 = now();
+      for (unsigned i = 0; i != num_samples; ++i) {
+        anim->eval(i * (anim->get_end_time() / num_samples), pose);
+      }
+      double ms = now() - t0;
+      return (double)num_samples * anim->get_num_channels() * 1000.0 / ms;
+    }
+
+    string run(const motion &m, float translate_error, float rotate_error, float scale_error) {
+      ref<animation> raw = new animation();
+      ref<animation> packed = new animation();
+      build(raw, m);
+      build(packed, m);
+      size_t raw_bytes = packed->get_num_bytes();
+      packed->compress(translate_error, rotate_error, scale_error);
+
+      // sample every source key. Translation must be within translate_error.
+      // The other matrix elements can be out by the angle times the scale, plus the scale error.
+      float max_translate = 0, max_linear = 0;
+      unsigned num_trs = 0, num_kept = 0;
+      for (int ch = 0; ch != num_channels; ++ch) {
+        num_trs += packed->get_format(ch) == animation::format_trs;
+        num_kept += packed->get_num_keys(ch);
+        unsigned cursor = 0;
+        for (unsigned k = 0; k != num_keys; ++k) {
+          float expected[16], actual[16];
+          make_key(expected, m, ch, k);
+          packed->sample_chan(ch, key_time(k), cursor, actual);
+          for (int i = 0; i != 12; ++i) {
+            float diff = fabsf(actual[i] - expected[i]) - 1e-6f * fabsf(expected[i]);
+            if ((i & 3) == 3) {
+              max_translate = std::max(max_translate, diff);
+            } else {
+              max_linear = std::max(max_linear, diff);
+            }
+          }
+        }
+      }
+
+      float linear_bound = rotate_error * (1 + m.grow) + scale_error + 1e-5f;
+      bool ok = max_translate <= translate_error && max_linear <= linear_bound;
+      all_ok = all_ok && ok;
+
+      double raw_rate = time_eval(raw);
+      double packed_rate = time_eval(packed);
+
+      string text;
+      text.format(
+        "%8s %4u/%-4u %8u %9u %9u %10.2g %10.2g %12.0f %12.0f %s\n",
+        m.name, num_trs, num_channels, num_kept, (unsigned)raw_bytes, (unsigned)packed->get_num_bytes(),
+        max_translate, max_linear, raw_rate, packed_rate, ok ? "ok" : "FAILED"
+      );
+      return text;
+    }
+
+  public:
+    /// this is called when we construct the class before everything is initialised.
+    example_animation_benchmark(int argc, char **argv) : app(argc, argv) {
+      num_channels = argc > 1 ? atoi(argv[1]) : 64;
+      all_ok = true;
+    }
+
+    /// this is called once OpenGL is initialized
+    void app_init() {
+      static const motion motions[] = {
+        { "walk", 1.0f, 30.0f, 0.0f },
+        { "pulse", 0.5f, 90.0f, 2.0f },
+        { "large", 2000.0f, 45.0f, 0.0f },
+      };
+
+      float translate_error = 0.0005f, rotate_error = 0.0005f, scale_error = 0.0005f;
+      string text;
+      text.format(
+        "%d channels of %d keys\n%8s %9s %8s %9s %9s %10s %10s %12s %12s\n",
+        num_channels, num_keys, "motion", "trs", "keys", "raw bytes", "bytes", "translate", "linear", "raw ch/s", "packed ch/s"
+      );
+      for (unsigned i = 0; i != sizeof(motions) / sizeof(motions[0]); ++i) {
+        text += run(motions[i], translate_error, rotate_error, scale_error);
+      }
+      text += all_ok ? "all within bounds\n" : "ERROR BOUNDS EXCEEDED\n";
+      printf("%s", text.c_str());
+
+      overlay = new text_overlay();
+      aabb bb(vec3(0, 0, 0), vec3(300, 100, 0));
+      results = new mesh_text(overlay->get_default_font(), text, &bb);
+      overlay->add_mesh_text(results);
+    }
+
+    /// this is called to draw the world
+    void draw_world(int x, int y, int w, int h) {
+      int vx = 0, vy = 0;
+      get_viewport_size(vx, vy);
+      glViewport(x, y, w, h);
+      glClearColor(0, 0, 0, 1);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+      results->update();
+      overlay->render(vx, vy);
+    }
+  };
+}
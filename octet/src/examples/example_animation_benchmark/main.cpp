@@ -0,0 +1,28 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Animation benchmark
+//
+
+#include <chrono>
+
+#include "../../octet.h"
+
+#include "example_animation_benchmark.h"
+
+/// Compress generated animations, check the error bounds and show the results.
+/// usage: example_animation_benchmark [num_channels]
+int main(int argc, char **argv) {
+  // set up the platform.
+  octet::app::init_all(argc, argv);
+
+  // our application.
+  octet::example_animation_benchmark app(argc, argv);
+  app.init();
+
+  // open windows
+  octet::app::run_all_apps();
+}
@@ -0,0 +1,222 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+namespace octet {
+  /// Measures evaluations per second for cpp_interpreter on some shader-like functions.
+  /// Each function is also written in C++ so that the results can be checked
+  /// and the speed compared without a GPU.
+  class example_interpreter_benchmark : public app {
+    enum {
+      max_components = 9,
+    };
+
+    typedef void (*native_fn)(const float *const *in, float *const *out, unsigned count);
+
+    struct kernel {
+      const char *name;
+      const char *source;
+      native_fn native;
+    };
+
+    ref<text_overlay> overlay;
+    ref<mesh_text> results;
+    int num_evaluations;
+
+    static double now() {
+      return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+    }
+
+    // light_dir and shininess are uniforms, set in run_kernel.
+    static void native_shade(const float *const *in, float *const *out, unsigned count) {
+      vec3 light = vec3(0.3f, 0.8f, 0.5f).normalize();
+      for (unsigned i = 0; i != count; ++i) {
+        vec3 n = vec3(in[0][i], in[1][i], in[2][i]).normalize();
+        vec3 v = vec3(in[3][i], in[4][i], in[5][i]).normalize();
+        vec3 h = (light + v).normalize();
+        float diffuse = std::min(std::max(n.dot(light), 0.0f), 1.0f);
+        float specular = 0;
+        if (diffuse > 0) {
+          specular = powf(std::min(std::max(n.dot(h), 0.0f), 1.0f), 16.0f);
+        }
+        for (unsigned j = 0; j != 3; ++j) {
+          out[j][i] = in[6 + j][i] * (diffuse + 0.1f) + specular;
+        }
+      }
+    }
+
+    static void native_waves(const float *const *in, float *const *out, unsigned count) {
+      for (unsigned i = 0; i != count; ++i) {
+        float x = in[0][i], y = in[1][i];
+        float sum = 0, amp = 0.5f;
+        for (int octave = 0; octave < 5; octave++) {
+          sum += amp * sinf(x * 3.0f) * cosf(y * 3.0f);
+          x = x * 2.0f + 0.5f;
+          y = y * 2.0f;
+          amp *= 0.5f;
+        }
+        out[0][i] = sum;
+      }
+    }
+
+    static void native_fresnel(const float *const *in, float *const *out, unsigned count) {
+      for (unsigned i = 0; i != count; ++i) {
+        float cos_theta = in[0][i];
+        float result = 1;
+        if (cos_theta > 0) {
+          result = 0.04f + (1 - 0.04f) * powf(1 - cos_theta, 5.0f);
+        }
+        out[0][i] = result;
+      }
+    }
+
+    static const kernel *get_kernels(unsigned &num_kernels) {
+      static const kernel kernels[] = {
+        {
+          "shade",
+          "uniform float3 light_dir;\n"
+          "uniform float shininess;\n"
+          "const float ambient = 0.1;\n"
+          "float3 shade(float3 normal, float3 view, float3 albedo) {\n"
+          "  float3 n = normalize(normal);\n"
+          "  float3 l = normalize(light_dir);\n"
+          "  float3 h = normalize(l + normalize(view));\n"
+          "  float diffuse = saturate(dot(n, l));\n"
+          "  float specular = 0.0;\n"
+          "  if (diffuse > 0.0) {\n"
+          "    specular = pow(saturate(dot(n, h)), shininess);\n"
+          "  }\n"
+          "  return albedo * (diffuse + ambient) + specular;\n"
+          "}\n",
+          native_shade
+        },
+        {
+          "waves",
+          "const int num_octaves = 5;\n"
+          "float wave(float2 p) { return sin(p.x * 3.0) * cos(p.y * 3.0); }\n"
+          "float waves(float2 p) {\n"
+          "  float sum = 0.0;\n"
+          "  float amp = 0.5;\n"
+          "  for (int octave = 0; octave < num_octaves; octave++) {\n"
+          "    sum += amp * wave(p);\n"
+          "    p = p * 2.0 + float2(0.5, 0.0);\n"
+          "    amp *= 0.5;\n"
+          "  }\n"
+          "  return sum;\n"
+          "}\n",
+          native_waves
+        },
+        {
+          "fresnel",
+          "const float f0 = 0.04;\n"
+          "float fresnel(float cos_theta) {\n"
+          "  if (cos_theta <= 0.0) return 1.0;\n"
+          "  return f0 + (1.0 - f0) * pow(1.0 - cos_theta, 5.0);\n"
+          "}\n",
+          native_fresnel
+        },
+      };
+      num_kernels = sizeof(kernels) / sizeof(kernels[0]);
+      return kernels;
+    }
+
+    // run a kernel both ways, returning the text for the results table.
+    string run_kernel(const kernel &k) {
+      string text;
+      compiler::cpp_parser parser;
+      parser.parse(k.source);
+
+      compiler::cpp_interpreter interp;
+      if (!interp.compile(parser, k.name)) {
+        text.format("%10s error: %s\n", k.name, interp.get_error());
+        return text;
+      }
+
+      float light_dir[] = { 0.3f, 0.8f, 0.5f };
+      float shininess = 16;
+      interp.set_uniform("light_dir", light_dir, 3);
+      interp.set_uniform("shininess", &shininess, 1);
+
+      unsigned num_inputs = interp.get_num_inputs();
+      unsigned num_outputs = interp.get_num_outputs();
+      dynarray<float> data;
+      data.resize(num_evaluations * (num_inputs + num_outputs * 2));
+      const float *inputs[max_components];
+      float *outputs[max_components];
+      float *expected[max_components];
+      for (unsigned i = 0; i != num_inputs; ++i) {
+        inputs[i] = &data[i * num_evaluations];
+      }
+      for (unsigned i = 0; i != num_outputs; ++i) {
+        outputs[i] = &data[(num_inputs + i) * num_evaluations];
+        expected[i] = &data[(num_inputs + num_outputs + i) * num_evaluations];
+      }
+
+      random rand;
+      for (unsigned i = 0; i != num_inputs * num_evaluations; ++i) {
+        data[i] = rand.get(-1.0f, 1.0f);
+      }
+
+      double t0 = now();
+      interp.run(inputs, outputs, num_evaluations);
+      double t1 = now();
+      k.native(inputs, expected, num_evaluations);
+      double t2 = now();
+
+      float max_error = 0;
+      for (unsigned i = 0; i != num_outputs; ++i) {
+        for (int j = 0; j != num_evaluations; ++j) {
+          max_error = std::max(max_error, fabsf(outputs[i][j] - expected[i][j]));
+        }
+      }
+
+      text.format(
+        "%10s %14.0f %14.0f %6u %6u %6u %10.2g\n",
+        k.name, num_evaluations * 1000.0 / (t1 - t0), num_evaluations * 1000.0 / (t2 - t1),
+        interp.get_num_instructions(), interp.get_num_slots(), interp.get_num_folded(), max_error
+      );
+      return text;
+    }
+
+  public:
+    /// this is called when we construct the class before everything is initialised.
+    example_interpreter_benchmark(int argc, char **argv) : app(argc, argv) {
+      num_evaluations = argc > 1 ? atoi(argv[1]) : 1000000;
+    }
+
+    /// this is called once OpenGL is initialized
+    void app_init() {
+      string text;
+      text.format(
+        "%d evaluations\n%10s %14s %14s %6s %6s %6s %10s\n",
+        num_evaluations, "kernel", "interp evals/s", "native evals/s", "instrs", "slots", "folded", "max error"
+      );
+
+      unsigned num_kernels = 0;
+      const kernel *kernels = get_kernels(num_kernels);
+      for (unsigned i = 0; i != num_kernels; ++i) {
+        text += run_kernel(kernels[i]);
+      }
+      printf("%s", text.c_str());
+
+      overlay = new text_overlay();
+      aabb bb(vec3(0, 0, 0), vec3(300, 100, 0));
+      results = new mesh_text(overlay->get_default_font(), text, &bb);
+      overlay->add_mesh_text(results);
+    }
+
+    /// this is called to draw the world
+    void draw_world(int x, int y, int w, int h) {
+      int vx = 0, vy = 0;
+      get_viewport_size(vx, vy);
+      glViewport(x, y, w, h);
+      glClearColor(0, 0, 0, 1);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+      results->update();
+      overlay->render(vx, vy);
+    }
+  };
+}
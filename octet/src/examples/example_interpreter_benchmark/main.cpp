@@ -0,0 +1,28 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Interpreter benchmark
+//
+
+#include <chrono>
+
+#include "../../octet.h"
+
+#include "example_interpreter_benchmark.h"
+
+/// Run shader functions on the CPU with cpp_interpreter, check them against C++ and show the results.
+/// usage: example_interpreter_benchmark [num_evaluations]
+int main(int argc, char **argv) {
+  // set up the platform.
+  octet::app::init_all(argc, argv);
+
+  // our application.
+  octet::example_interpreter_benchmark app(argc, argv);
+  app.init();
+
+  // open windows
+  octet::app::run_all_apps();
+}
@@ -0,0 +1,245 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+namespace octet {
+  /// The array-of-structures particle simulation that mesh_particle_system used to have:
+  /// each animator links to a billboard and dead slots stay in the loop.
+  /// This is here so that we can compare it against the new one.
+  class legacy_particle_system {
+  public:
+    struct billboard_particle {
+      int link;
+      vec3p pos;
+      vec2p size;
+      vec2p uv_bottom_left;
+      vec2p uv_top_right;
+      uint32_t angle;
+      bool enabled;
+    };
+
+    struct particle_animator {
+      int link;
+      vec3p vel;
+      vec3p acceleration;
+      uint32_t lifetime;
+      uint32_t age;
+      uint32_t spin;
+    };
+
+  private:
+    dynarray<billboard_particle> billboard_particles;
+    int free_billboard_particle;
+    dynarray<particle_animator> particle_animators;
+    int free_particle_animator;
+
+    template <class Type> int allocate(dynarray<Type> &array, int &free) {
+      int result = free;
+      if (free != -1) {
+        free = array[free].link;
+      } else if (array.size() < array.capacity()) {
+        result = (int)array.size();
+        array.resize(result+1);
+      }
+      return result;
+    }
+
+    template <class Type> void free(dynarray<Type> &array, int &free, int element) {
+      array[element].link = free;
+      free = element;
+    }
+
+  public:
+    legacy_particle_system(int capacity) {
+      billboard_particles.reserve(capacity);
+      particle_animators.reserve(capacity);
+      free_billboard_particle = -1;
+      free_particle_animator = -1;
+    }
+
+    void animate(float time_step) {
+      for (unsigned i = 0; i != particle_animators.size(); ++i) {
+        particle_animator &g = particle_animators[i];
+        if (g.link >= 0) {
+          billboard_particle &p = billboard_particles[g.link];
+          if (g.age >= g.lifetime) {
+            p.enabled = false;
+            free(billboard_particles, free_billboard_particle, g.link);
+            g.link = -1;
+            free(particle_animators, free_particle_animator, i);
+          } else {
+            p.pos = (vec3)p.pos + (vec3)g.vel * time_step;
+            g.vel = (vec3)g.vel + (vec3)g.acceleration * time_step;
+            p.angle += (uint32_t)(g.spin * time_step);
+            g.age++;
+          }
+        }
+      }
+    }
+
+    bool add(const billboard_particle &p, particle_animator &pa) {
+      int pidx = allocate(billboard_particles, free_billboard_particle);
+      if (pidx == -1) return false;
+      int aidx = allocate(particle_animators, free_particle_animator);
+      if (aidx == -1) {
+        free(billboard_particles, free_billboard_particle, pidx);
+        return false;
+      }
+      billboard_particles[pidx] = p;
+      pa.link = pidx;
+      particle_animators[aidx] = pa;
+      return true;
+    }
+  };
+
+  /// Times the particle simulation with the old array-of-structures loop and
+  /// with mesh_particle_system, then draws the particles.
+  ///
+  /// Both systems are kept full: every frame, the particles that died are replaced
+  /// by new ones, as a big fountain or explosion effect would do.
+  class example_particle_benchmark : public app {
+    enum { num_frames = 300 };
+
+    ref<visual_scene> app_scene;
+    ref<mesh_particle_system> system;
+    mesh_particle_system::emitter fountain;
+    int num_particles;
+    random r;
+
+    static double now() {
+      return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+    }
+
+    void init_fountain() {
+      memset(&fountain, 0, sizeof(fountain));
+      fountain.size = vec2p(0.05f, 0.05f);
+      fountain.uv_bottom_left = vec2p(0, 1);
+      fountain.uv_top_right = vec2p(0.125f, 1-0.125f);
+      fountain.vel = vec3p(0, 10, 0);
+      fountain.vel_spread = vec3p(3, 5, 3);
+      fountain.spin_spread = 3;
+      fountain.lifetime = 2;
+      fountain.lifetime_spread = 1;
+    }
+
+    // returns the time in ms per frame
+    double run_legacy(float time_step) {
+      legacy_particle_system legacy(num_particles);
+      legacy_particle_system::billboard_particle p;
+      memset(&p, 0, sizeof(p));
+      p.size = vec2p(0.05f, 0.05f);
+      p.enabled = true;
+      legacy_particle_system::particle_animator pa;
+      memset(&pa, 0, sizeof(pa));
+      pa.acceleration = vec3p(0, -9.8f, 0);
+
+      double total = 0;
+      for (int frame = 0; frame != num_frames; ++frame) {
+        double t0 = now();
+        legacy.animate(time_step);
+        // refill
+        for (;;) {
+          pa.vel = vec3p(r.get(-3.0f, 3.0f), r.get(5.0f, 15.0f), r.get(-3.0f, 3.0f));
+          pa.lifetime = (uint32_t)(r.get(1.0f, 3.0f) / time_step);
+          pa.spin = (uint32_t)r.get(0.0f, 3.0f);
+          if (!legacy.add(p, pa)) break;
+        }
+        total += now() - t0;
+      }
+      return total / num_frames;
+    }
+
+    // returns the time in ms per frame
+    double run_soa(mesh_particle_system *sys, float time_step) {
+      double total = 0;
+      for (int frame = 0; frame != num_frames; ++frame) {
+        double t0 = now();
+        sys->animate(time_step);
+        sys->emit(fountain, sys->get_billboard_capacity(), r);
+        total += now() - t0;
+      }
+      return total / num_frames;
+    }
+
+    // returns the time in ms per frame to build the vertices or instances.
+    double run_update(mesh_particle_system *sys) {
+      double total = 0;
+      for (int frame = 0; frame != num_frames; ++frame) {
+        double t0 = now();
+        sys->update();
+        total += now() - t0;
+      }
+      return total / num_frames;
+    }
+
+  public:
+    /// this is called when we construct the class before everything is initialised.
+    example_particle_benchmark(int argc, char **argv) : app(argc, argv) {
+      num_particles = argc > 1 ? atoi(argv[1]) : 100000;
+    }
+
+    /// this is called once OpenGL is initialized
+    void app_init() {
+      app_scene =  new visual_scene();
+      app_scene->create_default_camera_and_lights();
+      app_scene->get_camera_instance(0)->get_node()->translate(vec3(0, 5, 20));
+
+      init_fountain();
+      system = new mesh_particle_system(aabb(vec3(0, 0, 0), vec3(1, 1, 1)), num_particles, 0);
+      system->set_acceleration(vec3(0, -9.8f, 0));
+      system->set_cameraToWorld(app_scene->get_camera_instance(0)->get_node()->calcModelToWorld());
+
+      float time_step = 1.0f/60;
+      double legacy_ms = run_legacy(time_step);
+      double soa_ms = run_soa(system, time_step);
+      printf("%d particles, %d frames\n", num_particles, (int)num_frames);
+      printf("array of structures  %8.3f ms/frame %10.0f particles/ms\n", legacy_ms, num_particles / legacy_ms);
+      printf("structure of arrays  %8.3f ms/frame %10.0f particles/ms\n", soa_ms, num_particles / soa_ms);
+
+      // building four vertices per particle against one instance record.
+      double cpu_ms = run_update(system);
+      system->set_gpu_expansion(true);
+      double gpu_ms = system->get_gpu_expansion() ? run_update(system) : 0;
+      printf("update, CPU quads    %8.3f ms/frame %6d bytes/particle\n", cpu_ms, (int)(sizeof(mesh::vertex) * 4));
+      if (system->get_gpu_expansion()) {
+        printf("update, GPU quads    %8.3f ms/frame %6d bytes/particle\n", gpu_ms, (int)sizeof(mesh_particle_system::billboard_instance));
+      }
+
+      image *img = new image("assets/particles.gif");
+      material *sprites;
+      if (system->get_gpu_expansion()) {
+        param_shader *shader = mesh_particle_system::get_billboard_shader();
+        sprites = new material(img, NULL, shader);
+        shader->init(sprites->get_params());
+      } else {
+        sprites = new material(img);
+      }
+
+      scene_node *node = new scene_node();
+      app_scene->add_child(node);
+      app_scene->add_mesh_instance(new mesh_instance(node, system, sprites));
+    }
+
+    /// this is called to draw the world
+    void draw_world(int x, int y, int w, int h) {
+      int vx = 0, vy = 0;
+      get_viewport_size(vx, vy);
+      app_scene->begin_render(vx, vy);
+
+      camera_instance *ci = app_scene->get_camera_instance(0);
+
+      system->animate(1.0f/30);
+      system->emit(fountain, system->get_billboard_capacity(), r);
+      system->set_cameraToWorld(ci->get_node()->calcModelToWorld());
+      system->update();
+
+      // update matrices. assume 30 fps.
+      app_scene->update(1.0f/30);
+
+      // draw the scene
+      app_scene->render((float)vx / vy);
+    }
+  };
+}
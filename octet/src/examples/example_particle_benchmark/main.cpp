@@ -0,0 +1,28 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Particle benchmark
+//
+
+#include <chrono>
+
+#include "../../octet.h"
+
+#include "example_particle_benchmark.h"
+
+/// Time the particle simulation, then show the particles.
+/// usage: example_particle_benchmark [num_particles]
+int main(int argc, char **argv) {
+  // set up the platform.
+  octet::app::init_all(argc, argv);
+
+  // our application.
+  octet::example_particle_benchmark app(argc, argv);
+  app.init();
+
+  // open windows
+  octet::app::run_all_apps();
+}
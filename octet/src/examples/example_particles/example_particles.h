@@ -24,8 +24,20 @@ namespace octet {
       app_scene =  new visual_scene();
       app_scene->create_default_camera_and_lights();
 
-      material *sprites = new material(new image("assets/particles.gif"));
-      system = new mesh_particle_system();
+      system = new mesh_particle_system(aabb(vec3(0, 0, 0), vec3(1, 1, 1)), 4096);
+      system->set_acceleration(vec3(0, -9.8f, 0));
+
+      // expand the billboards in the vertex shader if we can.
+      system->set_gpu_expansion(true);
+      image *img = new image("assets/particles.gif");
+      material *sprites;
+      if (system->get_gpu_expansion()) {
+        param_shader *shader = mesh_particle_system::get_billboard_shader();
+        sprites = new material(img, NULL, shader);
+        shader->init(sprites->get_params());
+      } else {
+        sprites = new material(img);
+      }
 
       scene_node *node = new scene_node();
       app_scene->add_child(node);
@@ -40,22 +52,16 @@ namespace octet {
 
       camera_instance *ci = app_scene->get_camera_instance(0);
 
-      mesh_particle_system::billboard_particle p;
-      memset(&p, 0, sizeof(p));
-      p.pos = vec3p(0, 0, 0);
-      p.size = vec2p(0.5f, 0.5f);
-      p.uv_bottom_left = vec2p(0, 1);
-      p.uv_top_right = vec2p(0.125f, 1-0.125f);
-      p.enabled = true;
-      int pidx = system->add_billboard_particle(p);
-
-      mesh_particle_system::particle_animator pa;
-      memset(&pa, 0, sizeof(pa));
-      pa.link = pidx;
-      pa.acceleration = vec3p(0, -9.8f, 0);
-      pa.vel = vec3p(r.get(-3.0f, 3.0f), r.get(5.0f, 15.0f), 0.0f);
-      pa.lifetime = 50;
-      system->add_particle_animator(pa);
+      mesh_particle_system::emitter e;
+      memset(&e, 0, sizeof(e));
+      e.size = vec2p(0.5f, 0.5f);
+      e.uv_bottom_left = vec2p(0, 1);
+      e.uv_top_right = vec2p(0.125f, 1-0.125f);
+      e.vel = vec3p(0, 10, 0);
+      e.vel_spread = vec3p(3, 5, 0);
+      e.spin_spread = 3;
+      e.lifetime = 50.0f/30;
+      system->emit(e, 8, r);
 
       system->set_cameraToWorld(ci->get_node()->calcModelToWorld());
       system->animate(1.0f/30);
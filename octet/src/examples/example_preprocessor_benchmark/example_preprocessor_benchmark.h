@@ -0,0 +1,148 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+namespace octet {
+  /// Measures lines per second for cpp_preprocessor on a set of generated shader headers.
+  /// Each permutation includes the same guarded headers with different defines,
+  /// first with an empty file cache and then with the files already split into lines.
+  class example_preprocessor_benchmark : public app {
+    enum {
+      num_materials = 16,
+      lines_per_header = 200,
+    };
+
+    ref<text_overlay> overlay;
+    ref<mesh_text> results;
+    int num_permutations;
+
+    static double now() {
+      return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+    }
+
+    static void write_file(const char *name, const string &text) {
+      char path[256];
+      sprintf(path, "preprocessor_benchmark/%s", name);
+      FILE *file = fopen(path, "wb");
+      if (file) {
+        fwrite(text.c_str(), 1, strlen(text.c_str()), file);
+        fclose(file);
+      }
+    }
+
+    // a guarded header with lots of declarations and comments, like a shader library.
+    static void write_header(const char *name, const char *guard, const char *includes) {
+      string text;
+      text.format("// %s\n#ifndef %s\n#define %s\n%s\n", name, guard, guard, includes);
+      for (int i = 0; i != lines_per_header; ++i) {
+        string line;
+        if (i % 10 == 0) {
+          line.format("/* block %d\n   of functions */\n", i / 10);
+        } else if (i % 10 == 5) {
+          line.format("#if NUM_LIGHTS > %d\nuniform vec4 light_%s_%d[NUM_LIGHTS];\n#endif\n", i % 4, guard, i);
+        } else if (i % 10 == 7) {
+          line.format("vec3 scale_%s_%d(vec3 v) { return v * SCALE; } // uses a define\n", guard, i);
+        } else {
+          line.format("float %s_fn%d(float x, float y) { return x * %d.0 + y; }\n", guard, i, i);
+        }
+        text += line;
+      }
+      text += "#endif\n";
+      write_file(name, text);
+    }
+
+    static void write_files() {
+      #ifdef WIN32
+        _mkdir("preprocessor_benchmark");
+      #else
+        mkdir("preprocessor_benchmark", 0777);
+      #endif
+
+      write_header("common.h", "COMMON_H", "");
+      write_header("lights.h", "LIGHTS_H", "#include \"common.h\"");
+      for (int i = 0; i != num_materials; ++i) {
+        char name[32], guard[32];
+        sprintf(name, "material%d.h", i);
+        sprintf(guard, "MATERIAL%d_H", i);
+        write_header(name, guard, "#include \"common.h\"\n#include \"lights.h\"");
+      }
+    }
+
+    // preprocess every permutation, returning lines per second.
+    double run(bool clear_cache, unsigned &lines, unsigned &skipped) {
+      lines = skipped = 0;
+      double t0 = now();
+      for (int i = 0; i != num_permutations; ++i) {
+        if (clear_cache) {
+          compiler::cpp_preprocessor::clear_file_cache();
+        }
+
+        compiler::cpp_preprocessor pp;
+        char value[16];
+        sprintf(value, "%d", i % 5);
+        pp.define("NUM_LIGHTS", value);
+        pp.define("SCALE", i & 1 ? "2.0" : "0.5");
+
+        string source;
+        for (int j = 0; j != 4; ++j) {
+          string line;
+          line.format("#include \"preprocessor_benchmark/material%d.h\"\n", (i + j * 5) % num_materials);
+          source += line;
+        }
+        source += "void main() { gl_FragColor = vec4(scale_COMMON_H_7(vec3(1.0)), 1.0); }\n";
+
+        pp.begin(source);
+        while (pp.next_line()) {
+        }
+        lines += pp.get_num_lines();
+        skipped += pp.get_num_skipped_includes();
+      }
+      double ms = now() - t0;
+      return lines * 1000.0 / ms;
+    }
+
+  public:
+    /// this is called when we construct the class before everything is initialised.
+    example_preprocessor_benchmark(int argc, char **argv) : app(argc, argv) {
+      num_permutations = argc > 1 ? atoi(argv[1]) : 500;
+    }
+
+    /// this is called once OpenGL is initialized
+    void app_init() {
+      write_files();
+
+      unsigned cold_lines = 0, cold_skipped = 0, warm_lines = 0, warm_skipped = 0;
+      double cold = run(true, cold_lines, cold_skipped);
+      double warm = run(false, warm_lines, warm_skipped);
+
+      string text;
+      text.format(
+        "%d permutations\n%8s %14s %10s %10s\n%8s %14.0f %10u %10u\n%8s %14.0f %10u %10u\n",
+        num_permutations,
+        "cache", "lines/s", "lines", "skipped",
+        "cold", cold, cold_lines, cold_skipped,
+        "warm", warm, warm_lines, warm_skipped
+      );
+      printf("%s", text.c_str());
+
+      overlay = new text_overlay();
+      aabb bb(vec3(0, 0, 0), vec3(300, 100, 0));
+      results = new mesh_text(overlay->get_default_font(), text, &bb);
+      overlay->add_mesh_text(results);
+    }
+
+    /// this is called to draw the world
+    void draw_world(int x, int y, int w, int h) {
+      int vx = 0, vy = 0;
+      get_viewport_size(vx, vy);
+      glViewport(x, y, w, h);
+      glClearColor(0, 0, 0, 1);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+      results->update();
+      overlay->render(vx, vy);
+    }
+  };
+}
@@ -0,0 +1,28 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Preprocessor benchmark
+//
+
+#include <chrono>
+
+#include "../../octet.h"
+
+#include "example_preprocessor_benchmark.h"
+
+/// Time the preprocessor on generated shader headers and show the results.
+/// usage: example_preprocessor_benchmark [num_permutations]
+int main(int argc, char **argv) {
+  // set up the platform.
+  octet::app::init_all(argc, argv);
+
+  // our application.
+  octet::example_preprocessor_benchmark app(argc, argv);
+  app.init();
+
+  // open windows
+  octet::app::run_all_apps();
+}
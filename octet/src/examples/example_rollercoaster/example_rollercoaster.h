@@ -34,14 +34,14 @@ namespace octet {
       // note that this call will dump the code below to log.txt
       dict.dump_assets(log(""));
 
-      scene_node *trough = dict.get_scene_node("trough");
-      scene_node *Camera = dict.get_scene_node("Camera");
-      material *default_material = dict.get_material("default_material");
-      material *Material_material = dict.get_material("Material-material");
-      mesh *trough_mesh_Material_material = dict.get_mesh("trough-mesh+Material-material");
-      visual_scene *Scene = dict.get_visual_scene("Scene");
-      scene_node *Lamp = dict.get_scene_node("Lamp");
-      scene_node *start = dict.get_scene_node("start");
+      scene_node *trough = dict.get_scene_node(interned_string("trough"));
+      scene_node *Camera = dict.get_scene_node(interned_string("Camera"));
+      material *default_material = dict.get_material(interned_string("default_material"));
+      material *Material_material = dict.get_material(interned_string("Material-material"));
+      mesh *trough_mesh_Material_material = dict.get_mesh(interned_string("trough-mesh+Material-material"));
+      visual_scene *Scene = dict.get_visual_scene(interned_string("Scene"));
+      scene_node *Lamp = dict.get_scene_node(interned_string("Lamp"));
+      scene_node *start = dict.get_scene_node(interned_string("start"));
 
       mat4t location;
       location.translate(vec3(0, 0, 0));
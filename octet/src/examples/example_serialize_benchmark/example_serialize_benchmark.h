@@ -0,0 +1,284 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+namespace octet {
+  /// The unbuffered binary writer: one fwrite per value.
+  /// This is here so that we can compare it against binary_writer.
+  class stdio_binary_writer : public visitor {
+    FILE *file;
+
+    void write_int(int value) {
+      uint8_t b[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+      fwrite(b, 1, 4, file);
+    }
+
+  public:
+    stdio_binary_writer(FILE *file) {
+      this->file = file;
+      fwrite("octet\r\n\x1a", 1, 8, file);
+    }
+
+    bool begin_ref(void *ref, atom_t sid, atom_t type) { return false; }
+    bool begin_ref(void *ref, int index, atom_t type) { return false; }
+    bool begin_ref(void *ref, const char *sid, atom_t type) { return false; }
+    void end_ref() {}
+    bool begin_refs(atom_t sid, int &size, bool is_dict) { return false; }
+    void end_refs(bool is_dict) {}
+
+    void visit_bin(void *value, size_t size, atom_t sid, atom_t type) {
+      write_int(type);
+      write_int(sid);
+      write_int((int)size);
+      fwrite(value, 1, size, file);
+    }
+
+    void visit_string(string &value, atom_t sid) {
+      write_int(atom_string);
+      write_int(sid);
+      fwrite(value.c_str(), 1, value.size() + 1, file);
+    }
+  };
+
+  /// The unbuffered binary reader: one fread per value and one fgetc per character.
+  class stdio_binary_reader : public visitor {
+    FILE *file;
+    char tmp[256];
+
+    int read_int() {
+      uint8_t b[4];
+      fread(b, 1, 4, file);
+      return b[0] + (b[1] << 8) + (b[2] << 16) + (b[3] << 24);
+    }
+
+    bool check(int value) {
+      if (!get_error() && read_int() != value) set_error(true);
+      return get_error();
+    }
+
+  public:
+    stdio_binary_reader(FILE *file) {
+      this->file = file;
+      fread(tmp, 1, 8, file);
+    }
+
+    bool is_reader() { return true; }
+    bool begin_ref(void *ref, atom_t sid, atom_t type) { return false; }
+    bool begin_ref(void *ref, int index, atom_t type) { return false; }
+    bool begin_ref(void *ref, const char *sid, atom_t type) { return false; }
+    void end_ref() {}
+    bool begin_refs(atom_t sid, int &size, bool is_dict) { return false; }
+    void end_refs(bool is_dict) {}
+
+    unsigned begin_read_dynarray(unsigned elem_size, atom_t &sid) {
+      if (!check(atom_dynarray) && !check(sid)) {
+        return (unsigned)read_int() / elem_size;
+      }
+      return 0;
+    }
+
+    void end_read_dynarray(void *ptr, unsigned bytes) {
+      fread(ptr, 1, bytes, file);
+    }
+
+    void visit_bin(void *value, size_t size, atom_t sid, atom_t type) {
+      if (!check(type) && !check(sid) && !check((int)size)) {
+        fread(value, 1, size, file);
+      }
+    }
+
+    void visit_string(string &value, atom_t sid) {
+      if (!check(atom_string) && !check(sid)) {
+        int nchars = 0;
+        for(;;) {
+          int c = fgetc(file);
+          tmp[nchars] = c;
+          if (c <= 0) break;
+          nchars += nchars != sizeof(tmp)-1;
+        }
+        tmp[nchars] = 0;
+        value = tmp;
+      }
+    }
+  };
+
+  /// Times saving and loading a scene-sized set of objects with
+  /// binary_writer and binary_reader against the unbuffered versions above.
+  ///
+  /// Many small objects measure the per-value cost, one large mesh measures the
+  /// block copy path for POD arrays. All the writers must produce the same bytes.
+  class example_serialize_benchmark {
+    // a node-like object: lots of small values.
+    struct bench_object {
+      string name;
+      int32_t id;
+      uint32_t flags;
+      mat4t transform;
+      vec4 color;
+      dynarray<float> keys;
+
+      void visit(visitor &v) {
+        v.visit(name, atom_sid);
+        v.visit(id, atom_node);
+        v.visit(flags, atom_mode);
+        v.visit(transform, atom_transform);
+        v.visit(color, atom_color);
+        v.visit(keys, atom_time);
+      }
+    };
+
+    dynarray<bench_object> objects;
+    dynarray<vec4> vertices;
+    dynarray<uint32_t> indices;
+
+    void visit(visitor &v) {
+      int32_t num_objects = (int32_t)objects.size();
+      v.visit(num_objects, atom_num_slots);
+      if (v.is_reader()) objects.resize(num_objects);
+      for (int32_t i = 0; i != num_objects && !v.get_error(); ++i) {
+        objects[i].visit(v);
+      }
+      v.visit(vertices, atom_vertices);
+      v.visit(indices, atom_indices);
+    }
+
+    void build(int num_objects) {
+      objects.resize(num_objects);
+      for (int i = 0; i != num_objects; ++i) {
+        bench_object &obj = objects[i];
+        char tmp[64];
+        sprintf(tmp, "node_%d", i);
+        obj.name = tmp;
+        obj.id = i;
+        obj.flags = i * 0x9E3779B9u;
+        obj.transform.loadIdentity();
+        obj.transform.translate((float)i, 0, (float)-i);
+        obj.color = vec4(1, 0.5f, 0.25f, 1);
+        obj.keys.resize(4 + i % 29);
+        for (unsigned j = 0; j != obj.keys.size(); ++j) {
+          obj.keys[j] = j * 0.1f;
+        }
+      }
+
+      vertices.resize(num_objects * 16);
+      for (unsigned i = 0; i != vertices.size(); ++i) {
+        vertices[i] = vec4((float)i, (float)(i & 7), (float)(i >> 3), 1);
+      }
+      indices.resize(num_objects * 48);
+      for (unsigned i = 0; i != indices.size(); ++i) {
+        indices[i] = i % vertices.size();
+      }
+    }
+
+    // compare the contents of two benchmarks
+    bool same_as(const example_serialize_benchmark &rhs) const {
+      if (objects.size() != rhs.objects.size()) return false;
+      for (unsigned i = 0; i != objects.size(); ++i) {
+        const bench_object &a = objects[i];
+        const bench_object &b = rhs.objects[i];
+        if (strcmp(a.name.c_str(), b.name.c_str()) || a.id != b.id || a.flags != b.flags) return false;
+        if (memcmp(&a.transform, &b.transform, sizeof(mat4t)) || memcmp(&a.color, &b.color, sizeof(vec4))) return false;
+        if (a.keys.size() != b.keys.size() || memcmp(a.keys.data(), b.keys.data(), a.keys.size() * sizeof(float))) return false;
+      }
+      return
+        vertices.size() == rhs.vertices.size() && !memcmp(vertices.data(), rhs.vertices.data(), vertices.size() * sizeof(vec4)) &&
+        indices.size() == rhs.indices.size() && !memcmp(indices.data(), rhs.indices.data(), indices.size() * sizeof(uint32_t))
+      ;
+    }
+
+    static double now() {
+      return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+    }
+
+    static bool read_file(dynarray<uint8_t> &bytes, const char *file_name) {
+      file_map map(file_name);
+      if (map.get_error()) return false;
+      bytes.resize((size_t)map.get_size());
+      memcpy(bytes.data(), map.get_data(), bytes.size());
+      return true;
+    }
+
+    static bool check(bool ok, const char *what) {
+      printf("%-40s %s\n", what, ok ? "ok" : "FAILED");
+      return ok;
+    }
+
+  public:
+    /// Run the benchmark. Returns zero if the output of all readers and writers matched.
+    int run(int num_objects) {
+      const char *old_name = "serialize_benchmark_old.bin";
+      const char *new_name = "serialize_benchmark_new.bin";
+      build(num_objects);
+      printf("%d objects, %d vertices, %d indices\n", num_objects, vertices.size(), indices.size());
+
+      double t0 = now();
+      {
+        FILE *file = fopen(old_name, "wb");
+        if (!file) return 1;
+        stdio_binary_writer w(file);
+        visit(w);
+        fclose(file);
+      }
+      double t1 = now();
+      {
+        FILE *file = fopen(new_name, "wb");
+        if (!file) return 1;
+        binary_writer w(file);
+        visit(w);
+        w.flush();
+        fclose(file);
+      }
+      double t2 = now();
+      dynarray<uint8_t> memory;
+      {
+        binary_writer w(memory);
+        visit(w);
+      }
+      double t3 = now();
+
+      example_serialize_benchmark old_load, file_load, memory_load;
+      {
+        FILE *file = fopen(old_name, "rb");
+        stdio_binary_reader r(file);
+        old_load.visit(r);
+        fclose(file);
+      }
+      double t4 = now();
+      {
+        FILE *file = fopen(new_name, "rb");
+        binary_reader r(file);
+        file_load.visit(r);
+        fclose(file);
+      }
+      double t5 = now();
+      {
+        file_map map(new_name);
+        binary_reader r(map.get_data(), (size_t)map.get_size());
+        memory_load.visit(r);
+      }
+      double t6 = now();
+
+      printf("%u bytes\n", memory.size());
+      printf("write  stdio unbuffered  %8.2f ms\n", t1 - t0);
+      printf("write  buffered file     %8.2f ms\n", t2 - t1);
+      printf("write  memory            %8.2f ms\n", t3 - t2);
+      printf("read   stdio unbuffered  %8.2f ms\n", t4 - t3);
+      printf("read   buffered file     %8.2f ms\n", t5 - t4);
+      printf("read   mapped file       %8.2f ms\n", t6 - t5);
+
+      dynarray<uint8_t> old_bytes, new_bytes;
+      bool ok = read_file(old_bytes, old_name) && read_file(new_bytes, new_name);
+      ok = check(ok && old_bytes.size() == new_bytes.size() && !memcmp(old_bytes.data(), new_bytes.data(), old_bytes.size()), "buffered file matches stdio") && ok;
+      ok = check(old_bytes.size() == memory.size() && !memcmp(old_bytes.data(), memory.data(), memory.size()), "memory matches stdio") && ok;
+      ok = check(same_as(old_load), "stdio round trip") && ok;
+      ok = check(same_as(file_load), "buffered file round trip") && ok;
+      ok = check(same_as(memory_load), "mapped file round trip") && ok;
+
+      remove(old_name);
+      remove(new_name);
+      return ok ? 0 : 1;
+    }
+  };
+}
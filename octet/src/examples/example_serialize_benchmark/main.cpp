@@ -0,0 +1,21 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Serialization benchmark
+//
+
+#include <chrono>
+
+#include "../../octet.h"
+
+#include "example_serialize_benchmark.h"
+
+/// Time the binary reader and writer against unbuffered stdio.
+/// usage: example_serialize_benchmark [num_objects]
+int main(int argc, char **argv) {
+  octet::example_serialize_benchmark bench;
+  return bench.run(argc > 1 ? atoi(argv[1]) : 20000);
+}
@@ -0,0 +1,160 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+namespace octet {
+  /// Measures queries per second for mesh_voxels at several world sizes:
+  /// ray casts from the sky to the ground, sphere sweeps across the terrain
+  /// and contacts between the terrain and a rotated voxel ball resting on it.
+  class example_voxel_benchmark : public app {
+    // in voxels
+    enum { ball_radius = 12 };
+
+    ref<visual_scene> app_scene;
+    ref<mesh_voxels> world;
+    int num_queries;
+    random r;
+
+    static double now() {
+      return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+    }
+
+    // rolling hills filling about half the height of the world, in voxels.
+    static float terrain_height(float x, float z, int dim) {
+      return dim * (0.5f + 0.2f * sinf(x * 0.05f) * cosf(z * 0.07f));
+    }
+
+    static mesh_voxels *make_terrain(int cubes) {
+      mesh_voxels *result = new mesh_voxels(1.0f / 32, ivec3(cubes, cubes, cubes));
+      int dim = cubes * 32;
+      for (int z = 0; z != dim; ++z) {
+        for (int x = 0; x != dim; ++x) {
+          int h = (int)terrain_height((float)x, (float)z, dim);
+          for (int y = 0; y < h; ++y) {
+            result->set_voxel(ivec3(x, y, z), true);
+          }
+        }
+      }
+      result->update_lod();
+      return result;
+    }
+
+    static mesh_voxels *make_ball(float voxel_size) {
+      mesh_voxels *result = new mesh_voxels(voxel_size, ivec3(1, 1, 1));
+      for (int z = 0; z != 32; ++z) {
+        for (int y = 0; y != 32; ++y) {
+          for (int x = 0; x != 32; ++x) {
+            if (length(vec3(x + 0.5f, y + 0.5f, z + 0.5f) - 16.0f) < ball_radius) {
+              result->set_voxel(ivec3(x, y, z), true);
+            }
+          }
+        }
+      }
+      result->update_lod();
+      return result;
+    }
+
+    // random point in a box of half size "half" around the origin
+    vec3 random_point(float half) {
+      return vec3(r.get(-half, half), r.get(-half, half), r.get(-half, half));
+    }
+
+    // returns queries per second
+    double time_rays(mesh_voxels *voxels, float half) {
+      double t0 = now();
+      for (int i = 0; i != num_queries; ++i) {
+        vec3 start(r.get(-half, half), half, r.get(-half, half));
+        vec3 end(r.get(-half, half), -half, r.get(-half, half));
+        mesh_voxels::voxel_hit hit;
+        voxels->ray_cast(hit, ray(start, end));
+      }
+      double ms = now() - t0;
+      return num_queries * 1000.0 / ms;
+    }
+
+    // returns queries per second
+    double time_sweeps(mesh_voxels *voxels, float half) {
+      double t0 = now();
+      for (int i = 0; i != num_queries; ++i) {
+        sphere ball(random_point(half), half * 0.05f);
+        mesh_voxels::voxel_hit hit;
+        voxels->sweep_sphere(hit, ball, random_point(half * 0.25f));
+      }
+      double ms = now() - t0;
+      return num_queries * 1000.0 / ms;
+    }
+
+    // returns queries per second
+    double time_contacts(mesh_voxels *voxels, mesh_voxels *ball, float half, float &average_contacts) {
+      mat4t identity;
+      dynarray<mesh_voxels::voxel_contact> contacts;
+      unsigned total = 0;
+      int num = num_queries / 10;
+      int dim = (int)(half * 64);
+      double t0 = now();
+      for (int i = 0; i != num; ++i) {
+        // rest the ball on the ground a voxel or two deep, somewhere in the middle of the world.
+        float x = r.get(dim * 0.25f, dim * 0.75f);
+        float z = r.get(dim * 0.25f, dim * 0.75f);
+        float y = terrain_height(x, z, dim) + ball_radius - 2;
+        mat4t mxb;
+        mxb.translate(vec3(x, y, z) * (1.0f / 32) - half);
+        mxb.rotateX(r.get(0.0f, 90.0f));
+        mxb.rotateY(r.get(0.0f, 90.0f));
+        total += voxels->get_contacts(contacts, *ball, identity, mxb);
+      }
+      double ms = now() - t0;
+      average_contacts = (float)total / num;
+      return num * 1000.0 / ms;
+    }
+
+  public:
+    /// this is called when we construct the class before everything is initialised.
+    example_voxel_benchmark(int argc, char **argv) : app(argc, argv) {
+      num_queries = argc > 1 ? atoi(argv[1]) : 20000;
+    }
+
+    /// this is called once OpenGL is initialized
+    void app_init() {
+      printf("%d queries per test\n", num_queries);
+      printf("%10s %14s %14s %14s %10s\n", "voxels", "rays/s", "sweeps/s", "contacts/s", "points");
+
+      ref<mesh_voxels> ball = make_ball(1.0f / 32);
+      for (int cubes = 1; cubes <= 8; cubes *= 2) {
+        world = make_terrain(cubes);
+        float half = cubes * 0.5f;
+        float average_contacts = 0;
+        double rays = time_rays(world, half);
+        double sweeps = time_sweeps(world, half);
+        double contacts = time_contacts(world, ball, half, average_contacts);
+        printf("%6d^3 %14.0f %14.0f %14.0f %10.2f\n", cubes * 32, rays, sweeps, contacts, average_contacts);
+      }
+
+      app_scene = new visual_scene();
+      app_scene->create_default_camera_and_lights();
+      app_scene->get_camera_instance(0)->get_node()->translate(vec3(0, 4, 12));
+      app_scene->get_camera_instance(0)->set_far_plane(100);
+
+      world->set_greedy_meshing(true);
+      world->update();
+      scene_node *node = new scene_node();
+      app_scene->add_child(node);
+      app_scene->add_mesh_instance(new mesh_instance(node, world, new material(vec4(0.4f, 0.7f, 0.3f, 1))));
+    }
+
+    /// this is called to draw the world
+    void draw_world(int x, int y, int w, int h) {
+      int vx = 0, vy = 0;
+      get_viewport_size(vx, vy);
+      app_scene->begin_render(vx, vy);
+
+      // update matrices. assume 30 fps.
+      app_scene->update(1.0f/30);
+
+      // draw the scene
+      app_scene->render((float)vx / vy);
+    }
+  };
+}
@@ -0,0 +1,31 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Voxel query benchmark
+//
+
+#include <chrono>
+
+// the voxel meshes are experimental and off by default
+#define OCTET_VOXEL_TEST 1
+
+#include "../../octet.h"
+
+#include "example_voxel_benchmark.h"
+
+/// Time voxel ray casts, sphere sweeps and contacts, then show the biggest world.
+/// usage: example_voxel_benchmark [num_queries]
+int main(int argc, char **argv) {
+  // set up the platform.
+  octet::app::init_all(argc, argv);
+
+  // our application.
+  octet::example_voxel_benchmark app(argc, argv);
+  app.init();
+
+  // open windows
+  octet::app::run_all_apps();
+}
@@ -27,7 +27,7 @@ namespace octet { namespace helpers {
       // that works in screen pixels.
       text_scene = new visual_scene();
 
-      param_shader *shader = new param_shader("shaders/default.vs", "shaders/text.fs");
+      param_shader *shader = param_shader::get("shaders/default.vs", "shaders/text.fs");
 
       // Make a material from the font image.
       mat = new material(page, NULL, shader);
@@ -29,6 +29,7 @@ namespace octet { namespace loaders {
 
     TiXmlDocument doc;
     string doc_path;
+    bool compress_animations;
     dictionary<TiXmlElement *, allocator> ids;
     dynarray<float> temp_floats;
 
@@ -422,13 +423,19 @@ namespace octet { namespace loaders {
       return new param_color(pbi, vec4(deflt, 0, 0, 0), app_utils::get_atom(value), param::stage_fragment);
     }
 
+    // name of the material used when a mesh has none
+    static const interned_string &default_material_name() {
+      static const interned_string name("default_material");
+      return name;
+    }
+
     // add all the materials from the collada file to the resources collection
     void add_materials(resource_dict &dict) {
       TiXmlElement *lib_mat = child(doc.RootElement(), "library_materials");
 
-      if (!dict.has_resource("default_material")) {
+      if (!dict.has_resource(default_material_name())) {
         material *defmat = new material(vec4(0.5, 0.5, 0.5, 1));
-        dict.set_resource("default_material", defmat);
+        dict.set_resource(default_material_name(), defmat);
       }
 
       if (!lib_mat) return;
@@ -476,7 +483,7 @@ namespace octet { namespace loaders {
           const char *symbol = instance->Attribute("symbol");
           const char *target = instance->Attribute("target");
           material *mat = dict.get_material(target);
-          if (!mat) mat = dict.get_material("default_material");
+          if (!mat) mat = dict.get_material(default_material_name());
           const char *mesh_url = url;
           string new_url;
 
@@ -500,7 +507,7 @@ namespace octet { namespace loaders {
         }
       } else {
         mesh *mesh = dict.get_mesh(url);
-        material *mat = dict.get_material("default_material");
+        material *mat = dict.get_material(default_material_name());
         if (mesh) {
           mesh_instance *mi = new mesh_instance(node, mesh, mat, skel);
           s.add_mesh_instance(mi);
@@ -807,16 +814,20 @@ namespace octet { namespace loaders {
             anim->add_channel(target, node_sid, sub_target_sid, component_sid, times, values);
           }
         }
+
+        // drop redundant keys and quantise transforms.
+        // This saves memory but makes sampling slower, so only if asked.
+        if (compress_animations) {
+          anim->compress();
+        }
       }
     }
 
     // build the scene_node heirachy
     void build_heirachy(dynarray<TiXmlElement *> &node_elems, dynarray<scene_node *> &nodes, TiXmlElement *scene_element, resource_dict &dict, visual_scene &s) {
       // create a stack to avoid recursion (a bad thing in games)
-      dynarray<TiXmlElement *> stack;
-      dynarray<scene_node *> node_stack;
-      stack.reserve(64);
-      node_stack.reserve(64);
+      small_dynarray<TiXmlElement *, 64> stack;
+      small_dynarray<scene_node *, 64> node_stack;
 
       node_stack.push_back(s.get_root_node());
       stack.push_back(scene_element);
@@ -1211,6 +1222,13 @@ namespace octet { namespace loaders {
 
   public:
     collada_builder() {
+      compress_animations = false;
+    }
+
+    /// Compress animations as they are loaded (see animation::compress).
+    /// They take much less memory but are several times slower to sample. Off by default.
+    void set_compress_animations(bool value) {
+      compress_animations = value;
     }
 
     // public function to load a collada file
@@ -8,11 +8,24 @@
 // jpeg file decoder - tiny and fast
 //
 // See http://en.wikipedia.org/wiki/JPEG
-// 
+//
+// The IDCT and colour conversion are done in fixed point, eight at a time with SSE2.
+// Files with restart markers are decoded on several threads, one restart interval
+// at a time, and files can be decoded at 1/2, 1/4 or 1/8 size for thumbnails.
+//
 namespace octet { namespace loaders {
   class jpeg_decoder {
     enum { debug = 0 };
 
+    // do not start a thread for fewer MCUs than this.
+    enum { min_mcus_per_thread = 64 };
+
+    // huffman codes up to this length are found with a single table lookup.
+    enum { fast_bits = 9 };
+
+    // the most 8x8 blocks in a MCU allowed by the standard.
+    enum { max_mcu_blocks = 10 };
+
     // image dimensions
     unsigned precision;
     unsigned width;
@@ -28,26 +41,64 @@ namespace octet { namespace loaders {
     unsigned successive_high;
     unsigned successive_low;
 
+    // number of MCUs between restart markers, zero if there are none.
+    unsigned restart_interval;
+
+    // decode at 1/2^log2_scale of the size.
+    unsigned log2_scale;
+
+    // the most threads to use, zero for one per core.
+    unsigned max_threads;
+
     // how many blocks in a MCU (see mcu_block below)
     unsigned num_mcu_blocks;
     unsigned num_components_in_scan;
 
-    // skip a number of bits in the file.
+    // the biggest sampling factors in the scan: the MCU is 8*max_hsamp x 8*max_vsamp pixels.
+    unsigned max_hsamp;
+    unsigned max_vsamp;
+    unsigned mcus_across;
+    unsigned mcus_down;
+
+    // reads bits from one piece of entropy coded data.
     // there is a special case where every 0xff byte is followed by 0x00
-    static void skip_bits(unsigned bits, unsigned &acc, const uint8_t *&src, int &shift) {
-      shift -= bits;
-      while (shift < 0) {
-        // grab more bytes
-        uint8_t byte = *src++;
-        acc = acc * 256 + byte;
-        if (byte == 0xff) {
+    struct bit_reader {
+      // the low "bits" bits of acc are the next bits of the file.
+      uint64_t acc;
+      int bits;
+      const uint8_t *src;
+      const uint8_t *src_max;
+
+      void init(const uint8_t *begin, const uint8_t *end) {
+        acc = 0;
+        bits = 0;
+        src = begin;
+        src_max = end;
+        fill();
+      }
+
+      // grab bytes until we have at least 56 bits. Past the end of the data, we read zeros.
+      void fill() {
+        while (bits <= 56) {
+          uint8_t byte = src < src_max ? *src++ : 0;
           // in JPEG, an 0xff byte is followed by a zero
-          // do not advance past any other 0xff marker
-          src += src[0] == 0x00 ? 1 : -1;
+          if (byte == 0xff && src < src_max && src[0] == 0x00) src++;
+          acc = acc << 8 | byte;
+          bits += 8;
         }
-        shift += 8;
       }
-    }
+
+      // the next 16 bits of the file
+      unsigned peek16() const {
+        return (uint16_t)(acc >> (bits - 16));
+      }
+
+      // skip a number of bits in the file.
+      void skip(unsigned n) {
+        bits -= (int)n;
+        if (bits < 16) fill();
+      }
+    };
 
     // this is a component usually Y (brightness), Cb (blueness) and Cr (redness)
     // from the file.
@@ -67,15 +118,17 @@ namespace octet { namespace loaders {
       uint8_t comp;
       uint8_t ac_table;
       uint8_t dc_table;
-      unsigned width_in_blocks;
-      unsigned height_in_blocks;
-      int last_dc;
+      // blocks of this component in a MCU
+      uint8_t hsamp;
+      uint8_t vsamp;
+      // the size of the blocks after the IDCT
+      uint8_t block_size;
     } scan_components[4];
 
     // quantisation table. We multiply the dc and ac coefficients by these numbers.
     // this is the lossy part of the compression
     struct quant_table {
-      float table[64];
+      uint16_t table[64];
     } quant_tables[4];
 
     // A huffman table maps variable length codes to lengths and values.
@@ -88,21 +141,31 @@ namespace octet { namespace loaders {
       uint16_t maxcodes[17];
       uint16_t offset[17];
 
+      // length * 256 + value for codes of up to fast_bits bits, zero for longer codes.
+      uint16_t fast[1 << fast_bits];
+
       // decode a variable length huffman code
-      // we grab the next 16 bits and look in the maxcodes table to see how many
+      // most codes are short and we find them in the fast table.
+      // otherwise we grab the next 16 bits and look in the maxcodes table to see how many
       // bits the code has. After that, we strip the right hand bits and
       // look up the code in a table.
-      unsigned decode(unsigned &acc, const uint8_t *&src, int &shift) {
+      OCTET_HOT unsigned decode(bit_reader &bits) const {
+        unsigned acc16 = bits.peek16();
+        unsigned entry = fast[acc16 >> (16 - fast_bits)];
+        if (entry) {
+          bits.skip(entry >> 8);
+          return entry & 0xff;
+        }
+
         unsigned i = min_len;
-        unsigned short acc16 = acc >> shift;
 
         // find the shortest code that this could be
         for (; acc16 > maxcodes[i]; ++i) {
         }
 
         unsigned code = ( acc16 >> (15-i) ) - offset[i];
-        skip_bits(i + 1, acc, src, shift);
-        return huffval[code];
+        bits.skip(i + 1);
+        return code < 256 ? huffval[code] : 0;
       }
     } huffman_tables[2][4];
 
@@ -113,11 +176,35 @@ namespace octet { namespace loaders {
       huffman_table *dc_table;
       huffman_table *ac_table;
       quant_table *quant;
-      scan_component *scan_comp;
-    } mcu_blocks[8];
+      // the scan component and the position of the block in the component's part of the MCU.
+      uint8_t comp;
+      uint8_t x;
+      uint8_t y;
+    } mcu_blocks[max_mcu_blocks];
+
+    // the entropy coded data between two restart markers.
+    struct segment {
+      const uint8_t *begin;
+      const uint8_t *end;
+    };
+
+    dynarray<segment> segments;
+    std::atomic<unsigned> next_segment;
+
+    // the RGBA output, upside down for OpenGL.
+    uint8_t *image_base;
 
-    float dct_coeffs[8*64];
-    float ycrcb_values[8*64];
+    // everything a thread needs to decode MCUs.
+    struct mcu_state {
+      bit_reader bits;
+      int last_dc[4];
+      // all zero between blocks
+      int16_t coeffs[64];
+      // samples of each component for a row of MCUs
+      dynarray<uint8_t> planes[4];
+      // chroma rows stretched to the width of the luma
+      dynarray<uint8_t> rows[4];
+    };
 
     unsigned u2(const uint8_t *src) {
       return src[0] * 256 + src[1];
@@ -125,7 +212,7 @@ namespace octet { namespace loaders {
 
     // dct coefficients are stored in zig-zag order because the top
     // left is far more common.
-    uint8_t zig_zag(unsigned i) {
+    static uint8_t zig_zag(unsigned i) {
       static const uint8_t zig_zag_[64] = {
         0, 1, 8, 16, 9, 2, 3, 10,
         17, 24, 32, 25, 18, 11, 4, 5,
@@ -140,39 +227,39 @@ namespace octet { namespace loaders {
     }
 
     // negative numbers need to be twiddled as all numbers coming in are positive.
-    static int extend(unsigned bits, unsigned &acc, const uint8_t *&src, int &shift) {
-      uint16_t acc16 = acc >> shift;
-      unsigned v = acc16 >> (16 - bits);
-      return v < ( 1u << ( bits-1 ) ) ? (int)v + ( -1 << bits ) + 1 : (int)v;
+    static int extend(unsigned bits, const bit_reader &reader) {
+      unsigned v = reader.peek16() >> (16 - bits);
+      return v < ( 1u << ( bits-1 ) ) ? (int)v - ( 1 << bits ) + 1 : (int)v;
     }
 
     // decode one block of an MCU which may contain many blocks
     // The Y component may have four blocks, for example, and only one each of Cr, Cb
-    void decode_mcu_block(unsigned block_num, unsigned &acc, const uint8_t *&src, int &shift, float *outptr) {
-      mcu_block &block = mcu_blocks[block_num];
-
-      unsigned value = block.dc_table->decode(acc, src, shift);
+    // returns false if the block only has a DC term.
+    bool decode_mcu_block(const mcu_block &block, mcu_state &s, int16_t *outptr) const {
+      bit_reader &bits = s.bits;
+      unsigned value = block.dc_table->decode(bits);
 
       int dc = 0;
       if (value) {
-        dc = extend(value, acc, src, shift);
-        skip_bits(value, acc, src, shift);
-        //if (debug) printf("dc=%d\n", dc);
+        dc = extend(value, bits);
+        bits.skip(value);
       }
-      int abs_dc = block.scan_comp->last_dc += dc;
-      outptr[0] = abs_dc * block.quant->table[0];
+      int abs_dc = s.last_dc[block.comp] += dc;
+      outptr[0] = (int16_t)(abs_dc * block.quant->table[0]);
 
-      for (int ac_coef = 1; ac_coef < 64; ++ac_coef) {
-        unsigned value = block.ac_table->decode(acc, src, shift);
+      bool has_ac = false;
+      for (unsigned ac_coef = 1; ac_coef < 64; ++ac_coef) {
+        unsigned value = block.ac_table->decode(bits);
         unsigned skip = value >> 4;
         value &= 0x0f;
         ac_coef += skip;
 
         if (value) {
-          int ac = extend(value, acc, src, shift);
-          skip_bits(value, acc, src, shift);
-          //if (debug) printf("ac=%d,%d coef=%d zig_zag=%d\n", skip, ac, ac_coef, zig_zag(ac_coef));
-          outptr[zig_zag(ac_coef)] = (float)ac * block.quant->table[ac_coef];
+          int ac = extend(value, bits);
+          bits.skip(value);
+          unsigned index = ac_coef < 63 ? ac_coef : 63;
+          outptr[zig_zag(index)] = (int16_t)(ac * block.quant->table[index]);
+          has_ac = true;
         } else if (skip != 15) {
           break;
         }
@@ -180,53 +267,62 @@ namespace octet { namespace loaders {
       if (debug) {
         for (int j = 0; j != 8; ++j) {
           for (int i = 0; i != 8; ++i) {
-            printf("%3.0f ", outptr[i+j*8]);
+            printf("%4d ", outptr[i+j*8]);
           }
           printf("\n");
         }
       }
+      return has_ac;
+    }
+
+    // fixed point with 12 bits after the point.
+    static int fix(float x) {
+      return (int)floorf(x * 4096 + 0.5f);
+    }
+
+    static uint8_t clamp(int v) {
+      return (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
     }
 
-    // one dimensional inverse DCT.
+    // one dimensional inverse DCT in fixed point. The results are 4096 times too big.
     // c0 is the DC term and c1..c7 increase in frequency
     // example: c0 = 128, c1..c7 = 0 -> 128, 128, 128, 128, 128, 128, 128, 128
-    // todo: improve this!
-    OCTET_HOT void idct(float &c0, float &c1, float &c2, float &c3, float &c4, float &c5, float &c6, float &c7) {
-      float c2c6_1 = (c2 + c6) * 0.541196100f;
-      float c2c6_2 = c2c6_1 + c6 * -1.847759065f;
-      float c2c6_3 = c2c6_1 + c2 * 0.765366865f;
-    
-      float c0c4_1 = c0 + c4;
-      float c0c4_2 = c0 - c4;
-    
-      float ceven_1 = c0c4_1 + c2c6_3;
-      float ceven_2 = c0c4_1 - c2c6_3;
-      float ceven_3 = c0c4_2 + c2c6_2;
-      float ceven_4 = c0c4_2 - c2c6_2;
-    
-      float c1c7 = c7 + c1;
-      float c3c5 = c5 + c3;
-      float c7c3 = c7 + c3;
-      float c5c1 = c5 + c1;
-      float codd_0 = (c7c3 + c5c1) * 1.175875602f;
-    
-      float codd_4 = c7 * 0.298631336f;
-      float codd_3 = c5 * 2.053119869f;
-      float codd_2 = c3 * 3.072711026f;
-      float codd_1 = c1 * 1.501321110f;
-      c1c7 = c1c7 * -0.899976223f;
-      c3c5 = c3c5 * -2.562915447f;
-      c7c3 = c7c3 * -1.961570560f;
-      c5c1 = c5c1 * -0.390180644f;
-    
+    static OCTET_HOT void idct(int &c0, int &c1, int &c2, int &c3, int &c4, int &c5, int &c6, int &c7) {
+      int c2c6_1 = (c2 + c6) * fix(0.541196100f);
+      int c2c6_2 = c2c6_1 + c6 * fix(-1.847759065f);
+      int c2c6_3 = c2c6_1 + c2 * fix(0.765366865f);
+
+      int c0c4_1 = (c0 + c4) * 4096;
+      int c0c4_2 = (c0 - c4) * 4096;
+
+      int ceven_1 = c0c4_1 + c2c6_3;
+      int ceven_2 = c0c4_1 - c2c6_3;
+      int ceven_3 = c0c4_2 + c2c6_2;
+      int ceven_4 = c0c4_2 - c2c6_2;
+
+      int c1c7 = c7 + c1;
+      int c3c5 = c5 + c3;
+      int c7c3 = c7 + c3;
+      int c5c1 = c5 + c1;
+      int codd_0 = (c7c3 + c5c1) * fix(1.175875602f);
+
+      int codd_4 = c7 * fix(0.298631336f);
+      int codd_3 = c5 * fix(2.053119869f);
+      int codd_2 = c3 * fix(3.072711026f);
+      int codd_1 = c1 * fix(1.501321110f);
+      c1c7 = c1c7 * fix(-0.899976223f);
+      c3c5 = c3c5 * fix(-2.562915447f);
+      c7c3 = c7c3 * fix(-1.961570560f);
+      c5c1 = c5c1 * fix(-0.390180644f);
+
       c7c3 += codd_0;
       c5c1 += codd_0;
-    
+
       codd_4 += c1c7 + c7c3;
       codd_3 += c3c5 + c5c1;
       codd_2 += c3c5 + c7c3;
       codd_1 += c1c7 + c5c1;
-    
+
       c0 = ceven_1 + codd_1;
       c7 = ceven_1 - codd_1;
       c1 = ceven_3 + codd_2;
@@ -237,120 +333,445 @@ namespace octet { namespace loaders {
       c4 = ceven_2 - codd_4;
     }
 
-    // Two dimensional inverse DCT
-    // we can do the rows and columns separately.
-    // Optimisations include spotting blank rows and columns, but this
-    // is just a reference design.
-    void inverse_dct(float *inptr) {
-      // do rows
+  #if OCTET_SSE2
+    // eight 32 bit results in two registers.
+    struct wide {
+      __m128i lo;
+      __m128i hi;
+    };
+
+    static wide widen(__m128i x) {
+      // x * 4096
+      wide result;
+      result.lo = _mm_srai_epi32(_mm_unpacklo_epi16(_mm_setzero_si128(), x), 4);
+      result.hi = _mm_srai_epi32(_mm_unpackhi_epi16(_mm_setzero_si128(), x), 4);
+      return result;
+    }
+
+    static wide add(const wide &a, const wide &b) {
+      wide result;
+      result.lo = _mm_add_epi32(a.lo, b.lo);
+      result.hi = _mm_add_epi32(a.hi, b.hi);
+      return result;
+    }
+
+    static wide sub(const wide &a, const wide &b) {
+      wide result;
+      result.lo = _mm_sub_epi32(a.lo, b.lo);
+      result.hi = _mm_sub_epi32(a.hi, b.hi);
+      return result;
+    }
+
+    // a constant pair for _mm_madd_epi16
+    static __m128i pair(int a, int b) {
+      return _mm_setr_epi16((short)a, (short)b, (short)a, (short)b, (short)a, (short)b, (short)a, (short)b);
+    }
+
+    // out0 = a * k0.first + b * k0.second, out1 = a * k1.first + b * k1.second
+    static void rotate(wide &out0, wide &out1, __m128i a, __m128i b, __m128i k0, __m128i k1) {
+      __m128i lo = _mm_unpacklo_epi16(a, b);
+      __m128i hi = _mm_unpackhi_epi16(a, b);
+      out0.lo = _mm_madd_epi16(lo, k0);
+      out0.hi = _mm_madd_epi16(hi, k0);
+      out1.lo = _mm_madd_epi16(lo, k1);
+      out1.hi = _mm_madd_epi16(hi, k1);
+    }
+
+    // out0 = (a + b + bias) >> shift, out1 = (a - b + bias) >> shift
+    static void butterfly(__m128i &out0, __m128i &out1, wide a, const wide &b, __m128i bias, int shift) {
+      a.lo = _mm_add_epi32(a.lo, bias);
+      a.hi = _mm_add_epi32(a.hi, bias);
+      wide sum = add(a, b);
+      wide dif = sub(a, b);
+      out0 = _mm_packs_epi32(_mm_srai_epi32(sum.lo, shift), _mm_srai_epi32(sum.hi, shift));
+      out1 = _mm_packs_epi32(_mm_srai_epi32(dif.lo, shift), _mm_srai_epi32(dif.hi, shift));
+    }
+
+    // the same as idct() above on eight columns at once.
+    static OCTET_HOT void idct_pass(__m128i *row, __m128i bias, int shift) {
+      // even part
+      wide t2e, t3e;
+      rotate(t2e, t3e, row[2], row[6], pair(fix(0.541196100f), fix(0.541196100f) + fix(-1.847759065f)), pair(fix(0.541196100f) + fix(0.765366865f), fix(0.541196100f)));
+      wide t0e = widen(_mm_add_epi16(row[0], row[4]));
+      wide t1e = widen(_mm_sub_epi16(row[0], row[4]));
+      wide x0 = add(t0e, t3e);
+      wide x3 = sub(t0e, t3e);
+      wide x1 = add(t1e, t2e);
+      wide x2 = sub(t1e, t2e);
+
+      // odd part
+      wide y0o, y1o, y2o, y3o, y4o, y5o;
+      rotate(y0o, y2o, row[7], row[3], pair(fix(-1.961570560f) + fix(0.298631336f), fix(-1.961570560f)), pair(fix(-1.961570560f), fix(-1.961570560f) + fix(3.072711026f)));
+      rotate(y1o, y3o, row[5], row[1], pair(fix(-0.390180644f) + fix(2.053119869f), fix(-0.390180644f)), pair(fix(-0.390180644f), fix(-0.390180644f) + fix(1.501321110f)));
+      rotate(y4o, y5o, _mm_add_epi16(row[1], row[7]), _mm_add_epi16(row[3], row[5]), pair(fix(1.175875602f) + fix(-0.899976223f), fix(1.175875602f)), pair(fix(1.175875602f), fix(1.175875602f) + fix(-2.562915447f)));
+      wide x4 = add(y0o, y4o);
+      wide x5 = add(y1o, y5o);
+      wide x6 = add(y2o, y5o);
+      wide x7 = add(y3o, y4o);
+
+      butterfly(row[0], row[7], x0, x7, bias, shift);
+      butterfly(row[1], row[6], x1, x6, bias, shift);
+      butterfly(row[2], row[5], x2, x5, bias, shift);
+      butterfly(row[3], row[4], x3, x4, bias, shift);
+    }
+
+    // steps of the 8x8 transposes
+    static void interleave16(__m128i &a, __m128i &b) {
+      __m128i tmp = a;
+      a = _mm_unpacklo_epi16(a, b);
+      b = _mm_unpackhi_epi16(tmp, b);
+    }
+
+    static void interleave8(__m128i &a, __m128i &b) {
+      __m128i tmp = a;
+      a = _mm_unpacklo_epi8(a, b);
+      b = _mm_unpackhi_epi8(tmp, b);
+    }
+  #endif
+
+    // Two dimensional inverse DCT to 8x8 samples.
+    // we can do the columns and rows separately, keeping two extra bits in between.
+    // With SSE2 we do all eight columns or rows at once.
+    static void inverse_dct(const int16_t *inptr, uint8_t *outptr, int stride) {
+    #if OCTET_SSE2
+      __m128i row[8];
       for (unsigned i = 0; i != 8; ++i) {
-        idct(inptr[8*0+i], inptr[8*1+i], inptr[8*2+i], inptr[8*3+i], inptr[8*4+i], inptr[8*5+i], inptr[8*6+i], inptr[8*7+i]);
+        row[i] = _mm_loadu_si128((const __m128i*)(inptr + i*8));
       }
 
+      // do columns
+      idct_pass(row, _mm_set1_epi32(512), 10);
+
+      // transpose
+      for (unsigned i = 0; i != 4; ++i) interleave16(row[i], row[i+4]);
+      for (unsigned i = 0; i != 8; i += 4) {
+        interleave16(row[i], row[i+2]);
+        interleave16(row[i+1], row[i+3]);
+      }
+      for (unsigned i = 0; i != 8; i += 2) interleave16(row[i], row[i+1]);
+
+      // do rows, adding 128 and rounding
+      idct_pass(row, _mm_set1_epi32((1 << 16) + (128 << 17)), 17);
+
+      // clamp to 0..255 and transpose back
+      __m128i p0 = _mm_packus_epi16(row[0], row[1]);
+      __m128i p1 = _mm_packus_epi16(row[2], row[3]);
+      __m128i p2 = _mm_packus_epi16(row[4], row[5]);
+      __m128i p3 = _mm_packus_epi16(row[6], row[7]);
+      interleave8(p0, p2);
+      interleave8(p1, p3);
+      interleave8(p0, p1);
+      interleave8(p2, p3);
+      interleave8(p0, p2);
+      interleave8(p1, p3);
+
+      __m128i rows[4] = { p0, p2, p1, p3 };
+      for (unsigned i = 0; i != 4; ++i) {
+        _mm_storel_epi64((__m128i*)outptr, rows[i]);
+        outptr += stride;
+        _mm_storel_epi64((__m128i*)outptr, _mm_shuffle_epi32(rows[i], 0x4e));
+        outptr += stride;
+      }
+    #else
+      int tmp[64];
+
       // do columns
       for (unsigned i = 0; i != 8; ++i) {
-        idct(inptr[8*i+0], inptr[8*i+1], inptr[8*i+2], inptr[8*i+3], inptr[8*i+4], inptr[8*i+5], inptr[8*i+6], inptr[8*i+7]);
+        const int16_t *in = inptr + i;
+        int *t = tmp + i;
+        if (!(in[8*1] | in[8*2] | in[8*3] | in[8*4] | in[8*5] | in[8*6] | in[8*7])) {
+          // most columns only have a DC term.
+          for (unsigned j = 0; j != 8; ++j) {
+            t[8*j] = in[0] * 4;
+          }
+        } else {
+          int c0 = in[8*0], c1 = in[8*1], c2 = in[8*2], c3 = in[8*3], c4 = in[8*4], c5 = in[8*5], c6 = in[8*6], c7 = in[8*7];
+          idct(c0, c1, c2, c3, c4, c5, c6, c7);
+          t[8*0] = (c0 + 512) >> 10; t[8*1] = (c1 + 512) >> 10; t[8*2] = (c2 + 512) >> 10; t[8*3] = (c3 + 512) >> 10;
+          t[8*4] = (c4 + 512) >> 10; t[8*5] = (c5 + 512) >> 10; t[8*6] = (c6 + 512) >> 10; t[8*7] = (c7 + 512) >> 10;
+        }
+      }
+
+      // do rows. 4096 from idct(), 4 from the columns and 8 from the DCT scale: 2^17
+      const int bias = (1 << 16) + (128 << 17);
+      for (unsigned j = 0; j != 8; ++j) {
+        int *t = tmp + j*8;
+        int c0 = t[0], c1 = t[1], c2 = t[2], c3 = t[3], c4 = t[4], c5 = t[5], c6 = t[6], c7 = t[7];
+        idct(c0, c1, c2, c3, c4, c5, c6, c7);
+        outptr[0] = clamp((c0 + bias) >> 17); outptr[1] = clamp((c1 + bias) >> 17);
+        outptr[2] = clamp((c2 + bias) >> 17); outptr[3] = clamp((c3 + bias) >> 17);
+        outptr[4] = clamp((c4 + bias) >> 17); outptr[5] = clamp((c5 + bias) >> 17);
+        outptr[6] = clamp((c6 + bias) >> 17); outptr[7] = clamp((c7 + bias) >> 17);
+        outptr += stride;
       }
+    #endif
 
       if (debug) {
         for (int j = 0; j != 8; ++j) {
           for (int i = 0; i != 8; ++i) {
-            printf("%f ", inptr[i+j*8]);
+            printf("%3d ", outptr[i+(j-8)*stride]);
           }
           printf("\n");
         }
       }
     }
 
-    // clamp to 0..255 range without using branches.
-    // fabsf is usually implemented in hardware (with fast math options)
-    OCTET_HOT uint8_t clamp(float v) {
-      // v + fabsf(v) = 2v when v > 0
-      // v + fabsf(v) = 0  when v < 0
-      float clamp0 = v + fabsf(v);
+    // inverse DCT to n x n samples (n = 4 or 2) by averaging the 8x8 ones, for scaled down images.
+    static void inverse_dct_reduced(const int16_t *inptr, uint8_t *outptr, int stride, unsigned n) {
+      uint8_t full[64];
+      inverse_dct(inptr, full, 8);
+
+      // add up pairs of columns and then pairs of rows.
+      uint16_t sums[4][8];
+      for (unsigned j = 0; j != 4; ++j) {
+        const uint8_t *src = full + j * 16;
+        for (unsigned i = 0; i != 4; ++i) {
+          sums[j][i] = (uint16_t)(src[i*2] + src[i*2+1] + src[i*2+8] + src[i*2+9]);
+        }
+      }
+
+      if (n == 4) {
+        for (unsigned j = 0; j != 4; ++j) {
+          for (unsigned i = 0; i != 4; ++i) {
+            outptr[i] = (uint8_t)((sums[j][i] + 2) >> 2);
+          }
+          outptr += stride;
+        }
+      } else {
+        for (unsigned j = 0; j != 2; ++j) {
+          for (unsigned i = 0; i != 2; ++i) {
+            unsigned sum = sums[j*2][i*2] + sums[j*2][i*2+1] + sums[j*2+1][i*2] + sums[j*2+1][i*2+1];
+            outptr[i] = (uint8_t)((sum + 8) >> 4);
+          }
+          outptr += stride;
+        }
+      }
+    }
+
+    // blocks with only a DC term are flat.
+    static void fill_block(uint8_t *outptr, int stride, unsigned n, int dc) {
+      uint8_t value = clamp(((dc + 4) >> 3) + 128);
+      for (unsigned j = 0; j != n; ++j) {
+        memset(outptr, value, n);
+        outptr += stride;
+      }
+    }
+
+    // fixed point YCbCr to RGB conversion with 14 bits after the point.
+    // See http://en.wikipedia.org/wiki/YCbCr
+    enum {
+      cr_to_r = 22970,  // 1.402
+      cb_to_g = -5638,  // -0.344136
+      cr_to_g = -11700, // -0.714136
+      cb_to_b = 29032,  // 1.772
+    };
 
-      // v - fabsf(v-n) = n when v > n
-      // v - fabsf(v-n) = 2v - n when v < n
-      return (uint8_t)( ( clamp0 - fabsf( clamp0 - (255.999f * 2) ) ) * 0.25f + 128 );
+    // convert from YCrCb to RGB
+    static void color_convert(uint8_t *outptr, const uint8_t *y, const uint8_t *cb, const uint8_t *cr, unsigned n) {
+      unsigned i = 0;
+    #if OCTET_SSE2
+      __m128i zero = _mm_setzero_si128();
+      __m128i half = _mm_set1_epi16(128);
+      __m128i round = _mm_set1_epi32(1 << 13);
+      __m128i k_r = pair(0, cr_to_r);
+      __m128i k_g = pair(cb_to_g, cr_to_g);
+      __m128i k_b = pair(cb_to_b, 0);
+      __m128i alpha = _mm_set1_epi8((char)0xff);
+      for (; i + 8 <= n; i += 8) {
+        __m128i y16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(y + i)), zero);
+        __m128i cb16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(cb + i)), zero), half);
+        __m128i cr16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(cr + i)), zero), half);
+        __m128i lo = _mm_unpacklo_epi16(cb16, cr16);
+        __m128i hi = _mm_unpackhi_epi16(cb16, cr16);
+
+        __m128i r = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(lo, k_r), round), 14), _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(hi, k_r), round), 14));
+        __m128i g = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(lo, k_g), round), 14), _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(hi, k_g), round), 14));
+        __m128i b = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(lo, k_b), round), 14), _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(hi, k_b), round), 14));
+
+        // add y and clamp to 0..255
+        __m128i r8 = _mm_packus_epi16(_mm_add_epi16(y16, r), zero);
+        __m128i g8 = _mm_packus_epi16(_mm_add_epi16(y16, g), zero);
+        __m128i b8 = _mm_packus_epi16(_mm_add_epi16(y16, b), zero);
+
+        // rgba
+        __m128i rg = _mm_unpacklo_epi8(r8, g8);
+        __m128i ba = _mm_unpacklo_epi8(b8, alpha);
+        _mm_storeu_si128((__m128i*)(outptr + i*4), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i*)(outptr + i*4 + 16), _mm_unpackhi_epi16(rg, ba));
+      }
+    #endif
+      for (; i != n; ++i) {
+        int yi = y[i];
+        int cbi = cb[i] - 128;
+        int cri = cr[i] - 128;
+        outptr[i*4+0] = clamp(yi + ((cri * cr_to_r + (1 << 13)) >> 14));
+        outptr[i*4+1] = clamp(yi + ((cbi * cb_to_g + cri * cr_to_g + (1 << 13)) >> 14));
+        outptr[i*4+2] = clamp(yi + ((cbi * cb_to_b + (1 << 13)) >> 14));
+        outptr[i*4+3] = 0xff;
+      }
     }
 
     // convert from Y to RGB
-    // The 0.125 scaling factor is because the DCT data has a scale of 8
-    void color_convert_444_greyscale(uint8_t *outptr, int stride, float *inptr) {
-      for (unsigned j = 0; j != 8; ++j) {
-        for (unsigned i = 0; i != 8; ++i) {
-          float y = inptr[0];
-          inptr++;
-          outptr[0] = clamp(128 + y * 0.125f);
-          outptr[1] = clamp(128 + y * 0.125f);
-          outptr[2] = clamp(128 + y * 0.125f);
-          outptr[3] = 0xff;
-          outptr += 4;
+    static void color_convert_greyscale(uint8_t *outptr, const uint8_t *y, unsigned n) {
+      unsigned i = 0;
+    #if OCTET_SSE2
+      __m128i alpha = _mm_set1_epi8((char)0xff);
+      for (; i + 8 <= n; i += 8) {
+        __m128i y8 = _mm_loadl_epi64((const __m128i*)(y + i));
+        __m128i yy = _mm_unpacklo_epi8(y8, y8);
+        __m128i ya = _mm_unpacklo_epi8(y8, alpha);
+        _mm_storeu_si128((__m128i*)(outptr + i*4), _mm_unpacklo_epi16(yy, ya));
+        _mm_storeu_si128((__m128i*)(outptr + i*4 + 16), _mm_unpackhi_epi16(yy, ya));
+      }
+    #endif
+      for (; i != n; ++i) {
+        outptr[i*4+0] = outptr[i*4+1] = outptr[i*4+2] = y[i];
+        outptr[i*4+3] = 0xff;
+      }
+    }
+
+    // decode all the blocks of a MCU into the planes of a row of MCUs.
+    void decode_mcu(mcu_state &s, unsigned mcu_x) const {
+      for (unsigned b = 0; b != num_mcu_blocks; ++b) {
+        const mcu_block &block = mcu_blocks[b];
+        bool has_ac = decode_mcu_block(block, s, s.coeffs);
+
+        const scan_component &sc = scan_components[block.comp];
+        unsigned n = sc.block_size;
+        unsigned w = sc.hsamp * n;
+        int stride = w * mcus_across;
+        uint8_t *samples = s.planes[block.comp].data() + block.y * n * stride + mcu_x * w + block.x * n;
+        if (!has_ac || n == 1) {
+          fill_block(samples, stride, n, s.coeffs[0]);
+        } else if (n == 8) {
+          inverse_dct(s.coeffs, samples, stride);
+        } else {
+          inverse_dct_reduced(s.coeffs, samples, stride, n);
+        }
+
+        // leave the coefficients clear for the next block.
+        if (has_ac) {
+          memset(s.coeffs, 0, sizeof(s.coeffs));
+        } else {
+          s.coeffs[0] = 0;
         }
-        outptr += stride - 32;
       }
     }
 
-    // convert from YCrCb to RGB
-    // See http://en.wikipedia.org/wiki/YCbCr
-    // The 0.125 scaling factor is because the DCT data has a scale of 8
-    void color_convert_444(uint8_t *outptr, int stride, float *inptr) {
-      for (unsigned j = 0; j != 8; ++j) {
-        for (unsigned i = 0; i != 8; ++i) {
-          float y = inptr[0];
-          float cb = inptr[64];
-          float cr = inptr[128];
-          inptr++;
-          outptr[0] = clamp(128 + y * 0.125f + cr * (1.402f * 0.125f));
-          outptr[1] = clamp(128 + y * 0.125f - cb * (0.34414f * 0.125f) - cr * (0.71414f * 0.125f));
-          outptr[2] = clamp(128 + y * 0.125f + cb * (1.772f * 0.125f));
-          outptr[3] = 0xff;
-          outptr += 4;
+    // convert MCUs x0..x1 of a row of MCUs from component samples to RGBA pixels.
+    // doing a run of MCUs at once gives long rows for the SSE2 colour conversion.
+    void color_convert_mcus(mcu_state &s, unsigned mcu_y, unsigned x0, unsigned x1) const {
+      unsigned mcu_width = max_hsamp * (8 >> log2_scale);
+      unsigned mcu_height = max_vsamp * (8 >> log2_scale);
+      unsigned num_pixels = (x1 - x0) * mcu_width;
+      int stride = width * 4;
+      for (unsigned j = 0; j != mcu_height; ++j) {
+        // the image is upside down for OpenGL.
+        uint8_t *outptr = image_base + (height - 1 - mcu_y * mcu_height - j) * stride + x0 * mcu_width * 4;
+
+        // make the chroma rows the same size as the luma rows.
+        const uint8_t *rows[4];
+        for (unsigned c = 0; c != num_components_in_scan; ++c) {
+          const scan_component &sc = scan_components[c];
+          unsigned w = sc.hsamp * sc.block_size;
+          const uint8_t *src = s.planes[c].data() + (j * sc.vsamp * sc.block_size / mcu_height) * w * mcus_across + x0 * w;
+          if (w == mcu_width) {
+            rows[c] = src;
+          } else {
+            unsigned repeat = mcu_width / w;
+            uint8_t *row = s.rows[c].data();
+            for (unsigned i = 0; i != num_pixels; ++i) {
+              row[i] = src[i / repeat];
+            }
+            rows[c] = row;
+          }
+        }
+
+        if (num_components_in_scan == 1) {
+          color_convert_greyscale(outptr, rows[0], num_pixels);
+        } else {
+          color_convert(outptr, rows[0], rows[1], rows[2], num_pixels);
         }
-        outptr += stride - 32;
       }
     }
 
-    // convert from YCrCb to RGB
-    // See http://en.wikipedia.org/wiki/YCbCr
-    // The 0.125 scaling factor is because the DCT data has a scale of 8
-    void color_convert_411(uint8_t *outptr, int stride, float *inptr) {
-      for (unsigned j = 0; j != 8; ++j) {
-        for (unsigned i = 0; i != 8; ++i) {
-          float y0 = inptr[0x00];
-          float y1 = inptr[0x40];
-          float y2 = inptr[0x80];
-          float y3 = inptr[0xc0];
-          float cb = inptr[0x100];
-          float cr = inptr[0x140];
-          inptr++;
-          outptr[0] = clamp(128 + y0 * 0.125f + cr * (1.402f * 0.125f));
-          outptr[1] = clamp(128 + y0 * 0.125f - cb * (0.34414f * 0.125f) - cr * (0.71414f * 0.125f));
-          outptr[2] = clamp(128 + y0 * 0.125f + cb * (1.772f * 0.125f));
-          outptr[3] = 0xff;
-          outptr += 4;
-          outptr[0] = clamp(128 + y1 * 0.125f + cr * (1.402f * 0.125f));
-          outptr[1] = clamp(128 + y1 * 0.125f - cb * (0.34414f * 0.125f) - cr * (0.71414f * 0.125f));
-          outptr[2] = clamp(128 + y1 * 0.125f + cb * (1.772f * 0.125f));
-          outptr[3] = 0xff;
-          outptr += stride - 4;
-          outptr[0] = clamp(128 + y2 * 0.125f + cr * (1.402f * 0.125f));
-          outptr[1] = clamp(128 + y2 * 0.125f - cb * (0.34414f * 0.125f) - cr * (0.71414f * 0.125f));
-          outptr[2] = clamp(128 + y2 * 0.125f + cb * (1.772f * 0.125f));
-          outptr[3] = 0xff;
-          outptr += 4;
-          outptr[0] = clamp(128 + y3 * 0.125f + cr * (1.402f * 0.125f));
-          outptr[1] = clamp(128 + y3 * 0.125f - cb * (0.34414f * 0.125f) - cr * (0.71414f * 0.125f));
-          outptr[2] = clamp(128 + y3 * 0.125f + cb * (1.772f * 0.125f));
-          outptr[3] = 0xff;
-          outptr += -stride + 4;
+    // decode the MCUs between two restart markers.
+    void decode_segment(mcu_state &s, unsigned index) const {
+      const segment &seg = segments[index];
+      unsigned num_mcus = mcus_across * mcus_down;
+      unsigned first = restart_interval ? index * restart_interval : 0;
+      if (first >= num_mcus) return;
+      unsigned last = restart_interval && num_mcus - first > restart_interval ? first + restart_interval : num_mcus;
+
+      s.bits.init(seg.begin, seg.end);
+      for (unsigned i = 0; i != 4; ++i) {
+        s.last_dc[i] = 0;
+      }
+
+      unsigned x0 = first % mcus_across;
+      for (unsigned mcu = first; mcu < last; ++mcu) {
+        unsigned x = mcu % mcus_across;
+        decode_mcu(s, x);
+        if (x == mcus_across - 1 || mcu == last - 1) {
+          color_convert_mcus(s, mcu / mcus_across, x0, x + 1);
+          x0 = 0;
+        }
+      }
+    }
+
+    // each thread takes the next segment until there are none left.
+    void decode_segments() {
+      mcu_state s;
+      memset(s.coeffs, 0, sizeof(s.coeffs));
+      unsigned mcu_width = max_hsamp * (8 >> log2_scale);
+      for (unsigned c = 0; c != num_components_in_scan; ++c) {
+        const scan_component &sc = scan_components[c];
+        s.planes[c].resize(mcus_across * sc.hsamp * sc.block_size * sc.vsamp * sc.block_size);
+        s.rows[c].resize(mcus_across * mcu_width);
+      }
+
+      for (;;) {
+        unsigned index = next_segment++;
+        if (index >= segments.size()) break;
+        decode_segment(s, index);
+      }
+    }
+
+    // split the entropy coded data at the restart markers.
+    // returns the end of the data: the next marker that is not a restart.
+    const uint8_t *find_segments(const uint8_t *src, const uint8_t *src_max) {
+      segments.resize(0);
+      segment seg;
+      seg.begin = src;
+      for (;;) {
+        src = (const uint8_t*)memchr(src, 0xff, src_max - src);
+        if (!src || src + 1 >= src_max) {
+          src = src_max;
+          break;
+        }
+        uint8_t marker = src[1];
+        if (marker == 0x00 || marker == 0xff) {
+          // a zero after 0xff in the data or a fill byte before a marker.
+          src += marker ? 1 : 2;
+        } else if (marker >= 0xd0 && marker <= 0xd7) {
+          // RSTn
+          if (restart_interval) {
+            seg.end = src;
+            segments.push_back(seg);
+            seg.begin = src + 2;
+          }
+          src += 2;
+        } else {
+          break;
         }
-        outptr += stride*2 - 64;
       }
+      seg.end = src;
+      segments.push_back(seg);
+      return src;
     }
 
     // JPEG files are split up into chunks starting with 0xff
-    unsigned decode_chunk(const uint8_t *src, dynarray<uint8_t> &image, uint16_t &format) {
+    unsigned decode_chunk(const uint8_t *src, const uint8_t *src_max, dynarray<uint8_t> &image, uint16_t &format) {
       if (debug) printf("decode_chunk %02x\n", src[1]);
 
       unsigned length = 2;
@@ -391,15 +812,15 @@ namespace octet { namespace loaders {
             c.quantisation_table = src[10 + i*3 + 2] & 3;
             if (debug) printf("id=%d h=%d v=%d q=%d\n", c.id, c.hsamp, c.vsamp, c.quantisation_table);
           }
-          
+
         } break;
 
         // huffman tables
         case 0xc4: {
           length = u2(src + 2) + 2;
           src += 4;
-          const uint8_t *src_max = src + length;
-          while (src + 17 <= src_max) {
+          const uint8_t *table_max = src + length;
+          while (src + 17 <= table_max) {
             unsigned index = src[0];
             unsigned is_ac = (index >> 4) & 1;
             index &= 3;
@@ -410,13 +831,14 @@ namespace octet { namespace loaders {
               count += num_codes[i];
             }
             src += 17;
-            if (src + count > src_max || count > 256) return 0;
+            if (src + count > table_max || count > 256) return 0;
             memcpy(h.huffval, src, count);
             src += count;
 
             unsigned dest = 0;
             unsigned code = 0;
             h.min_len = 0;
+            memset(h.fast, 0, sizeof(h.fast));
             bool done_min_len = false;
             for (unsigned len = 1; len < 17; ++len) {
               h.offset[len-1] = code - dest;
@@ -426,6 +848,13 @@ namespace octet { namespace loaders {
               }
               for (unsigned i = 0; i != num_codes[len-1]; ++i) {
                 if (debug) printf("code=%04x len=%d\n", ( ( code + i ) << (16 - len) ), len );
+                if (len <= fast_bits) {
+                  // every fast_bits prefix that starts with this code
+                  unsigned first = ( code + i ) << (fast_bits - len);
+                  for (unsigned j = 0; j != 1u << (fast_bits - len); ++j) {
+                    h.fast[first + j] = (uint16_t)( len * 256 + h.huffval[dest + i] );
+                  }
+                }
               }
               dest += num_codes[len-1];
               code = code + num_codes[len-1];
@@ -434,7 +863,7 @@ namespace octet { namespace loaders {
               if (debug) printf("h.maxcodes[%d] = %04x\n", len-1, h.maxcodes[len-1]);
             }
             h.maxcodes[16] = 0xffff;
-            
+
             if (debug) printf("DHT %d\n", index);
           }
         } break;
@@ -453,12 +882,19 @@ namespace octet { namespace loaders {
         case 0xda: {
           const uint8_t *src0 = src;
           length = u2(src + 2) + 2;
+          const uint8_t *header_max = src + length;
           src += 4;
           num_components_in_scan = *src++;
-          unsigned max_hsamp = 1;
-          unsigned max_vsamp = 1;
+          max_hsamp = 1;
+          max_vsamp = 1;
           num_mcu_blocks = 0;
-          const uint8_t *src_max = src + length;
+
+          // we need all the components in one scan.
+          if (num_components_in_scan != num_components) {
+            printf("warning: only interleaved scans are supported\n");
+            return 0;
+          }
+
           for (unsigned i = 0; i != num_components_in_scan; ++i) {
             scan_component &sc = scan_components[i];
             unsigned id = *src++;
@@ -471,108 +907,114 @@ namespace octet { namespace loaders {
             }
             if (comp >= num_components) return 0;
             component &c = components[comp];
-            max_hsamp = c.hsamp > max_hsamp ? c.hsamp : max_hsamp;
-            max_vsamp = c.vsamp > max_vsamp ? c.vsamp : max_vsamp;
             sc.comp = comp;
+
+            // a scan of one component has one block per MCU.
+            sc.hsamp = num_components_in_scan == 1 ? 1 : c.hsamp;
+            sc.vsamp = num_components_in_scan == 1 ? 1 : c.vsamp;
+            if (sc.hsamp == 0 || sc.hsamp > 4 || sc.vsamp == 0 || sc.vsamp > 4) return 0;
+            max_hsamp = sc.hsamp > max_hsamp ? sc.hsamp : max_hsamp;
+            max_vsamp = sc.vsamp > max_vsamp ? sc.vsamp : max_vsamp;
             if (debug) printf("SOS comp=%d ac=%d dc=%d\n", comp, sc.ac_table, sc.dc_table);
-            unsigned samps = c.hsamp * c.vsamp;
 
-            if (num_mcu_blocks + samps > sizeof(mcu_blocks)/sizeof(mcu_blocks[0])) {
+            if (num_mcu_blocks + sc.hsamp * sc.vsamp > max_mcu_blocks) {
               printf("too many mcu blocks\n");
               return 0;
             }
 
-            for (unsigned j = 0; j != samps; ++j) {
-              mcu_block &m = mcu_blocks[num_mcu_blocks++];
-              m.dc_table = &huffman_tables[0][sc.dc_table];
-              m.ac_table = &huffman_tables[1][sc.ac_table];
-              m.quant = &quant_tables[c.quantisation_table];
-              m.scan_comp = &sc;
+            for (unsigned y = 0; y != sc.vsamp; ++y) {
+              for (unsigned x = 0; x != sc.hsamp; ++x) {
+                mcu_block &m = mcu_blocks[num_mcu_blocks++];
+                m.dc_table = &huffman_tables[0][sc.dc_table];
+                m.ac_table = &huffman_tables[1][sc.ac_table];
+                m.quant = &quant_tables[c.quantisation_table];
+                m.comp = (uint8_t)i;
+                m.x = (uint8_t)x;
+                m.y = (uint8_t)y;
+              }
             }
-
-            sc.last_dc = 0;
           }
 
-          // at present, we only support YCrCb in 4:4:4
-          if (num_mcu_blocks != 1 && num_mcu_blocks != 3 && num_mcu_blocks != 6) {
-            printf("only 4:4:4 and 4:1:1 greyscale and ycrcb supported (%d mcu blocks)\n", num_mcu_blocks);
-            return 0;
+          // when we scale the image down, we make the chroma blocks bigger than the luma
+          // ones rather than throwing away detail and repeating samples.
+          for (unsigned i = 0; i != num_components_in_scan; ++i) {
+            scan_component &sc = scan_components[i];
+            if (max_hsamp % sc.hsamp || max_vsamp % sc.vsamp) {
+              printf("warning: unsupported sampling %dx%d\n", sc.hsamp, sc.vsamp);
+              return 0;
+            }
+            unsigned n = 8 >> log2_scale;
+            while (n < 8 && sc.hsamp * n * 2 <= max_hsamp * (8 >> log2_scale) && sc.vsamp * n * 2 <= max_vsamp * (8 >> log2_scale)) {
+              n *= 2;
+            }
+            sc.block_size = (uint8_t)n;
           }
 
           spectral_start = *src++;
           spectral_end = *src++;
           successive_high = src[0] >> 4;
           successive_low = *src++ & 0x0f;
-          if (src > src_max) return 0;
+          if (src > header_max) return 0;
 
-          for (unsigned i = 0; i != num_components_in_scan; ++i) {
-            scan_component &sc = scan_components[i];
-            component &c = components[sc.comp];
-            sc.width_in_blocks = width * c.hsamp / max_hsamp;
-            sc.height_in_blocks = height * c.hsamp / max_hsamp;
-          }
-
-          width = (width + max_hsamp * 8 - 1) & ~(max_hsamp * 8 - 1);
-          height = (height + max_vsamp * 8 - 1) & ~(max_vsamp * 8 - 1);
+          mcus_across = ( width + max_hsamp * 8 - 1 ) / (max_hsamp * 8);
+          mcus_down = ( height + max_vsamp * 8 - 1 ) / (max_vsamp * 8);
 
-          unsigned xmax = ( width + max_hsamp * 8 - 1 ) / (max_hsamp * 8);
-          unsigned ymax = ( height + max_vsamp * 8 - 1 ) / (max_vsamp * 8);
-
-          unsigned acc = 0;
-          int shift = 0;
-          skip_bits(16, acc, src, shift);
-          
-          int stride = width * 4;
+          // the image is a whole number of MCUs.
+          width = mcus_across * max_hsamp * (8 >> log2_scale);
+          height = mcus_down * max_vsamp * (8 >> log2_scale);
 
           unsigned size = width * height * 4;
           size_t base = image.size();
           image.resize(base + size);
           format = 0x1908; // GL_RGBA
 
-          uint8_t *image_base = image.data() + base;
+          image_base = image.data() + base;
 
-          for (unsigned y = 0; y != ymax; ++y) {
-            for (unsigned x = 0; x != xmax; ++x) {
-              float *coeffs = dct_coeffs;
-              memset(coeffs, 0, 64 * num_mcu_blocks * sizeof(float));
-              for (unsigned b = 0; b < num_mcu_blocks; ++b) {
-                decode_mcu_block(b, acc, src, shift, coeffs);
-                inverse_dct(coeffs);
-                coeffs += 64;
-              }
-              if (num_mcu_blocks == 1) {
-                // assume 4:4:4 Greyscale
-                color_convert_444_greyscale(&image_base[((height - 1 - y * 8) * stride) + (x * 8 * 4)], -stride, dct_coeffs);
-              } else if (num_mcu_blocks == 3) {
-                // assume 4:4:4 YCbCr
-                color_convert_444(&image_base[((height - 1 - y * 8) * stride) + (x * 8 * 4)], -stride, dct_coeffs);
-              } else if (num_mcu_blocks == 6) {
-                // assume 4:1:1 YCbCr
-                color_convert_411(&image_base[((height - 1 - y * 16) * stride) + (x * 16 * 4)], -stride, dct_coeffs);
-              }
-            }
+          const uint8_t *end = find_segments(src, src_max);
+
+          unsigned num_threads = max_threads ? max_threads : std::thread::hardware_concurrency();
+          unsigned max_useful = mcus_across * mcus_down / min_mcus_per_thread;
+          if (max_useful > segments.size()) max_useful = segments.size();
+          if (num_threads > max_useful) num_threads = max_useful;
+          if (debug) printf("%d segments %d threads\n", segments.size(), num_threads);
+
+          next_segment = 0;
+          dynarray<std::thread> threads;
+          for (unsigned i = 1; i < num_threads; ++i) {
+            threads.push_back(std::thread(&jpeg_decoder::decode_segments, this));
+          }
+          decode_segments();
+          for (unsigned i = 0; i != threads.size(); ++i) {
+            threads[i].join();
           }
-          skip_bits(shift, acc, src, shift);
-          length = (unsigned)(src - src0);
+
+          length = (unsigned)(end - src0);
         } break;
 
         // quantisation tables (the lossy bit)
         case 0xdb: {
           length = u2(src + 2) + 2;
-          const uint8_t *src_max = src + length;
+          const uint8_t *table_max = src + length;
           src += 4;
-          while (src < src_max) {
+          while (src < table_max) {
             unsigned prec = (src[0] >> 4) & 1;
             unsigned n = src[0] & 0x0f;
             src++;
             for (unsigned i = 0; i != 64; ++i) {
-              quant_tables[n&3].table[i] = (float)( prec ? u2(src) : *src );
+              quant_tables[n&3].table[i] = (uint16_t)( prec ? u2(src) : *src );
               src += prec + 1;
             }
             if (debug) printf("DQT %d %d\n", prec, n);
           }
         } break;
 
+        // restart interval
+        case 0xdd: {
+          length = u2(src + 2) + 2;
+          restart_interval = u2(src + 4);
+          if (debug) printf("DRI %d\n", restart_interval);
+        } break;
+
         // JFIF stubset of JPEG
         case 0xe0: {
           length = u2(src + 2) + 2;
@@ -588,6 +1030,23 @@ namespace octet { namespace loaders {
       return length;
     }
   public:
+    jpeg_decoder() {
+      restart_interval = 0;
+      log2_scale = 0;
+      max_threads = 0;
+    }
+
+    /// decode at 1/2, 1/4 or 1/8 of the size (log2_scale = 1, 2, 3).
+    /// 1/8 size only uses the DC terms and is very fast. Good for thumbnails and distant LODs.
+    void set_log2_scale(unsigned value) {
+      log2_scale = value < 3 ? value : 3;
+    }
+
+    /// the most threads to use for files with restart markers. Zero means one per core.
+    void set_max_threads(unsigned value) {
+      max_threads = value;
+    }
+
     // get an opengl texture from a file in memory
     void get_image(dynarray<uint8_t> &image, uint16_t &format, uint16_t &width_, uint16_t &height_, const uint8_t *src, const uint8_t *src_max) {
       while (src < src_max) {
@@ -595,7 +1054,7 @@ namespace octet { namespace loaders {
           printf("warning: bad JPEG file\n");
           return;
         }
-        unsigned length = decode_chunk(src, image, format);
+        unsigned length = decode_chunk(src, src_max, image, format);
         if (!length) {
           printf("warning: bad JPEG file @ chunk %02x\n", src[1]);
           return;
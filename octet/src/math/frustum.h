@@ -0,0 +1,94 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// View frustum: six half spaces bounding the visible volume of a camera
+//
+
+namespace octet { namespace math {
+  /// frustum: used for visibility culling.
+  /// A point is inside the frustum if it is inside all six half spaces.
+  class frustum {
+    enum { num_planes = 6 };
+
+    // left, right, bottom, top, near, far
+    half_space planes[num_planes];
+
+    // build a normalised half space from a row of plane coefficients (dot(p, xyz) + w >= 0)
+    static half_space make_half_space(vec4_in coeffs) {
+      float scale = coeffs.xyz().lengthRecip();
+      return half_space(coeffs.xyz() * scale, coeffs.w() * scale);
+    }
+  public:
+    /// Default frustum: the unit cube of projection space.
+    frustum() {
+      mat4t identity;
+      identity.loadIdentity();
+      init(identity);
+    }
+
+    /// Construct from a world to projection (or model to projection) matrix.
+    frustum(mat4t_in worldToProjection) {
+      init(worldToProjection);
+    }
+
+    /// Extract the six planes from a projection matrix (Gribb and Hartmann).
+    /// As our matrices are row major, the clip space coordinates are dot products with the columns.
+    /// The half spaces are in the space the matrix transforms from.
+    void init(mat4t_in worldToProjection) {
+      vec4 cx = worldToProjection.column(0);
+      vec4 cy = worldToProjection.column(1);
+      vec4 cz = worldToProjection.column(2);
+      vec4 cw = worldToProjection.column(3);
+      planes[0] = make_half_space(cw + cx); // -w <= x
+      planes[1] = make_half_space(cw - cx); // x <= w
+      planes[2] = make_half_space(cw + cy); // -w <= y
+      planes[3] = make_half_space(cw - cy); // y <= w
+      planes[4] = make_half_space(cw + cz); // -w <= z
+      planes[5] = make_half_space(cw - cz); // z <= w
+    }
+
+    /// Get one of the six bounding half spaces (left, right, bottom, top, near, far).
+    const half_space &get_plane(int i) const {
+      return planes[i];
+    }
+
+    /// Is point inside the frustum?
+    bool intersects(const vec3 &rhs) const {
+      for (int i = 0; i != num_planes; ++i) {
+        if (!planes[i].intersects(rhs)) return false;
+      }
+      return true;
+    }
+
+    /// Is aabb partly inside the frustum?
+    /// Note: this is conservative. Boxes near the corners may be accepted.
+    bool intersects(const aabb &rhs) const {
+      for (int i = 0; i != num_planes; ++i) {
+        if (!planes[i].intersects(rhs)) return false;
+      }
+      return true;
+    }
+
+    /// Is sphere partly inside the frustum?
+    bool intersects(const sphere &rhs) const {
+      for (int i = 0; i != num_planes; ++i) {
+        if (!planes[i].intersects(rhs)) return false;
+      }
+      return true;
+    }
+
+    const char *toString(char *dest, size_t len) const {
+      char tmp[num_planes][64];
+      snprintf(dest, len, "[%s, %s, %s, %s, %s, %s]",
+        planes[0].toString(tmp[0], sizeof(tmp[0])), planes[1].toString(tmp[1], sizeof(tmp[1])),
+        planes[2].toString(tmp[2], sizeof(tmp[2])), planes[3].toString(tmp[3], sizeof(tmp[3])),
+        planes[4].toString(tmp[4], sizeof(tmp[4])), planes[5].toString(tmp[5], sizeof(tmp[5]))
+      );
+      return dest;
+    }
+  };
+} }
+
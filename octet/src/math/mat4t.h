@@ -487,6 +487,31 @@ namespace octet { namespace math {
 		  }
     }
   
+    /// Split a transform into translation, rotation and scale.
+    /// Only exact for matrices without shear. A mirror is returned as a negative x scale.
+    void get_trs(vec4 &translate, quat &rotate, vec4 &scale) const {
+      translate = vec4(v[3].xyz(), 0);
+      scale = vec4(v[0].xyz().length(), v[1].xyz().length(), v[2].xyz().length(), 0);
+      if (cross(v[0].xyz(), v[1].xyz()).dot(v[2].xyz()) < 0) {
+        scale[0] = -scale[0];
+      }
+      mat4t r(1.0f);
+      for (int i = 0; i != 3; ++i) {
+        r.v[i] = vec4(v[i].xyz(), 0) * (scale[i] ? 1.0f / scale[i] : 0.0f);
+      }
+      rotate = r.toQuaternion();
+    }
+
+    /// Build a transform that scales, then rotates, then translates.
+    mat4t &init_trs(const vec4 &translate, const quat &rotate, const vec4 &scale) {
+      *this = mat4t(rotate);
+      v[0] = v[0] * scale[0];
+      v[1] = v[1] * scale[1];
+      v[2] = v[2] * scale[2];
+      v[3] = vec4(translate.xyz(), 1);
+      return *this;
+    }
+
     /// Convert to a string for debugging.
     const char *toString(char *dest, size_t len) const
     {
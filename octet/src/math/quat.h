@@ -18,6 +18,11 @@ namespace octet { namespace math {
     quat &operator*=(const quat &r) { *(vec4*)this = qmul(r); return *this; }
     quat conjugate() const { return qconj(); }
     vec4 rotate(const vec4 &r) const { return (*this * r) * conjugate(); }
+    /// normalised linear interpolation, taking the short way round.
+    quat nlerp(const quat &r, float t) const {
+      vec4 rr = dot(r) < 0 ? -r : (const vec4 &)r;
+      return quat(((vec4&)*this + (rr - *this) * t).normalize());
+    }
   };
 
 } }
@@ -22,9 +22,20 @@ namespace octet {
     attribute_blendindices = 7,
     attribute_texcoord = 8,
     attribute_uv = 8,
+    attribute_instance = 9,  // per-instance model to camera matrix: uses four slots (9-12)
     attribute_tangent = 14,
     attribute_bitangent = 15,
     attribute_binormal = 15,
+
+    // per-particle attributes for the particle shaders (see mesh_particle_system).
+    // There are only 16 locations, so these reuse the slots of standard attributes.
+    // shader::link binds them only for programs initialised with particles set.
+    attribute_particle_pos = 4,
+    attribute_particle_uv = 5,
+    attribute_particle_size = 6,
+    attribute_particle_tail = 6,      // trails only, billboards use this slot for the size
+    attribute_particle_tail_uv = 1,   // trails only
+    attribute_particle_axis = 13,
   };
 
   enum key {
@@ -112,6 +123,7 @@ namespace octet {
 
     void end_frame() {
       prev_keys = keys;
+      frame_allocator::reset();
     }
 
     virtual void draw_world(int x, int y, int w, int h) = 0;
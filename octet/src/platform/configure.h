@@ -31,11 +31,49 @@
   #pragma warning(disable : 4996)
 #endif
 
+// hardware instancing needs glDrawElementsInstanced and glVertexAttribDivisor (GL 3.3, ES3)
+#ifndef OCTET_INSTANCING
+  #if OCTET_MAC || OCTET_VITA
+    #define OCTET_INSTANCING 0
+  #else
+    #define OCTET_INSTANCING 1
+  #endif
+#endif
+
+// linked shader programs are saved with glGetProgramBinary (GL 4.1, ES3)
+#ifndef OCTET_PROGRAM_BINARY
+  #if OCTET_MAC || OCTET_VITA
+    #define OCTET_PROGRAM_BINARY 0
+  #else
+    #define OCTET_PROGRAM_BINARY 1
+  #endif
+#endif
+
 #if OCTET_MAC
   #define OCTET_SSE 1
   #define GL_UNIFORM_BUFFER 0
 #endif
 
+// SSE2 integer operations are available on every x86-64 target, even where OCTET_SSE is not set.
+#ifndef OCTET_SSE2
+  #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define OCTET_SSE2 1
+  #else
+    #define OCTET_SSE2 0
+  #endif
+#endif
+
+// set OCTET_VISITOR_TRACE to 1 to log every value read or written by the visitors.
+// This is very slow, so it is off by default.
+#ifndef OCTET_VISITOR_TRACE
+  #define OCTET_VISITOR_TRACE 0
+#endif
+
+// set OCTET_VOXEL_TRACE to 1 to log the blocks visited by the voxel collision tests.
+#ifndef OCTET_VOXEL_TRACE
+  #define OCTET_VOXEL_TRACE 0
+#endif
+
 // use <> to include from standard directories
 // use "" to include from our own project
 #include <stdio.h>
@@ -44,20 +82,45 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <math.h>
+#include <float.h>
 #include <assert.h>
 #include <string>
 #include <vector>
 #include <array>
 #include <deque>
+#include <unordered_map>
 #include <queue>
 #include <algorithm>
 #include <numeric>
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#if OCTET_SSE2
+  #include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+  #include <intrin.h>
+#endif
 
 #if defined(WIN32)
   #include <direct.h>
+  #include <sys/stat.h>
+#endif
+
+// memory mapped files (see file_map.h)
+#if defined(__unix__) || defined(__APPLE__)
+  #define OCTET_MMAP 1
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#else
+  #define OCTET_MMAP 0
 #endif
 
 namespace octet {
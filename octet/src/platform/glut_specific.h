@@ -152,8 +152,8 @@ namespace octet {
     static void timer(int value) {
       glutTimerFunc(16, timer, 1);
       map_t &m = map();
-      for (int i = 0; i != m.size(); ++i) {
-        if (m.get_key(i)) {
+      for (unsigned i = 0; i != m.capacity(); ++i) {
+        if (m.is_used(i)) {
           glutSetWindow(m.get_key(i));
           glutPostRedisplay();
         }
@@ -177,8 +177,8 @@ namespace octet {
 
     static void run_all_apps() {
       map_t &m = map();
-      for (int i = 0; i != m.size(); ++i) {
-        if (m.get_key(i)) {
+      for (unsigned i = 0; i != m.capacity(); ++i) {
+        if (m.is_used(i)) {
           glutSetWindow(m.get_key(i));
           glutDisplayFunc(display);
           glutReshapeFunc(reshape);
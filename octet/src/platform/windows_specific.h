@@ -84,7 +84,7 @@
 namespace octet {
   class HWND_cmp : public hash_map_cmp {
   public:
-    static unsigned get_hash(HWND key) { return fuzz_hash((unsigned)(intptr_t)key); }
+    static unsigned get_hash(HWND key) { return fuzz_hash64((uint64_t)(uintptr_t)key); }
 
     static bool is_empty(HWND key) { return !key; }
   };
@@ -341,9 +341,9 @@ namespace octet {
         // waste some time. (do not do this in real games!)
         Sleep(1000/30);
 
-        for (int i = 0; i != m.size(); ++i) {
+        for (unsigned i = 0; i != m.capacity(); ++i) {
           // note: because Win8 generates an invisible window, we need to check m.value(i)
-          if (m.get_key(i) && m.get_value(i)) {
+          if (m.is_used(i) && m.get_value(i)) {
             m.get_value(i)->render();
           }
         }
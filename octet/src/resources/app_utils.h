@@ -85,6 +85,56 @@ namespace octet { namespace resources {
       return path;
     }
 
+    /// Get the bytes of a URL without copying them if possible.
+    ///
+    /// Plain files are memory mapped and stored files in zip archives point into the mapped archive.
+    /// Compressed zip files are inflated into a buffer owned by the view.
+    /// Returns false if the URL could not be read.
+    static bool get_url_view(file_view &view, const char *url) {
+      view.reset();
+      if (!strncmp(url, "zip://", 6)) {
+        const char *zip = strstr(url + 6, ".zip");
+        if (zip) {
+          int path_len = (int)(zip - (url + 6) + 4);
+          string zip_url;
+          zip_url.set(url + 6, path_len);
+          const char *file = (url + 6) + path_len;
+          file += file[0] == '/';
+          zip_file *zip = get_zip_file(zip_url.c_str());
+          if (!zip) {
+            // view was reset above, so it is left empty.
+            return false;
+          }
+          const uint8_t *data = 0;
+          unsigned size = 0;
+          dynarray<uint8_t> buffer;
+          if (!zip->get_file_data(data, size, buffer, file)) {
+            return false;
+          }
+          if (buffer.size()) {
+            view.own(buffer);
+          } else {
+            view.borrow(data, size, zip);
+          }
+          return true;
+        }
+      } else if (!strncmp(url, "http://", 7)) {
+        // http
+      } else {
+        const char *path = get_path(url);
+        file_map *map = new file_map(path, file_map::advice_sequential);
+        if (map->get_error()) {
+          char tmp[1024];
+          printf("file %s not found. cwd=%s\n", path, getcwd(tmp, sizeof(tmp)));
+          delete map;
+          return false;
+        }
+        view.own(map);
+        return true;
+      }
+      return false;
+    }
+
     /// Get a file into a buffer, given a URL.
     static void get_url(dynarray<unsigned char> &buffer, const char *url) {
       if (!strncmp(url, "zip://", 6)) {
@@ -210,34 +260,74 @@ namespace octet { namespace resources {
     }
 
     /// Get the system atom dictionary. Atoms are unique names with an integer representation.
+    ///
+    /// All the keys are interned strings, so the names of atoms can be found without a search.
     static dictionary<atom_t> *get_atom_dict() {
       static dictionary<atom_t> *dict;
-      if (!dict) dict = new dictionary<atom_t>();
+      if (!dict) {
+        dict = new dictionary<atom_t>();
+        for (unsigned i = 1; predefined_atom(i); ++i) {
+          (*dict)[interned_string(predefined_atom(i))] = (atom_t)i;
+        }
+      }
       return dict;
     }
 
+    /// Names of atoms that are not predefined, indexed by atom - first user atom.
+    static dynarray<const char *> &get_user_atom_names() {
+      static dynarray<const char *> names;
+      return names;
+    }
+
+    /// The first atom that is not predefined.
+    static unsigned get_first_user_atom() {
+      static unsigned first_user_atom = 0;
+      if (first_user_atom == 0) {
+        for (first_user_atom = 1; predefined_atom(first_user_atom); ++first_user_atom) {
+        }
+      }
+      return first_user_atom;
+    }
+
+    /// Find the atom for a string without adding one. Returns atom_ if there is none.
+    /// Nothing is interned, so this is safe to use with arbitrary text.
+    static atom_t find_atom(const char *name) {
+      if (name == 0 || name[0] == 0) {
+        return atom_;
+      }
+      dictionary<atom_t> *dict = get_atom_dict();
+      int index = dict->get_index(name);
+      return index != -1 ? dict->get_value(index) : atom_;
+    }
+
     /// Get a unique int for a string (atom). Atoms are unique names with an integer representation.
     /// These values are much cheaper to work with than strings.
+    /// The name is only interned if it is a new atom.
     static atom_t get_atom(const char *name) {
-      // the null name is 0
-      if (name == 0 || name[0] == 0) {
+      atom_t atom = find_atom(name);
+      if (atom != atom_ || name == 0 || name[0] == 0) {
+        return atom;
+      }
+      return get_atom(interned_string(name));
+    }
+
+    /// Get the atom for an interned string. This is a single hash probe.
+    static atom_t get_atom(const interned_string &name) {
+      if (name.empty()) {
         return atom_;
       }
 
       dictionary<atom_t> *dict = get_atom_dict();
-
-      static int num_atoms = 0;
-      if (num_atoms == 0) {
-        for (++num_atoms; predefined_atom(num_atoms); num_atoms++) {
-          (*dict)[predefined_atom(num_atoms)] = (atom_t)num_atoms;
-        }
-      }
-      if (dict->contains(name)) {
-        //log("old atom %s %d\n", name, (*dict)[name]);
-        return (*dict)[name];
+      int index = dict->get_index(name);
+      if (index != -1) {
+        //log("old atom %s %d\n", name.c_str(), dict->get_value(index));
+        return dict->get_value(index);
       } else {
-        //log("new atom %s %d\n", name, num_atoms);
-        return (*dict)[name] = (atom_t)num_atoms++;
+        dynarray<const char *> &names = get_user_atom_names();
+        atom_t atom = (atom_t)(get_first_user_atom() + names.size());
+        //log("new atom %s %d\n", name.c_str(), atom);
+        names.push_back(name.c_str());
+        return (*dict)[name] = atom;
       }
     }
 
@@ -274,15 +364,10 @@ namespace octet { namespace resources {
       const char *name = predefined_atom((unsigned)atom);
       if (name) return name;
 
-      // slow!
-      dictionary<atom_t> *dict = get_atom_dict();
-      unsigned num_indices = dict->get_num_indices();
-      for (unsigned i = 0; i != num_indices; ++i) {
-        if (dict->get_value(i) == atom) {
-          return dict->get_key(i);
-        }
-      }
-      return "???";
+      // user atoms follow the predefined ones.
+      dynarray<const char *> &names = get_user_atom_names();
+      unsigned index = (unsigned)atom - get_first_user_atom();
+      return index < names.size() ? names[index] : "???";
     }
   };
 } }
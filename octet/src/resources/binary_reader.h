@@ -11,15 +11,62 @@ namespace octet { namespace resources {
   /// The binary reader is a visitor that is used to load a binary file.
   /// The binary reader will use a factory to create new classes, providied the class is in classes.h
   class binary_reader : public visitor {
-    enum { debug = true };
+    enum { debug = OCTET_VISITOR_TRACE };
+    enum { buffer_size = 0x10000 };
     hash_map<void *, int> refs;
     dynarray<void *> id_to_ref;
+
+    // bytes are read from [cur, end). A file reader refills the buffer
+    // when it runs out. A memory reader reads the caller's bytes in place.
+    const uint8_t *cur;
+    const uint8_t *end;
     FILE *file;
-    char tmp[256];
+    dynarray<uint8_t> buffer;
+    dynarray<char> tmp;
+
+    bool refill() {
+      if (!file) return false;
+      size_t bytes = fread(buffer.data(), 1, buffer_size, file);
+      cur = buffer.data();
+      end = cur + bytes;
+      return bytes != 0;
+    }
+
+    // slow path for read(): the request runs past the end of the buffer.
+    void read_slow(uint8_t *dest, size_t bytes) {
+      while (bytes) {
+        if (cur == end) {
+          if (file && bytes >= buffer_size) {
+            // bulk path: big blocks go straight from the file to their destination.
+            size_t got = fread(dest, 1, bytes, file);
+            dest += got;
+            bytes -= got;
+            if (!bytes) break;
+          }
+          if (!refill()) {
+            if (debug) log("error: unexpected end of file\n");
+            memset(dest, 0, bytes);
+            set_error(true);
+            return;
+          }
+        }
+        size_t avail = end - cur;
+        size_t chunk = bytes < avail ? bytes : avail;
+        memcpy(dest, cur, chunk);
+        cur += chunk;
+        dest += chunk;
+        bytes -= chunk;
+      }
+    }
 
-    void read(uint8_t *src, size_t bytes) {
+    void read(uint8_t *dest, size_t bytes) {
       //if (debug) log("read %08x bytes\n", bytes);
-      fread(src, 1, bytes, file);
+      if ((size_t)(end - cur) >= bytes) {
+        memcpy(dest, cur, bytes);
+        cur += bytes;
+      } else {
+        read_slow(dest, bytes);
+      }
     }
 
     int read_int() {
@@ -38,22 +85,44 @@ namespace octet { namespace resources {
       return (atom_t)value;
     }
 
+    const uint8_t *find_zero() const {
+      return cur != end ? (const uint8_t*)memchr(cur, 0, end - cur) : NULL;
+    }
+
+    // strings in a memory block are used in place.
+    // strings in a file are copied as the buffer may be refilled.
     const char *read_string() {
-      int nchars = 0;
-      for(;;) {
-        int c = fgetc(file);
-        tmp[nchars] = c;
-        if (c == 0) break;
-        nchars += nchars != sizeof(tmp)-1;
+      const uint8_t *zero = find_zero();
+      if (zero && !file) {
+        const char *result = (const char*)cur;
+        cur = zero + 1;
+        if (debug) log("%*sread %s\n", get_depth()*2, "", result);
+        return result;
+      }
+
+      tmp.resize(0);
+      for (;;) {
+        zero = find_zero();
+        const uint8_t *stop = zero ? zero + 1 : end;
+        size_t pos = tmp.size();
+        tmp.resize(pos + (stop - cur));
+        memcpy(tmp.data() + pos, cur, stop - cur);
+        cur = stop;
+        if (zero) break;
+        if (!refill()) {
+          set_error(true);
+          tmp.push_back(0);
+          break;
+        }
       }
-      if (debug) log("%*sread %s\n", get_depth()*2, "", tmp);
-      return tmp;
+      if (debug) log("%*sread %s\n", get_depth()*2, "", tmp.data());
+      return tmp.data();
     }
 
     bool check_atom(atom_t sid) {
       if (!get_error()) {
         atom_t test = read_atom();
-        log("%*scheck_atom %s\n", get_depth()*2, "", app_utils::get_atom_name(sid));
+        if (debug) log("%*scheck_atom %s\n", get_depth()*2, "", app_utils::get_atom_name(sid));
         if (test != sid) {
           log("error: expected %s\n", app_utils::get_atom_name(sid));
           set_error(true);
@@ -65,7 +134,7 @@ namespace octet { namespace resources {
     bool check_size(size_t size) {
       if (!get_error()) {
         int test = read_int();
-        log("%*scheck_size %d\n", get_depth()*2, "", size);
+        if (debug) log("%*scheck_size %d\n", get_depth()*2, "", size);
         if (test != (int)size) {
           log("error: expected %d bytes\n", size);
           set_error(true);
@@ -75,7 +144,7 @@ namespace octet { namespace resources {
     }
 
     void *get_ref(int id) {
-      log("%*sget_ref %d/%d\n", get_depth()*2, "", id, id_to_ref.size());
+      if (debug) log("%*sget_ref %d/%d\n", get_depth()*2, "", id, id_to_ref.size());
       if (id == (int)id_to_ref.size()) {
         return NULL;
       } else if (id > (int)id_to_ref.size()) {
@@ -87,21 +156,40 @@ namespace octet { namespace resources {
       }
     }
 
-  public:
-    /// Construct a binary reader for a file.
-    binary_reader(FILE *file) {
+    void init(const uint8_t *data, size_t size, FILE *file) {
       if (debug) log("binary_reader\n");
       id_to_ref.reserve(256);
       id_to_ref.push_back(NULL);
 
       this->file = file;
-      char tmp[8];
-      fread(tmp, 1, sizeof(tmp), file);
-      if (memcmp(tmp, "octet", 5)) {
+      cur = data;
+      end = data + size;
+
+      uint8_t header[8];
+      read(header, sizeof(header));
+      if (get_error() || memcmp(header, "octet", 5)) {
         set_error(true);
       }
     }
 
+  public:
+    /// Construct a binary reader for a file.
+    /// The file is read in large chunks.
+    binary_reader(FILE *file) {
+      buffer.resize(buffer_size);
+      init(buffer.data(), 0, file);
+    }
+
+    /// Construct a binary reader for a block of memory, such as a mapped file.
+    /// The bytes must stay alive until the reader is destroyed.
+    ///
+    ///     file_view view;
+    ///     app_utils::get_url_view(view, "save.bin");
+    ///     binary_reader reader(view.data(), view.size());
+    binary_reader(const uint8_t *data, size_t size) {
+      init(data, size, NULL);
+    }
+
     /// Destroy the reader
     ~binary_reader() {
     }
@@ -176,12 +264,18 @@ namespace octet { namespace resources {
     /// Begin reading a dynarray
     unsigned begin_read_dynarray(unsigned elem_size, atom_t &sid) {
       if (!check_atom(atom_dynarray) && !check_atom(sid)) {
-        return (unsigned)read_int() / elem_size;
+        unsigned bytes = (unsigned)read_int();
+        if (!file && bytes > (size_t)(end - cur)) {
+          log("error: dynarray larger than file\n");
+          set_error(true);
+          return 0;
+        }
+        return bytes / elem_size;
       }
       return 0;
     }
 
-    /// finish reading a dynarray
+    /// finish reading a dynarray. The elements are copied as one block.
     void end_read_dynarray(void *ptr, unsigned bytes) {
       read((uint8_t*)ptr, bytes);
     }
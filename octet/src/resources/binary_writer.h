@@ -11,14 +11,47 @@ namespace octet { namespace resources {
   /// The binary writer is a visitor that writes binary files.
   /// Use this to save game worlds or to do game saves.
   class binary_writer : public visitor {
-    enum { debug = true };
+    enum { debug = OCTET_VISITOR_TRACE };
+    enum { buffer_size = 0x10000 };
     hash_map<void *, int> refs;
     int next_id;
+
+    // bytes are written to [cur, end). When the space runs out, a file writer
+    // flushes the buffer and a memory writer grows the destination.
+    uint8_t *cur;
+    uint8_t *end;
     FILE *file;
+    dynarray<uint8_t> *dest;
+    dynarray<uint8_t> buffer;
+
+    // slow path for write(): the bytes do not fit in the buffer.
+    void write_slow(const uint8_t *src, size_t bytes) {
+      if (file) {
+        flush();
+        if (bytes >= buffer_size) {
+          // bulk path: big blocks go straight to the file.
+          fwrite(src, 1, bytes, file);
+          return;
+        }
+      } else {
+        size_t used = cur - dest->data();
+        size_t new_size = used * 2 > used + bytes ? used * 2 : used + bytes;
+        dest->resize(new_size);
+        cur = dest->data() + used;
+        end = dest->data() + dest->size();
+      }
+      memcpy(cur, src, bytes);
+      cur += bytes;
+    }
 
     void write(const uint8_t *src, size_t bytes) {
       //if (debug) log("%*swrite %08x bytes\n", get_depth()*2, "", bytes);
-      fwrite(src, 1, bytes, file);
+      if ((size_t)(end - cur) >= bytes) {
+        memcpy(cur, src, bytes);
+        cur += bytes;
+      } else {
+        write_slow(src, bytes);
+      }
     }
 
     void write_int(int value) {
@@ -38,18 +71,48 @@ namespace octet { namespace resources {
       write((const uint8_t*)value, (int)strlen(value)+1);
     }
 
-  public:
-    /// Construct a binary writer from a file
-    binary_writer(FILE *file) {
+    void init() {
       if (debug) log("%*sbinary_writer\n", get_depth()*2, "");
       next_id = 1;
+      write((const uint8_t*)"octet\r\n\x1a", 8);
+    }
+
+  public:
+    /// Construct a binary writer from a file.
+    /// Output is buffered, call flush() or destroy the writer to finish the file.
+    binary_writer(FILE *file) {
       this->file = file;
+      dest = NULL;
+      buffer.resize(buffer_size);
+      cur = buffer.data();
+      end = cur + buffer_size;
+      init();
+    }
 
-      fwrite("octet\r\n\x1a", 1, 8, file);
+    /// Construct a binary writer that appends to a block of memory.
+    /// Call flush() or destroy the writer before using the bytes.
+    binary_writer(dynarray<uint8_t> &dest) {
+      file = NULL;
+      this->dest = &dest;
+      cur = end = dest.data() + dest.size();
+      init();
     }
 
     /// Destroy the writer
     ~binary_writer() {
+      flush();
+    }
+
+    /// Write any buffered bytes to the file, or trim the memory block to the bytes written.
+    void flush() {
+      if (file) {
+        fwrite(buffer.data(), 1, cur - buffer.data(), file);
+        cur = buffer.data();
+      } else {
+        size_t used = cur - dest->data();
+        dest->resize(used);
+        cur = end = dest->data() + used;
+      }
     }
 
     /// Write a dictionary entry.
@@ -153,7 +216,8 @@ namespace octet { namespace resources {
       //write_atom(atom_end_refs);
     }
 
-    /// Write an opaque binary object
+    /// Write an opaque binary object.
+    /// POD dynarrays come through here as one block.
     void visit_bin(void *value, size_t size, atom_t sid, atom_t type) {
       write_atom(type);
       write_atom(sid);
@@ -6,75 +6,192 @@
 //
 // map a file to memory
 
-class file_map {
-  #ifdef WIN32
-    HANDLE file_handle;
-    HANDLE mapping_handle;
-  #else
-    int file_handle;
-  #endif
-  uint64_t size;
-  const uint8_t *data;
-  const char *error;
-public:
-  file_map(const char *file_name) {
-    error = 0;
-    data = 0;
-    size = 0;
-
-    if (file_name == NULL) {
-      error = "no file name";
-      return;
-    }
+namespace octet { namespace resources {
+  /// Read-only view of a whole file in memory.
+  ///
+  /// On Windows and POSIX systems the file is memory mapped, so pages are read
+  /// from disk on demand and no heap memory is used. On other systems the file is read
+  /// into a buffer.
+  ///
+  ///     file_map map("assets/big.zip");
+  ///     if (!map.get_error()) decode(map.get_data(), map.get_data() + map.get_size());
+  class file_map {
+  public:
+    /// How the file will be accessed. Used as a hint to the virtual memory system.
+    enum advice {
+      advice_normal,
+      advice_sequential,  // read from start to end: read ahead aggressively
+      advice_random,      // read in no particular order: don't read ahead
+      advice_will_need,   // start reading the pages now
+    };
 
+  private:
     #ifdef WIN32
-      mapping_handle = INVALID_HANDLE_VALUE;
+      HANDLE file_handle;
+      HANDLE mapping_handle;
+    #elif OCTET_MMAP
+      int file_handle;
+    #endif
+    uint64_t size;
+    const uint8_t *data;
+    const char *error;
+    bool mapped;
 
-      file_handle = CreateFileA(
-        file_name, GENERIC_READ, FILE_SHARE_READ, 0,
-        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0
-      );
+    // no copying
+    file_map(const file_map &rhs);
+    void operator=(const file_map &rhs);
 
-      if (file_handle == INVALID_HANDLE_VALUE) {
+    // read the file into memory on systems that can't map files
+    void read_file(const char *file_name) {
+      FILE *file = fopen(file_name, "rb");
+      if (!file) {
         error = "could not open file";
         return;
       }
+      fseek(file, 0, SEEK_END);
+      size = (uint64_t)ftell(file);
+      fseek(file, 0, SEEK_SET);
+      uint8_t *bytes = (uint8_t*)allocator::malloc((size_t)size + 1);
+      size = fread(bytes, 1, (size_t)size, file);
+      bytes[size] = 0;
+      fclose(file);
+      data = bytes;
+    }
+
+  public:
+    /// Map a file into memory. Check get_error() for failure.
+    file_map(const char *file_name, advice hint = advice_sequential) {
+      error = 0;
+      data = 0;
+      size = 0;
+      mapped = false;
 
-      DWORD sizehi = 0, sizelo = GetFileSize(file_handle, &sizehi);
-      size = ((uint64_t)sizehi << 32) | sizelo;
-      mapping_handle = CreateFileMappingA(file_handle, 0, PAGE_READONLY, 0, 0, 0);
+      #ifdef WIN32
+        file_handle = INVALID_HANDLE_VALUE;
+        mapping_handle = NULL;
+      #elif OCTET_MMAP
+        file_handle = -1;
+      #endif
 
-      if (mapping_handle == INVALID_HANDLE_VALUE) {
-        error = "could not map file";
+      if (file_name == NULL) {
+        error = "no file name";
         return;
       }
 
-      data = (const uint8_t *)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
-    #else
-      //file_handle = open(file_name, O_RDONLY);
-      //mmap
-    #endif
-  }
+      #ifdef WIN32
+        file_handle = CreateFileA(
+          file_name, GENERIC_READ, FILE_SHARE_READ, 0,
+          OPEN_EXISTING, hint == advice_random ? FILE_FLAG_RANDOM_ACCESS : FILE_FLAG_SEQUENTIAL_SCAN, 0
+        );
 
-  ~file_map() {
-    #ifdef WIN32
-      UnmapViewOfFile(data);
-      CloseHandle(file_handle);
-      CloseHandle(mapping_handle);
-    #else
-    #endif
-  }
+        if (file_handle == INVALID_HANDLE_VALUE) {
+          error = "could not open file";
+          return;
+        }
 
-  const char *get_error() const {
-    return error;
-  }
+        DWORD sizehi = 0, sizelo = GetFileSize(file_handle, &sizehi);
+        size = ((uint64_t)sizehi << 32) | sizelo;
 
-  const uint8_t *get_data() const {
-    return data;
-  }
+        // empty files can't be mapped, but they are not an error.
+        if (size == 0) return;
 
-  uint64_t get_size() const {
-    return size;
-  }
-};
+        mapping_handle = CreateFileMappingA(file_handle, 0, PAGE_READONLY, 0, 0, 0);
+
+        if (mapping_handle == NULL) {
+          error = "could not map file";
+          return;
+        }
+
+        data = (const uint8_t *)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+        if (!data) {
+          error = "could not map file";
+          return;
+        }
+        mapped = true;
+      #elif OCTET_MMAP
+        file_handle = open(file_name, O_RDONLY);
+        if (file_handle < 0) {
+          error = "could not open file";
+          return;
+        }
+
+        struct stat st;
+        if (fstat(file_handle, &st) != 0) {
+          error = "could not get file size";
+          return;
+        }
+        size = (uint64_t)st.st_size;
+
+        // empty files can't be mapped, but they are not an error.
+        if (size == 0) return;
+
+        void *addr = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, file_handle, 0);
+        if (addr == MAP_FAILED) {
+          error = "could not map file";
+          return;
+        }
+        data = (const uint8_t *)addr;
+        mapped = true;
+
+        // the mapping keeps the file open.
+        close(file_handle);
+        file_handle = -1;
+
+        advise(hint);
+      #else
+        read_file(file_name);
+      #endif
+    }
 
+    /// Unmap the file.
+    ~file_map() {
+      #ifdef WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping_handle != NULL) CloseHandle(mapping_handle);
+        if (file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+      #elif OCTET_MMAP
+        if (data) munmap((void*)data, (size_t)size);
+        if (file_handle >= 0) close(file_handle);
+      #else
+        if (data) allocator::free((void*)data, (size_t)size + 1);
+      #endif
+    }
+
+    /// Tell the virtual memory system how we are going to read part of the file.
+    /// Does nothing where madvise is not available.
+    void advise(advice hint, uint64_t offset = 0, uint64_t length = ~(uint64_t)0) {
+      #if OCTET_MMAP
+        if (!mapped || offset >= size) return;
+        if (length > size - offset) length = size - offset;
+
+        // madvise needs a page aligned address.
+        uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+        uint64_t start = offset & ~(page_size - 1);
+        length += offset - start;
+
+        static const int hints[] = { MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED };
+        madvise((void*)(data + start), (size_t)length, hints[hint]);
+      #endif
+    }
+
+    /// Return NULL if the file was mapped, or some text describing the error.
+    const char *get_error() const {
+      return error;
+    }
+
+    /// Get the first byte of the file. This is NULL for an empty file.
+    const uint8_t *get_data() const {
+      return data;
+    }
+
+    /// Get the size of the file in bytes.
+    uint64_t get_size() const {
+      return size;
+    }
+
+    /// Return true if the file is memory mapped rather than copied to the heap.
+    bool is_mapped() const {
+      return mapped;
+    }
+  };
+} }
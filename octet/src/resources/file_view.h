@@ -0,0 +1,99 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// read-only bytes of a file without copying
+//
+
+namespace octet { namespace resources {
+  /// A borrowed (data, size) view of the contents of a URL.
+  ///
+  /// The bytes may be a memory mapped file, part of a mapped zip file or a decoded buffer.
+  /// Decoders that take (src, src_max) can use the bytes in place with no heap copy.
+  /// The view keeps whatever owns the bytes alive until it is destroyed.
+  ///
+  ///     file_view view;
+  ///     app_utils::get_url_view(view, "assets/duck.gif");
+  ///     dec.get_image(bytes, format, width, height, view.data(), view.data() + view.size());
+  ///
+  /// Note: the bytes are not zero terminated, use get_url() for text that needs a terminator.
+  class file_view {
+    file_map *map;
+    ref<zip_file> zip;
+    dynarray<uint8_t> buffer;
+    const uint8_t *data_;
+    size_t size_;
+
+    // no copying
+    file_view(const file_view &rhs);
+    void operator=(const file_view &rhs);
+  public:
+    /// Make an empty view.
+    file_view() {
+      map = 0;
+      data_ = 0;
+      size_ = 0;
+    }
+
+    /// Release the bytes.
+    ~file_view() {
+      reset();
+    }
+
+    /// Release the bytes and make the view empty.
+    void reset() {
+      delete map;
+      map = 0;
+      zip = 0;
+      buffer.reset();
+      data_ = 0;
+      size_ = 0;
+    }
+
+    /// Take ownership of a file mapping.
+    void own(file_map *new_map) {
+      reset();
+      map = new_map;
+      data_ = map->get_data();
+      size_ = (size_t)map->get_size();
+    }
+
+    /// Take the contents of a buffer (no copy).
+    void own(dynarray<uint8_t> &new_buffer) {
+      reset();
+      buffer = std::move(new_buffer);
+      data_ = buffer.data();
+      size_ = buffer.size();
+    }
+
+    /// Use bytes that belong to a zip file, keeping the zip file alive.
+    void borrow(const uint8_t *data, size_t size, zip_file *owner) {
+      reset();
+      zip = owner;
+      data_ = data;
+      size_ = size;
+    }
+
+    /// First byte of the view.
+    const uint8_t *data() const {
+      return data_;
+    }
+
+    /// Number of bytes in the view.
+    size_t size() const {
+      return size_;
+    }
+
+    /// Return true if there are no bytes.
+    bool empty() const {
+      return size_ == 0;
+    }
+
+    /// Return true if the bytes were not copied to the heap.
+    bool is_zero_copy() const {
+      return size_ != 0 && buffer.size() == 0;
+    }
+  };
+} }
@@ -214,6 +214,15 @@ namespace octet { namespace resources {
       #endif
     }
 
+    /// discard the contents of a streaming buffer before refilling it.
+    /// this lets the driver hand us fresh memory instead of waiting for the GPU.
+    void orphan(GLuint kind = GL_STREAM_DRAW) {
+      #ifndef OCTET_GLES2
+        glBindBuffer(target, buffer);
+        glBufferData(target, size, NULL, kind);
+      #endif
+    }
+
     /// bind the resource to the target
     void bind() const {
       glBindBuffer(target, buffer);
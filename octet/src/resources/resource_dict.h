@@ -83,6 +83,11 @@ namespace octet { namespace resources {
       return dict.contains(name);
     }
 
+    /// does the dictionary have this resource? (fast version for interned names)
+    bool has_resource(const interned_string &name) {
+      return dict.contains(name);
+    }
+
     /// Get a generic resource by name
     /// Note: you can get a specific type using get_<typename>
     /// For example, scene_node *node = dict.get_scene_node("name");
@@ -99,6 +104,12 @@ namespace octet { namespace resources {
       }
     }
 
+    /// Get a generic resource by interned name. This is a single hash probe.
+    resource *get_resource(const interned_string &name) {
+      int index = dict.get_index(name);
+      return index == -1 ? NULL : (resource*)dict.get_value(index);
+    }
+
     /// As this dict represents a game world, what is the active scene?
     scene::visual_scene *get_active_scene() const {
       return active_scene;
@@ -109,8 +120,16 @@ namespace octet { namespace resources {
       active_scene = value;
     }
 
+    /// Add a resource by name. The name is interned so that interned lookups only compare pointers.
     void set_resource(const char *name, resource *value) {
       if (name && name[0]) {
+        dict[interned_string(name)] = value;
+      }
+    }
+
+    /// Add a resource with an interned name. The dictionary shares the name with the string table.
+    void set_resource(const interned_string &name, resource *value) {
+      if (!name.empty()) {
         dict[name] = value;
       }
     }
@@ -133,7 +152,9 @@ namespace octet { namespace resources {
       return result;
     }
 
-    #define OCTET_CLASS(N, X) N::X *get_##X(const char *id) { resource *res = get_resource(id); return res ? res->get_##X() : 0; }
+    #define OCTET_CLASS(N, X) \
+      N::X *get_##X(const char *id) { resource *res = get_resource(id); return res ? res->get_##X() : 0; } \
+      N::X *get_##X(const interned_string &id) { resource *res = get_resource(id); return res ? res->get_##X() : 0; }
     //#pragma message("resource_dict.h")
     #include "classes.h"
     #undef OCTET_CLASS
@@ -164,7 +185,7 @@ namespace octet { namespace resources {
           for (char *p = c_name.data(); *p; ++p) {
             if (*p == '-' || *p == '+') *p = '_';
           }
-          fprintf(log, "    %s *%s = dict.get_%s(\"%s\");\n", type, c_name.c_str(), type, key);
+          fprintf(log, "    %s *%s = dict.get_%s(interned_string(\"%s\"));\n", type, c_name.c_str(), type, key);
         }
       }
       fflush(log);
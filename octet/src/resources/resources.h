@@ -19,6 +19,7 @@
   // resources
   #include "../resources/file_map.h"
   #include "../resources/zip_file.h"
+  #include "../resources/file_view.h"
   #include "../resources/app_utils.h"
   #include "../resources/visitor.h"
   #include "../resources/binary_writer.h"
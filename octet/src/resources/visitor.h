@@ -20,7 +20,7 @@ namespace octet { namespace resources {
   /// A visitor pattern can be used to solve a number of problems and provides
   /// "Metadata" for the classes.
   class visitor {
-    enum { debug = true };
+    enum { debug = OCTET_VISITOR_TRACE };
     unsigned depth;
     bool error;
 
@@ -281,7 +281,7 @@ namespace octet { namespace resources {
                 set_error(true);
                 return;
               }
-              value[key] = val;
+              value[interned_string(key)] = val;
               add_new_ref((void*)val);
               begin_visit(type_name);
               val->visit(*this);
@@ -289,7 +289,7 @@ namespace octet { namespace resources {
               end_visit(type_name);
               end_ref();
             } else {
-              value[key] = (type*)ref;
+              value[interned_string(key)] = (type*)ref;
             }
           }
         } else {
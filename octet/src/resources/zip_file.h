@@ -9,9 +9,12 @@ namespace octet { namespace resources {
   /// Zip file reader, uses zip_decoder to inflate compressed files.
   /// Zip files are smaller and faster than regular files.
   /// They make updates easier and work will over the internet.
+  ///
+  /// The zip file is memory mapped. Stored (uncompressed) files can be used
+  /// in place with get_view() and compressed files are inflated straight from the mapping.
   class zip_file {
     int ref_cnt;
-    FILE *the_file;
+    file_map map;
 
     struct dir_entry {
       uint32_t offset;
@@ -41,30 +44,48 @@ namespace octet { namespace resources {
       return (int16_t)(src[0] + src[1] * 256);
     }
 
+    // find the start of the data for a directory entry, or NULL if it is bad.
+    const uint8_t *get_entry_data(const dir_entry &d) {
+      const uint8_t *base = map.get_data();
+      uint64_t size = map.get_size();
+      /*local file header signature     4 bytes  (0x04034b50) 0
+      version needed to extract       2 bytes 4
+      general purpose bit flag        2 bytes 6
+      compression method              2 bytes 8
+      last mod file time              2 bytes 10
+      last mod file date              2 bytes 12
+      crc-32                          4 bytes 14
+      compressed size                 4 bytes 18
+      uncompressed size               4 bytes 22
+      file name length                2 bytes 26
+      extra field length              2 bytes 28 / 30*/
+      if ((uint64_t)d.offset + 30 > size) return NULL;
+      const uint8_t *header = base + d.offset;
+      if (u4(header) != 0x04034b50) return NULL;
+      uint64_t start = (uint64_t)d.offset + 30 + u2(header + 26) + u2(header + 28);
+      if (start + d.csize > size) return NULL;
+      return base + start;
+    }
+
   public:
     /// Open a zip file for reading
-    zip_file(const char *filename) {
+    zip_file(const char *filename) : map(filename, file_map::advice_random) {
       ref_cnt = 0;
-      the_file = fopen(filename, "rb");
-      if (!the_file) {
+      if (map.get_error()) {
         printf("file %s not found\n", filename);
       } else {
-        uint8_t tmp[256];
-        unsigned tmp_size = (unsigned)sizeof(tmp);
-        fseek(the_file, 0, SEEK_END);
-        long file_size = ftell(the_file);
-        long search_offset = file_size - (long)tmp_size;
-        search_offset = search_offset < 0 ? 0 : search_offset;
-        fseek(the_file, search_offset, SEEK_SET);
-        fread(&tmp, 1, tmp_size, the_file);
-        for( unsigned i = 0; i != tmp_size; ++i) {
-          if (u4(tmp + i) == 0x06054b50) {
-            dynarray<uint8_t> dir;
-            dir.resize(u4(tmp + i + 12));
-            fseek(the_file, (long)u4(tmp + i + 16), SEEK_SET);
-            fread(&dir[0], 1, dir.size(), the_file);
-            for (unsigned i = 0; i + 4 < dir.size();) {
-              uint8_t *p = &dir[i];
+        const uint8_t *file_data = map.get_data();
+        unsigned file_size = (unsigned)map.get_size();
+        unsigned search_offset = file_size < 256 ? 0 : file_size - 256;
+        for( unsigned i = search_offset; i + 22 <= file_size; ++i) {
+          const uint8_t *tmp = file_data + i;
+          if (u4(tmp) == 0x06054b50) {
+            unsigned dir_size = u4(tmp + 12);
+            unsigned dir_offset = u4(tmp + 16);
+            if ((uint64_t)dir_offset + dir_size > file_size) break;
+            const uint8_t *dir = file_data + dir_offset;
+            for (unsigned i = 0; i + 46 <= dir_size;) {
+              const uint8_t *p = dir + i;
               if (u4(p) != 0x02014b50) break;
               struct dir_entry d;
               d.compression = u2(p + 10);
@@ -72,9 +93,11 @@ namespace octet { namespace resources {
               d.usize = u4(p + 24);
               unsigned file_name_len = u2(p + 28);
               unsigned extra_len = u2(p + 30);
+              unsigned comment_len = u2(p + 32);
+              if (i + 46 + file_name_len > dir_size) break;
               string file;
               file.set((const char*)(p + 46), file_name_len);
-              i += 46 + file_name_len + extra_len;
+              i += 46 + file_name_len + extra_len + comment_len;
               d.offset = u4(p + 42);// + (46 + file_name_len + extra_len);
               for (unsigned i = 0; file[i]; ++i) {
                 if (file[i] == '\\') file[i] = '/';
@@ -90,7 +113,6 @@ namespace octet { namespace resources {
 
     /// close the zip file
     ~zip_file() {
-      if (the_file) fclose(the_file);
     }
 
     /// allow ref<zip_file>
@@ -100,7 +122,7 @@ namespace octet { namespace resources {
 
     /// allow ref<zip_file>
     void release() {
-      if (--ref_cnt) {
+      if (--ref_cnt == 0) {
         delete this;
       }
     }
@@ -109,34 +131,44 @@ namespace octet { namespace resources {
     void get_file(dynarray<uint8_t> &buffer, const char *file) {
       int index = directory.get_index(file);
       if (index < 0) return;
-      if (!the_file) return;
       const dir_entry &d = directory.get_value(index);
-      buffer.resize(d.usize);
-      fseek(the_file, d.offset, SEEK_SET);
-      /*local file header signature     4 bytes  (0x04034b50) 0
-      version needed to extract       2 bytes 4
-      general purpose bit flag        2 bytes 6
-      compression method              2 bytes 8
-      last mod file time              2 bytes 10
-      last mod file date              2 bytes 12
-      crc-32                          4 bytes 14
-      compressed size                 4 bytes 18
-      uncompressed size               4 bytes 22
-      file name length                2 bytes 26
-      extra field length              2 bytes 28 / 30*/
+      const uint8_t *src = get_entry_data(d);
+      if (!src) return;
+      if (d.compression == 0) {
+        buffer.resize(d.usize);
+        memcpy(buffer.data(), src, d.usize);
+      } else if (d.compression == 8) {
+        // the decoder may read up to four bytes past the end of the compressed data.
+        // this is safe as the central directory always follows the file data.
+        buffer.resize(d.usize);
+        decoder.decode(buffer.data(), buffer.data() + d.usize, src, src + d.csize);
+      }
+    }
 
-      uint8_t tmp[30];
-      fread(tmp, 1, sizeof(tmp), the_file);
-      if (u4(tmp) != 0x04034b50) return;
-      unsigned extra = u2(tmp + 26) + u2(tmp + 28);
-      fseek(the_file, d.offset + 30 + extra, SEEK_SET);
+    /// Get a file without copying it if possible.
+    ///
+    /// For stored files, data points straight into the mapped zip file and stays valid while the zip_file exists.
+    /// Compressed files are inflated into buffer.
+    /// Returns false if the file is not in the zip.
+    bool get_file_data(const uint8_t *&data, unsigned &size, dynarray<uint8_t> &buffer, const char *file) {
+      int index = directory.get_index(file);
+      if (index < 0) return false;
+      const dir_entry &d = directory.get_value(index);
+      const uint8_t *src = get_entry_data(d);
+      if (!src) return false;
       if (d.compression == 0) {
-        fread(buffer.data(), 1, d.usize, the_file);
+        map.advise(file_map::advice_will_need, (uint64_t)(src - map.get_data()), d.csize);
+        data = src;
+        size = d.usize;
+        return true;
       } else if (d.compression == 8) {
-        dynarray<uint8_t> uncomp(d.csize + 4); // note: + 4 bytes prevents decode() overflowing
-        fread(uncomp.data(), 1, d.csize, the_file);
-        decoder.decode(buffer.data(), buffer.data() + d.usize, uncomp.data(), uncomp.data() + d.csize);
+        buffer.resize(d.usize);
+        decoder.decode(buffer.data(), buffer.data() + d.usize, src, src + d.csize);
+        data = buffer.data();
+        size = d.usize;
+        return true;
       }
+      return false;
     }
   };
 } }
@@ -7,8 +7,21 @@
 
 namespace octet { namespace scene {
   /// Animation resource: Contains times and values.
-  /// Still a work in progress. Requires splines, compression, blending etc.
+  ///
+  /// Channels are added as float times and float values (format_raw).
+  /// Call compress() after loading to drop keys that can be interpolated and to store
+  /// transforms as quantised translate, rotate and scale tracks (format_trs).
+  /// Sampling decodes directly from the compressed data, which is smaller but slower
+  /// than sampling raw channels. The collada loader only compresses if asked.
   class animation : public resource {
+  public:
+    /// How the keys of a channel are stored.
+    enum format {
+      format_raw,  /// float times, float values.
+      format_trs,  /// 4x4 transform stored as 16 bit times, translate, smallest three rotate and scale.
+    };
+
+  private:
     // todo: this could be a GL/CL buffer
     dynarray<unsigned char> data;
 
@@ -19,7 +32,32 @@ namespace octet { namespace scene {
       atom_t component;    /// component (eg. ANGLE)
       int offset;          /// where in data
       unsigned num_times;  /// how many time values
-      unsigned component_size; /// number of bytes per component
+      unsigned component_size; /// number of bytes per component when sampled
+      unsigned format;     /// format_raw or format_trs
+    };
+
+    // which tracks of a format_trs channel have keys.
+    enum {
+      trs_translate = 1,
+      trs_rotate = 2,
+      trs_scale = 4,
+    };
+
+    // start of a format_trs channel in data.
+    // animated tracks are quantised to 16 bits between base and base + range.
+    // constant tracks have no keys; translate and scale use base, rotate uses rotate_const.
+    struct trs_header {
+      float time_scale;      // seconds per time step
+      uint32_t flags;        // trs_translate etc.
+      float translate_base[3];
+      float translate_range[3];
+      float scale_base[3];
+      float scale_range[3];
+      float rotate_const[4];
+      uint32_t times_offset; // uint16 times, relative to the header
+      uint32_t translate_offset; // 3 x uint16 per key
+      uint32_t rotate_offset;    // 3 x uint16 per key
+      uint32_t scale_offset;     // 3 x uint16 per key
     };
 
     // format and component of channels
@@ -31,9 +69,310 @@ namespace octet { namespace scene {
     dynarray<ref<resource> > targets;
 
     float end_time;
+
+    // add count items to the end of dest, padded to four bytes. returns the offset.
+    template <class item_t> static unsigned append(dynarray<unsigned char> &dest, const item_t *src, unsigned count) {
+      unsigned offset = dest.size();
+      unsigned bytes = count * sizeof(item_t);
+      dest.resize(offset + ((bytes + 3) & ~3));
+      memcpy(dest.data() + offset, src, bytes);
+      return offset;
+    }
+
+    static uint16_t quantise(float value, float base, float range) {
+      float x = range ? (value - base) / range : 0;
+      x = x < 0 ? 0 : x > 1 ? 1 : x;
+      return (uint16_t)(x * 65535 + 0.5f);
+    }
+
+    static float dequantise(uint16_t value, float base, float range) {
+      return base + value * (range * (1.0f / 65535));
+    }
+
+    static vec4 dequantise3(const uint16_t *value, const float *base, const float *range) {
+      return vec4(dequantise(value[0], base[0], range[0]), dequantise(value[1], base[1], range[1]), dequantise(value[2], base[2], range[2]), 0);
+    }
+
+    // "smallest three" quaternion: drop the largest component and store the others in 15 bits.
+    // the index of the dropped component goes in the top bits of the first two words.
+    static void encode_quat(uint16_t *dest, const vec4 &value) {
+      int largest = 0;
+      for (int i = 1; i != 4; ++i) {
+        if (fabsf(value[i]) > fabsf(value[largest])) largest = i;
+      }
+      vec4 q = value[largest] < 0 ? -value : value;
+      static const float scale = 0.70710678f;
+      for (int i = 0, j = 0; i != 4; ++i) {
+        if (i != largest) {
+          float x = (q[i] / scale) * 0.5f + 0.5f;
+          x = x < 0 ? 0 : x > 1 ? 1 : x;
+          dest[j++] = (uint16_t)(x * 32767 + 0.5f);
+        }
+      }
+      dest[0] |= (largest >> 1) << 15;
+      dest[1] |= (largest & 1) << 15;
+    }
+
+    static vec4 decode_quat(const uint16_t *src) {
+      int largest = (src[0] >> 15) * 2 + (src[1] >> 15);
+      static const float scale = 0.70710678f * 2 / 32767;
+      vec4 q;
+      float sum = 0;
+      for (int i = 0, j = 0; i != 4; ++i) {
+        if (i != largest) {
+          float x = (src[j++] & 0x7fff) * scale - 0.70710678f;
+          q[i] = x;
+          sum += x * x;
+        }
+      }
+      q[largest] = sqrtf(sum < 1 ? 1 - sum : 0);
+      return q;
+    }
+
+    // angle between two rotations. acos of the dot product loses too much precision near zero,
+    // so use the length of the chord between the quaternions instead.
+    static float quat_angle(const vec4 &a, const vec4 &b) {
+      vec4 d = a - b, s = a + b;
+      float chord = sqrtf(std::min(d.dot(d), s.dot(s))) * 0.5f;
+      return 4 * asinf(chord < 1 ? chord : 1);
+    }
+
+    static float max_diff(const vec4 &a, const vec4 &b) {
+      vec4 d = a - b;
+      return std::max(std::max(fabsf(d[0]), fabsf(d[1])), fabsf(d[2]));
+    }
+
+    // split a (transposed) matrix key into translate, rotate and scale.
+    static void decompose(const float *value, vec4 &translate, vec4 &rotate, vec4 &scale) {
+      mat4t m;
+      m.init_transpose(value);
+      quat q(0, 0, 0, 1);
+      m.get_trs(translate, q, scale);
+      rotate = q;
+    }
+
+    // build a (transposed) matrix key from translate, rotate and scale.
+    static void compose(float *dest, const vec4 &translate, const vec4 &rotate, const vec4 &scale) {
+      mat4t m;
+      m.init_trs(translate, quat(rotate), scale);
+      for (int i = 0; i != 4; ++i) {
+        for (int j = 0; j != 4; ++j) {
+          dest[j * 4 + i] = m[i][j];
+        }
+      }
+    }
+
+    // choose the keys to keep. fits(a, b) returns true if interpolating
+    // between keys a and b reproduces all the keys in between.
+    template <class fits_t> static void select_keys(dynarray<unsigned> &keep, unsigned num_keys, fits_t fits) {
+      keep.resize(0);
+      keep.push_back(0);
+      unsigned start = 0;
+      while (start + 1 < num_keys) {
+        unsigned end = start + 1;
+        while (end + 1 < num_keys && fits(start, end + 1)) {
+          end++;
+        }
+        keep.push_back(end);
+        start = end;
+      }
+    }
+
+    // remove keys from a raw channel that can be interpolated from their neighbours.
+    void compress_raw(channel &ch, dynarray<unsigned char> &new_data, float error) const {
+      const float *times = (const float *)&data[ch.offset];
+      const float *values = times + ch.num_times;
+      unsigned num_floats = ch.component_size / sizeof(float);
+
+      dynarray<unsigned> keep;
+      select_keys(keep, ch.num_times, [&](unsigned a, unsigned b) {
+        if (times[b] == times[a]) return false;
+        for (unsigned i = a + 1; i != b; ++i) {
+          float t = (times[i] - times[a]) / (times[b] - times[a]);
+          for (unsigned j = 0; j != num_floats; ++j) {
+            float va = values[a * num_floats + j];
+            float vb = values[b * num_floats + j];
+            if (fabsf(va + (vb - va) * t - values[i * num_floats + j]) > error) return false;
+          }
+        }
+        return true;
+      });
+
+      dynarray<float> new_times(keep.size());
+      dynarray<float> new_values(keep.size() * num_floats);
+      for (unsigned i = 0; i != keep.size(); ++i) {
+        new_times[i] = times[keep[i]];
+        memcpy(&new_values[i * num_floats], values + keep[i] * num_floats, ch.component_size);
+      }
+      ch.offset = append(new_data, new_times.data(), new_times.size());
+      append(new_data, new_values.data(), new_values.size());
+      ch.num_times = keep.size();
+    }
+
+    // convert a raw transform channel to format_trs.
+    // Returns false if the transform has shear or a track can't be quantised to within its error bound.
+    bool compress_trs(channel &ch, dynarray<unsigned char> &new_data, float translate_error, float rotate_error, float scale_error) const {
+      const float *times = (const float *)&data[ch.offset];
+      const float *values = times + ch.num_times;
+      unsigned num_keys = ch.num_times;
+
+      dynarray<vec4> translate(num_keys), rotate(num_keys), scale(num_keys);
+      for (unsigned i = 0; i != num_keys; ++i) {
+        decompose(values + i * 16, translate[i], rotate[i], scale[i]);
+        if (i && rotate[i].dot(rotate[i-1]) < 0) rotate[i] = -rotate[i];
+
+        float check[16];
+        compose(check, translate[i], rotate[i], scale[i]);
+        for (unsigned j = 0; j != 16; ++j) {
+          if (fabsf(check[j] - values[i * 16 + j]) > 1e-4f * (1 + fabsf(values[i * 16 + j]))) return false;
+        }
+      }
+
+      trs_header h;
+      memset(&h, 0, sizeof(h));
+      float last_time = times[num_keys-1];
+      h.time_scale = last_time > 0 ? last_time / 65535 : 1;
+
+      vec4 tmin = translate[0], tmax = translate[0], smin = scale[0], smax = scale[0];
+      bool translate_const = true, rotate_const = true, scale_const = true;
+      for (unsigned i = 0; i != num_keys; ++i) {
+        tmin = min(tmin, translate[i]); tmax = max(tmax, translate[i]);
+        smin = min(smin, scale[i]); smax = max(smax, scale[i]);
+        translate_const = translate_const && max_diff(translate[i], translate[0]) <= translate_error;
+        rotate_const = rotate_const && quat_angle(rotate[i], rotate[0]) <= rotate_error;
+        scale_const = scale_const && max_diff(scale[i], scale[0]) <= scale_error;
+      }
+
+      h.flags = (translate_const ? 0 : trs_translate) | (rotate_const ? 0 : trs_rotate) | (scale_const ? 0 : trs_scale);
+      for (int i = 0; i != 3; ++i) {
+        h.translate_base[i] = translate_const ? translate[0][i] : tmin[i];
+        h.translate_range[i] = translate_const ? 0 : tmax[i] - tmin[i];
+        h.scale_base[i] = scale_const ? scale[0][i] : smin[i];
+        h.scale_range[i] = scale_const ? 0 : smax[i] - smin[i];
+      }
+      for (int i = 0; i != 4; ++i) {
+        h.rotate_const[i] = rotate[0][i];
+      }
+
+      // quantise every key, then fit using the values we will actually decode.
+      dynarray<uint16_t> qtimes(num_keys), qtranslate(num_keys * 3), qrotate(num_keys * 3), qscale(num_keys * 3);
+      dynarray<vec4> dtranslate(num_keys), drotate(num_keys), dscale(num_keys);
+      for (unsigned i = 0; i != num_keys; ++i) {
+        qtimes[i] = quantise(times[i], 0, h.time_scale * 65535);
+        for (int j = 0; j != 3; ++j) {
+          qtranslate[i*3+j] = quantise(translate[i][j], h.translate_base[j], h.translate_range[j]);
+          qscale[i*3+j] = quantise(scale[i][j], h.scale_base[j], h.scale_range[j]);
+        }
+        encode_quat(&qrotate[i*3], rotate[i]);
+        dtranslate[i] = dequantise3(&qtranslate[i*3], h.translate_base, h.translate_range);
+        dscale[i] = dequantise3(&qscale[i*3], h.scale_base, h.scale_range);
+        drotate[i] = rotate_const ? rotate[0] : decode_quat(&qrotate[i*3]);
+      }
+
+      // any key may be kept, so every key must decode to within the bounds.
+      // 16 bits is not enough for a track whose range is over about 131070 times the error, so it stays raw.
+      for (unsigned i = 0; i != num_keys; ++i) {
+        if (!translate_const && max_diff(dtranslate[i], translate[i]) > translate_error) return false;
+        if (!rotate_const && quat_angle(drotate[i], rotate[i]) > rotate_error) return false;
+        if (!scale_const && max_diff(dscale[i], scale[i]) > scale_error) return false;
+      }
+
+      dynarray<unsigned> keep;
+      select_keys(keep, num_keys, [&](unsigned a, unsigned b) {
+        if (qtimes[b] == qtimes[a]) return false;
+        for (unsigned i = a + 1; i != b; ++i) {
+          float t = float(qtimes[i] - qtimes[a]) / (qtimes[b] - qtimes[a]);
+          if (!translate_const && max_diff(dtranslate[a] + (dtranslate[b] - dtranslate[a]) * t, translate[i]) > translate_error) return false;
+          if (!rotate_const && quat_angle(quat(drotate[a]).nlerp(drotate[b], t), rotate[i]) > rotate_error) return false;
+          if (!scale_const && max_diff(dscale[a] + (dscale[b] - dscale[a]) * t, scale[i]) > scale_error) return false;
+        }
+        return true;
+      });
+
+      unsigned num_kept = keep.size();
+      dynarray<uint16_t> ktimes(num_kept), ktranslate(num_kept * 3), krotate(num_kept * 3), kscale(num_kept * 3);
+      for (unsigned i = 0; i != num_kept; ++i) {
+        unsigned k = keep[i];
+        ktimes[i] = qtimes[k];
+        for (int j = 0; j != 3; ++j) {
+          ktranslate[i*3+j] = qtranslate[k*3+j];
+          krotate[i*3+j] = qrotate[k*3+j];
+          kscale[i*3+j] = qscale[k*3+j];
+        }
+      }
+
+      unsigned offset = append(new_data, &h, 1);
+      h.times_offset = append(new_data, ktimes.data(), num_kept) - offset;
+      if (!translate_const) h.translate_offset = append(new_data, ktranslate.data(), num_kept * 3) - offset;
+      if (!rotate_const) h.rotate_offset = append(new_data, krotate.data(), num_kept * 3) - offset;
+      if (!scale_const) h.scale_offset = append(new_data, kscale.data(), num_kept * 3) - offset;
+      memcpy(&new_data[offset], &h, sizeof(h));
+
+      ch.offset = offset;
+      ch.num_times = num_kept;
+      ch.format = format_trs;
+      return true;
+    }
+
+    // sample a raw channel
+    void sample_raw(const channel &ch, float time, unsigned &cursor, float *dest) const {
+      const float *times = (const float *)&data[ch.offset];
+      const float *values = times + ch.num_times;
+      unsigned num_floats = ch.component_size / sizeof(float);
+
+      unsigned a = cursor = find_key(times, ch.num_times, cursor, time);
+      if (ch.num_times < 2) {
+        memcpy(dest, values, ch.component_size);
+        return;
+      }
+
+      float t = times[a+1] != times[a] ? (time - times[a]) / (times[a+1] - times[a]) : 0;
+      t = t < 0 ? 0 : t > 1 ? 1 : t;
+      const float *ka = values + a * num_floats;
+      const float *kb = ka + num_floats;
+      for (unsigned i = 0; i != num_floats; ++i) {
+        dest[i] = ka[i] + (kb[i] - ka[i]) * t;
+      }
+    }
+
+    // sample a compressed transform channel as translate, rotate and scale
+    void sample_trs(const channel &ch, float time, unsigned &cursor, vec4 &translate, vec4 &rotate, vec4 &scale) const {
+      const unsigned char *base = &data[ch.offset];
+      const trs_header &h = *(const trs_header *)base;
+      const uint16_t *times = (const uint16_t *)(base + h.times_offset);
+      float u = time / h.time_scale;
+
+      unsigned a = cursor = find_key(times, ch.num_times, cursor, u);
+      unsigned b = ch.num_times < 2 ? a : a + 1;
+      float t = times[b] != times[a] ? (u - times[a]) / (times[b] - times[a]) : 0;
+      t = t < 0 ? 0 : t > 1 ? 1 : t;
+
+      translate = vec4(h.translate_base[0], h.translate_base[1], h.translate_base[2], 0);
+      if (h.flags & trs_translate) {
+        const uint16_t *keys = (const uint16_t *)(base + h.translate_offset);
+        vec4 ta = dequantise3(keys + a * 3, h.translate_base, h.translate_range);
+        vec4 tb = dequantise3(keys + b * 3, h.translate_base, h.translate_range);
+        translate = ta + (tb - ta) * t;
+      }
+
+      rotate = vec4(h.rotate_const[0], h.rotate_const[1], h.rotate_const[2], h.rotate_const[3]);
+      if (h.flags & trs_rotate) {
+        const uint16_t *keys = (const uint16_t *)(base + h.rotate_offset);
+        rotate = quat(decode_quat(keys + a * 3)).nlerp(decode_quat(keys + b * 3), t);
+      }
+
+      scale = vec4(h.scale_base[0], h.scale_base[1], h.scale_base[2], 0);
+      if (h.flags & trs_scale) {
+        const uint16_t *keys = (const uint16_t *)(base + h.scale_offset);
+        vec4 sa = dequantise3(keys + a * 3, h.scale_base, h.scale_range);
+        vec4 sb = dequantise3(keys + b * 3, h.scale_base, h.scale_range);
+        scale = sa + (sb - sa) * t;
+      }
+    }
+
   public:
     RESOURCE_META(animation)
-  
+
     /// Default constructor. Use add_channel to add channels to the animation,
     animation() {
       end_time = 0;
@@ -72,14 +411,28 @@ namespace octet { namespace scene {
       return targets[ch];
     }
 
+    /// how is the channel stored? (format_raw or format_trs)
+    format get_format(int ch) const {
+      return (format)channels[ch].format;
+    }
+
+    /// how many keys does the channel have?
+    unsigned get_num_keys(int ch) const {
+      return channels[ch].num_times;
+    }
+
     /// how long is the animation?
     float get_end_time() const {
       return end_time;
     }
 
-    /// add a channel to the animation.
-    // just store the floats in the channel for now.
-    // todo: optimise animation data
+    /// how much memory do the keys and channels use?
+    size_t get_num_bytes() const {
+      return data.size() + channels.size() * sizeof(channel);
+    }
+
+    /// add a channel to the animation. Times are in seconds.
+    /// The keys are stored as floats; call compress() when all channels have been added.
     void add_channel(resource *target, atom_t sid, atom_t sub_target, atom_t component, dynarray<float> &times, dynarray<float> &values) {
       int num_times = (int)times.size();
       int num_values = (int)values.size();
@@ -91,63 +444,147 @@ namespace octet { namespace scene {
       ch.sub_target = sub_target;
       ch.component = component;
       ch.component_size = component_size;
+      ch.format = format_raw;
 
-      int offset = ch.offset = (int)data.size();
-      int bytes = num_times * sizeof(unsigned short) + component_size * num_times;
-      data.resize(ch.offset + bytes);
       end_time = times[num_times-1] > end_time ? times[num_times-1] : end_time;
-      for (int i = 0; i != num_times; ++i) {
-        unsigned short it = (unsigned short)( times[i] * 1000 );
-        *((unsigned short*)&data[offset]) = it;
-        offset += sizeof(unsigned short);
-      }
-      
-      memcpy(&data[offset], &values[0], component_size * num_times);
+      ch.offset = append(data, &times[0], num_times);
+      append(data, &values[0], num_values);
       channels.push_back(ch);
       targets.push_back(target);
     }
 
-    /// Evaluate one channel. Time is in ms. This is very inefficient, it is much better to evalaute all channels together.
-    void eval_chan(int chan, float time, resource *target) const {
-      int time_ms = int(time * 1000);
-      const channel &ch = channels[chan];
-      unsigned short *p = (unsigned short *)&data[ch.offset];
-      unsigned a = 0;
-      unsigned b = ch.num_times - 1;
-      unsigned component_size = ch.component_size;
-      //log("ec %f %d\n", time, time_ms);
-
-      if (time_ms < p[0]) {
-        time_ms = p[0];
-      } else if (time_ms >= p[b]) {
-        time_ms = p[b];
-        a = b - 1;
-      } else {
+    /// Compress the animation. Call this at load time or before saving.
+    ///
+    /// Keys that can be interpolated from their neighbours to within the error bounds are dropped.
+    /// Transform channels become 16 bit translate and scale tracks and smallest-three rotation
+    /// tracks; tracks that do not change are stored once.
+    /// Transforms whose tracks cover too big a range to quantise within the bounds stay as floats.
+    /// translate_error and scale_error are in model units, rotate_error is in radians.
+    /// Other channels use translate_error as an absolute error bound.
+    void compress(float translate_error = 0.0005f, float rotate_error = 0.0005f, float scale_error = 0.0005f) {
+      dynarray<unsigned char> new_data;
+      for (unsigned i = 0; i != channels.size(); ++i) {
+        channel &ch = channels[i];
+        if (ch.format != format_raw) {
+          // already compressed
+          unsigned old_offset = ch.offset;
+          unsigned end = i + 1 < channels.size() ? channels[i+1].offset : data.size();
+          ch.offset = append(new_data, &data[old_offset], end - old_offset);
+        } else if (is_transform(i) && compress_trs(ch, new_data, translate_error, rotate_error, scale_error)) {
+          // transform is now format_trs
+        } else {
+          compress_raw(ch, new_data, translate_error);
+        }
+      }
+      data = std::move(new_data);
+    }
+
+    /// Find the pair of keys (a, a+1) either side of time.
+    /// Start looking at the pair we used last time; when playing forward this is
+    /// almost always the same pair or the next one.
+    template <class time_t> static unsigned find_key(const time_t *times, unsigned num_times, unsigned cursor, float time) {
+      if (num_times < 2) return 0;
+      unsigned last = num_times - 2;
+      if (cursor > last) cursor = last;
+
+      if (time < times[cursor]) {
+        // we have gone backwards (eg. looped), so search the keys before the cursor.
+        unsigned a = 0;
+        unsigned b = cursor;
         while (b - a > 1) {
           unsigned mid = a + ((b - a) >> 1);
-          if (time_ms > p[mid]) {
+          if (time >= times[mid]) {
             a = mid;
           } else {
             b = mid;
           }
         }
+        return a;
+      }
+
+      while (cursor < last && time >= times[cursor + 1]) {
+        cursor++;
       }
+      return cursor;
+    }
 
-      //log("t=%d a=%d b=%d p[a]=%d p[b]=%d\n", time_ms, a, b, p[a], p[b]);
+    /// Sample one channel into dest. Time is in seconds. cursor is the key pair used last time (updated).
+    void sample_chan(int chan, float time, unsigned &cursor, float *dest) const {
+      const channel &ch = channels[chan];
+      if (ch.format == format_trs) {
+        vec4 translate, rotate, scale;
+        sample_trs(ch, time, cursor, translate, rotate, scale);
+        compose(dest, translate, rotate, scale);
+      } else {
+        sample_raw(ch, time, cursor, dest);
+      }
+    }
 
-      unsigned data_offset = ch.offset + ch.num_times * sizeof(unsigned short);
+    /// Set up a pose to receive all the channels of this animation.
+    void init_pose(animation_pose &pose) const {
+      unsigned num_channels = channels.size();
+      pose.offsets.resize(num_channels);
+      pose.cursors.resize(num_channels);
+      unsigned num_values = 0;
+      for (unsigned i = 0; i != num_channels; ++i) {
+        pose.offsets[i] = num_values;
+        pose.cursors[i] = 0;
+        num_values += channels[i].component_size / sizeof(float);
+      }
+      pose.values.resize(num_values);
+    }
 
-      float t = float(time_ms - p[a]) / (p[b] - p[a]);
-      float tmp1[16];
-      float tmp2[16];
-      if (component_size <= sizeof(tmp1)) {
-        memcpy(tmp1, &data[data_offset + a * component_size], component_size);
-        memcpy(tmp2, &data[data_offset + b * component_size], component_size);
-        for (int i = 0; i != component_size/4; ++i) {
-          tmp1[i] = tmp1[i] * (1-t) + tmp2[i] * t;
-        }
-        //log("  t=%f %f %f %f\n", t, tmp1[0], tmp1[1], tmp1[2]);
-        target->set_value(ch.sid, ch.sub_target, ch.component, tmp1);
+    /// Evaluate all the channels at once. Time is in seconds.
+    /// This is much faster than calling eval_chan for each channel.
+    void eval(float time, animation_pose &pose) const {
+      if (pose.get_num_channels() != channels.size()) {
+        init_pose(pose);
+      }
+
+      unsigned *cursors = pose.cursors.data();
+      for (unsigned ch = 0; ch != channels.size(); ++ch) {
+        sample_chan(ch, time, cursors[ch], pose.get_values(ch));
+      }
+    }
+
+    /// Is this channel a 4x4 transform?
+    bool is_transform(int chan) const {
+      return channels[chan].sub_target == atom_transform && channels[chan].component_size == 16 * sizeof(float);
+    }
+
+    /// Evaluate one channel into a pose. Time is in seconds.
+    void eval_chan(int chan, float time, animation_pose &pose) const {
+      if (pose.get_num_channels() != channels.size()) {
+        init_pose(pose);
+      }
+      sample_chan(chan, time, pose.cursors[chan], pose.get_values(chan));
+    }
+
+    /// Evaluate a transform channel as translate, rotate and scale for blending.
+    /// Compressed channels are decoded without building a matrix.
+    void eval_trs(int chan, float time, animation_pose &pose, vec4 &translate, vec4 &rotate, vec4 &scale) const {
+      if (pose.get_num_channels() != channels.size()) {
+        init_pose(pose);
+      }
+      const channel &ch = channels[chan];
+      if (ch.format == format_trs) {
+        sample_trs(ch, time, pose.cursors[chan], translate, rotate, scale);
+      } else {
+        float *values = pose.get_values(chan);
+        sample_raw(ch, time, pose.cursors[chan], values);
+        decompose(values, translate, rotate, scale);
+      }
+    }
+
+    /// Evaluate one channel and send it to the target. Time is in seconds.
+    /// This is very inefficient, it is much better to evaluate all channels together with eval().
+    void eval_chan(int chan, float time, resource *target) const {
+      float tmp[16];
+      unsigned cursor = ~0u;
+      if (channels[chan].component_size <= sizeof(tmp)) {
+        sample_chan(chan, time, cursor, tmp);
+        const channel &ch = channels[chan];
+        target->set_value(ch.sid, ch.sub_target, ch.component, tmp);
       }
     }
   };
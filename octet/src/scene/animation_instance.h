@@ -15,6 +15,108 @@ namespace octet { namespace scene {
     float time;
     bool is_looping;
     bool is_paused;
+
+    // values of all the channels at the current time, and where they go.
+    animation_pose pose;
+    dynarray<resource *> channel_targets;
+    dynarray<scene_node *> channel_nodes;
+
+    // blending: if skel is set, bone transforms go to the skeleton's blend buffer.
+    ref<skeleton> skel;
+    float weight;
+    float fade_target;
+    float fade_rate;
+    bool is_additive;
+    dynarray<int> channel_bones;
+
+    // for additive instances, the pose at time zero that the changes are relative to.
+    dynarray<vec4> reference_pose;
+
+    // find the target of each channel. Transforms of scene nodes are written directly.
+    void bind_channels() {
+      unsigned num_channels = anim->get_num_channels();
+      channel_targets.resize(num_channels);
+      channel_nodes.resize(num_channels);
+      channel_bones.resize(num_channels);
+      for (unsigned ch = 0; ch != num_channels; ++ch) {
+        resource *res = target ? (resource*)target : anim->get_target(ch);
+        scene_node *node = res ? res->get_scene_node() : NULL;
+        bool is_transform = anim->is_transform(ch);
+        channel_targets[ch] = res;
+        channel_nodes[ch] = is_transform ? node : NULL;
+        channel_bones[ch] = skel && is_transform && node ? skel->find_node(node) : -1;
+      }
+
+      reference_pose.resize(0);
+      if (is_additive) {
+        animation_pose ref_pose;
+        reference_pose.resize(num_channels * 3);
+        for (unsigned ch = 0; ch != num_channels; ++ch) {
+          if (channel_bones[ch] != -1) {
+            anim->eval_trs(ch, 0, ref_pose, reference_pose[ch*3+0], reference_pose[ch*3+1], reference_pose[ch*3+2]);
+          }
+        }
+      }
+    }
+
+    // send one channel of the pose to its target.
+    void apply_chan(unsigned ch) {
+      if (channel_nodes[ch]) {
+        channel_nodes[ch]->access_nodeToParent().init_transpose(pose.get_values(ch));
+      } else if (channel_targets[ch]) {
+        channel_targets[ch]->set_value(anim->get_sid(ch), anim->get_sub_target(ch), anim->get_component(ch), pose.get_values(ch));
+      }
+    }
+
+    // send the pose to the targets.
+    void apply_pose() {
+      if (channel_targets.size() != pose.get_num_channels()) {
+        bind_channels();
+      }
+
+      for (unsigned ch = 0; ch != channel_targets.size(); ++ch) {
+        apply_chan(ch);
+      }
+    }
+
+    // add the bone channels to the skeleton's blend buffer, apply the others directly.
+    void blend_pose() {
+      if (channel_bones.size() != anim->get_num_channels()) {
+        bind_channels();
+      }
+
+      for (unsigned ch = 0; ch != channel_bones.size(); ++ch) {
+        int bone = channel_bones[ch];
+        if (bone == -1) {
+          anim->eval_chan(ch, time, pose);
+          apply_chan(ch);
+        } else {
+          vec4 translate, rotate, scale;
+          anim->eval_trs(ch, time, pose, translate, rotate, scale);
+          if (is_additive) {
+            const vec4 *ref = &reference_pose[ch*3];
+            vec4 scale_change(
+              ref[2][0] ? scale[0] / ref[2][0] : 1,
+              ref[2][1] ? scale[1] / ref[2][1] : 1,
+              ref[2][2] ? scale[2] / ref[2][2] : 1,
+              0
+            );
+            skel->blend_bone_additive(bone, translate - ref[0], rotate.qmul(ref[1].qconj()), scale_change, weight);
+          } else {
+            skel->blend_bone(bone, translate, rotate, scale, weight);
+          }
+        }
+      }
+    }
+
+    // move the weight towards the fade target.
+    void update_fade(float delta_time) {
+      if (weight < fade_target) {
+        weight = std::min(fade_target, weight + fade_rate * delta_time);
+      } else if (weight > fade_target) {
+        weight = std::max(fade_target, weight - fade_rate * delta_time);
+      }
+    }
   public:
     RESOURCE_META(animation_instance)
 
@@ -25,6 +127,9 @@ namespace octet { namespace scene {
       this->time = 0;
       this->is_looping = is_looping;
       this->is_paused = false;
+      weight = fade_target = 1;
+      fade_rate = 0;
+      is_additive = false;
     }
 
     /// serialize the animation
@@ -46,17 +151,79 @@ namespace octet { namespace scene {
       return time;
     }
 
+    /// get the values of all channels at the current time.
+    const animation_pose &get_pose() const {
+      return pose;
+    }
+
+    /// Blend the bones of this animation into a skeleton instead of writing them directly.
+    /// Several instances can then play on one skeleton, with weights, fades and additive layers.
+    /// The skeleton mixes them once, before calculating the bone matrices.
+    void set_skeleton(skeleton *value) {
+      skel = value;
+      channel_bones.reset();
+    }
+
+    /// get the skeleton we are blending into, if any.
+    skeleton *get_skeleton() const {
+      return skel;
+    }
+
+    /// set the blend weight (0..1) and stop any fade.
+    void set_weight(float value) {
+      weight = fade_target = value;
+    }
+
+    /// get the current blend weight.
+    float get_weight() const {
+      return weight;
+    }
+
+    /// change the blend weight to target over duration seconds.
+    void fade_to(float target_weight, float duration) {
+      fade_target = target_weight;
+      if (duration > 0) {
+        fade_rate = fabsf(target_weight - weight) / duration;
+      } else {
+        weight = target_weight;
+      }
+    }
+
+    /// fade the weight up from zero to one.
+    void fade_in(float duration) {
+      weight = 0;
+      fade_to(1, duration);
+    }
+
+    /// fade the weight down to zero.
+    void fade_out(float duration) {
+      fade_to(0, duration);
+    }
+
+    /// An additive instance adds its change from its first frame to the other instances
+    /// on the skeleton, eg. a breathing or aiming layer on top of a walk.
+    void set_additive(bool value) {
+      is_additive = value;
+      channel_bones.reset();
+    }
+
+    /// is this an additive layer?
+    bool get_additive() const {
+      return is_additive;
+    }
+
     /// update the animation and the resources it connects to.
+    /// All channels are sampled in one pass, then sent to the targets
+    /// or, if there is a skeleton, added to its blend buffer.
     void update(float delta_time) {
-      if (target) {
-        for (int ch = 0; ch != anim->get_num_channels(); ++ch) {
-          anim->eval_chan(ch, time, target);
+      update_fade(delta_time);
+      if (skel) {
+        if (weight > 0) {
+          blend_pose();
         }
       } else {
-        for (int ch = 0; ch != anim->get_num_channels(); ++ch) {
-          resource *anim_target = anim->get_target(ch);
-          anim->eval_chan(ch, time, anim_target);
-        }
+        anim->eval(time, pose);
+        apply_pose();
       }
 
       //log("update %f\n", delta_time);
@@ -0,0 +1,59 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Sampled values of every channel of an animation
+//
+
+namespace octet { namespace scene {
+  /// Output of animation::eval: the values of all the channels at one time.
+  ///
+  /// The values of all channels are packed into one float array, so
+  /// sampling a whole animation writes one contiguous block of memory.
+  /// The pose also remembers which key each channel used last time, so playing
+  /// forward finds the next key in O(1) instead of searching the whole channel.
+  class animation_pose {
+    friend class animation;
+
+    // all channel values, packed. offsets[ch] is the first value of channel ch.
+    dynarray<float> values;
+    dynarray<unsigned> offsets;
+
+    // for each channel, the first key of the pair we interpolated last time
+    dynarray<unsigned> cursors;
+
+  public:
+    animation_pose() {
+    }
+
+    /// Number of channels in the pose.
+    unsigned get_num_channels() const {
+      return cursors.size();
+    }
+
+    /// Values of a channel, eg. 16 floats for a transform.
+    float *get_values(unsigned ch) {
+      return values.data() + offsets[ch];
+    }
+
+    /// Values of a channel, eg. 16 floats for a transform.
+    const float *get_values(unsigned ch) const {
+      return values.data() + offsets[ch];
+    }
+
+    /// Number of floats in a channel.
+    unsigned get_num_values(unsigned ch) const {
+      unsigned end = ch + 1 == offsets.size() ? values.size() : offsets[ch + 1];
+      return end - offsets[ch];
+    }
+
+    /// Forget the cursors, eg. after jumping to a new time.
+    void reset_cursors() {
+      for (unsigned i = 0; i != cursors.size(); ++i) {
+        cursors[i] = 0;
+      }
+    }
+  };
+}}
@@ -0,0 +1,192 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Linear blend skinning on the CPU
+//
+
+namespace octet { namespace scene {
+  /// Skins a mesh on the CPU into a streaming vertex buffer.
+  ///
+  /// The skinned vertex shader has room for 192 matrices. Skeletons with more bones
+  /// than that are skinned here instead and drawn with the ordinary static shader.
+  /// Positions, normals, tangents and bitangents come out in camera space, so draw
+  /// the result with cameraToProjection and an identity modelToCamera.
+  ///
+  /// Vertices are independent, so skin_range() can be called from several threads
+  /// on different ranges. update() splits large meshes across hardware threads.
+  class cpu_skinner : public resource {
+    enum {
+      max_weights = 4,
+      no_offset = ~0u,
+
+      // meshes smaller than this are not worth starting threads for.
+      min_vertices_per_thread = 8192,
+    };
+
+    // the mesh we skin and the copy we draw.
+    ref<mesh> src;
+    ref<mesh> dest;
+
+    // the bind pose vertices, read back from the source once.
+    dynarray<uint8_t> bind_vertices;
+
+    unsigned num_vertices;
+    unsigned stride;
+
+    // byte offsets of the float attributes in a vertex, no_offset if absent.
+    unsigned pos_offset;
+    unsigned pos_size;
+    unsigned dir_offsets[3];
+    unsigned weight_offset;
+    unsigned num_weights;
+    unsigned index_offset;
+    unsigned num_indices;
+
+    // offset of a float attribute, or no_offset.
+    unsigned float_offset(unsigned attr, unsigned min_size, unsigned &size) const {
+      unsigned slot = src->get_slot(attr);
+      if (slot == ~0u || src->get_kind(slot) != GL_FLOAT || src->get_size(slot) < min_size) {
+        size = 0;
+        return no_offset;
+      }
+      size = src->get_size(slot);
+      return src->get_offset(slot);
+    }
+
+  public:
+    /// Prepare to skin a mesh. Check is_valid() before using it.
+    cpu_skinner(mesh *src_mesh) {
+      src = src_mesh;
+      num_vertices = src->get_num_vertices();
+      stride = src->get_stride();
+
+      unsigned size = 0;
+      pos_offset = float_offset(attribute_pos, 3, pos_size);
+      dir_offsets[0] = float_offset(attribute_normal, 3, size);
+      dir_offsets[1] = float_offset(attribute_tangent, 3, size);
+      dir_offsets[2] = float_offset(attribute_bitangent, 3, size);
+      weight_offset = float_offset(attribute_blendweight, 1, num_weights);
+      index_offset = float_offset(attribute_blendindices, 1, num_indices);
+      if (num_weights > max_weights - 1) num_weights = max_weights - 1;
+      if (num_indices > max_weights) num_indices = max_weights;
+
+      if (!is_valid()) return;
+
+      size_t bytes = (size_t)num_vertices * stride;
+      bind_vertices.resize((unsigned)bytes);
+      {
+        gl_resource::rolock lock(src->get_vertices());
+        memcpy(bind_vertices.data(), lock.u8(), bytes);
+      }
+
+      // the copy shares the index buffer and attribute formats but has no skin,
+      // so it is drawn like any other static mesh.
+      dest = new mesh(*src);
+      dest->set_skin(0);
+      gl_resource *vertices = new gl_resource();
+      vertices->allocate(GL_ARRAY_BUFFER, bytes, GL_STREAM_DRAW);
+      dest->set_vertices(vertices);
+    }
+
+    /// Can we skin this mesh? It needs float positions, blend weights and blend indices.
+    bool is_valid() const {
+      return num_vertices != 0 && pos_offset != no_offset && weight_offset != no_offset && index_offset != no_offset;
+    }
+
+    /// The mesh this skinner reads from.
+    mesh *get_src() const {
+      return src;
+    }
+
+    /// The mesh to draw after update().
+    mesh *get_mesh() const {
+      return dest;
+    }
+
+    /// Skin vertices [begin, end) into dest_bytes, which has the layout of the source mesh.
+    /// palette is the array returned by skeleton::calc_transforms. Safe to call from any thread.
+    void skin_range(uint8_t *dest_bytes, const mat4t *palette, unsigned begin, unsigned end) const {
+      const uint8_t *src_bytes = bind_vertices.data();
+      for (unsigned v = begin; v != end; ++v) {
+        const uint8_t *sv = src_bytes + (size_t)v * stride;
+        uint8_t *dv = dest_bytes + (size_t)v * stride;
+
+        // copy uvs, colors and anything else we don't transform.
+        memcpy(dv, sv, stride);
+
+        // weight 0 is what the other weights leave over, as in the skinned shader.
+        const float *w = (const float*)(sv + weight_offset);
+        const float *idx = (const float*)(sv + index_offset);
+        float weights[max_weights] = { 1, 0, 0, 0 };
+        for (unsigned j = 0; j != num_weights; ++j) {
+          weights[j+1] = w[j];
+          weights[0] -= w[j];
+        }
+
+        // blend the rows of the bone matrices: four vec4 multiply-adds per row.
+        const mat4t &m0 = palette[(unsigned)idx[0]];
+        vec4 row0 = m0.row(0) * weights[0];
+        vec4 row1 = m0.row(1) * weights[0];
+        vec4 row2 = m0.row(2) * weights[0];
+        vec4 row3 = m0.row(3) * weights[0];
+        for (unsigned j = 1; j != num_indices; ++j) {
+          float wj = weights[j];
+          if (wj == 0) continue;
+          const mat4t &m = palette[(unsigned)idx[j]];
+          row0 += m.row(0) * wj;
+          row1 += m.row(1) * wj;
+          row2 += m.row(2) * wj;
+          row3 += m.row(3) * wj;
+        }
+
+        // row vector convention: out = p.x * row0 + p.y * row1 + p.z * row2 + p.w * row3
+        const float *p = (const float*)(sv + pos_offset);
+        float pw = pos_size > 3 ? p[3] : 1.0f;
+        vec4 pos = row0 * p[0] + row1 * p[1] + row2 * p[2] + row3 * pw;
+        float *dp = (float*)(dv + pos_offset);
+        dp[0] = pos[0]; dp[1] = pos[1]; dp[2] = pos[2];
+        if (pos_size > 3) dp[3] = pos[3];
+
+        for (unsigned d = 0; d != 3; ++d) {
+          if (dir_offsets[d] == no_offset) continue;
+          const float *n = (const float*)(sv + dir_offsets[d]);
+          vec4 dir = row0 * n[0] + row1 * n[1] + row2 * n[2];
+          float *dn = (float*)(dv + dir_offsets[d]);
+          dn[0] = dir[0]; dn[1] = dir[1]; dn[2] = dir[2];
+        }
+      }
+    }
+
+    /// Skin the whole mesh with a new palette and upload it. Returns the mesh to draw.
+    mesh *update(const mat4t *palette) {
+      gl_resource *vertices = dest->get_vertices();
+      vertices->orphan();
+      gl_resource::wolock lock(vertices);
+      uint8_t *dest_bytes = lock.u8();
+
+      unsigned num_threads = std::thread::hardware_concurrency();
+      unsigned max_threads = num_vertices / min_vertices_per_thread;
+      if (num_threads > max_threads) num_threads = max_threads;
+
+      if (num_threads <= 1) {
+        skin_range(dest_bytes, palette, 0, num_vertices);
+      } else {
+        // this thread does the last range.
+        dynarray<std::thread> threads;
+        unsigned per_thread = (num_vertices + num_threads - 1) / num_threads;
+        for (unsigned i = 0; i != num_threads - 1; ++i) {
+          unsigned begin = i * per_thread;
+          threads.push_back(std::thread(&cpu_skinner::skin_range, this, dest_bytes, palette, begin, begin + per_thread));
+        }
+        skin_range(dest_bytes, palette, (num_threads - 1) * per_thread, num_vertices);
+        for (unsigned i = 0; i != threads.size(); ++i) {
+          threads[i].join();
+        }
+      }
+      return dest;
+    }
+  };
+}}
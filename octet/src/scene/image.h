@@ -31,6 +31,9 @@ namespace octet { namespace scene {
     uint8_t mip_levels;
     uint8_t cube_faces;
 
+    // JPEG files are decoded at 1/2, 1/4 or 1/8 size when this is 1, 2 or 3.
+    uint8_t log2_scale;
+
     // derived attributes (not for saving)
     // todo: use gl_resource
     GLuint gl_texture;
@@ -47,6 +50,7 @@ namespace octet { namespace scene {
       mip_levels = 1;
       cube_faces = is_cubemap ? 6 : 1;
       format = 0;
+      log2_scale = 0;
     }
 
     // these are here to avoid including glext.h which may be platform dependent.
@@ -258,8 +262,10 @@ namespace octet { namespace scene {
     }
 
     /// give url of file to load.
-    image(const char *name) {
+    /// log2_scale shrinks JPEG files by 2, 4 or 8 as they decode, for thumbnails and distant LODs.
+    image(const char *name, unsigned log2_scale = 0) {
       init(name);
+      this->log2_scale = (uint8_t)(log2_scale < 3 ? log2_scale : 3);
     }
 
     /// generate an image from an opengl texture
@@ -335,23 +341,26 @@ namespace octet { namespace scene {
     }
 
     void load_part(const char *_url) {
-      dynarray<uint8_t> buffer;
-      app_utils::get_url(buffer, _url);
-      const unsigned char *src = &buffer[0];
-      const unsigned char *src_max = src + buffer.size();
-      if (buffer.size() >= 6 && !memcmp(&buffer[0], "GIF89a", 6)) {
+      // decode straight from the mapped file, no copy.
+      file_view view;
+      app_utils::get_url_view(view, _url);
+      const unsigned char *src = view.data();
+      const unsigned char *src_max = src + view.size();
+      size_t size = view.size();
+      if (size >= 6 && !memcmp(src, "GIF89a", 6)) {
         gif_decoder dec;
         dec.get_image(bytes, format, width, height, src, src_max);
-      } else if (buffer.size() >= 6 && buffer[0] == 0xff && buffer[1] == 0xd8) {
+      } else if (size >= 6 && src[0] == 0xff && src[1] == 0xd8) {
         jpeg_decoder dec;
+        dec.set_log2_scale(log2_scale);
         dec.get_image(bytes, format, width, height, src, src_max);
-      } else if (buffer.size() >= 6 && buffer[0] == 0 && buffer[1] == 0 && buffer[2] == 2) {
+      } else if (size >= 6 && src[0] == 0 && src[1] == 0 && src[2] == 2) {
         tga_decoder dec;
         dec.get_image(bytes, format, width, height, src, src_max);
-      } else if (buffer.size() >= 4 && buffer[0] == 'D' && buffer[1] == 'D' && buffer[2] == 'S' && buffer[3] == ' ') {
+      } else if (size >= 4 && src[0] == 'D' && src[1] == 'D' && src[2] == 'S' && src[3] == ' ') {
         dds_decoder dec;
         dec.get_image(bytes, format, width, height, src, src_max);
-      } else if (buffer.size() >= 348 && (!memcmp(&buffer[344], "ni1", 4) || !memcmp(&buffer[344], "n+1", 4))) {
+      } else if (size >= 348 && (!memcmp(src + 344, "ni1", 4) || !memcmp(src + 344, "n+1", 4))) {
         nifti_decoder dec;
         gl_target = GL_TEXTURE_3D;
         dec.get_image(bytes, format, width, height, depth, frames, src, src_max);
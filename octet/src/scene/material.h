@@ -24,15 +24,59 @@ namespace octet { namespace scene {
     //dynarray<uint8_t> static_buffer;
     dynarray<uint8_t> buffer;
 
+    // the first num_dynamic_params params change every draw (matrices and lighting)
+    unsigned num_dynamic_params;
+
+    // the dynamic params, kept when they are made so that drawing does not search for them.
+    param_uniform *modelToProjection_param;
+    param_uniform *modelToCamera_param;
+    param_uniform *lighting_param;
+    param_uniform *num_lights_param;
+
+    // uniforms that must be uploaded even if the program already has this material's values.
+    enum {
+      dirty_static = 1,
+      dirty_static_instanced = 2,
+      dirty_lighting = 4,
+      dirty_lighting_instanced = 8,
+      dirty_all = 15,
+    };
+    uint8_t dirty;
+
+    // translucent materials are drawn after opaque ones, back to front.
+    bool translucent;
+
+    // if we are using one of the default shaders, this is its fragment shader.
+    // we use it to make an instanced variant on demand.
+    const char *default_fragment_shader;
+
+    // variant of the shader that takes model to camera matrices from an instance buffer
+    ref<param_shader> instanced_shader;
+    GLint instanced_cameraToProjection;
+
+    void init_defaults() {
+      num_dynamic_params = 0;
+      modelToProjection_param = modelToCamera_param = lighting_param = num_lights_param = NULL;
+      dirty = dirty_all;
+      translucent = false;
+      default_fragment_shader = NULL;
+      instanced_cameraToProjection = -1;
+    }
+
     // create the parameters that change frequently such as the matrices and lighting
     void create_dynamic_params() {
       buffer.reserve(0x200);
       param_buffer_info dynamic_pbi(buffer);
 
-      params.push_back(new param_uniform(dynamic_pbi, NULL, atom_modelToProjection, GL_FLOAT_MAT4, 1, param::stage_vertex));
-      params.push_back(new param_uniform(dynamic_pbi, NULL, atom_modelToCamera, GL_FLOAT_MAT4, 1, param::stage_vertex));
-      params.push_back(new param_uniform(dynamic_pbi, NULL, atom_lighting, GL_FLOAT_VEC4, ambient_size + max_lights * light_size, param::stage_fragment));
-      params.push_back(new param_uniform(dynamic_pbi, NULL, atom_num_lights, GL_INT, 1, param::stage_fragment));
+      modelToProjection_param = new param_uniform(dynamic_pbi, NULL, atom_modelToProjection, GL_FLOAT_MAT4, 1, param::stage_vertex);
+      modelToCamera_param = new param_uniform(dynamic_pbi, NULL, atom_modelToCamera, GL_FLOAT_MAT4, 1, param::stage_vertex);
+      lighting_param = new param_uniform(dynamic_pbi, NULL, atom_lighting, GL_FLOAT_VEC4, ambient_size + max_lights * light_size, param::stage_fragment);
+      num_lights_param = new param_uniform(dynamic_pbi, NULL, atom_num_lights, GL_INT, 1, param::stage_fragment);
+      params.push_back(modelToProjection_param);
+      params.push_back(modelToCamera_param);
+      params.push_back(lighting_param);
+      params.push_back(num_lights_param);
+      num_dynamic_params = params.size();
     }
 
     // create the attribute parameters
@@ -42,6 +86,37 @@ namespace octet { namespace scene {
       params.push_back(new param_attribute(atom_normal, GL_FLOAT_VEC3));
     }
 
+    // If the program has our uniforms, it no longer has anyone's.
+    void release_program_state(param_shader *ps) {
+      shader::program_state *state = ps ? ps->get_program_state() : NULL;
+      if (state && state->uniform_owner == this) {
+        state->uniform_owner = NULL;
+      }
+    }
+
+    // Send the lighting to the program if it has changed since we last sent it.
+    // The lights change once a frame at most, so this is usually just a compare.
+    void upload_lighting(bool instanced, const vec4 *light_uniforms, int num_light_uniforms, int num_lights) {
+      uint8_t flag = instanced ? dirty_lighting_instanced : dirty_lighting;
+      bool changed = (dirty & flag) != 0;
+      if (lighting_param) {
+        void *dest = buffer.data() + lighting_param->get_offset();
+        size_t size = sizeof(vec4) * num_light_uniforms;
+        if (changed || memcmp(dest, light_uniforms, size)) {
+          memcpy(dest, light_uniforms, size);
+          instanced ? lighting_param->render_instanced(buffer.data()) : lighting_param->render(buffer.data());
+        }
+      }
+      if (num_lights_param) {
+        int32_t *dest = (int32_t*)(buffer.data() + num_lights_param->get_offset());
+        if (changed || *dest != num_lights) {
+          *dest = num_lights;
+          instanced ? num_lights_param->render_instanced(buffer.data()) : num_lights_param->render(buffer.data());
+        }
+      }
+      dirty &= ~flag;
+    }
+
   public:
     RESOURCE_META(material)
 
@@ -53,10 +128,12 @@ namespace octet { namespace scene {
 
     /// Default constructor makes a blank material.
     material() {
+      init_defaults();
     }
 
     /// Alternative constructor.
     material(const vec4 &color, param_shader *shader = NULL) {
+      init_defaults();
       // materials are constructed from parameters which build the final shader.
       // this allows us to use OpenGLES2 (uniforms) and 3 (buffers) as well as new shader features.
       params.reserve(16);
@@ -68,7 +145,8 @@ namespace octet { namespace scene {
       params.push_back(new param_color(static_pbi, color, atom_diffuse, param::stage_fragment));
 
       if (shader == NULL) {
-        shader = new param_shader("shaders/default.vs", "shaders/default_solid.fs");
+        default_fragment_shader = "shaders/default_solid.fs";
+        shader = param_shader::get("shaders/default.vs", default_fragment_shader);
       }
       shader->init(params);
       custom_shader = shader;
@@ -76,6 +154,7 @@ namespace octet { namespace scene {
 
     /// create a material from an existing image
     material(image *img, sampler *smpl = NULL, param_shader *shader = NULL) {
+      init_defaults();
       if (!smpl) smpl = new sampler();
 
       params.reserve(16);
@@ -87,13 +166,21 @@ namespace octet { namespace scene {
       params.push_back(new param_sampler(static_pbi, atom_diffuse_sampler, img, smpl, param::stage_fragment));
 
       if (shader == NULL) {
-        shader = new param_shader("shaders/default.vs", "shaders/default_textured.fs");
+        default_fragment_shader = "shaders/default_textured.fs";
+        shader = param_shader::get("shaders/default.vs", default_fragment_shader);
         shader->init(params);
       }
       custom_shader = shader;
     }
 
     material(param *diffuse, param *ambient, param *emission, param *specular, param *bump, param *shininess) {
+      init_defaults();
+    }
+
+    /// A new material could get our address, so forget that the programs have our uniforms.
+    ~material() {
+      release_program_state(custom_shader);
+      release_program_state(instanced_shader);
     }
 
     /// Serialize.
@@ -107,35 +194,93 @@ namespace octet { namespace scene {
       log("lu[1] = %s\n", light_uniforms[1].toString(tmp, sizeof(tmp)));
       log("lu[2] = %s\n", light_uniforms[2].toString(tmp, sizeof(tmp)));
       log("lu[3] = %s\n", light_uniforms[3].toString(tmp, sizeof(tmp)));*/
-      {
-        // matrices and lighting go in the dynamic uniform buffer
-        param_uniform *modelToProjection_param = get_param_uniform(atom_modelToProjection);
-        if (modelToProjection_param) modelToProjection_param->set_value(buffer.data(), modelToProjection.get(), sizeof(modelToProjection));
+      render_shader();
+      render_static();
+      render_dynamic(modelToProjection, modelToCamera, light_uniforms, num_light_uniforms, num_lights);
+    }
+
+    /// Select the shader program for this material.
+    /// Used by the render queue, which skips this if the program has not changed.
+    void render_shader() {
+      custom_shader->render();
+    }
+
+    /// Set the uniforms that do not change between draws (colours and textures).
+    /// Used by the render queue, which skips this if the material has not changed.
+    /// The uniforms are only sent if another material has used the program since, or they have changed.
+    void render_static() {
+      shader::program_state *state = custom_shader->get_program_state();
+      if (!state || state->uniform_owner != this || (dirty & dirty_static)) {
+        for (unsigned i = num_dynamic_params; i < params.size(); ++i) {
+          params[i]->render(buffer.data());
+        }
+        // the program has another material's lighting too.
+        if (state) state->uniform_owner = this;
+        dirty = (dirty & ~dirty_static) | dirty_lighting;
+      } else {
+        for (unsigned i = num_dynamic_params; i < params.size(); ++i) {
+          params[i]->bind_texture();
+        }
+      }
+    }
 
-        param_uniform *modelToCamera_param = get_param_uniform(atom_modelToCamera);
-        if (modelToCamera_param) modelToCamera_param->set_value(buffer.data(), modelToCamera.get(), sizeof(modelToCamera));
+    /// Set the uniforms that change every draw (matrices and lighting).
+    void render_dynamic(const mat4t &modelToProjection, const mat4t &modelToCamera, vec4 *light_uniforms, int num_light_uniforms, int num_lights) {
+      if (modelToProjection_param) {
+        modelToProjection_param->set_value(buffer.data(), modelToProjection.get(), sizeof(modelToProjection));
+        modelToProjection_param->render(buffer.data());
+      }
+      if (modelToCamera_param) {
+        modelToCamera_param->set_value(buffer.data(), modelToCamera.get(), sizeof(modelToCamera));
+        modelToCamera_param->render(buffer.data());
+      }
+      upload_lighting(false, light_uniforms, num_light_uniforms, num_lights);
+    }
 
-        param_uniform *lighting_param = get_param_uniform(atom_lighting);
-        if (lighting_param) lighting_param->set_value(buffer.data(), light_uniforms, sizeof(vec4) * num_light_uniforms);
+    /// Can this material draw many instances in one call?
+    /// Only materials using the default shaders have an instanced variant.
+    bool can_instance() const {
+      return OCTET_INSTANCING && default_fragment_shader != NULL;
+    }
 
-        param_uniform *num_lights_param = get_param_uniform(atom_num_lights);
-        if (num_lights_param) num_lights_param->set_value(buffer.data(), &num_lights, sizeof(int32_t));
+    /// Get the instanced variant of the shader, building it on first use.
+    param_shader *get_instanced_shader() {
+      if (!instanced_shader && can_instance()) {
+        instanced_shader = param_shader::get("shaders/default_instanced.vs", default_fragment_shader);
+        instanced_shader->init(params, true);
+        instanced_cameraToProjection = glGetUniformLocation(instanced_shader->get_program(), "cameraToProjection");
       }
+      return instanced_shader;
+    }
 
-      custom_shader->render();
+    /// Select the instanced shader program.
+    void render_shader_instanced() {
+      get_instanced_shader()->render();
+    }
 
-      {
-        // colours and textures go in the static uniform buffer
-        for (unsigned i = 0; i != params.size(); ++i) {
-          param_uniform *pu = params[i]->get_param_uniform();
-          if (pu) {
-            //printf("%s: %d off=%x\n", app_utils::get_atom_name(pu->get_name()), pu->get_uniform_buffer_index(), pu->get_offset());
-            pu->render(buffer.data());
-          }
+    /// Set the colours and textures for the instanced shader.
+    void render_static_instanced() {
+      shader::program_state *state = instanced_shader->get_program_state();
+      if (!state || state->uniform_owner != this || (dirty & dirty_static_instanced)) {
+        for (unsigned i = num_dynamic_params; i < params.size(); ++i) {
+          params[i]->render_instanced(buffer.data());
+        }
+        if (state) state->uniform_owner = this;
+        dirty = (dirty & ~dirty_static_instanced) | dirty_lighting_instanced;
+      } else {
+        for (unsigned i = num_dynamic_params; i < params.size(); ++i) {
+          params[i]->bind_texture();
         }
       }
     }
 
+    /// Set the per-batch uniforms for the instanced shader.
+    /// The model to camera matrices come from the instance buffer.
+    void render_dynamic_instanced(const mat4t &cameraToProjection, vec4 *light_uniforms, int num_light_uniforms, int num_lights) {
+      upload_lighting(true, light_uniforms, num_light_uniforms, num_lights);
+      glUniformMatrix4fv(instanced_cameraToProjection, 1, GL_FALSE, cameraToProjection.get());
+    }
+
     /// Set the uniforms for this material on skinned meshes.
     void render_skinned(const mat4t &cameraToProjection, const mat4t *modelToCamera, int num_nodes, vec4 *light_uniforms, int num_light_uniforms, int num_lights) const {
       //shader.render_skinned(cameraToProjection, modelToCamera, num_nodes, light_uniforms, num_light_uniforms, num_lights);
@@ -162,25 +307,49 @@ namespace octet { namespace scene {
     void set_diffuse(const vec4 &color) {
       if (param *p = get_param_uniform(atom_diffuse)) {
         p->get_param_uniform()->set_value(buffer.data(), &color, sizeof(color));
+        dirty |= dirty_static | dirty_static_instanced;
       }
     }
 
+    /// set the value of a uniform. It is sent to the program before the next draw.
     void set_uniform(param_uniform *param, const void *data, size_t size) {
       memcpy(buffer.data() + param->get_offset(), data, size);
+      dirty |= dirty_static | dirty_static_instanced;
     }
 
     dynarray<ref<param> > &get_params() {
       return params;
     }
 
+    /// get the shader used by this material (may be NULL)
+    param_shader *get_shader() const {
+      return custom_shader;
+    }
+
+    /// is this material drawn after the opaque ones?
+    bool get_translucent() const {
+      return translucent;
+    }
+
+    /// translucent materials are drawn after opaque ones, back to front.
+    void set_translucent(bool value) {
+      translucent = value;
+    }
+
     param_uniform *add_uniform(const void *data, atom_t name, uint16_t _type, uint16_t _repeat, param::stage_type _stage=param::stage_fragment) {
       param_buffer_info pbi(buffer);
       param_uniform *result = new param_uniform(pbi, data, name, _type, _repeat, _stage);
       params.push_back(result);
+      dirty |= dirty_static | dirty_static_instanced;
 
       param_bind_info pbind;
       pbind.program = custom_shader->get_program();
       result->bind(pbind);
+      if (instanced_shader) {
+        pbind.program = instanced_shader->get_program();
+        pbind.instanced = true;
+        result->bind(pbind);
+      }
       return result;
     }
 
@@ -189,10 +358,16 @@ namespace octet { namespace scene {
       pbi.texture_slot = texture_slot;
       param_sampler *result = new param_sampler(pbi, name, _image, _sampler, _stage);
       params.push_back(result);
+      dirty |= dirty_static | dirty_static_instanced;
 
       param_bind_info pbind;
       pbind.program = custom_shader->get_program();
       result->bind(pbind);
+      if (instanced_shader) {
+        pbind.program = instanced_shader->get_program();
+        pbind.instanced = true;
+        result->bind(pbind);
+      }
       return result;
     }
   };
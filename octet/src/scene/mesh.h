@@ -37,8 +37,13 @@ namespace octet { namespace scene {
     ref<gl_resource> vertices;
     ref<gl_resource> indices;
 
+    // optional per-instance vertex buffer, see add_instance_attribute()
+    ref<gl_resource> instance_vertices;
+    uint32_t num_instances;
+    uint16_t instance_stride;
+
     // attribute formats
-    enum { max_slots = 16 };
+    enum { max_slots = 16, format_instance = 1 << 15 };
     uint32_t format[max_slots];
 
     uint32_t num_indices;
@@ -176,6 +181,10 @@ namespace octet { namespace scene {
       index_type = rhs.index_type;
       mode = rhs.mode;
 
+      instance_vertices = rhs.instance_vertices;
+      num_instances = rhs.num_instances;
+      instance_stride = rhs.instance_stride;
+
       mesh_skin = rhs.mesh_skin;
     }
 
@@ -198,6 +207,9 @@ namespace octet { namespace scene {
       index_type = GL_UNSIGNED_SHORT;
       mode = GL_TRIANGLES;
 
+      num_instances = 0;
+      instance_stride = 0;
+
       mesh_skin = _skin;
 
       if (max_vertices || max_indices) {
@@ -243,11 +255,26 @@ namespace octet { namespace scene {
     /// Add an extra attribute to the mesh. eg. add_attribute(attribute_pos, 3, GL_FLOAT, 0)
     unsigned add_attribute(unsigned attr, unsigned size, unsigned kind, unsigned offset, unsigned norm=0) {
       assert(num_slots < max_slots);
+      // the format packs offset, attr and size into 6, 4 and 2 bits. (trail meshes use offsets up to 60)
+      assert(offset < 64 && attr < 16 && size >= 1 && size <= 4);
       format[num_slots] = (offset << 9) + (attr << 5) + ((size-1) << 3) + (kind - GL_BYTE);
       if (norm) normalized |= 1 << num_slots;
       return num_slots++;
     }
 
+    /// Add an attribute that is read once per instance from the instance buffer.
+    /// Meshes with instance attributes are drawn get_num_instances() times (needs OCTET_INSTANCING).
+    unsigned add_instance_attribute(unsigned attr, unsigned size, unsigned kind, unsigned offset, unsigned norm=0) {
+      unsigned slot = add_attribute(attr, size, kind, offset, norm);
+      format[slot] |= format_instance;
+      return slot;
+    }
+
+    /// Is this slot read from the instance buffer?
+    bool is_instance_attribute(unsigned slot) const {
+      return (format[slot] & format_instance) != 0;
+    }
+
     /// helper function: how many bytes does this GL_? type use?
     static unsigned kind_size(unsigned kind) {
       static const uint8_t bytes[] = { 1, 1, 2, 2, 4, 4, 4, 4 };
@@ -383,13 +410,13 @@ namespace octet { namespace scene {
         // note that it is your responsibility to deallocate resources!
         btIndexedMesh mesh;
         mesh.m_numTriangles = get_num_indices() / 3;
-        mesh.m_triangleIndexBase = (const unsigned char *)malloc(get_indices()->get_size());
-        mesh.m_triangleIndexStride = sizeof(uint32_t) * 3;
+        mesh.m_triangleIndexBase = (const unsigned char *)malloc(get_indices()->get_size());
+        mesh.m_triangleIndexStride = sizeof(uint32_t) * 3;
         mesh.m_numVertices = get_num_vertices();
-        mesh.m_vertexBase = (const unsigned char *)malloc(get_vertices()->get_size());
-        mesh.m_vertexStride = get_stride();
-
-        {
+        mesh.m_vertexBase = (const unsigned char *)malloc(get_vertices()->get_size());
+        mesh.m_vertexStride = get_stride();
+
+        {
           gl_resource::rolock idx_lock(get_indices());
           gl_resource::rolock vtx_lock(get_vertices());
           memcpy((void*)mesh.m_triangleIndexBase, idx_lock.u8() + get_index_size() * first_index, get_indices()->get_size());
@@ -483,16 +510,35 @@ namespace octet { namespace scene {
         unsigned kind = get_kind(slot);
         unsigned attr = get_attr(slot);
         size_t offset = get_offset(slot);
-        glVertexAttribPointer(attr, size, kind, n & 1, get_stride(), (void*)(offset));
-        glEnableVertexAttribArray(attr);
+        if (!is_instance_attribute(slot)) {
+          glVertexAttribPointer(attr, size, kind, n & 1, get_stride(), (void*)(offset));
+          glEnableVertexAttribArray(attr);
+        }
         n >>= 1;
       }
+
+      #if OCTET_INSTANCING
+        if (instance_vertices) {
+          instance_vertices->bind();
+          n = normalized;
+          for (unsigned slot = 0; slot != get_num_slots(); ++slot) {
+            if (is_instance_attribute(slot)) {
+              unsigned attr = get_attr(slot);
+              glVertexAttribPointer(attr, get_size(slot), get_kind(slot), (n >> slot) & 1, instance_stride, (void*)(size_t)get_offset(slot));
+              glEnableVertexAttribArray(attr);
+              glVertexAttribDivisor(attr, 1);
+            }
+          }
+        }
+      #endif
     }
 
     /// When rendering a mesh, call this next to draw the primitives.
     void draw() {
       //printf("de %04x %d %d\n", get_mode(), get_num_vertices(), get_index_type());
-      if (get_index_type()) {
+      if (instance_vertices) {
+        if (num_instances) draw_instanced(num_instances);
+      } else if (get_index_type()) {
         indices->bind();
         glDrawElements(get_mode(), get_num_indices(), get_index_type(), (GLvoid*)(get_index_size() * first_index));
       } else {
@@ -500,11 +546,26 @@ namespace octet { namespace scene {
       }
     }
 
+    /// Draw many copies of the mesh in one call. The caller sets up per-instance attributes.
+    void draw_instanced(unsigned count) {
+      #if OCTET_INSTANCING
+        if (get_index_type()) {
+          indices->bind();
+          glDrawElementsInstanced(get_mode(), get_num_indices(), get_index_type(), (GLvoid*)(get_index_size() * first_index), count);
+        } else {
+          glDrawArraysInstanced(get_mode(), 0, get_num_vertices(), count);
+        }
+      #endif
+    }
+
     /// When rendering a mesh, call this last to disable attributes.
     void disable_attributes() {
       for (unsigned slot = 0; slot != get_num_slots(); ++slot) {
         unsigned attr = get_attr(slot);
         glDisableVertexAttribArray(attr);
+        #if OCTET_INSTANCING
+          if (is_instance_attribute(slot)) glVertexAttribDivisor(attr, 0);
+        #endif
       }
     }
 
@@ -636,8 +697,29 @@ namespace octet { namespace scene {
       vertices = value;
     }
 
+    /// access the per-instance vertex buffer, if any
+    gl_resource *get_instance_vertices() const {
+      return instance_vertices;
+    }
+
+    /// set the per-instance vertex buffer used by attributes added with add_instance_attribute()
+    void set_instance_vertices(gl_resource *value, unsigned stride) {
+      instance_vertices = value;
+      instance_stride = (uint16_t)stride;
+    }
+
+    /// how many instances to draw if the mesh has an instance buffer
+    unsigned get_num_instances() const {
+      return num_instances;
+    }
+
+    /// set how many instances to draw
+    void set_num_instances(unsigned value) {
+      num_instances = value;
+    }
+
     /// assign a vector to the vertex buffer and set params
-    template <class elem_t> void set_vertices(const dynarray<elem_t> &rhs) {
+    template <class elem_t, class allocator_t> void set_vertices(const dynarray<elem_t, allocator_t> &rhs) {
       if (!vertices || vertices->get_size() != rhs.size() * sizeof(elem_t)) {
         vertices = new gl_resource();
         vertices->allocate(GL_ARRAY_BUFFER, rhs.size() * sizeof(elem_t));
@@ -653,7 +735,7 @@ namespace octet { namespace scene {
     }
 
     /// assign a vector to the index buffer and set params
-    template <class elem_t> void set_indices(const dynarray<elem_t> &rhs) {
+    template <class elem_t, class allocator_t> void set_indices(const dynarray<elem_t, allocator_t> &rhs) {
       if (!indices || indices->get_size() != rhs.size() * sizeof(elem_t)) {
         indices = new gl_resource();
         indices->allocate(GL_ELEMENT_ARRAY_BUFFER, rhs.size() * sizeof(elem_t));
@@ -957,10 +1039,12 @@ namespace octet { namespace scene {
       return true;
     }
 
+    // the geometry is copied to the mesh when the sink is destroyed,
+    // so the arrays can come from the frame allocator.
     template <class vertex_t> struct sink {
       mesh *mesh_;
-      dynarray<vertex_t> vertices;
-      dynarray<uint32_t> indices;
+      dynarray<vertex_t, frame_allocator> vertices;
+      dynarray<uint32_t, frame_allocator> indices;
       mat4t transform;
 
       sink(mesh *mesh_, mat4t_in transform) :
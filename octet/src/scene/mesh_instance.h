@@ -11,7 +11,7 @@ namespace octet { namespace scene {
   /// Instance of a mesh in a game world; node, mesh, material and skin.
   class mesh_instance : public resource {
   public:
-    enum { flag_selected = 1 << 0, flag_enabled = 1 << 1, flag_lod = 1 << 2 };
+    enum { flag_selected = 1 << 0, flag_enabled = 1 << 1, flag_lod = 1 << 2, flag_no_cull = 1 << 3 };
 
   private:
     // which scene_node (model to world matrix) to use in the scene
@@ -26,6 +26,9 @@ namespace octet { namespace scene {
     // for characters, which skeleton to use
     ref<skeleton> skel;
 
+    // for characters skinned on the CPU, the streaming copy of the mesh
+    ref<cpu_skinner> skinner;
+
     // assorted mesh instance booleans (see flag_*)
     unsigned flags;
 
@@ -35,6 +38,9 @@ namespace octet { namespace scene {
     // if the object is further than this from the camera, do not draw.
     float max_draw_distance;
 
+    // lower layers are drawn first (0..render_queue::max_layer)
+    unsigned layer;
+
   public:
     RESOURCE_META(mesh_instance)
 
@@ -47,6 +53,7 @@ namespace octet { namespace scene {
       flags = flag_enabled;
       min_draw_distance = -8.507059e37f;
       max_draw_distance = 8.507059e37f;
+      layer = 0;
     }
 
     /// metadata visitor. Used for serialisation and script interface.
@@ -121,6 +128,15 @@ namespace octet { namespace scene {
     /// Get the skeleton for this instance.
     skeleton *get_skeleton() const { return skel; }
 
+    /// Get a CPU skinner for the mesh, making one if the mesh has changed.
+    /// Returns null if the mesh can't be skinned on the CPU.
+    cpu_skinner *get_cpu_skinner() {
+      if (!skinner || skinner->get_src() != msh) {
+        skinner = new cpu_skinner(msh);
+      }
+      return skinner->is_valid() ? (cpu_skinner*)skinner : 0;
+    }
+
     /// Get the flags for this instance.
     unsigned get_flags() const { return flags; }
 
@@ -130,6 +146,9 @@ namespace octet { namespace scene {
     /// Get the LOD max distance
     float get_max_draw_distance() const { return max_draw_distance; }
 
+    /// Get the render layer
+    unsigned get_layer() const { return layer; }
+
     /// Set the transformation for this instance.
     void set_node(scene_node *value) { node = value; }
 
@@ -150,6 +169,9 @@ namespace octet { namespace scene {
 
     /// Set the flags for this instance.
     void set_max_draw_distance(float value) { max_draw_distance = value; }
+
+    /// Set the render layer. Lower layers are drawn first.
+    void set_layer(unsigned value) { layer = value; }
   };
 }}
 
@@ -8,6 +8,11 @@ namespace octet { namespace scene {
   /// Particle system: billboards, trails and cloth.
   /// Note all particles in the system must use the same material, but you
   /// can use a custom shader to select different effects.
+  ///
+  /// Billboard particles are stored as a structure of arrays (one float array per
+  /// component) and the live particles are packed at the start of the arrays.
+  /// When a particle dies, the last particle is moved into its place, so animate()
+  /// only ever touches live particles and can integrate four at a time with SSE.
   class mesh_particle_system : public mesh {
   public:
     /// general particle, billboard, trail, cloth etc.
@@ -18,16 +23,35 @@ namespace octet { namespace scene {
     };
 
     /// traditional sprite-like particle, ie. smoke, fire, sparks etc.
-    /// link unused
-    struct billboard_particle : particle {
+    /// Used to add a particle; the system keeps its own copy of the values.
+    struct billboard_particle {
+      vec3p pos;              /// world space position
+      vec3p vel;              /// world space velocity per second
       vec2p size;             /// half-size in world space
       vec2p uv_bottom_left;   /// texture location
       vec2p uv_top_right;     /// texture location
-      uint32_t angle;         /// rotation angle 2^32 = 360 degrees
-      bool enabled;
+      float angle;            /// rotation in radians
+      float spin;             /// change in angle per second
+      float lifetime;         /// time to live in seconds
       billboard_particle() {}
     };
 
+    /// Spawns many billboard particles at once. Each value is picked from
+    /// [value - spread, value + spread].
+    struct emitter {
+      vec3p pos;
+      vec3p pos_spread;
+      vec3p vel;
+      vec3p vel_spread;
+      vec2p size;
+      vec2p uv_bottom_left;
+      vec2p uv_top_right;
+      float spin_spread;
+      float lifetime;
+      float lifetime_spread;
+      emitter() {}
+    };
+
     /// trail-like particle, tyre streaks, missile trails, lasers, volumetric lights, hair etc.
     /// link points to previous particle in trail.
     struct trail_particle : particle {
@@ -44,64 +68,140 @@ namespace octet { namespace scene {
       vec2p uv;
     };
 
-    /// animator for particles
-    /// link points to particle
-    struct particle_animator {
-      int link;
-      vec3p vel;
-      vec3p acceleration;
-      uint32_t lifetime;      /// time to live in frames
-      uint32_t age;           /// how many frames has this particle lived;
-      uint32_t spin;
-    };
-
-    /// animator for cloth particles
-    /// left, bottom link to other particle animators
-    struct cloth_particle_animator : particle_animator {
-      int left;
-      int bottom;
-      float mass;
-      vec2p angle_stiffness;
-      vec2p spacing_stiffness;
-      vec2p spacing;
-    };
-
     /// sphere collider, used to prevent penetration of particles
     struct sphere_collider {
       float restitution;
       float friction;
       sphere geom;
     };
+
+    /// What we upload for each billboard in GPU expansion mode (see shaders/particle_billboard.vs)
+    struct billboard_instance {
+      float pos[3];
+      float angle;
+      float size[2];
+      float uv[4];    /// bottom left, top right
+    };
+
+    /// What we upload for each trail segment in GPU expansion mode (see shaders/particle_trail.vs)
+    struct trail_instance {
+      float pos[4];      /// head position and half width
+      float tail[4];     /// tail position and half width
+      float axis[3];     /// across the trail, zero to face the camera
+      float uv[4];       /// head top, head bottom
+      float tail_uv[4];  /// tail top, tail bottom
+    };
   private:
+    // live billboard particles, one array per component.
+    // particles [0, num_billboards) are alive. the arrays are padded to a
+    // multiple of four so that the SIMD loop can run over the last group.
+    dynarray<float> pos_x, pos_y, pos_z;
+    dynarray<float> vel_x, vel_y, vel_z;
+    dynarray<float> angle, spin, life;
+    dynarray<vec2p> size;
+    dynarray<vec4> uvs;  // bottom left, top right
+    unsigned num_billboards;
+    unsigned billboard_capacity;
 
-    // POD (plain-old-data) structure dynarray of camera-facing particles
-    dynarray<billboard_particle> billboard_particles;
-    int free_billboard_particle;
+    // acceleration of all billboards, eg. gravity
+    vec3p acceleration;
 
     // POD structure dynarray of trail particles.
     dynarray<trail_particle> trail_particles;
     int free_trail_particle;
 
-    // POD structure dynarray of animators for particles.
-    dynarray<particle_animator> particle_animators;
-    int free_particle_animator;
-
     // camera matrix
     mat4t cameraToWorld;
 
-    void init(const aabb &size, int bbcap, int tpcap, int pacap) {
+    // in GPU expansion mode, this mesh draws one quad per billboard_instance
+    // and trail_mesh draws one quad per trail_instance.
+    bool gpu_expansion;
+    ref<gl_resource> billboard_instances;
+    ref<mesh> trail_mesh;
+
+    // the corners of the quad for GPU expansion: tl, tr, br, bl like the CPU quads
+    void add_corner_attribute(mesh *msh) {
+      static const float corners[] = { -1, 1,  1, 1,  1, -1,  -1, -1 };
+      msh->add_attribute(attribute_uv, 2, GL_FLOAT, 0);
+      msh->set_params(sizeof(float) * 2, 6, 4, GL_TRIANGLES, GL_UNSIGNED_INT);
+      get_vertices()->assign(corners, 0, sizeof(corners));
+    }
+
+    // write the instance buffers for GPU expansion
+    void update_instances() {
+      if (num_billboards) {
+        billboard_instances->orphan();
+        gl_resource::wolock lock(billboard_instances);
+        billboard_instance *dest = (billboard_instance*)lock.u8();
+        for (unsigned i = 0; i != num_billboards; ++i, ++dest) {
+          vec2 sz = size[i];
+          const vec4 &uv = uvs[i];
+          dest->pos[0] = pos_x[i]; dest->pos[1] = pos_y[i]; dest->pos[2] = pos_z[i];
+          dest->angle = angle[i];
+          dest->size[0] = sz.x(); dest->size[1] = sz.y();
+          dest->uv[0] = uv.x(); dest->uv[1] = uv.y(); dest->uv[2] = uv.z(); dest->uv[3] = uv.w();
+        }
+      }
+      set_num_instances(num_billboards);
+
+      // one segment for each particle linked to a previous one
+      unsigned num_segments = 0;
+      if (trail_particles.size()) {
+        gl_resource *instances = trail_mesh->get_instance_vertices();
+        instances->orphan();
+        gl_resource::wolock lock(instances);
+        trail_instance *dest = (trail_instance*)lock.u8();
+        for (unsigned i = 0; i != trail_particles.size(); ++i) {
+          const trail_particle &head = trail_particles[i];
+          if (head.link < 0) continue;
+          const trail_particle &tail = trail_particles[head.link];
+          vec3 hp = head.pos, tp = tail.pos, axis = head.axis;
+          vec2 ht = head.uv_top, hb = head.uv_bottom, tt = tail.uv_top, tb = tail.uv_bottom;
+          dest->pos[0] = hp.x(); dest->pos[1] = hp.y(); dest->pos[2] = hp.z(); dest->pos[3] = head.size;
+          dest->tail[0] = tp.x(); dest->tail[1] = tp.y(); dest->tail[2] = tp.z(); dest->tail[3] = tail.size;
+          dest->axis[0] = axis.x(); dest->axis[1] = axis.y(); dest->axis[2] = axis.z();
+          dest->uv[0] = ht.x(); dest->uv[1] = ht.y(); dest->uv[2] = hb.x(); dest->uv[3] = hb.y();
+          dest->tail_uv[0] = tt.x(); dest->tail_uv[1] = tt.y(); dest->tail_uv[2] = tb.x(); dest->tail_uv[3] = tb.y();
+          dest++;
+          num_segments++;
+        }
+      }
+      trail_mesh->set_num_instances(num_segments);
+    }
+
+    void init(const aabb &size, int bbcap, int tpcap) {
       set_default_attributes();
       set_aabb(size);
-      billboard_particles.reserve(bbcap);
+
+      billboard_capacity = (bbcap + 3) & ~3;
+      num_billboards = 0;
+      dynarray<float> *streams[] = { &pos_x, &pos_y, &pos_z, &vel_x, &vel_y, &vel_z, &angle, &spin, &life };
+      for (unsigned i = 0; i != sizeof(streams)/sizeof(streams[0]); ++i) {
+        streams[i]->resize(billboard_capacity);
+        memset(streams[i]->data(), 0, billboard_capacity * sizeof(float));
+      }
+      this->size.resize(billboard_capacity);
+      uvs.resize(billboard_capacity);
+      acceleration = vec3p(0, 0, 0);
+
       trail_particles.reserve(tpcap);
-      particle_animators.reserve(pacap);
-      free_billboard_particle = -1;
       free_trail_particle = -1;
-      free_particle_animator = -1;
+      gpu_expansion = false;
 
-      unsigned vsize = (bbcap * 4 + tpcap * 2) * sizeof(vertex);
-      unsigned isize = (bbcap * 6 + tpcap * 6) * sizeof(uint32_t);
+      unsigned vsize = (billboard_capacity * 4 + tpcap * 2) * sizeof(vertex);
+      unsigned isize = (billboard_capacity * 6 + tpcap * 6) * sizeof(uint32_t);
       mesh::allocate(vsize, isize);
+
+      // the billboard indices never change, so write them once.
+      gl_resource::wolock ilock(get_indices());
+      uint32_t *idx = ilock.u32();
+      for (unsigned i = 0; i != billboard_capacity; ++i) {
+        unsigned v = i * 4;
+        idx[0] = v; idx[1] = v+1; idx[2] = v+2;
+        idx[3] = v; idx[4] = v+2; idx[5] = v+3;
+        idx += 6;
+      }
+      set_index_type(GL_UNSIGNED_INT);
     }
 
     // pool allocation of particles.
@@ -117,37 +217,78 @@ namespace octet { namespace scene {
       return result;
     }
 
-    // return to pool
-    template <class Type> void free(dynarray<Type> &array, int &free, int element) {
-      array[free].link = free;
-      free = element;
+    // move the last live billboard into slot i.
+    void remove_billboard(unsigned i) {
+      unsigned last = --num_billboards;
+      pos_x[i] = pos_x[last]; pos_y[i] = pos_y[last]; pos_z[i] = pos_z[last];
+      vel_x[i] = vel_x[last]; vel_y[i] = vel_y[last]; vel_z[i] = vel_z[last];
+      angle[i] = angle[last]; spin[i] = spin[last]; life[i] = life[last];
+      size[i] = size[last];
+      uvs[i] = uvs[last];
+    }
+
+    // integrate the live particles. returns true if any of them died.
+    bool integrate(float time_step) {
+      float *px = pos_x.data(), *py = pos_y.data(), *pz = pos_z.data();
+      float *vx = vel_x.data(), *vy = vel_y.data(), *vz = vel_z.data();
+      float *pa = angle.data(), *ps = spin.data(), *pl = life.data();
+      unsigned n = num_billboards;
+      vec3 dv = (vec3)acceleration * time_step;
+      bool any_dead = false;
+
+      #if OCTET_SSE2
+        __m128 dt = _mm_set1_ps(time_step);
+        __m128 dvx = _mm_set1_ps(dv.x()), dvy = _mm_set1_ps(dv.y()), dvz = _mm_set1_ps(dv.z());
+        __m128 zero = _mm_setzero_ps();
+        for (unsigned i = 0; i < n; i += 4) {
+          __m128 x = _mm_loadu_ps(vx + i), y = _mm_loadu_ps(vy + i), z = _mm_loadu_ps(vz + i);
+          _mm_storeu_ps(px + i, _mm_add_ps(_mm_loadu_ps(px + i), _mm_mul_ps(x, dt)));
+          _mm_storeu_ps(py + i, _mm_add_ps(_mm_loadu_ps(py + i), _mm_mul_ps(y, dt)));
+          _mm_storeu_ps(pz + i, _mm_add_ps(_mm_loadu_ps(pz + i), _mm_mul_ps(z, dt)));
+          _mm_storeu_ps(vx + i, _mm_add_ps(x, dvx));
+          _mm_storeu_ps(vy + i, _mm_add_ps(y, dvy));
+          _mm_storeu_ps(vz + i, _mm_add_ps(z, dvz));
+          _mm_storeu_ps(pa + i, _mm_add_ps(_mm_loadu_ps(pa + i), _mm_mul_ps(_mm_loadu_ps(ps + i), dt)));
+          __m128 l = _mm_sub_ps(_mm_loadu_ps(pl + i), dt);
+          _mm_storeu_ps(pl + i, l);
+
+          // ignore the padding after the last particle
+          int dead = _mm_movemask_ps(_mm_cmple_ps(l, zero));
+          if (n - i < 4) dead &= (1 << (n - i)) - 1;
+          any_dead |= dead != 0;
+        }
+      #else
+        for (unsigned i = 0; i != n; ++i) {
+          px[i] += vx[i] * time_step;
+          py[i] += vy[i] * time_step;
+          pz[i] += vz[i] * time_step;
+          vx[i] += dv.x();
+          vy[i] += dv.y();
+          vz[i] += dv.z();
+          pa[i] += ps[i] * time_step;
+          pl[i] -= time_step;
+          any_dead |= pl[i] <= 0;
+        }
+      #endif
+      return any_dead;
     }
 
   public:
     RESOURCE_META(mesh_particle_system)
 
-    /// Default constructor
-    mesh_particle_system(aabb_in size=aabb(vec3(0, 0, 0), vec3(1, 1, 1)), int bbcap=256, int tpcap=256, int pacap=256) {
-      init(size, bbcap, tpcap, pacap);
+    /// Make a particle system with room for bbcap billboards and tpcap trail particles.
+    mesh_particle_system(aabb_in size=aabb(vec3(0, 0, 0), vec3(1, 1, 1)), int bbcap=256, int tpcap=256) {
+      init(size, bbcap, tpcap);
     }
 
-    /// Update the vertices for newtonian physics.
+    /// Update the particles for newtonian physics and remove the ones that have expired.
     void animate(float time_step) {
-      for (unsigned i = 0; i != particle_animators.size(); ++i) {
-        particle_animator &g = particle_animators[i];
-        if (g.link >= 0) {
-          billboard_particle &p = billboard_particles[g.link];
-          if (g.age >= g.lifetime) {
-            p.enabled = false;
-            free(billboard_particles, free_billboard_particle, g.link);
-            g.link = -1;
-            free(particle_animators, free_particle_animator, i);
-          } else {
-            p.pos = (vec3)p.pos + (vec3)g.vel * time_step;
-            g.vel = (vec3)g.vel + (vec3)g.acceleration * time_step;
-            p.angle += (uint32_t)(g.spin * time_step);
-            g.age++;
-          }
+      if (!integrate(time_step)) return;
+
+      // go backwards so that the particle we move into a dead slot has already been tested.
+      for (unsigned i = num_billboards; i-- != 0; ) {
+        if (life[i] <= 0) {
+          remove_billboard(i);
         }
       }
     }
@@ -157,66 +298,161 @@ namespace octet { namespace scene {
       cameraToWorld = mx;
     }
 
+    /// Set the acceleration of all the billboard particles, eg. vec3(0, -9.8f, 0)
+    void set_acceleration(vec3_in value) {
+      acceleration = value;
+    }
+
+    /// Expand the particles into quads on the GPU instead of building vertices every frame.
+    /// Each billboard then costs one billboard_instance write in update().
+    /// Draw this mesh with a material using get_billboard_shader() and
+    /// get_trail_mesh() with get_trail_shader(). Needs OCTET_INSTANCING.
+    void set_gpu_expansion(bool value) {
+      value = value && OCTET_INSTANCING;
+      if (value == gpu_expansion) return;
+      gpu_expansion = value;
+
+      clear_attributes();
+      if (value) {
+        add_corner_attribute(this);
+        add_instance_attribute(attribute_particle_pos, 4, GL_FLOAT, 0);
+        add_instance_attribute(attribute_particle_size, 2, GL_FLOAT, 16);
+        add_instance_attribute(attribute_particle_uv, 4, GL_FLOAT, 24);
+        if (!billboard_instances) {
+          billboard_instances = new gl_resource();
+          billboard_instances->allocate(GL_ARRAY_BUFFER, billboard_capacity * sizeof(billboard_instance), GL_STREAM_DRAW);
+        }
+        set_instance_vertices(billboard_instances, sizeof(billboard_instance));
+
+        // the trail mesh shares our corners and indices.
+        trail_mesh = new mesh(*this);
+        trail_mesh->clear_attributes();
+        add_corner_attribute(trail_mesh);
+        trail_mesh->add_instance_attribute(attribute_particle_pos, 4, GL_FLOAT, 0);
+        trail_mesh->add_instance_attribute(attribute_particle_tail, 4, GL_FLOAT, 16);
+        trail_mesh->add_instance_attribute(attribute_particle_axis, 3, GL_FLOAT, 32);
+        trail_mesh->add_instance_attribute(attribute_particle_uv, 4, GL_FLOAT, 44);
+        trail_mesh->add_instance_attribute(attribute_particle_tail_uv, 4, GL_FLOAT, 60);
+        gl_resource *trail_instances = new gl_resource();
+        trail_instances->allocate(GL_ARRAY_BUFFER, trail_particles.capacity() * sizeof(trail_instance), GL_STREAM_DRAW);
+        trail_mesh->set_instance_vertices(trail_instances, sizeof(trail_instance));
+      } else {
+        set_default_attributes();
+        set_instance_vertices(NULL, 0);
+        trail_mesh = NULL;
+      }
+      set_num_instances(0);
+    }
+
+    /// Are the particles expanded on the GPU?
+    bool get_gpu_expansion() const {
+      return gpu_expansion;
+    }
+
+    /// In GPU expansion mode, the mesh that draws the trails. NULL otherwise.
+    mesh *get_trail_mesh() const {
+      return trail_mesh;
+    }
+
+    /// The shader for the billboards in GPU expansion mode, with fs_url for the colour.
+    static param_shader *get_billboard_shader(const char *fs_url = "shaders/default_textured.fs") {
+      return param_shader::get("shaders/particle_billboard.vs", fs_url, "", true);
+    }
+
+    /// The shader for get_trail_mesh(), with fs_url for the colour.
+    static param_shader *get_trail_shader(const char *fs_url = "shaders/default_textured.fs") {
+      return param_shader::get("shaders/particle_trail.vs", fs_url, "", true);
+    }
+
     /// Generate mesh from particles
     virtual void update() {
-      //unsigned np = billboard_particles.size();
-      //unsigned vsize = billboard_particles.capacity() * sizeof(vertex) * 4;
-      //unsigned isize = billboard_particles.capacity() * sizeof(uint32_t) * 4;
+      if (gpu_expansion) {
+        update_instances();
+        return;
+      }
 
       gl_resource::wolock vlock(get_vertices());
       vertex *vtx = (vertex*)vlock.u8();
-      gl_resource::wolock ilock(get_indices());
-      uint32_t *idx = ilock.u32();
-      unsigned num_vertices = 0;
-      unsigned num_indices = 0;
 
       vec3 cx = cameraToWorld.x().xyz();
       vec3 cy = cameraToWorld.y().xyz();
       vec3p n = cameraToWorld.z().xyz();
 
-      for (unsigned i = 0; i != billboard_particles.size(); ++i) {
-        billboard_particle &p = billboard_particles[i];
-        if (p.enabled) {
-          vec2 size = p.size;
-          vec3 dx = size.x() * cx;
-          vec3 dy = size.y() * cy;
-          vec2 bl = p.uv_bottom_left;
-          vec2 tr = p.uv_top_right;
-          vec2 tl = vec2(bl.x(), tr.y());
-          vec2 br = vec2(tr.x(), bl.y());
-          vtx->pos = (vec3)p.pos - dx + dy; vtx->normal = n; vtx->uv = tl; vtx++;
-          vtx->pos = (vec3)p.pos + dx + dy; vtx->normal = n; vtx->uv = tr; vtx++;
-          vtx->pos = (vec3)p.pos + dx - dy; vtx->normal = n; vtx->uv = br; vtx++;
-          vtx->pos = (vec3)p.pos - dx - dy; vtx->normal = n; vtx->uv = bl; vtx++;
-          idx[0] = num_vertices; idx[1] = num_vertices+1; idx[2] = num_vertices+2;
-          idx[3] = num_vertices; idx[4] = num_vertices+2; idx[5] = num_vertices+3;
-          idx += 6;
-          num_vertices += 4;
-          num_indices += 6;
+      for (unsigned i = 0; i != num_billboards; ++i) {
+        vec3 pos(pos_x[i], pos_y[i], pos_z[i]);
+        vec3 ax = cx, ay = cy;
+        if (angle[i] != 0) {
+          float c = cosf(angle[i]), s = sinf(angle[i]);
+          ax = cx * c + cy * s;
+          ay = cy * c - cx * s;
         }
+        vec2 sz = size[i];
+        vec3 dx = sz.x() * ax;
+        vec3 dy = sz.y() * ay;
+        const vec4 &uv = uvs[i];
+        vtx->pos = pos - dx + dy; vtx->normal = n; vtx->uv = vec2(uv.x(), uv.w()); vtx++;
+        vtx->pos = pos + dx + dy; vtx->normal = n; vtx->uv = vec2(uv.z(), uv.w()); vtx++;
+        vtx->pos = pos + dx - dy; vtx->normal = n; vtx->uv = vec2(uv.z(), uv.y()); vtx++;
+        vtx->pos = pos - dx - dy; vtx->normal = n; vtx->uv = vec2(uv.x(), uv.y()); vtx++;
       }
 
-      set_num_vertices(num_vertices);
-      set_num_indices(num_indices);
+      set_num_vertices(num_billboards * 4);
+      set_num_indices(num_billboards * 6);
       //dump(log("mesh\n"));
     }
 
-    /// Add a billboard particle. Returns -1 if capacity reached.
-    int add_billboard_particle(const billboard_particle &p) {
-      int i = allocate(billboard_particles, free_billboard_particle);
-      if (i != -1) {
-        billboard_particles[i] = p;
-      }
-      return i;
+    /// Add a billboard particle. Returns false if capacity reached.
+    bool add_billboard_particle(const billboard_particle &p) {
+      if (num_billboards == billboard_capacity) return false;
+      unsigned i = num_billboards++;
+      vec3 pos = p.pos, vel = p.vel;
+      vec2 bl = p.uv_bottom_left, tr = p.uv_top_right;
+      pos_x[i] = pos.x(); pos_y[i] = pos.y(); pos_z[i] = pos.z();
+      vel_x[i] = vel.x(); vel_y[i] = vel.y(); vel_z[i] = vel.z();
+      angle[i] = p.angle; spin[i] = p.spin; life[i] = p.lifetime;
+      size[i] = p.size;
+      uvs[i] = vec4(bl.x(), bl.y(), tr.x(), tr.y());
+      return true;
     }
 
-    /// Add a particle animator. Returns -1 if capacity reached.
-    int add_particle_animator(const particle_animator &p) {
-      int i = allocate(particle_animators, free_particle_animator);
-      if (i != -1) {
-        particle_animators[i] = p;
-      }
-      return i;
+    /// Spawn up to count billboard particles. Returns the number actually added.
+    unsigned emit(const emitter &e, unsigned count, random &r) {
+      unsigned room = billboard_capacity - num_billboards;
+      if (count > room) count = room;
+      vec3 pos = e.pos, pos_spread = e.pos_spread, vel = e.vel, vel_spread = e.vel_spread;
+      vec2 bl = e.uv_bottom_left, tr = e.uv_top_right;
+      vec4 uv(bl.x(), bl.y(), tr.x(), tr.y());
+
+      // fill one array at a time.
+      unsigned begin = num_billboards, end = num_billboards + count;
+      for (unsigned i = begin; i != end; ++i) pos_x[i] = pos.x() + r.get(-pos_spread.x(), pos_spread.x());
+      for (unsigned i = begin; i != end; ++i) pos_y[i] = pos.y() + r.get(-pos_spread.y(), pos_spread.y());
+      for (unsigned i = begin; i != end; ++i) pos_z[i] = pos.z() + r.get(-pos_spread.z(), pos_spread.z());
+      for (unsigned i = begin; i != end; ++i) vel_x[i] = vel.x() + r.get(-vel_spread.x(), vel_spread.x());
+      for (unsigned i = begin; i != end; ++i) vel_y[i] = vel.y() + r.get(-vel_spread.y(), vel_spread.y());
+      for (unsigned i = begin; i != end; ++i) vel_z[i] = vel.z() + r.get(-vel_spread.z(), vel_spread.z());
+      for (unsigned i = begin; i != end; ++i) angle[i] = 0;
+      for (unsigned i = begin; i != end; ++i) spin[i] = r.get(-e.spin_spread, e.spin_spread);
+      for (unsigned i = begin; i != end; ++i) life[i] = e.lifetime + r.get(-e.lifetime_spread, e.lifetime_spread);
+      for (unsigned i = begin; i != end; ++i) size[i] = e.size;
+      for (unsigned i = begin; i != end; ++i) uvs[i] = uv;
+      num_billboards = end;
+      return count;
+    }
+
+    /// Number of live billboard particles.
+    unsigned get_num_billboard_particles() const {
+      return num_billboards;
+    }
+
+    /// Maximum number of billboard particles.
+    unsigned get_billboard_capacity() const {
+      return billboard_capacity;
+    }
+
+    /// Position of a live billboard particle. Indices change when particles die.
+    vec3 get_billboard_pos(unsigned i) const {
+      return vec3(pos_x[i], pos_y[i], pos_z[i]);
     }
 
     /// Add a trail particle. Returns -1 if capacity reached.
@@ -228,23 +464,16 @@ namespace octet { namespace scene {
       return i;
     }
 
-    billboard_particle &access_billboard_particle(int i) { return billboard_particles[i]; }
     trail_particle &access_trail_particle(int i) { return trail_particles[i]; }
-    particle_animator &access_particle_animator(int i) { return particle_animators[i]; }
 
     /// Serialise
     void visit(visitor &v) {
       mesh::visit(v);
       /*
-      v.visit(billboard_particles);
-      v.visit(free_billboard_particle);
       v.visit(trail_particles);
       v.visit(free_trail_particle);
-      v.visit(particle_animators);
-      v.visit(free_particle_animator);
       v.visit(cameraToWorld);
       */
     }
   };
 }}
-
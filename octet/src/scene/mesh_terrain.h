@@ -31,8 +31,8 @@ namespace octet { namespace scene {
 
     // override the update function to draw different geometry.
     void update() {
-      dynarray<mesh::vertex> vertices;
-      dynarray<uint32_t> indices;
+      dynarray<mesh::vertex, frame_allocator> vertices;
+      dynarray<uint32_t, frame_allocator> indices;
 
       vertices.reserve((dimensions.x()+1) * (dimensions.z()+1));
 
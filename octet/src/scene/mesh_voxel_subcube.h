@@ -8,37 +8,46 @@
 //
 
 namespace octet { namespace scene {
+  /// Call the interface for each row of exposed faces in a subcube.
+  /// neighbours are the opaque bits of the subcubes at -x, +x, -y, +y, -z and +z,
+  /// so that faces hidden by the next subcube are skipped. NULL means empty space.
   template <class interface_t, int dim> class mesh_iterate_faces : public interface_t {
   public:
-    void iterate(const uint32_t *opaque) {
+    void iterate(const uint32_t *opaque, const uint32_t *const *neighbours = 0) {
+      static const uint32_t empty[dim*dim] = { 0 };
+      const uint32_t *nb[6];
+      for (int i = 0; i != 6; ++i) {
+        nb[i] = neighbours && neighbours[i] ? neighbours[i] : empty;
+      }
+
       for (int z = 0; z != dim; ++z) {
         for (int y = 0; y != dim; ++y) {
           uint32_t p00 = opaque[z*dim+y];
-          interface_t::add_lefts( p00 & ~(p00 << 1), y, z );
-          interface_t::add_rights( p00 & ~(p00 >> 1), y, z );
+          interface_t::add_lefts( p00 & ~(p00 << 1 | nb[0][z*dim+y] >> (dim-1)), y, z );
+          interface_t::add_rights( p00 & ~(p00 >> 1 | nb[1][z*dim+y] << (dim-1)), y, z );
         }
       }
 
       for (int z = 0; z != dim; ++z) {
-        interface_t::add_bottoms( opaque[z*dim+0], 0, z );
+        interface_t::add_bottoms( opaque[z*dim+0] & ~nb[2][z*dim+(dim-1)], -1, z );
         for (int y = 0; y != dim-1; ++y) {
           uint32_t p00 = opaque[z*dim+y];
           uint32_t p01 = opaque[z*dim+(y+1)];
           interface_t::add_bottoms( p01 & ~p00, y, z );
           interface_t::add_tops( p00 & ~p01, y, z );
         }
-        interface_t::add_tops( opaque[z*dim+(dim-1)], dim-1, z );
+        interface_t::add_tops( opaque[z*dim+(dim-1)] & ~nb[3][z*dim+0], dim-1, z );
       }
 
       for (int y = 0; y != dim; ++y) {
-        interface_t::add_backs( opaque[0*dim+y], y, 0 );
+        interface_t::add_backs( opaque[0*dim+y] & ~nb[4][(dim-1)*dim+y], y, -1 );
         for (int z = 0; z != dim-1; ++z) {
           uint32_t p00 = opaque[z*dim+y];
           uint32_t p10 = opaque[(z+1)*dim+y];
           interface_t::add_backs( p10 & ~p00, y, z );
           interface_t::add_fronts( p00 & ~p10, y, z );
         }
-        interface_t::add_fronts( opaque[(dim-1)*dim+y], y, dim-1 );
+        interface_t::add_fronts( opaque[(dim-1)*dim+y] & ~nb[5][0*dim+y], y, dim-1 );
       }
     }
   };
@@ -55,6 +64,8 @@ namespace octet { namespace scene {
     void add_backs(uint32_t v, int, int) { num_faces += pop_count(v); }
   };
 
+  /// Writes four vertices per face. The indices are the same for every face
+  /// so mesh_voxels keeps them in a fixed index buffer.
   class face_adder {
   public:
     vec3 origin;
@@ -62,14 +73,12 @@ namespace octet { namespace scene {
     vec3 dy;
     vec3 dz;
     mesh::vertex *vtx;
-    uint32_t *idx;
     float voxel_size;
     unsigned num_faces;
 
     face_adder() { num_faces = 0; }
 
     void add_faces(uint32_t v, vec3_in base, vec3_in du, vec3_in dv, const vec3p &normal) {
-      unsigned idx_val = num_faces * 4;
       for (int i = 0; i < 32; v >>= 1, i++) {
         if ((v & 0xff) == 0) { v >>= 8; i += 8; }
         if ((v & 0x3) == 0) { v >>= 2; i += 2; }
@@ -79,13 +88,7 @@ namespace octet { namespace scene {
           vtx->pos = pos + du; vtx->normal = normal; vtx->uv = vec2p(1, 0); vtx++;
           vtx->pos = pos + du + dv; vtx->normal = normal; vtx->uv = vec2p(1, 1); vtx++;
           vtx->pos = pos + dv; vtx->normal = normal; vtx->uv = vec2p(0, 1); vtx++;
-          idx[0] = idx_val + 0;
-          idx[3] = idx[1] = idx_val + 1;
-          idx[5] = idx[2] = idx_val + 3;
-          idx[4] = idx_val + 2;
-          idx += 6;
           num_faces++;
-          idx_val += 4;
         }
       }
     }
@@ -134,6 +137,103 @@ namespace octet { namespace scene {
     }
   };
 
+  /// Joins coplanar neighbouring faces of a subcube into larger quads.
+  ///
+  /// The faces are gathered into a 32x32 bit mask for each plane and direction.
+  /// merge() takes each run of bits in a row and grows it over the following rows
+  /// for as long as they have the same run. If vtx is NULL, merge() only counts quads.
+  class greedy_face_adder {
+    enum { dim = 32 };
+
+    // masks[dir][plane][row] for -x, +x, -y, +y, -z, +z.
+    // x faces: row = z, bit = y. y faces: row = z, bit = x. z faces: row = y, bit = x.
+    uint32_t masks[6][dim][dim];
+
+    // x faces arrive with x in the bits, so turn them around.
+    void add_transposed(int dir, uint32_t v, int y, int z) {
+      while (v) {
+        int x = ctz(v);
+        v &= v - 1;
+        masks[dir][x][z] |= 1u << y;
+      }
+    }
+
+    // add a quad covering u0..u1 and v0..v1 in voxels on the plane at c.
+    void add_quad(int dir, int c, int u0, int u1, int v0, int v1) {
+      num_faces++;
+      if (!vtx) return;
+
+      int n = dir >> 1;
+      int axis_u = n == 0 ? 1 : 0;
+      int axis_v = n == 2 ? 1 : 2;
+      bool positive = (dir & 1) != 0;
+
+      // same corners and winding as face_adder, stretched over the quad.
+      vec3 base(0, 0, 0), du(0, 0, 0), dv(0, 0, 0), normal(0, 0, 0);
+      base[n] = (float)c;
+      base[axis_u] = (float)(positive ? u1 : u0);
+      base[axis_v] = (float)(positive ? v1 : v0);
+      du[axis_u] = (float)(positive ? u0 - u1 : u1 - u0);
+      dv[axis_v] = (float)(positive ? v0 - v1 : v1 - v0);
+      normal[n] = positive ? 1.0f : -1.0f;
+
+      vec3 pos = origin + base * voxel_size;
+      du = du * voxel_size;
+      dv = dv * voxel_size;
+      // the texture repeats once per voxel.
+      float w = (float)(u1 - u0), h = (float)(v1 - v0);
+      vtx->pos = pos; vtx->normal = normal; vtx->uv = vec2p(0, 0); vtx++;
+      vtx->pos = pos + du; vtx->normal = normal; vtx->uv = vec2p(w, 0); vtx++;
+      vtx->pos = pos + du + dv; vtx->normal = normal; vtx->uv = vec2p(w, h); vtx++;
+      vtx->pos = pos + dv; vtx->normal = normal; vtx->uv = vec2p(0, h); vtx++;
+    }
+
+  public:
+    vec3 origin;
+    float voxel_size;
+    mesh::vertex *vtx;
+    // quads after merging
+    unsigned num_faces;
+    // voxel faces before merging
+    unsigned num_voxel_faces;
+
+    greedy_face_adder() { vtx = NULL; voxel_size = 1; clear(); }
+
+    void clear() {
+      memset(masks, 0, sizeof(masks));
+      num_faces = num_voxel_faces = 0;
+    }
+
+    void add_lefts(uint32_t v, int y, int z) { num_voxel_faces += pop_count(v); add_transposed(0, v, y, z); }
+    void add_rights(uint32_t v, int y, int z) { num_voxel_faces += pop_count(v); add_transposed(1, v, y, z); }
+    void add_bottoms(uint32_t v, int y, int z) { num_voxel_faces += pop_count(v); masks[2][y+1][z] |= v; }
+    void add_tops(uint32_t v, int y, int z) { num_voxel_faces += pop_count(v); masks[3][y][z] |= v; }
+    void add_backs(uint32_t v, int y, int z) { num_voxel_faces += pop_count(v); masks[4][z+1][y] |= v; }
+    void add_fronts(uint32_t v, int y, int z) { num_voxel_faces += pop_count(v); masks[5][z][y] |= v; }
+
+    /// Make the quads from the masks. This clears the masks.
+    void merge() {
+      for (int dir = 0; dir != 6; ++dir) {
+        for (int plane = 0; plane != dim; ++plane) {
+          uint32_t *rows = masks[dir][plane];
+          for (int row = 0; row != dim; ++row) {
+            while (rows[row]) {
+              int u0 = ctz(rows[row]);
+              int len = ctz(~(rows[row] >> u0));
+              uint32_t run = len == 32 ? 0xffffffff : ((1u << len) - 1) << u0;
+              int row_end = row + 1;
+              while (row_end != dim && (rows[row_end] & run) == run) {
+                rows[row_end++] &= ~run;
+              }
+              rows[row] &= ~run;
+              add_quad(dir, plane + (dir & 1), u0, u0 + len, row, row_end);
+            }
+          }
+        }
+      }
+    }
+  };
+
   /// experimental voxel world subcube class.
   class mesh_voxel_subcube : public resource {
     enum {
@@ -170,6 +270,19 @@ namespace octet { namespace scene {
     static unsigned get4(uint32_t *src, unsigned x, unsigned y, unsigned z) { return (src[off4(x,y,z)] >> shift4(x,y,z)) & 1; }
     static unsigned get2(uint32_t *src, unsigned x, unsigned y, unsigned z) { return (src[off2(x,y,z)] >> shift2(x,y,z)) & 1; }
 
+    // which borders does a change to row (y, z) touch?
+    static unsigned change_mask(uint32_t changed, int y, int z) {
+      if (!changed) return 0;
+      unsigned mask = changed_any;
+      if (changed & 1) mask |= changed_neg_x;
+      if (changed >> (dim-1)) mask |= changed_pos_x;
+      if (y == 0) mask |= changed_neg_y;
+      if (y == dim-1) mask |= changed_pos_y;
+      if (z == 0) mask |= changed_neg_z;
+      if (z == dim-1) mask |= changed_pos_z;
+      return mask;
+    }
+
     static unsigned rot(unsigned x, unsigned amount) { return (x << amount) | (x >> (32-amount)); }
 
     // abcd -> acbd
@@ -178,6 +291,18 @@ namespace octet { namespace scene {
   public:
     RESOURCE_META(mesh_voxel_subcube)
 
+    /// Bits returned by add_voxels and set_voxel. The border bits say which
+    /// neighbouring subcubes can see the change.
+    enum {
+      changed_neg_x = 1 << 0,
+      changed_pos_x = 1 << 1,
+      changed_neg_y = 1 << 2,
+      changed_pos_y = 1 << 3,
+      changed_neg_z = 1 << 4,
+      changed_pos_z = 1 << 5,
+      changed_any = 1 << 6,
+    };
+
     mesh_voxel_subcube() {
       memset(opaque, 0, sizeof(opaque));
       //update_lod();
@@ -263,6 +388,11 @@ namespace octet { namespace scene {
       assert(any - any_opaque == num_lod);
     }
 
+    /// the voxels, one bit per voxel in 32x32 words: opaque[z*32+y] >> x
+    const uint32_t *get_opaque() const {
+      return opaque;
+    }
+
     void count_faces(mesh_iterate_faces<face_counter, dim> &count) {
       count.iterate(opaque);
     }
@@ -271,17 +401,31 @@ namespace octet { namespace scene {
       add.iterate(opaque);
     }
 
-    template <class set> void add_voxels(mat4t_in voxelToWorld, const set &set_in) {
+    /// Add the voxels inside a shape. Returns a mask of changed_* bits.
+    template <class set> unsigned add_voxels(mat4t_in voxelToWorld, const set &set_in) {
+      unsigned mask = 0;
       for (int z = 0; z != dim; ++z) {
         for (int y = 0; y != dim; ++y) {
+          uint32_t row = opaque[z*dim+y];
           for (int x = 0; x != dim; ++x) {
             vec3 txyz = vec3(x, y, z) * voxelToWorld;
             if (set_in.intersects(txyz)) {
-              opaque[z*dim+y] |= 1 << x;
+              row |= 1 << x;
             }
           }
+          mask |= change_mask(row ^ opaque[z*dim+y], y, z);
+          opaque[z*dim+y] = row;
         }
       }
+      return mask;
+    }
+
+    /// Set or clear one voxel. Returns a mask of changed_* bits.
+    unsigned set_voxel(ivec3_in pos, bool value) {
+      uint32_t &row = opaque[pos.z()*dim+pos.y()];
+      uint32_t old = row;
+      row = value ? row | (1u << pos.x()) : row & ~(1u << pos.x());
+      return change_mask(row ^ old, pos.y(), pos.z());
     }
 
     void dump_lod(FILE *fp, const char *label, uint32_t *src) {
@@ -27,13 +27,103 @@ namespace octet { namespace scene {
 
   /// Experimental Voxel world mesh, uses subcubes to create a voxel world.
   class mesh_voxels : public mesh {
+  public:
+    /// Where a ray or a sweep first touched a voxel mesh, in mesh space.
+    struct voxel_hit {
+      vec3 pos;
+      vec3 normal;
+      ivec3 voxel;
+      // fraction of the ray or sweep distance
+      float t;
+    };
+
+    /// A point where two voxel meshes touch, in world space.
+    struct voxel_contact {
+      vec3 pos;
+      vec3 normal;
+      float depth;
+    };
+
+  private:
+    // set OCTET_VOXEL_TRACE to log every pair of blocks visited by the collision tests.
+    enum { trace = OCTET_VOXEL_TRACE };
+
     ivec3 size;
     float voxel_size;
 
-    enum { log_subcube_dim = 5, subcube_dim = 1 << log_subcube_dim };
+    enum {
+      log_subcube_dim = 5,
+      subcube_dim = 1 << log_subcube_dim,
+      subcube_words = subcube_dim * subcube_dim,
+      // a thread needs at least this many subcubes to remesh.
+      min_jobs_per_thread = 4,
+    };
 
     dynarray<ref<mesh_voxel_subcube> > subcubes;
 
+    // per subcube flags: what needs updating.
+    enum { dirty_mesh = 1, dirty_lod = 2 };
+    dynarray<uint8_t> flags;
+
+    // each subcube owns a range of faces in the pooled vertex buffer.
+    // faces past num_faces are zero-area triangles.
+    struct subcube_range {
+      unsigned first_face;
+      unsigned max_faces;
+      unsigned num_faces;
+      unsigned num_voxel_faces;
+    };
+    dynarray<subcube_range> ranges;
+
+    // faces in the buffers, faces drawn and faces in abandoned ranges.
+    unsigned pool_faces;
+    unsigned used_faces;
+    unsigned wasted_faces;
+
+    // a remesh in progress.
+    struct remesh_job {
+      int subcube;
+      unsigned num_faces;
+      unsigned num_voxel_faces;
+      unsigned first_staged;
+      unsigned old_first_face;
+      unsigned old_max_faces;
+    };
+    dynarray<remesh_job> jobs;
+    std::atomic<unsigned> next_job;
+    dynarray<vertex> staging;
+
+    // copies of the voxels of the subcubes being remeshed and their neighbours.
+    dynarray<uint32_t> snapshots;
+    dynarray<int> snapshot_slots;
+
+    std::thread worker;
+    std::atomic<bool> jobs_done;
+    bool repacking;
+    unsigned num_remeshed;
+
+    // join neighbouring faces into bigger quads. jobs_greedy is the setting the jobs started with.
+    bool greedy;
+    bool jobs_greedy;
+
+    int subcube_index(ivec3_in pos) const {
+      return pos.x() + size.x() * (pos.y() + size.y() * pos.z());
+    }
+
+    ivec3 subcube_pos(int index) const {
+      return ivec3(index % size.x(), (index / size.x()) % size.y(), index / (size.x() * size.y()));
+    }
+
+    // -x, +x, -y, +y, -z, +z as in mesh_voxel_subcube::changed_*
+    static const ivec3 &neighbour_delta(int i) {
+      static const ivec3 d[] = {
+        ivec3(-1, 0, 0), ivec3(1, 0, 0),
+        ivec3(0, -1, 0), ivec3(0, 1, 0),
+        ivec3(0, 0, -1), ivec3(0, 0, 1),
+      };
+      return d[i];
+    }
+
     struct kd_node {
       int axis;
       int kids[2];
@@ -64,47 +154,177 @@ namespace octet { namespace scene {
       return d[i];
     }
 
-    void update_mesh() {
+    // remesh the jobs from next_job onwards. Called on several threads at once.
+    void mesh_jobs(bool add_pass) {
       mesh_iterate_faces<face_counter, subcube_dim> count;
-      for (unsigned i = 0; i != subcubes.size(); ++i) {
-        mesh_voxel_subcube *p = subcubes[i];
-        if (p) {
-          p->count_faces(count);
-        }
-      }
-
-      allocate(sizeof(vertex)*count.num_faces*4, sizeof(uint32_t)*count.num_faces*6);
-      set_num_indices(count.num_faces*6);
-      set_num_vertices(count.num_faces*4);
-
       mesh_iterate_faces<face_adder, subcube_dim> add;
-      add.vtx = (vertex *)get_vertices()->lock();
-      add.idx = (uint32_t *)get_indices()->lock();
       add.dx = vec3(voxel_size, 0.0f, 0.0f);
       add.dy = vec3(0.0f, voxel_size, 0.0f);
       add.dz = vec3(0.0f, 0.0f, voxel_size);
       add.voxel_size = voxel_size;
-
       vec3 offset = vec3(size) * (-0.5f * subcube_dim * voxel_size);
       vec3 scale(subcube_dim * voxel_size);
-      int idx = 0;
-      for (int z = 0; z != size.z(); ++z) {
-        for (int y = 0; y != size.y(); ++y) {
-          for (int x = 0; x != size.x(); ++x) {
-            mesh_voxel_subcube *p = subcubes[idx++];
-            add.origin = vec3(x, y, z) * scale + offset;
-            if (p) {
-              p->add_faces(add);
-            }
+
+      for (;;) {
+        unsigned j = next_job++;
+        if (j >= jobs.size()) break;
+        remesh_job &job = jobs[j];
+        ivec3 pos = subcube_pos(job.subcube);
+
+        // the subcube and its neighbours as they were when we started.
+        const uint32_t *opaque = &snapshots[snapshot_slots[job.subcube] * subcube_words];
+        const uint32_t *neighbours[6];
+        for (int i = 0; i != 6; ++i) {
+          ivec3 npos = pos + neighbour_delta(i);
+          bool inside = all(npos >= ivec3(0, 0, 0)) && all(npos < size);
+          int slot = inside ? snapshot_slots[subcube_index(npos)] : -1;
+          neighbours[i] = slot == -1 ? NULL : &snapshots[slot * subcube_words];
+        }
+
+        if (jobs_greedy) {
+          // merge once to count the quads and again to add them.
+          mesh_iterate_faces<greedy_face_adder, subcube_dim> greedy;
+          greedy.origin = vec3(pos) * scale + offset;
+          greedy.voxel_size = voxel_size;
+          greedy.vtx = add_pass ? &staging[job.first_staged * 4] : NULL;
+          greedy.iterate(opaque, neighbours);
+          greedy.merge();
+          assert(!add_pass || greedy.num_faces == job.num_faces);
+          job.num_faces = greedy.num_faces;
+          job.num_voxel_faces = greedy.num_voxel_faces;
+        } else if (add_pass) {
+          add.origin = vec3(pos) * scale + offset;
+          add.vtx = &staging[job.first_staged * 4];
+          add.num_faces = 0;
+          add.iterate(opaque, neighbours);
+          assert(add.num_faces == job.num_faces);
+        } else {
+          count.num_faces = 0;
+          count.iterate(opaque, neighbours);
+          job.num_faces = job.num_voxel_faces = count.num_faces;
+        }
+      }
+    }
+
+    // run one pass over the jobs, on several threads if there is enough work.
+    void run_pass(bool add_pass) {
+      next_job = 0;
+      unsigned num_threads = std::thread::hardware_concurrency();
+      unsigned max_threads = jobs.size() / min_jobs_per_thread;
+      if (num_threads > max_threads) num_threads = max_threads;
+
+      dynarray<std::thread> threads;
+      for (unsigned i = 1; i < num_threads; ++i) {
+        threads.push_back(std::thread(&mesh_voxels::mesh_jobs, this, add_pass));
+      }
+      mesh_jobs(add_pass);
+      for (unsigned i = 0; i != threads.size(); ++i) {
+        threads[i].join();
+      }
+    }
+
+    // mesh all the jobs into the staging buffer. This does not touch GL or the live voxels.
+    void run_jobs() {
+      run_pass(false);
+      unsigned num_staged = 0;
+      for (unsigned j = 0; j != jobs.size(); ++j) {
+        jobs[j].first_staged = num_staged;
+        num_staged += jobs[j].num_faces;
+      }
+      staging.resize(num_staged * 4);
+      run_pass(true);
+      jobs_done = true;
+    }
+
+    // make room for at least min_faces faces in the pooled buffers, keeping the first used_faces.
+    void grow_pool(unsigned min_faces) {
+      unsigned new_faces = pool_faces + pool_faces / 2;
+      if (new_faces < min_faces) new_faces = min_faces;
+
+      gl_resource *vertices = new gl_resource();
+      vertices->allocate(GL_ARRAY_BUFFER, new_faces * 4 * sizeof(vertex), GL_DYNAMIC_DRAW);
+      if (used_faces) {
+        gl_resource::rolock old_lock(get_vertices());
+        vertices->assign(old_lock.u8(), 0, used_faces * 4 * sizeof(vertex));
+      }
+      set_vertices(vertices);
+
+      // every face uses the same pattern of indices.
+      dynarray<uint32_t> indices(new_faces * 6);
+      for (unsigned i = 0; i != new_faces; ++i) {
+        uint32_t *idx = &indices[i * 6];
+        idx[0] = i * 4 + 0;
+        idx[3] = idx[1] = i * 4 + 1;
+        idx[5] = idx[2] = i * 4 + 3;
+        idx[4] = i * 4 + 2;
+      }
+      set_indices(indices);
+      pool_faces = new_faces;
+    }
+
+    // copy the finished jobs into the pooled buffers and switch to the new faces in one go.
+    void commit_jobs() {
+      if (repacking) {
+        memset(ranges.data(), 0, ranges.size() * sizeof(subcube_range));
+        used_faces = wasted_faces = 0;
+      }
+
+      // subcubes that outgrow their range move to the end of the pool.
+      unsigned old_used_faces = used_faces;
+      for (unsigned j = 0; j != jobs.size(); ++j) {
+        remesh_job &job = jobs[j];
+        subcube_range &range = ranges[job.subcube];
+        job.old_first_face = range.first_face;
+        job.old_max_faces = 0;
+        if (job.num_faces > range.max_faces) {
+          job.old_max_faces = range.max_faces;
+          wasted_faces += range.max_faces;
+          range.first_face = used_faces;
+          range.max_faces = job.num_faces + job.num_faces / 4 + 4;
+          used_faces += range.max_faces;
+        }
+        range.num_faces = job.num_faces;
+        range.num_voxel_faces = job.num_voxel_faces;
+      }
+
+      if (used_faces > pool_faces) {
+        unsigned keep = used_faces;
+        used_faces = old_used_faces;
+        grow_pool(keep);
+        used_faces = keep;
+      }
+
+      if (!jobs.empty()) {
+        gl_resource::wolock vtx_lock(get_vertices());
+        vertex *vtx = (vertex*)vtx_lock.u8();
+        for (unsigned j = 0; j != jobs.size(); ++j) {
+          const remesh_job &job = jobs[j];
+          const subcube_range &range = ranges[job.subcube];
+          // unused faces are zero-area triangles.
+          if (job.old_max_faces) {
+            memset(vtx + job.old_first_face * 4, 0, job.old_max_faces * 4 * sizeof(vertex));
           }
+          memcpy(vtx + range.first_face * 4, &staging[job.first_staged * 4], job.num_faces * 4 * sizeof(vertex));
+          memset(vtx + (range.first_face + job.num_faces) * 4, 0, (range.max_faces - job.num_faces) * 4 * sizeof(vertex));
         }
       }
 
-      assert(count.num_faces == add.num_faces);
+      set_num_vertices(used_faces * 4);
+      set_num_indices(used_faces * 6);
+      num_remeshed = jobs.size();
+      jobs.resize(0);
+      staging.reset();
+    }
 
-      get_vertices()->unlock();
-      get_indices()->unlock();
-      //dump(log("voxels\n"));
+    void mark_dirty(ivec3_in pos, unsigned mask) {
+      if (!(mask & mesh_voxel_subcube::changed_any)) return;
+      flags[subcube_index(pos)] |= dirty_mesh | dirty_lod;
+      for (int i = 0; i != 6; ++i) {
+        ivec3 npos = pos + neighbour_delta(i);
+        if ((mask & (1 << i)) && all(npos >= ivec3(0, 0, 0)) && all(npos < size)) {
+          flags[subcube_index(npos)] |= dirty_mesh;
+        }
+      }
     }
 
     template <class set> void add_voxels(mat4t_in voxelToWorld, const set &set_in) {
@@ -118,7 +338,7 @@ namespace octet { namespace scene {
             vec3 pos = vec3(x, y, z) * scale + offset;
             localVoxelToWorld.translate(pos.x(), pos.y(), pos.z());
             //localVoxelToWorld.w() += vec4(0.5f, 0.5f, 0.5f, 0.0f);
-            subcubes[idx++]->add_voxels(localVoxelToWorld, set_in);
+            mark_dirty(ivec3(x, y, z), subcubes[idx++]->add_voxels(localVoxelToWorld, set_in));
           }
         }
       }
@@ -158,6 +378,341 @@ namespace octet { namespace scene {
       return *this;
     }*/
 
+    // mesh space position of the corner of voxel (0, 0, 0).
+    vec3 get_corner() const {
+      return vec3(size) * (-0.5f * subcube_dim * voxel_size);
+    }
+
+    // Is any voxel set in the block of 2^level voxels at pos (in blocks)?
+    // Blocks outside the mesh are empty. Blocks bigger than a subcube, and subcubes
+    // whose LODs are out of date, are assumed to have something in them.
+    unsigned any_at(ivec3_in pos, int level) const {
+      ivec3 start = pos << level;
+      if (any(start < ivec3(0, 0, 0)) || any(start >= size * subcube_dim)) return 0;
+      if (level > log_subcube_dim) return 1;
+      int index = subcube_index(start >> log_subcube_dim);
+      if (level != 0 && (flags[index] & dirty_lod)) return 1;
+      return subcubes[index]->is_any((start & (subcube_dim-1)) >> level, level);
+    }
+
+    // smallest level whose single block covers the whole mesh.
+    int get_top_level() const {
+      int dim = std::max(size.x(), std::max(size.y(), size.z())) * subcube_dim;
+      int level = 0;
+      while ((1 << level) < dim) ++level;
+      return level;
+    }
+
+    // Separating axis test between a block of mesh a and a block of mesh b,
+    // done in a's voxel space where a's blocks are axis aligned cubes.
+    // Everything that depends only on the orientation is worked out once per query.
+    class block_overlap {
+      mat4t b_to_a;
+      vec3 axes[3];
+      float scale;
+      float r[3][3];
+      float row_sums[3];
+      float col_sums[3];
+      float cross_a[3][3];
+      float cross_b[3][3];
+
+    public:
+      block_overlap(const mesh_voxels &a, const mesh_voxels &b, mat4t_in mxa, mat4t_in mxb) {
+        b_to_a = b.get_voxelToMesh() * mxb * inverse3x4(a.get_voxelToMesh() * mxa);
+        scale = length(b_to_a[0].xyz());
+        float abs_r[3][3];
+        for (int j = 0; j != 3; ++j) {
+          axes[j] = normalize(b_to_a[j].xyz());
+          for (int i = 0; i != 3; ++i) {
+            r[i][j] = axes[j][i];
+            // the epsilon stops parallel edges from making a bad cross product axis.
+            abs_r[i][j] = fabsf(r[i][j]) + 1e-6f;
+          }
+        }
+        for (int i = 0; i != 3; ++i) {
+          row_sums[i] = abs_r[i][0] + abs_r[i][1] + abs_r[i][2];
+          col_sums[i] = abs_r[0][i] + abs_r[1][i] + abs_r[2][i];
+        }
+        for (int i = 0; i != 3; ++i) {
+          int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+          for (int j = 0; j != 3; ++j) {
+            int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+            cross_a[i][j] = abs_r[i1][j] + abs_r[i2][j];
+            cross_b[i][j] = abs_r[i][j1] + abs_r[i][j2];
+          }
+        }
+      }
+
+      /// centre of a block of b in a's voxel space
+      vec3 centre_b(ivec3_in pos, int level) const {
+        return ((vec3(pos) + 0.5f) * (float)(1 << level)) * b_to_a;
+      }
+
+      /// a direction in b's voxel space turned into a's voxel space
+      vec3 direction_b(vec3_in v) const {
+        return axes[0] * v.x() + axes[1] * v.y() + axes[2] * v.z();
+      }
+
+      /// half size of a block of b in a's voxels
+      float half_b(int level) const {
+        return (float)(1 << level) * 0.5f * scale;
+      }
+
+      /// do cubes of half size ha at ca (axis aligned) and hb at cb (b's axes) overlap?
+      bool overlaps(vec3_in ca, float ha, vec3_in cb, float hb) const {
+        vec3 t = cb - ca;
+        for (int i = 0; i != 3; ++i) {
+          if (fabsf(t[i]) > ha + hb * row_sums[i]) return false;
+        }
+        for (int j = 0; j != 3; ++j) {
+          if (fabsf(dot(t, axes[j])) > ha * col_sums[j] + hb) return false;
+        }
+        for (int i = 0; i != 3; ++i) {
+          int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+          for (int j = 0; j != 3; ++j) {
+            if (fabsf(t[i2] * r[i1][j] - t[i1] * r[i2][j]) > ha * cross_a[i][j] + hb * cross_b[i][j]) return false;
+          }
+        }
+        return true;
+      }
+
+      /// the face axis with the least overlap, pointing from b to a, and the overlap.
+      float penetration(vec3_in ca, float ha, vec3_in cb, float hb, vec3 &normal) const {
+        vec3 t = cb - ca;
+        float depth = FLT_MAX;
+        for (int i = 0; i != 3; ++i) {
+          float d = ha + hb * row_sums[i] - fabsf(t[i]);
+          if (d < depth) {
+            depth = d;
+            normal = vec3(0, 0, 0);
+            normal[i] = t[i] > 0 ? -1.0f : 1.0f;
+          }
+        }
+        for (int j = 0; j != 3; ++j) {
+          float tj = dot(t, axes[j]);
+          float d = ha * col_sums[j] + hb - fabsf(tj);
+          if (d < depth) {
+            depth = d;
+            normal = tj > 0 ? -axes[j] : axes[j];
+          }
+        }
+        return depth;
+      }
+    };
+
+    // Walk the LOD pyramids of two meshes, splitting the bigger block of each
+    // overlapping pair, and call the visitor for each pair of voxels that overlap.
+    // The visitor returns false to stop early.
+    template <class visitor_t> void visit_overlaps(const mesh_voxels &b, mat4t_in mxa, mat4t_in mxb, visitor_t &visitor) const {
+      const mesh_voxels &a = *this;
+      block_overlap test(a, b, mxa, mxb);
+
+      dynarray<entries> stack;
+      stack.reserve(64);
+      stack.push_back(entries(entry(a.get_top_level(), ivec3(0, 0, 0), false), entry(b.get_top_level(), ivec3(0, 0, 0), false)));
+
+      while (!stack.empty()) {
+        entry ta = stack.back().first;
+        entry tb = stack.back().second;
+        stack.pop_back();
+
+        if (!a.any_at(ta.pos, ta.level) || !b.any_at(tb.pos, tb.level)) continue;
+
+        float ha = (float)(1 << ta.level) * 0.5f;
+        float hb = test.half_b(tb.level);
+        vec3 ca = (vec3(ta.pos) + 0.5f) * (float)(1 << ta.level);
+        vec3 cb = test.centre_b(tb.pos, tb.level);
+        if (!test.overlaps(ca, ha, cb, hb)) continue;
+
+        if (trace) {
+          char tmp[2][128];
+          log("%3d a: %s @%d  b: %s @%d\n", stack.size(), ta.pos.toString(tmp[0], sizeof(tmp[0])), ta.level, tb.pos.toString(tmp[1], sizeof(tmp[1])), tb.level);
+        }
+
+        if (ta.level == 0 && tb.level == 0) {
+          if (!visitor(test, ta.pos, ca, tb.pos, cb)) return;
+        } else if (ta.level != 0 && (tb.level == 0 || ha >= hb)) {
+          for (int i = 0; i != 8; ++i) {
+            stack.push_back(entries(entry(ta.level - 1, ta.pos * 2 + delta(i), false), tb));
+          }
+        } else {
+          for (int i = 0; i != 8; ++i) {
+            stack.push_back(entries(ta, entry(tb.level - 1, tb.pos * 2 + delta(i), false)));
+          }
+        }
+      }
+    }
+
+    // stops at the first overlap.
+    struct first_overlap {
+      bool found;
+      first_overlap() { found = false; }
+      bool operator()(const block_overlap &, ivec3_in, vec3_in, ivec3_in, vec3_in) {
+        found = true;
+        return false;
+      }
+    };
+
+    // the directions from a voxel to its empty neighbours, added up.
+    vec3 surface_normal(ivec3_in pos) const {
+      vec3 normal(0, 0, 0);
+      for (int i = 0; i != 6; ++i) {
+        if (!any_at(pos + neighbour_delta(i), 0)) normal += vec3(neighbour_delta(i));
+      }
+      return normal;
+    }
+
+    // makes a contact for each overlapping pair of voxels.
+    struct contact_collector {
+      const mesh_voxels *a;
+      const mesh_voxels *b;
+      dynarray<voxel_contact> *contacts;
+      mat4t a_to_world;
+      unsigned max_contacts;
+      // reduce the contacts when we have this many.
+      unsigned max_raw;
+
+      bool operator()(const block_overlap &test, ivec3_in pa, vec3_in ca, ivec3_in pb, vec3_in cb) {
+        vec3 normal;
+        float depth = test.penetration(ca, 0.5f, cb, test.half_b(0), normal);
+
+        // the surfaces of the two voxels give a better normal than the overlap
+        // of two cubes when the meshes are deeper into each other than a voxel.
+        vec3 surface = test.direction_b(b->surface_normal(pb)) - a->surface_normal(pa);
+        if (squared(surface) > 1e-6f) normal = normalize(surface);
+
+        voxel_contact c;
+        c.pos = ((ca + cb) * 0.5f) * a_to_world;
+        c.normal = normalize((normal.xyz0() * a_to_world).xyz());
+        c.depth = depth * a->voxel_size;
+        contacts->push_back(c);
+        if (contacts->size() == max_raw) {
+          reduce_contacts(*contacts, max_contacts);
+        }
+        return true;
+      }
+    };
+
+    // Keep the deepest contact, then repeatedly the one furthest from those kept.
+    static void reduce_contacts(dynarray<voxel_contact> &contacts, unsigned max_contacts) {
+      unsigned num = contacts.size();
+      if (num <= max_contacts) return;
+      if (max_contacts == 0) {
+        contacts.resize(0);
+        return;
+      }
+
+      unsigned deepest = 0;
+      for (unsigned i = 1; i != num; ++i) {
+        if (contacts[i].depth > contacts[deepest].depth) deepest = i;
+      }
+      std::swap(contacts[0], contacts[deepest]);
+
+      // nearest[i] is the squared distance from contact i to the nearest kept contact.
+      dynarray<float> nearest(num);
+      for (unsigned i = 1; i != num; ++i) {
+        nearest[i] = squared(contacts[i].pos - contacts[0].pos);
+      }
+      for (unsigned kept = 1; kept != max_contacts; ++kept) {
+        unsigned furthest = kept;
+        for (unsigned i = kept + 1; i < num; ++i) {
+          if (nearest[i] > nearest[furthest]) furthest = i;
+        }
+        std::swap(contacts[kept], contacts[furthest]);
+        std::swap(nearest[kept], nearest[furthest]);
+        for (unsigned i = kept + 1; i < num; ++i) {
+          float d2 = squared(contacts[i].pos - contacts[kept].pos);
+          if (d2 < nearest[i]) nearest[i] = d2;
+        }
+      }
+      contacts.resize(max_contacts);
+    }
+
+    // state of a sphere sweep in voxel space.
+    struct sweep_state {
+      vec3 start;
+      vec3 distance;
+      float radius;
+      float best_t;
+      vec3 best_normal;
+      ivec3 best_voxel;
+    };
+
+    // first t in [0, 1] at which a ray enters a box, or a value > 1 if it misses.
+    static float ray_enter_box(vec3_in start, vec3_in distance, vec3_in lo, vec3_in hi, float &t_exit) {
+      float t_enter = -FLT_MAX;
+      t_exit = FLT_MAX;
+      for (int i = 0; i != 3; ++i) {
+        if (distance[i] == 0) {
+          if (start[i] < lo[i] || start[i] > hi[i]) return FLT_MAX;
+        } else {
+          float rd = 1.0f / distance[i];
+          float t0 = (lo[i] - start[i]) * rd, t1 = (hi[i] - start[i]) * rd;
+          if (t0 > t1) std::swap(t0, t1);
+          if (t0 > t_enter) t_enter = t0;
+          if (t1 < t_exit) t_exit = t1;
+        }
+      }
+      return t_enter <= t_exit && t_exit >= 0 && t_enter <= 1 ? t_enter : FLT_MAX;
+    }
+
+    // distance from the sweep's sphere at t to a box, less the radius.
+    static float sweep_gap(const sweep_state &s, float t, vec3_in lo, vec3_in hi) {
+      vec3 c = s.start + s.distance * t;
+      return length(c - min(max(c, lo), hi)) - s.radius;
+    }
+
+    // time of impact of the sphere with one voxel, if earlier than best_t.
+    static void sweep_voxel(sweep_state &s, ivec3_in voxel) {
+      vec3 lo = vec3(voxel), hi = lo + 1.0f;
+      float t_exit;
+      float t_enter = ray_enter_box(s.start, s.distance, lo - s.radius, hi + s.radius, t_exit);
+      if (t_enter >= s.best_t) return;
+
+      // the grown box has rounded edges and corners. The gap is convex in t,
+      // so find its smallest value and then the first time it reaches zero.
+      float t0 = std::max(t_enter, 0.0f), t1 = std::min(t_exit, 1.0f);
+      float t = t0;
+      if (sweep_gap(s, t0, lo, hi) > s.radius * 1e-4f) {
+        float a = t0, b = t1;
+        for (int i = 0; i != 24; ++i) {
+          float m1 = a + (b - a) * (1.0f/3), m2 = b - (b - a) * (1.0f/3);
+          if (sweep_gap(s, m1, lo, hi) < sweep_gap(s, m2, lo, hi)) b = m2; else a = m1;
+        }
+        float t_closest = (a + b) * 0.5f;
+        if (sweep_gap(s, t_closest, lo, hi) > 0) return;
+        a = t0; b = t_closest;
+        for (int i = 0; i != 24; ++i) {
+          float m = (a + b) * 0.5f;
+          if (sweep_gap(s, m, lo, hi) > 0) a = m; else b = m;
+        }
+        t = b;
+      }
+      if (t >= s.best_t) return;
+
+      vec3 c = s.start + s.distance * t;
+      vec3 n = c - min(max(c, lo), hi);
+      s.best_t = t;
+      s.best_normal = squared(n) > 0 ? normalize(n) : vec3(0, 0, 0);
+      s.best_voxel = voxel;
+    }
+
+    // sweep the sphere against a block, nearest children first.
+    void sweep_block(sweep_state &s, ivec3_in pos, int level) const {
+      if (!any_at(pos, level)) return;
+      vec3 lo = vec3(pos << level), hi = lo + (float)(1 << level);
+      float t_exit;
+      if (ray_enter_box(s.start, s.distance, lo - s.radius, hi + s.radius, t_exit) >= s.best_t) return;
+      if (level == 0) {
+        sweep_voxel(s, pos);
+      } else {
+        int first = (s.distance.x() < 0 ? 1 : 0) | (s.distance.y() < 0 ? 2 : 0) | (s.distance.z() < 0 ? 4 : 0);
+        for (int i = 0; i != 8; ++i) {
+          sweep_block(s, pos * 2 + delta(i ^ first), level - 1);
+        }
+      }
+    }
+
   public:
     RESOURCE_META(mesh_voxels)
 
@@ -169,6 +724,16 @@ namespace octet { namespace scene {
       //set_aabb(aabb(vec3(0, 0, 0), size));
 
       subcubes.resize(size.x() * size.y() * size.z());
+      flags.resize(subcubes.size());
+      memset(flags.data(), dirty_mesh | dirty_lod, flags.size());
+      ranges.resize(subcubes.size());
+      memset(ranges.data(), 0, ranges.size() * sizeof(subcube_range));
+      snapshot_slots.resize(subcubes.size());
+      pool_faces = used_faces = wasted_faces = 0;
+      jobs_done = false;
+      repacking = false;
+      num_remeshed = 0;
+      greedy = jobs_greedy = false;
       set_aabb(aabb(vec3(0, 0, 0), vec3(size)*(voxel_size*subcube_dim*0.5f)));
       int idx = 0;
       for (int z = 0; z != size.z(); ++z) {
@@ -184,14 +749,86 @@ namespace octet { namespace scene {
       update_lod();
     }
 
-    /// Update only the LODs used for collision detection.
+    ~mesh_voxels() {
+      if (worker.joinable()) worker.join();
+    }
+
+    /// Update only the LODs used for collision detection, for the subcubes that changed.
     void update_lod() {
       for (unsigned i = 0; i != subcubes.size(); ++i) {
         mesh_voxel_subcube *p = subcubes[i];
-        if (p) {
+        if (p && (flags[i] & dirty_lod)) {
           p->update_lod();
+          flags[i] &= ~dirty_lod;
+        }
+      }
+    }
+
+    /// Start remeshing the subcubes that changed since the last remesh.
+    /// In the background, the faces are built on a worker thread from a copy of
+    /// the voxels; call finish_update_mesh() every frame to swap them in.
+    /// Does nothing if a remesh is already running.
+    void begin_update_mesh(bool in_background = true) {
+      if (worker.joinable() || !jobs.empty()) return;
+
+      // when too much of the pool is in abandoned ranges, pack it again.
+      repacking = wasted_faces > 1024 && wasted_faces * 2 > used_faces;
+
+      for (unsigned i = 0; i != subcubes.size(); ++i) {
+        if (repacking || (flags[i] & dirty_mesh)) {
+          remesh_job job = { (int)i, 0, 0, 0, 0, 0 };
+          jobs.push_back(job);
+          flags[i] &= ~dirty_mesh;
+        }
+      }
+      if (jobs.empty()) return;
+
+      // snapshot the voxels of the jobs and their neighbours.
+      memset(snapshot_slots.data(), 0xff, snapshot_slots.size() * sizeof(int));
+      unsigned num_slots = 0;
+      for (unsigned j = 0; j != jobs.size(); ++j) {
+        ivec3 pos = subcube_pos(jobs[j].subcube);
+        for (int i = -1; i != 6; ++i) {
+          ivec3 npos = i == -1 ? pos : pos + neighbour_delta(i);
+          if (all(npos >= ivec3(0, 0, 0)) && all(npos < size)) {
+            int index = subcube_index(npos);
+            if (snapshot_slots[index] == -1 && subcubes[index]) {
+              snapshot_slots[index] = num_slots++;
+            }
+          }
         }
       }
+      snapshots.resize(num_slots * subcube_words);
+      for (unsigned i = 0; i != subcubes.size(); ++i) {
+        if (snapshot_slots[i] != -1) {
+          memcpy(&snapshots[snapshot_slots[i] * subcube_words], subcubes[i]->get_opaque(), subcube_words * sizeof(uint32_t));
+        }
+      }
+
+      jobs_done = false;
+      jobs_greedy = greedy;
+      if (in_background) {
+        worker = std::thread(&mesh_voxels::run_jobs, this);
+      } else {
+        run_jobs();
+      }
+    }
+
+    /// If a remesh has finished, copy its faces to the GL buffers.
+    /// With wait, block until it has finished. Must be called on the GL thread.
+    /// Returns true if the mesh changed.
+    bool finish_update_mesh(bool wait = false) {
+      if (jobs.empty() || (!wait && !jobs_done)) return false;
+      if (worker.joinable()) worker.join();
+      commit_jobs();
+      return true;
+    }
+
+    /// Remesh the subcubes that changed and wait for the result.
+    void update_mesh() {
+      finish_update_mesh(true);
+      begin_update_mesh(false);
+      finish_update_mesh(true);
     }
 
     /// Update both the mesh and the LODs.
@@ -200,6 +837,51 @@ namespace octet { namespace scene {
       update_mesh();
     }
 
+    /// Set or clear one voxel. pos is in voxels, from 0 to 32 * the number of subcubes.
+    /// Only the subcube and the neighbours that share the voxel's faces get remeshed.
+    void set_voxel(ivec3_in pos, bool value) {
+      ivec3 cube = pos >> log_subcube_dim;
+      mark_dirty(cube, get_subcube(cube)->set_voxel(pos & ivec3(subcube_dim-1), value));
+    }
+
+    /// Join coplanar neighbouring faces into larger quads. Remeshes everything on the next update.
+    /// This makes far fewer triangles for flat areas. The uvs repeat once per voxel.
+    void set_greedy_meshing(bool value) {
+      if (value == greedy) return;
+      greedy = value;
+      for (unsigned i = 0; i != flags.size(); ++i) {
+        flags[i] |= dirty_mesh;
+      }
+    }
+
+    /// Are faces being joined into larger quads?
+    bool get_greedy_meshing() const {
+      return greedy;
+    }
+
+    /// Number of triangles in the mesh.
+    unsigned get_num_triangles() const {
+      unsigned faces = 0;
+      for (unsigned i = 0; i != ranges.size(); ++i) {
+        faces += ranges[i].num_faces;
+      }
+      return faces * 2;
+    }
+
+    /// Number of triangles the mesh would have with one quad per voxel face.
+    unsigned get_num_voxel_triangles() const {
+      unsigned faces = 0;
+      for (unsigned i = 0; i != ranges.size(); ++i) {
+        faces += ranges[i].num_voxel_faces;
+      }
+      return faces * 2;
+    }
+
+    /// Number of subcubes remeshed by the last update.
+    unsigned get_num_remeshed() const {
+      return num_remeshed;
+    }
+
     /// Serialize.
     void visit(visitor &v) {
       mesh::visit(v);
@@ -229,7 +911,7 @@ namespace octet { namespace scene {
     mesh_voxel_subcube *get_subcube(ivec3_in pos) const {
       assert(all(pos < size));
       //assert(x < (unsigned)size.x() && y < (unsigned)size.y() && z < (unsigned)size.z());
-      return subcubes[pos.x()+ size.x() * (pos.y() + size.y()*pos.z())];
+      return subcubes[subcube_index(pos)];
     }
 
     /// Is any cube in this subcube collidable?
@@ -247,72 +929,149 @@ namespace octet { namespace scene {
       }
     }
 
-    /// Experimental: collide two orientated voxel meshes.
-    bool intersects(const mesh_voxels &b, const mat4t &mxa, const mat4t &mxb) const {
-      const mesh_voxels &a = *this;
-      vec3 corner_a(vec3(a.size) * (a.voxel_size * (-0.5f * subcube_dim)));
-      vec3 corner_b(vec3(b.size) * (b.voxel_size * (-0.5f * subcube_dim)));
+    /// matrix from voxel coordinates (0 to 32 * the number of subcubes) to mesh space
+    mat4t get_voxelToMesh() const {
+      vec3 corner = get_corner();
+      return mat4t(
+        vec4(voxel_size, 0, 0, 0),
+        vec4(0, voxel_size, 0, 0),
+        vec4(0, 0, voxel_size, 0),
+        vec4(corner.x(), corner.y(), corner.z(), 1)
+      );
+    }
+
+    /// Is this voxel set? pos is in voxels. Voxels outside the mesh are empty.
+    bool get_voxel(ivec3_in pos) const {
+      return any_at(pos, 0) != 0;
+    }
 
-      //mat4t atob = inverse3x4(mxa) * mxb;
-      int levela = ilog2(a.size.x() * subcube_dim) + 1;
-      int levelb = ilog2(b.size.x() * subcube_dim) + 1;
+    /// Find the first voxel on a ray given in mesh space.
+    /// Marches voxel by voxel (DDA), skipping empty blocks using the LODs.
+    /// Call update_lod() or update() after editing for the fastest skipping.
+    bool ray_cast(voxel_hit &hit, const ray &the_ray) const {
+      ivec3 dims = size * subcube_dim;
+      vec3 org = (the_ray.get_start() - get_corner()) * (1.0f / voxel_size);
+      vec3 dir = the_ray.get_distance() * (1.0f / voxel_size);
 
-      dynarray<entries> stack;
-      stack.reserve(64);
-      stack.push_back(entries(
-        entry(levela, ivec3(0, 0, 0), false),
-        entry(levelb, ivec3(0, 0, 0), false)
-      ));
-
-      if (
-        !a.is_any(ivec3(0, 0, 0), levela) ||
-        !b.is_any(ivec3(0, 0, 0), levelb)
-      ) {
-        return false;
+      // clip the ray to the box of voxels.
+      float t_exit;
+      float t = ray_enter_box(org, dir, vec3(0, 0, 0), vec3(dims), t_exit);
+      if (t > 1) return false;
+      t_exit = std::min(t_exit, 1.0f);
+      int axis = -1;
+      if (t > 0) {
+        for (int i = 0; i != 3; ++i) {
+          if (dir[i] != 0 && t == ((dir[i] < 0 ? dims[i] : 0) - org[i]) * (1.0f / dir[i])) axis = i;
+        }
+      } else {
+        t = 0;
       }
 
-      while(!stack.is_empty()) {
-        entry ta = stack.back().first;
-        entry tb = stack.back().second;
-        stack.pop_back();
+      ivec3 step(dir.x() < 0 ? -1 : 1, dir.y() < 0 ? -1 : 1, dir.z() < 0 ? -1 : 1);
+      vec3 p = org + dir * t;
+      ivec3 cell;
+      for (int i = 0; i != 3; ++i) {
+        cell[i] = std::min(std::max((int)floorf(p[i]), 0), dims[i] - 1);
+      }
+
+      for (;;) {
+        // find the biggest empty block around this cell.
+        int level = 0;
+        for (int l = log_subcube_dim; l != 0; --l) {
+          if (!any_at(cell >> l, l)) {
+            level = l;
+            break;
+          }
+        }
+
+        if (level == 0 && any_at(cell, 0)) {
+          hit.t = t;
+          hit.voxel = cell;
+          hit.normal = vec3(0, 0, 0);
+          if (axis != -1) hit.normal[axis] = (float)-step[axis];
+          hit.pos = the_ray.get_start() + the_ray.get_distance() * t;
+          return true;
+        }
 
-        ivec3 npa = ta.pos * 2;
-        ivec3 npb = tb.pos * 2;
-        int lev_a = ta.level - 1;
-        int lev_b = tb.level - 1;
-        float scale_a = a.voxel_size * (1 << lev_a);
-        float scale_b = b.voxel_size * (1 << lev_b);
-
-        log("%3d ta: %2d %2d %2d @%d   tb: %2d %2d %2d @%d scale=%f,%f\n", stack.size(), ta.pos.x(), ta.pos.y(), ta.pos.z(), ta.level, tb.pos.x(), tb.pos.y(), tb.pos.z(), tb.level, scale_a, scale_b);
-
-        for (unsigned i = 0; i != 8; ++i) {
-          ivec3 posa = npa + delta(i);
-          if (is_any(posa, lev_a)) {
-            obb bounds_a(corner_a + vec3(posa) * scale_a + (scale_a * 0.5f), scale_a * 0.5f, mxa);
-            for (unsigned j = 0; j != 8; ++j) {
-              ivec3 posb = npb + delta(j);
-              if (is_any(posb, lev_b)) {
-                obb bounds_b(corner_b + vec3(posb) * scale_b + (scale_b * 0.5f), scale_b * 0.5f, mxb);
-                if (bounds_a.intersects(bounds_b)) {
-                  char buf[512];
-                  log("  bounds_a=%s\n", bounds_a.toString(buf, sizeof(buf)));
-                  log("  bounds_b=%s\n", bounds_b.toString(buf, sizeof(buf)));
-                  log("  a: %2d %2d %2d @%d   b: %2d %2d %2d @%d\n", posa.x(), posa.y(), posa.z(), lev_a, posb.x(), posb.y(), posb.z(), lev_b);
-                  if (lev_a == 0 || lev_b == 0) {
-                    char b[2][128];
-                    log("success @ %s/%s\n", posa.toString(b[0], sizeof(b[0])), posb.toString(b[1], sizeof(b[1])));
-                    return true;
-                  }
-
-                  stack.push_back(entries(entry(lev_a, posa, false), entry(lev_b, posb, false)));
-                }
-              }
+        // step out of the block through the nearest face.
+        int block = 1 << level;
+        ivec3 lo = cell & ivec3(~(block - 1));
+        float t_next = FLT_MAX;
+        for (int i = 0; i != 3; ++i) {
+          if (dir[i] != 0) {
+            float ti = ((float)(step[i] > 0 ? lo[i] + block : lo[i]) - org[i]) / dir[i];
+            if (ti < t_next) {
+              t_next = ti;
+              axis = i;
             }
           }
         }
+        if (t_next > t_exit) return false;
+        t = t_next;
+
+        p = org + dir * t;
+        for (int i = 0; i != 3; ++i) {
+          cell[i] = i == axis ? (step[i] > 0 ? lo[i] + block : lo[i] - 1) : std::min(std::max((int)floorf(p[i]), lo[i]), lo[i] + block - 1);
+        }
+        if (any(cell < ivec3(0, 0, 0)) || any(cell >= dims)) return false;
+      }
+    }
+
+    /// Sweep a sphere through distance, both in mesh space. Finds the first voxel it touches.
+    /// If the sphere starts touching a voxel, hit.t is zero.
+    bool sweep_sphere(voxel_hit &hit, const sphere &the_sphere, vec3_in distance) const {
+      sweep_state s;
+      s.start = (the_sphere.get_center() - get_corner()) * (1.0f / voxel_size);
+      s.distance = distance * (1.0f / voxel_size);
+      s.radius = the_sphere.get_radius() * (1.0f / voxel_size);
+      s.best_t = FLT_MAX;
+
+      // try each subcube the sweep passes near.
+      vec3 lo = min(s.start, s.start + s.distance) - s.radius;
+      vec3 hi = max(s.start, s.start + s.distance) + s.radius;
+      ivec3 cube_lo, cube_hi;
+      for (int i = 0; i != 3; ++i) {
+        cube_lo[i] = std::max((int)floorf(lo[i]) >> log_subcube_dim, 0);
+        cube_hi[i] = std::min((int)floorf(hi[i]) >> log_subcube_dim, size[i] - 1);
       }
-      log("fail\n");
-      return false;
+      for (int z = cube_lo.z(); z <= cube_hi.z(); ++z) {
+        for (int y = cube_lo.y(); y <= cube_hi.y(); ++y) {
+          for (int x = cube_lo.x(); x <= cube_hi.x(); ++x) {
+            sweep_block(s, ivec3(x, y, z), log_subcube_dim);
+          }
+        }
+      }
+
+      if (s.best_t > 1) return false;
+      hit.t = s.best_t;
+      hit.voxel = s.best_voxel;
+      hit.normal = s.best_normal;
+      hit.pos = the_sphere.get_center() + distance * s.best_t;
+      return true;
+    }
+
+    /// Find where this mesh (at mxa) touches mesh b (at mxb).
+    /// contacts gets up to max_contacts points in world space, spread over the touching area
+    /// and including the deepest. Normals point from b to this mesh. Returns the number of contacts.
+    unsigned get_contacts(dynarray<voxel_contact> &contacts, const mesh_voxels &b, mat4t_in mxa, mat4t_in mxb, unsigned max_contacts = 4) const {
+      contact_collector collect;
+      collect.a = this;
+      collect.b = &b;
+      collect.contacts = &contacts;
+      collect.a_to_world = get_voxelToMesh() * mxa;
+      collect.max_contacts = max_contacts;
+      collect.max_raw = std::max(max_contacts * 4, 256u);
+      contacts.resize(0);
+      visit_overlaps(b, mxa, mxb, collect);
+      reduce_contacts(contacts, max_contacts);
+      return contacts.size();
+    }
+
+    /// Do two orientated voxel meshes touch?
+    bool intersects(const mesh_voxels &b, const mat4t &mxa, const mat4t &mxb) const {
+      first_overlap first;
+      visit_overlaps(b, mxa, mxb, first);
+      return first.found;
     }
   };
 
@@ -37,6 +37,17 @@ namespace octet { namespace scene {
     virtual void render(const uint8_t *buffer) {
     }
 
+    /// as render(), but for the instanced variant of the shader.
+    /// Parameters without an instanced binding upload the same way as render().
+    virtual void render_instanced(const uint8_t *buffer) {
+      render(buffer);
+    }
+
+    /// bind any texture this parameter uses. Texture bindings are not part of the program,
+    /// so this is needed for every draw even if the uniforms are unchanged.
+    virtual void bind_texture() {
+    }
+
     const char *get_atom_name() const {
       return app_utils::get_atom_name(name);
     }
@@ -86,6 +97,12 @@ namespace octet { namespace scene {
 
   struct param_bind_info {
     GLint program;
+    bool instanced;  // binding to the instanced variant of the shader
+
+    param_bind_info() {
+      program = 0;
+      instanced = false;
+    }
   };
 
   struct param_buffer_info {
@@ -106,6 +123,7 @@ namespace octet { namespace scene {
   /// The parameter uniform records the location, name and type of the uniform as well as the repeat count for arrays.
   class param_uniform : public param {
     GLint uniform;           // uniform index
+    GLint instanced_uniform; // uniform index in the instanced shader
     uint16_t offset;         // offset in uniform buffer
     uint16_t repeat;         // how many in array?
     uint8_t uniform_buffer;  // Which uniform buffer? 0 = dynamic, 1 = static.
@@ -113,6 +131,8 @@ namespace octet { namespace scene {
     RESOURCE_META(param_uniform)
 
     param_uniform() {
+      uniform = -1;
+      instanced_uniform = -1;
     }
 
     /// create a new uniform parameter with a prototype in "buffer"
@@ -121,6 +141,8 @@ namespace octet { namespace scene {
       param(name, _type, _stage)
     {
       repeat = _repeat;
+      uniform = -1;
+      instanced_uniform = -1;
 
       // in uniform buffers, everything is in units of 16 bytes
       // matrices are repeats of vec4s
@@ -169,7 +191,8 @@ namespace octet { namespace scene {
 
     /// connect the parameter to the shader
     void bind(param_bind_info &pbi) {
-      uniform = glGetUniformLocation(pbi.program, get_atom_name());
+      GLint &location = pbi.instanced ? instanced_uniform : uniform;
+      location = glGetUniformLocation(pbi.program, get_atom_name());
       //log("bind %d %s\n", uniform, get_atom_name());
     }
 
@@ -200,8 +223,16 @@ namespace octet { namespace scene {
     /// for OpenGL ES2, call glUniform* to copy the uniform to the GPU command buffer.
     /// for OpenGL ES3, we can use the uniform buffer directly and so don't need this.
     void render(const uint8_t *buffer) {
-      GLint uni = get_uniform();
+      upload(uniform, buffer);
+    }
+
+    /// as render(), but using the location in the instanced shader.
+    void render_instanced(const uint8_t *buffer) {
+      upload(instanced_uniform, buffer);
+    }
 
+    /// call glUniform* for a specific location.
+    void upload(GLint uni, const uint8_t *buffer) {
       if (uni == -1) return;
 
       switch (get_gl_type()) {
@@ -290,6 +321,17 @@ namespace octet { namespace scene {
     /// Set the OpenGL state for this sampler.
     void render(const uint8_t *buffer) {
       param_uniform::render(buffer);
+      bind_texture();
+    }
+
+    /// Set the OpenGL state for this sampler in the instanced shader.
+    void render_instanced(const uint8_t *buffer) {
+      param_uniform::render_instanced(buffer);
+      bind_texture();
+    }
+
+    /// Bind the texture to our slot.
+    void bind_texture() {
       glActiveTexture(GL_TEXTURE0 + texture_slot);
       glBindTexture(sampler_->get_gl_target(), sampler_->get_gl_texture(image_));
 
@@ -298,31 +340,62 @@ namespace octet { namespace scene {
   };
 
   /// Shader that uses parameters.
+  ///
+  /// Use get() for shaders used by many materials: it returns the same object for the same files.
   class param_shader : public shader {
     std::string vertex_shader;
     std::string fragment_shader;
+    std::string defines;
+    bool particles;
+
+    // the text of a shader file, read once per run.
+    // dictionary would memset and bit-copy the strings, so use a std container.
+    static const std::string &get_source(const char *url) {
+      static std::unordered_map<std::string, std::string> sources;
+      auto found = sources.find(url);
+      if (found != sources.end()) return found->second;
+
+      dynarray<uint8_t> bytes;
+      app_utils::get_url(bytes, url);
+      std::string &source = sources[url];
+      source.assign((const char*)bytes.data(), (const char*)(bytes.data() + bytes.size()));
+      return source;
+    }
 
   public:
     RESOURCE_META(param_shader)
 
     param_shader() {
+      particles = false;
     }
 
-    param_shader(const char *vs_url, const char *fs_url) {
-      dynarray<uint8_t> vs;
-      dynarray<uint8_t> fs;
-      app_utils::get_url(vs, vs_url);
-      app_utils::get_url(fs, fs_url);
+    /// defines, if any, go before the source of both shaders, eg. "#define SHADOWS 1\n"
+    /// particles is for the particle shaders (see mesh_particle_system::get_billboard_shader).
+    param_shader(const char *vs_url, const char *fs_url, const char *defines = "", bool particles = false) {
+      vertex_shader = get_source(vs_url);
+      fragment_shader = get_source(fs_url);
+      this->defines = defines;
+      this->particles = particles;
+    }
 
-      vertex_shader.assign((const char*)vs.data(), (const char*)(vs.data() + vs.size()));
-      fragment_shader.assign((const char*)fs.data(), (const char*)(fs.data() + fs.size()));
+    /// Get the shader shared by everything that uses the same files and defines.
+    static param_shader *get(const char *vs_url, const char *fs_url, const char *defines = "", bool particles = false) {
+      static dictionary<ref<param_shader> > shaders;
+      string key;
+      key.format("%s|%s|%s|%d", vs_url, fs_url, defines, particles);
+      ref<param_shader> &result = shaders[key.c_str()];
+      if (!result) {
+        result = new param_shader(vs_url, fs_url, defines, particles);
+      }
+      return result;
     }
 
-    void init(dynarray<ref<param> > &params) {
-      shader::init(vertex_shader.data(), fragment_shader.data());
+    void init(dynarray<ref<param> > &params, bool instanced = false) {
+      shader::init(vertex_shader.c_str(), fragment_shader.c_str(), defines.c_str(), particles);
 
       param_bind_info pbi;
       pbi.program = get_program();
+      pbi.instanced = instanced;
 
       for (unsigned i = 0; i != params.size(); ++i) {
         params[i]->bind(pbi);
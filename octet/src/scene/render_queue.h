@@ -0,0 +1,166 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Render queue: sort draws by state to avoid redundant GL calls
+//
+
+namespace octet { namespace scene {
+  /// Per-frame list of draws.
+  ///
+  /// Each visible mesh instance is added with a 64 bit sort key built from
+  /// (layer, translucency, shader, material, mesh, depth). A radix sort then groups
+  /// draws that share state so that visual_scene can skip redundant program, uniform
+  /// and attribute setup.
+  ///
+  /// Opaque draws are sorted by state then front to back.
+  /// Translucent draws are sorted back to front then by state.
+  class render_queue {
+  public:
+    /// One draw: the instance and its per-instance matrices.
+    struct draw {
+      mesh_instance *mi;
+      mat4t modelToProjection;
+      mat4t modelToCamera;
+    };
+
+    // bit layout of the sort key (most significant first)
+    enum {
+      layer_bits = 4,
+      translucent_bits = 1,
+      shader_bits = 12,
+      material_bits = 14,
+      mesh_bits = 14,
+      depth_bits = 16,
+
+      depth_shift = 0,
+      mesh_shift = depth_shift + depth_bits,
+      material_shift = mesh_shift + mesh_bits,
+      shader_shift = material_shift + material_bits,
+      translucent_shift = shader_shift + shader_bits,
+      layer_shift = translucent_shift + translucent_bits,
+
+      // for translucent draws, depth goes above the state bits.
+      state_bits = shader_bits + material_bits + mesh_bits,
+      translucent_depth_shift = translucent_shift - depth_bits,
+      translucent_state_shift = translucent_depth_shift - state_bits,
+
+      max_layer = (1 << layer_bits) - 1,
+    };
+
+  private:
+    struct entry {
+      uint64_t key;
+      uint32_t index;
+    };
+
+    dynarray<draw> draws;
+    dynarray<entry> entries;
+    dynarray<entry> temp;
+
+    // hash a pointer to a small id. Collisions only cost batching, not correctness.
+    static uint64_t pointer_id(const void *ptr, unsigned bits) {
+      uint64_t x = (uint64_t)(uintptr_t)ptr * 0x9E3779B97F4A7C15ull;
+      return x >> (64 - bits);
+    }
+
+    static uint64_t mask(uint64_t value, unsigned bits) {
+      return value & ((1ull << bits) - 1);
+    }
+
+    // least significant digit radix sort, eight bits at a time.
+    // passes where every key has the same digit are skipped.
+    void radix_sort() {
+      unsigned size = entries.size();
+      temp.resize(size);
+      entry *src = entries.data();
+      entry *dest = temp.data();
+      for (unsigned shift = 0; shift != 64; shift += 8) {
+        unsigned count[256];
+        memset(count, 0, sizeof(count));
+        for (unsigned i = 0; i != size; ++i) {
+          count[(src[i].key >> shift) & 0xff]++;
+        }
+
+        if (count[(src[0].key >> shift) & 0xff] == size) continue;
+
+        unsigned total = 0;
+        for (unsigned i = 0; i != 256; ++i) {
+          unsigned c = count[i];
+          count[i] = total;
+          total += c;
+        }
+
+        for (unsigned i = 0; i != size; ++i) {
+          dest[count[(src[i].key >> shift) & 0xff]++] = src[i];
+        }
+        std::swap(src, dest);
+      }
+
+      if (src != entries.data()) {
+        memcpy(entries.data(), src, size * sizeof(entry));
+      }
+    }
+  public:
+    render_queue() {
+    }
+
+    /// Empty the queue at the start of a frame. Keeps the memory.
+    void reset() {
+      draws.resize(0);
+      entries.resize(0);
+    }
+
+    /// Build a sort key. depth is 0..1 from the near to the far plane.
+    static uint64_t make_key(unsigned layer, bool translucent, const void *shader, const void *mat, const void *msh, float depth) {
+      float clamped = depth < 0 ? 0 : depth > 1 ? 1 : depth;
+      uint64_t qdepth = (uint64_t)(clamped * ((1 << depth_bits) - 1));
+      uint64_t key = mask(layer, layer_bits) << layer_shift;
+      uint64_t state =
+        pointer_id(shader, shader_bits) << (material_bits + mesh_bits) |
+        pointer_id(mat, material_bits) << mesh_bits |
+        pointer_id(msh, mesh_bits)
+      ;
+      if (!translucent) {
+        key |= state << mesh_shift;
+        key |= qdepth << depth_shift;
+      } else {
+        // back to front, then by state.
+        key |= 1ull << translucent_shift;
+        key |= (((1 << depth_bits) - 1) - qdepth) << translucent_depth_shift;
+        key |= state << translucent_state_shift;
+      }
+      return key;
+    }
+
+    /// Add a draw to the queue.
+    void add(uint64_t key, mesh_instance *mi, const mat4t &modelToProjection, const mat4t &modelToCamera) {
+      entry e = { key, (uint32_t)draws.size() };
+      entries.push_back(e);
+      draws.resize(draws.size() + 1);
+      draw &d = draws.back();
+      d.mi = mi;
+      d.modelToProjection = modelToProjection;
+      d.modelToCamera = modelToCamera;
+    }
+
+    /// Sort the draws by key.
+    void sort() {
+      if (entries.size() > 1) {
+        radix_sort();
+      }
+    }
+
+    /// number of draws in the queue
+    unsigned size() const {
+      return entries.size();
+    }
+
+    /// get a draw in sorted order (after sort())
+    const draw &get_draw(unsigned i) const {
+      return draws[entries[i].index];
+    }
+  };
+}}
@@ -13,8 +13,10 @@
 #include "../scene/scene_node.h"
 #include "../scene/skin.h"
 #include "../scene/skeleton.h"
+#include "../scene/animation_pose.h"
 #include "../scene/animation.h"
 #include "../scene/mesh.h"
+#include "../scene/cpu_skinner.h"
 #include "../scene/image.h"
 #include "../scene/sampler.h"
 #include "../scene/param.h"
@@ -24,6 +26,7 @@
 #include "../scene/light_instance.h"
 #include "../scene/mesh_instance.h"
 #include "../scene/animation_instance.h"
+#include "../scene/render_queue.h"
 #include "../scene/visual_scene.h"
 #include "../scene/displacement_map.h"
 #include "../scene/indexer.h"
@@ -27,6 +27,38 @@ namespace octet { namespace scene {
     // is this node and all its children renderable?
     bool enabled;
 
+    // cached product of nodeToParent and all the parent transforms (valid when world_dirty is false)
+    mat4t modelToWorld;
+
+    // cached result of calcEnabled() (valid when world_dirty is false)
+    bool world_enabled;
+
+    // set when this node or one of its parents has changed since the cache was refreshed.
+    // invariant: if a node is dirty, all of its children are dirty too.
+    bool world_dirty;
+
+    // invalidate the cached world state of this node and all nodes below it.
+    void mark_dirty() {
+      if (!world_dirty) {
+        world_dirty = true;
+        for (int i = 0; i != children.size(); ++i) {
+          children[i]->mark_dirty();
+        }
+      }
+    }
+
+    // refresh the cache from an up-to-date parent.
+    void refresh_world() {
+      if (parent) {
+        modelToWorld = nodeToParent * parent->modelToWorld;
+        world_enabled = enabled && parent->world_enabled;
+      } else {
+        modelToWorld = nodeToParent;
+        world_enabled = enabled;
+      }
+      world_dirty = false;
+    }
+
   public:
     RESOURCE_META(scene_node)
 
@@ -35,6 +67,7 @@ namespace octet { namespace scene {
       nodeToParent.loadIdentity();
       sid = atom_;
       enabled = true;
+      world_dirty = true;
       if (parent) {
         parent->add_child(this);
       }
@@ -45,6 +78,7 @@ namespace octet { namespace scene {
       this->nodeToParent = nodeToParent;
       this->sid = sid;
       enabled = true;
+      world_dirty = true;
     }
 
     /// the virtual add_ref on animation_target gets passed to here and we pass iton (delegate it) to the resource
@@ -61,6 +95,7 @@ namespace octet { namespace scene {
     void set_value(atom_t sid, atom_t sub_target, atom_t component, float *value) {
       if (sub_target == atom_transform) {
         nodeToParent.init_transpose(value);
+        mark_dirty();
       }
     }
 
@@ -73,6 +108,7 @@ namespace octet { namespace scene {
       //log("visit scene_node nodeToParent\n");
       v.visit(nodeToParent, atom_nodeToParent);
       v.visit(sid, atom_sid);
+      mark_dirty();
     }
 
 
@@ -80,6 +116,7 @@ namespace octet { namespace scene {
     void add_child(scene_node *new_node) {
       new_node->parent = this;
       children.push_back(new_node);
+      new_node->mark_dirty();
     }
 
     /// Get the parent node of this node.
@@ -97,21 +134,51 @@ namespace octet { namespace scene {
       return children[index];
     }
 
+    /// Bring the cached world state of this node up to date.
+    /// Only the dirty part of the parent chain is recomputed.
+    void update_world() {
+      if (world_dirty) {
+        if (parent) parent->update_world();
+        refresh_world();
+      }
+    }
+
+    /// Refresh the cached world state of this node and every node below it in one top-down pass.
+    /// visual_scene calls this once per frame before rendering.
+    void update_world_hierarchy() {
+      small_dynarray<scene_node*, 64> stack;
+      update_world();
+      stack.push_back(this);
+      while (!stack.empty()) {
+        scene_node *node = stack.back();
+        stack.pop_back();
+        for (int i = 0; i != node->children.size(); ++i) {
+          scene_node *child = node->children[i];
+          // the parent is always clean by the time we get here.
+          if (child->world_dirty) child->refresh_world();
+          stack.push_back(child);
+        }
+      }
+    }
+
+    /// Get the cached scene_node to world matrix.
+    /// Note: if you hold on to the reference from access_nodeToParent(), call it again after
+    /// reading world state or the change will not be seen.
+    const mat4t &get_modelToWorld() {
+      update_world();
+      return modelToWorld;
+    }
+
     // compute the scene_node to world matrix for an individual scene_node;
     mat4t calcModelToWorld() {
-      mat4t result = nodeToParent;
-      for (scene_node *p = parent; p != NULL; p = p->parent) {
-        result = result * p->nodeToParent;
-      }
-      return result;
+      update_world();
+      return modelToWorld;
     }
 
     // calculate whether this node is enabled (recursively)
     bool calcEnabled() {
-      for (scene_node *p = this; p != NULL; p = p->parent) {
-        if (!p->enabled) return false;
-      }
-      return true;
+      update_world();
+      return world_enabled;
     }
 
     /// transform a point from model space to world space
@@ -135,6 +202,7 @@ namespace octet { namespace scene {
 
     /// access the node to parent transform matrix for writing.
     mat4t &access_nodeToParent() {
+      mark_dirty();
       return nodeToParent;
     }
 
@@ -166,26 +234,31 @@ namespace octet { namespace scene {
     /// set enabled state
     void set_enabled(bool value) {
       enabled = value;
+      mark_dirty();
     }
 
     /// reset the matrix
     void loadIdentity() {
       nodeToParent.loadIdentity();
+      mark_dirty();
     }
 
     /// Translate the matrix
     void translate(vec3_in xyz) {
       nodeToParent.translate(xyz[0], xyz[1], xyz[2]);
+      mark_dirty();
     }
 
     /// Rotate the matrix
     void rotate(float angle, vec3_in axis) {
       nodeToParent.rotate(angle, axis[0], axis[1], axis[2]);
+      mark_dirty();
     }
 
     /// Scale the matrix
     void scale(vec3_in xyz) {
       nodeToParent.scale(xyz[0], xyz[1], xyz[2]);
+      mark_dirty();
     }
 
     /// Get the identifying sid
@@ -195,8 +268,8 @@ namespace octet { namespace scene {
 
     /// recursively fetch all child nodes
     void get_all_child_nodes(dynarray<scene_node*> &nodes, dynarray<int> &parents) {
-      dynarray<scene_node*> stack;
-      dynarray<int> parent_stack;
+      small_dynarray<scene_node*, 64> stack;
+      small_dynarray<int, 64> parent_stack;
       stack.push_back(this);
       parent_stack.push_back(-1);
       while (!stack.empty()) {
@@ -20,10 +20,69 @@ namespace octet { namespace scene {
     // cached skin components
     dynarray<mat4t> result;  /// uniforms to shader
     dynarray<int> indices;   /// map skeleton to skin indices
+    dynarray<mat4t> skin_bind;  /// modelToBind * bindToModel for each skin joint
+    const skin *cached_skin;
+
+    // sid -> bone index, built on demand from joints.
+    hash_map<int, int> joint_index;
+    unsigned num_indexed_joints;
+
+    // shared pose for blending animations, one entry per bone.
+    // animation instances add weighted local poses, resolve_blend() mixes them once.
+    dynarray<vec4> blend_translate;
+    dynarray<vec4> blend_rotate;
+    dynarray<vec4> blend_scale;
+    dynarray<float> blend_weight;
+    dynarray<vec4> additive_translate;
+    dynarray<vec4> additive_rotate;
+    dynarray<vec4> additive_scale;
+    dynarray<uint8_t> blend_used;
+    bool blend_pending;
+
+    // pose of the bones before any blending, used to fill in weights below one.
+    dynarray<vec4> rest_translate;
+    dynarray<vec4> rest_rotate;
+    dynarray<vec4> rest_scale;
+
+    // clear the blend buffer for a new frame.
+    void begin_blend() {
+      unsigned num_bones = nodes.size();
+      if (rest_translate.size() != num_bones) {
+        rest_translate.resize(num_bones);
+        rest_rotate.resize(num_bones);
+        rest_scale.resize(num_bones);
+        for (unsigned i = 0; i != num_bones; ++i) {
+          quat r(0, 0, 0, 1);
+          nodes[i]->get_nodeToParent().get_trs(rest_translate[i], r, rest_scale[i]);
+          rest_rotate[i] = r;
+        }
+        blend_translate.resize(num_bones);
+        blend_rotate.resize(num_bones);
+        blend_scale.resize(num_bones);
+        blend_weight.resize(num_bones);
+        additive_translate.resize(num_bones);
+        additive_rotate.resize(num_bones);
+        additive_scale.resize(num_bones);
+        blend_used.resize(num_bones);
+      }
+
+      for (unsigned i = 0; i != num_bones; ++i) {
+        blend_translate[i] = blend_rotate[i] = blend_scale[i] = vec4(0, 0, 0, 0);
+        blend_weight[i] = 0;
+        additive_translate[i] = vec4(0, 0, 0, 0);
+        additive_rotate[i] = vec4(0, 0, 0, 1);
+        additive_scale[i] = vec4(1, 1, 1, 0);
+        blend_used[i] = 0;
+      }
+      blend_pending = true;
+    }
   public:
     RESOURCE_META(skeleton)
 
     skeleton() {
+      blend_pending = false;
+      cached_skin = 0;
+      num_indexed_joints = 0;
     }
 
     void visit(visitor &v) {
@@ -47,73 +106,132 @@ namespace octet { namespace scene {
 
     int get_num_bones() const { return result.size(); }
 
+    /// Find the bone with a sid. Returns -1 if there is none.
     int find_joint(atom_t sid) {
-      for (unsigned i = 0; i != joints.size(); ++i) {
-        if (joints[i] == sid) {
-          return i;
+      // add any joints added since the last call. the first bone with a sid wins.
+      for (; num_indexed_joints != joints.size(); ++num_indexed_joints) {
+        int key = (int)joints[num_indexed_joints];
+        if (!joint_index.contains(key)) {
+          joint_index[key] = num_indexed_joints;
         }
       }
+      int index = joint_index.get_index((int)sid);
+      return index == -1 ? -1 : joint_index.get_value(index);
+    }
+
+    /// Add a weighted local pose for a bone to the blend buffer.
+    /// rotate is a quaternion; translate and scale have w = 0.
+    void blend_bone(int index, const vec4 &translate, const vec4 &rotate, const vec4 &scale, float weight) {
+      if (!blend_pending) begin_blend();
+      // keep all the rotations in the same hemisphere so that they average properly.
+      float sign = blend_rotate[index].dot(rotate) < 0 ? -weight : weight;
+      blend_translate[index] += translate * weight;
+      blend_rotate[index] += rotate * sign;
+      blend_scale[index] += scale * weight;
+      blend_weight[index] += weight;
+      blend_used[index] = 1;
+    }
+
+    /// Add a weighted change to a bone's pose, applied on top of the blended pose.
+    /// rotate is a quaternion; scale is a multiplier.
+    void blend_bone_additive(int index, const vec4 &translate, const vec4 &rotate, const vec4 &scale, float weight) {
+      if (!blend_pending) begin_blend();
+      quat r = quat(0, 0, 0, 1).nlerp(quat(rotate), weight);
+      additive_translate[index] += translate * weight;
+      additive_rotate[index] = r.qmul(additive_rotate[index]);
+      additive_scale[index] = additive_scale[index] * (vec4(1, 1, 1, 0) + (scale - vec4(1, 1, 1, 0)) * weight);
+      blend_used[index] = 1;
+    }
+
+    /// Mix the blend buffer and write the result to the bone nodes.
+    /// If the weights of a bone add up to less than one, the rest pose fills the gap.
+    /// Called by calc_transforms; does nothing if nothing was blended since the last call.
+    void resolve_blend() {
+      if (!blend_pending) return;
+      blend_pending = false;
+
+      for (unsigned i = 0; i != nodes.size(); ++i) {
+        if (!blend_used[i]) continue;
+
+        vec4 translate = blend_translate[i];
+        vec4 rotate = blend_rotate[i];
+        vec4 scale = blend_scale[i];
+        float weight = blend_weight[i];
+        if (weight < 1) {
+          float rest = 1 - weight;
+          translate += rest_translate[i] * rest;
+          rotate += rest_rotate[i] * (rotate.dot(rest_rotate[i]) < 0 ? -rest : rest);
+          scale += rest_scale[i] * rest;
+          weight = 1;
+        }
+
+        float rcp = 1.0f / weight;
+        translate = translate * rcp + additive_translate[i];
+        rotate = additive_rotate[i].qmul(rotate.normalize());
+        scale = scale * rcp * additive_scale[i];
+
+        nodes[i]->access_nodeToParent().init_trs(translate, quat(rotate), scale);
+      }
+    }
+
+    /// Find the bone that uses a scene node. Returns -1 if the node is not in the skeleton.
+    int find_node(scene_node *node) const {
+      for (unsigned i = 0; i != nodes.size(); ++i) {
+        if (nodes[i] == node) return i;
+      }
       return -1;
     }
 
+    /// Build the matrix palette for a skin: one skin -> camera matrix per joint.
+    /// Returns get_num_bones() matrices.
     mat4t *calc_transforms(const mat4t &worldToCamera, skin *skn) {
-      //static bool first_frame = true;
-      if (boneToNode.size() < nodeToParents.size()) {
-        boneToNode.resize(nodeToParents.size());
-      }
+      resolve_blend();
 
-      // todo: optionally drive animation directly to the skeleton.
-      for (int i = 0; i != nodes.size(); ++i) {
-        nodeToParents[i] = nodes[i]->access_nodeToParent();
+      if (boneToNode.size() < nodes.size()) {
+        boneToNode.resize(nodes.size());
       }
 
-      // compute matrix heirachy
-      for (int i = 0; i != nodeToParents.size(); ++i) {
+      // compute matrix heirachy: skeleton -> parent -> parent -> world -> camera
+      // bones are in parent first order, so one pass is enough.
+      for (unsigned i = 0; i != nodes.size(); ++i) {
         int parent = parents[i];
-        // skeleton -> parent -> parent -> world -> camera
-        if (parent == -1) {
-          boneToNode[i] = nodeToParents[i] * worldToCamera;
-        } else {
-          boneToNode[i] = nodeToParents[i] * boneToNode[parent];
-        }
-        //log("%d %s p=%d\n", i, result[i].toString(), parent);
+        const mat4t &nodeToParent = nodes[i]->get_nodeToParent();
+        boneToNode[i] = nodeToParent * (parent == -1 ? worldToCamera : boneToNode[parent]);
       }
 
+      // the joint lookups and the skin matrices don't change, so do them once per skin.
       unsigned num_joints = skn->get_num_joints();
-      if (result.size() < num_joints) {
+      if (cached_skin != skn || result.size() != num_joints) {
+        cached_skin = skn;
         result.resize(num_joints);
         indices.resize(num_joints);
-        for (int i = 0; i != num_joints; ++i) {
-          // skin -> bind space -> skeleton -> parent -> parent -> world -> camera
+        skin_bind.resize(num_joints);
+        for (unsigned i = 0; i != num_joints; ++i) {
           indices[i] = find_joint(skn->get_joint(i));
+          skin_bind[i] = skn->get_modelToBind() * skn->get_bindToModel(i);
         }
       }
 
-      // premultiply by skin matrices
-      for (int i = 0; i != num_joints; ++i) {
-        // skin -> bind space -> skeleton -> parent -> parent -> world -> camera
-        int index = indices[i];
-        if (index != -1) {
-          result[i] = skn->get_modelToBind() * skn->get_bindToModel(i) * boneToNode[index];
-        } else {
-          result[i] = worldToCamera;
-        }
-        //if (first_frame) log("%d %d [%s]\n", i, index, result[i].toString());
+      // skin -> bind space -> skeleton -> parent -> parent -> world -> camera
+      // one matrix multiply per joint; each row is four vec4 multiply-adds.
+      const mat4t *bind = skin_bind.data();
+      const int *index = indices.data();
+      mat4t *dest = result.data();
+      for (unsigned i = 0; i != num_joints; ++i) {
+        dest[i] = index[i] != -1 ? bind[i] * boneToNode[index[i]] : worldToCamera;
       }
 
-      return &result[0];
+      return dest;
     }
 
-    // convert an sid into an index. (should be cached!)
+    /// Convert an sid into a bone index. Returns -1 if there is no such bone.
     int get_bone_index(atom_t sid) {
-      for (int i = 0; i != joints.size(); ++i) {
-        if (joints[i] == sid) return i;
-      }
-      return -1;
+      return find_joint(sid);
     }
 
+    /// Set the local transform of a bone.
     void set_bone(int index, const mat4t &value) {
-      nodeToParents[index] = value;
+      nodes[index]->access_nodeToParent() = value;
     }
   };
 }}
@@ -43,6 +43,43 @@ namespace octet { namespace scene {
 
     int frame_number;
 
+    /// reject mesh instances outside the camera frustum
+    bool frustum_culling;
+
+    /// per-frame culling statistics
+    int num_instances_tested;
+    int num_instances_culled;
+    int num_instances_drawn;
+
+    /// visible instances sorted by state
+    render_queue draws;
+
+    /// per-frame render queue statistics
+    int num_state_changes;
+    int num_state_changes_saved;
+    int num_draw_calls;
+
+    /// draw runs of instances with the same mesh and material in one call
+    bool instancing;
+
+    /// runs shorter than this are drawn one at a time
+    enum { min_instance_batch = 2 };
+
+    /// sizes of the runs of the sorted queue that share a mesh and material
+    dynarray<unsigned> batch_sizes;
+
+    /// per-instance model to camera matrices for instanced draws
+    ref<gl_resource> instance_buffer;
+
+    /// the skinned shader has this many matrices; bigger skeletons are skinned on the CPU
+    enum { max_shader_bones = 192 };
+
+    /// skin every skinned mesh on the CPU, not just the big ones
+    bool cpu_skinning;
+
+    /// per-frame count of meshes skinned on the CPU
+    int num_skinned_on_cpu;
+
     /// shaders to draw triangles
     ref<bump_shader> object_shader;
     ref<bump_shader> skin_shader;
@@ -114,7 +151,7 @@ namespace octet { namespace scene {
       for (unsigned mesh_index = 0; mesh_index != mesh_instances.size(); ++mesh_index) {
         mesh_instance *mi = mesh_instances[mesh_index];
         aabb bb = mi->get_mesh()->get_aabb();
-        bb = bb.get_transform(mi->get_node()->calcModelToWorld());
+        bb = bb.get_transform(mi->get_node()->get_modelToWorld());
         draw_aabb(bb);
       }
     }
@@ -181,8 +218,247 @@ namespace octet { namespace scene {
       }
     }
 
+    // can this draw be merged with others into one instanced call?
+    bool is_instanceable(mesh_instance *mi) const {
+      return
+        instancing &&
+        mi->get_material()->can_instance() &&
+        !(mi->get_flags() & mesh_instance::flag_selected) &&
+        !(mi->get_skeleton() && mi->get_mesh()->get_skin()) &&
+        !mi->get_mesh()->get_instance_vertices()
+      ;
+    }
+
+    // split the sorted queue into runs of draws sharing a mesh and material.
+    // returns the number of instance matrices needed.
+    unsigned calc_batches() {
+      unsigned num_instanced = 0;
+      batch_sizes.resize(0);
+      for (unsigned i = 0; i != draws.size(); ) {
+        mesh_instance *mi = draws.get_draw(i).mi;
+        unsigned j = i + 1;
+        if (is_instanceable(mi)) {
+          while (j != draws.size()) {
+            mesh_instance *mj = draws.get_draw(j).mi;
+            if (mj->get_mesh() != mi->get_mesh() || mj->get_material() != mi->get_material() || !is_instanceable(mj)) break;
+            ++j;
+          }
+        }
+        unsigned size = j - i;
+        if (size >= min_instance_batch) num_instanced += size;
+        batch_sizes.push_back(size);
+        i = j;
+      }
+      return num_instanced;
+    }
+
+    // copy the model to camera matrices of instanced batches to the instance buffer.
+    void fill_instance_buffer(unsigned num_instanced) {
+      unsigned bytes = num_instanced * sizeof(mat4t);
+      if (!instance_buffer || instance_buffer->get_size() < bytes) {
+        unsigned capacity = 64 * sizeof(mat4t);
+        while (capacity < bytes) capacity *= 2;
+        instance_buffer = new gl_resource();
+        instance_buffer->allocate(GL_ARRAY_BUFFER, capacity, GL_STREAM_DRAW);
+      } else {
+        instance_buffer->orphan();
+      }
+
+      gl_resource::wolock lock(instance_buffer);
+      mat4t *dest = (mat4t*)lock.u8();
+      unsigned first = 0;
+      for (unsigned b = 0; b != batch_sizes.size(); ++b) {
+        unsigned size = batch_sizes[b];
+        if (size >= min_instance_batch) {
+          for (unsigned i = 0; i != size; ++i) {
+            *dest++ = draws.get_draw(first + i).modelToCamera;
+          }
+        }
+        first += size;
+      }
+    }
+
+    // point the four instance matrix attributes at the buffer, starting at instance "first"
+    void enable_instance_attributes(unsigned first) {
+      #if OCTET_INSTANCING
+        instance_buffer->bind();
+        for (unsigned i = 0; i != 4; ++i) {
+          GLuint attr = attribute_instance + i;
+          glVertexAttribPointer(attr, 4, GL_FLOAT, GL_FALSE, sizeof(mat4t), (void*)(first * sizeof(mat4t) + i * sizeof(vec4)));
+          glVertexAttribDivisor(attr, 1);
+          glEnableVertexAttribArray(attr);
+        }
+      #endif
+    }
+
+    // restore the instance attribute slots for ordinary meshes
+    void disable_instance_attributes() {
+      #if OCTET_INSTANCING
+        for (unsigned i = 0; i != 4; ++i) {
+          GLuint attr = attribute_instance + i;
+          glVertexAttribDivisor(attr, 0);
+          glDisableVertexAttribArray(attr);
+        }
+      #endif
+    }
+
+    // draw the sorted queue, skipping program, material and mesh setup that has not changed.
+    // runs of instances sharing a mesh and material are drawn with one instanced call.
+    void submit_draws(const mat4t &cameraToProjection) {
+      param_shader *cur_shader = NULL;
+      material *cur_mat = NULL;
+      mesh *cur_msh = NULL;
+      num_state_changes = 0;
+      num_state_changes_saved = 0;
+      num_draw_calls = 0;
+      num_skinned_on_cpu = 0;
+
+      unsigned num_instanced = calc_batches();
+      if (num_instanced) {
+        fill_instance_buffer(num_instanced);
+      }
+
+      unsigned first_instance = 0;
+      unsigned i = 0;
+      for (unsigned b = 0; b != batch_sizes.size(); ++b) {
+        unsigned batch_size = batch_sizes[b];
+        if (batch_size >= min_instance_batch) {
+          mesh_instance *mi = draws.get_draw(i).mi;
+          mesh *msh = mi->get_mesh();
+          material *mat = mi->get_material();
+
+          /// instanced rendering: one draw call for the whole run.
+          param_shader *shader = mat->get_instanced_shader();
+          if (shader != cur_shader) {
+            mat->render_shader_instanced();
+            cur_shader = shader;
+            cur_mat = NULL;
+            num_state_changes++;
+          } else {
+            num_state_changes_saved++;
+          }
+
+          if (mat != cur_mat) {
+            mat->render_static_instanced();
+            cur_mat = mat;
+            num_state_changes++;
+          } else {
+            num_state_changes_saved++;
+          }
+          num_state_changes_saved += 2 * (batch_size - 1);
+
+          mat->render_dynamic_instanced(cameraToProjection, light_uniforms, num_light_uniforms, num_lights);
+
+          if (msh != cur_msh) {
+            if (cur_msh) cur_msh->disable_attributes();
+            msh->enable_attributes();
+            cur_msh = msh;
+            num_state_changes++;
+          } else {
+            num_state_changes_saved++;
+          }
+          num_state_changes_saved += batch_size - 1;
+
+          enable_instance_attributes(first_instance);
+          msh->draw_instanced(batch_size);
+          disable_instance_attributes();
+          num_instances_drawn += batch_size;
+          num_draw_calls++;
+
+          first_instance += batch_size;
+          i += batch_size;
+          continue;
+        }
+
+        // a run of one, or draws we can't instance.
+        for (unsigned end = i + batch_size; i != end; ++i) {
+          const render_queue::draw &d = draws.get_draw(i);
+          mesh_instance *mi = d.mi;
+          mesh *msh = mi->get_mesh();
+          skin *skn = msh->get_skin();
+          skeleton *skel = mi->get_skeleton();
+          material *mat = mi->get_material();
+
+          if (!skel || !skn) {
+            /// normal rendering for single matrix objects
+            /// build a projection matrix: model -> world -> camera_instance -> projection
+            /// the projection space is the cube -1 <= x/w, y/w, z/w <= 1
+            if (mat->get_shader() != cur_shader) {
+              mat->render_shader();
+              cur_shader = mat->get_shader();
+              cur_mat = NULL;
+              num_state_changes++;
+            } else {
+              num_state_changes_saved++;
+            }
+
+            if (mat != cur_mat) {
+              mat->render_static();
+              cur_mat = mat;
+              num_state_changes++;
+            } else {
+              num_state_changes_saved++;
+            }
+
+            mat->render_dynamic(d.modelToProjection, d.modelToCamera, light_uniforms, num_light_uniforms, num_lights);
+          } else {
+            /// multi-matrix rendering
+            mat4t *transforms = skel->calc_transforms(d.modelToCamera, skn);
+            int num_bones = skel->get_num_bones();
+            cpu_skinner *skinner = cpu_skinning || num_bones > max_shader_bones ? mi->get_cpu_skinner() : NULL;
+            if (skinner) {
+              // too many bones for the shader: skin into camera space on the CPU
+              // and draw with the static shader.
+              msh = skinner->update(transforms);
+              mat4t identity;
+              mat->render_shader();
+              mat->render_static();
+              mat->render_dynamic(cameraToProjection, identity, light_uniforms, num_light_uniforms, num_lights);
+              num_skinned_on_cpu++;
+            } else if (num_bones > max_shader_bones) {
+              printf("warning: too many bones (%d/%d)\n", num_bones, (int)max_shader_bones);
+            } else {
+              mat->render_skinned(cameraToProjection, transforms, num_bones, light_uniforms, num_light_uniforms, num_lights);
+            }
+            // we don't know what the skinned path has changed.
+            cur_shader = NULL;
+            cur_mat = NULL;
+          }
+
+          /*if (true) {
+            static bool dumped;
+            if (!dumped) { msh->dump_transformed(modelToProjection); dumped = true; }
+          }*/
+          if (msh != cur_msh) {
+            if (cur_msh) cur_msh->disable_attributes();
+            msh->enable_attributes();
+            cur_msh = msh;
+            num_state_changes++;
+          } else {
+            num_state_changes_saved++;
+          }
+          msh->draw();
+          num_instances_drawn++;
+          num_draw_calls++;
+
+          if (mi->get_flags() & mesh_instance::flag_selected) {
+            aabb bb = msh->get_aabb();
+            bb = bb.get_transform(mi->get_node()->get_modelToWorld());
+            cur_msh->disable_attributes();
+            cur_msh = NULL;
+            draw_aabb(bb);
+          }
+        }
+      }
+
+      if (cur_msh) cur_msh->disable_attributes();
+    }
+
     void render_impl(bump_shader &object_shader, bump_shader &skin_shader, camera_instance &cam, float aspect_ratio) {
-      mat4t cameraToWorld = cam.get_node()->calcModelToWorld();
+      // refresh the cached world matrices once per frame
+      update_world_hierarchy();
+
+      mat4t cameraToWorld = cam.get_node()->get_modelToWorld();
 
       mat4t worldToCamera;
       cameraToWorld.invertQuick(worldToCamera);
@@ -192,6 +468,13 @@ namespace octet { namespace scene {
       cam.set_cameraToWorld(cameraToWorld, aspect_ratio);
       mat4t cameraToProjection = cam.get_cameraToProjection();
 
+      // world space view volume for culling
+      frustum view_frustum(worldToCamera * cameraToProjection);
+      num_instances_tested = 0;
+      num_instances_culled = 0;
+      num_instances_drawn = 0;
+      draws.reset();
+
       draw_debug_data(cam);
 
       for (unsigned mesh_index = 0; mesh_index != mesh_instances.size(); ++mesh_index) {
@@ -210,7 +493,22 @@ namespace octet { namespace scene {
         skeleton *skel = mi->get_skeleton();
         material *mat = mi->get_material();
 
-        mat4t modelToWorld = node->calcModelToWorld();
+        const mat4t &modelToWorld = node->get_modelToWorld();
+
+        // reject instances outside the view frustum.
+        // skinned meshes can move outside their bind pose bounds, so we always draw them.
+        if (frustum_culling && !(flags & mesh_instance::flag_no_cull) && !(skel && skn)) {
+          aabb bb = msh->get_aabb();
+          // an empty box means the mesh has no bounds
+          if (any(bb.get_half_extent() != vec3(0, 0, 0))) {
+            num_instances_tested++;
+            if (!view_frustum.intersects(bb.get_transform(modelToWorld))) {
+              num_instances_culled++;
+              continue;
+            }
+          }
+        }
+
         mat4t modelToCamera;
         mat4t modelToProjection;
         cam.get_matrices(modelToProjection, modelToCamera, modelToWorld);
@@ -228,38 +526,14 @@ namespace octet { namespace scene {
           }
         }
 
-        if (!skel || !skn) {
-          /// normal rendering for single matrix objects
-          /// build a projection matrix: model -> world -> camera_instance -> projection
-          /// the projection space is the cube -1 <= x/w, y/w, z/w <= 1
-          mat->render(modelToProjection, modelToCamera, light_uniforms, num_light_uniforms, num_lights);
-        } else {
-          /// multi-matrix rendering
-          mat4t *transforms = skel->calc_transforms(modelToCamera, skn);
-          int num_bones = skel->get_num_bones();
-          if(num_bones > 192) {
-            GLint mvuv = 0;
-            //glGetIntegerv(GL_MAX_VERTEX_UNIFORM_VECTORS, &mvuv);
-            printf("warning: too many bones (%d/%d)\n", num_bones, mvuv/4);
-          } else {
-            mat->render_skinned(cameraToProjection, transforms, num_bones, light_uniforms, num_light_uniforms, num_lights);
-          }
-        }
-
-        /*if (true) {
-          static bool dumped;
-          if (!dumped) { msh->dump_transformed(modelToProjection); dumped = true; }
-        }*/
-        msh->enable_attributes();
-        msh->draw();
-        msh->disable_attributes();
-
-        if (mi->get_flags() & mesh_instance::flag_selected) {
-          aabb bb = mi->get_mesh()->get_aabb();
-          bb = bb.get_transform(mi->get_node()->calcModelToWorld());
-          draw_aabb(bb);
-        }
+        // sort by layer, translucency, shader, material, mesh then depth
+        float depth = -modelToCamera.w().z() / cam.get_far_plane();
+        uint64_t key = render_queue::make_key(mi->get_layer(), mat->get_translucent(), mat->get_shader(), mat, msh, depth);
+        draws.add(key, mi, modelToProjection, modelToCamera);
       }
+
+      draws.sort();
+      submit_draws(cameraToProjection);
       frame_number++;
     }
   public:
@@ -268,6 +542,16 @@ namespace octet { namespace scene {
     /// Create an empty visual_scene; Use add_* functions to add components to the scene.
     visual_scene() {
       frame_number = 0;
+      frustum_culling = true;
+      num_instances_tested = 0;
+      num_instances_culled = 0;
+      num_instances_drawn = 0;
+      num_state_changes = 0;
+      num_state_changes_saved = 0;
+      num_draw_calls = 0;
+      instancing = OCTET_INSTANCING != 0;
+      cpu_skinning = false;
+      num_skinned_on_cpu = 0;
       num_light_uniforms = 0;
       num_lights = 0;
       render_aabbs = false;
@@ -511,6 +795,56 @@ namespace octet { namespace scene {
       dump_vertices = value;
     }
 
+    /// enable or disable frustum culling of mesh instances (on by default).
+    void set_frustum_culling(bool value) {
+      frustum_culling = value;
+    }
+
+    /// how many mesh instances were tested against the frustum last frame?
+    int get_num_instances_tested() const {
+      return num_instances_tested;
+    }
+
+    /// how many mesh instances were rejected by the frustum last frame?
+    int get_num_instances_culled() const {
+      return num_instances_culled;
+    }
+
+    /// how many mesh instances were drawn last frame?
+    int get_num_instances_drawn() const {
+      return num_instances_drawn;
+    }
+
+    /// how many program, material and mesh changes were made last frame?
+    int get_num_state_changes() const {
+      return num_state_changes;
+    }
+
+    /// how many program, material and mesh changes did sorting avoid last frame?
+    int get_num_state_changes_saved() const {
+      return num_state_changes_saved;
+    }
+
+    /// how many draw calls were made last frame?
+    int get_num_draw_calls() const {
+      return num_draw_calls;
+    }
+
+    /// enable or disable hardware instancing (on by default where supported).
+    void set_instancing(bool value) {
+      instancing = value && OCTET_INSTANCING;
+    }
+
+    /// skin all meshes on the CPU (off by default: only skeletons too big for the shader are).
+    void set_cpu_skinning(bool value) {
+      cpu_skinning = value;
+    }
+
+    /// how many meshes were skinned on the CPU last frame?
+    int get_num_skinned_on_cpu() const {
+      return num_skinned_on_cpu;
+    }
+
     /// access camera_instance information
     camera_instance *get_camera_instance(int index) {
       return camera_instances[index];
@@ -548,6 +882,12 @@ namespace octet { namespace scene {
         inst->update(delta_time);
       }
 
+      // mix the poses of blended animations once per skeleton.
+      for (int idx = 0; idx != animation_instances.size(); ++idx) {
+        skeleton *skel = animation_instances[idx]->get_skeleton();
+        if (skel) skel->resolve_blend();
+      }
+
       for (int idx = 0; idx != mesh_instances.size(); ++idx) {
         mesh_instance *inst = mesh_instances[idx];
         inst->update(delta_time);
@@ -569,15 +909,24 @@ namespace octet { namespace scene {
     }
 
     /// play an animation on another target (not the same one as in the collada file)
-    void play(animation *anim, resource *target, bool is_looping) {
+    /// Use the returned instance to set up blending.
+    animation_instance *play(animation *anim, resource *target, bool is_looping) {
       animation_instance *inst = new animation_instance(anim, target, is_looping);
       animation_instances.push_back(inst);
+      return inst;
     }
 
     /// play an animation with built-in targets (as in the collada file)
-    void play(animation *anim, bool is_looping) {
+    /// Use the returned instance to set up blending, eg.
+    ///
+    ///     scene->play(walk, true)->set_skeleton(skel);
+    ///     animation_instance *run_inst = scene->play(run, true);
+    ///     run_inst->set_skeleton(skel);
+    ///     run_inst->fade_in(0.5f);
+    animation_instance *play(animation *anim, bool is_looping) {
       animation_instance *inst = new animation_instance(anim, NULL, is_looping);
       animation_instances.push_back(inst);
+      return inst;
     }
 
     /// find a mesh instance for a node
@@ -598,7 +947,7 @@ namespace octet { namespace scene {
       for (int i = 0; i != mesh_instances.size(); ++i) {
         mesh_instance *mi = mesh_instances[i];
         if (mi && mi->get_node()) {
-          mat4t nodeToWorld = mi->get_node()->calcModelToWorld();
+          const mat4t &nodeToWorld = mi->get_node()->get_modelToWorld();
           aabb bb = mi->get_mesh()->get_aabb();
           bb = bb.get_transform(nodeToWorld);
           if (first) {
@@ -624,10 +973,12 @@ namespace octet { namespace scene {
       result.mi = 0;
       result.depth = rational(0, 0);
 
+      update_world_hierarchy();
+
       for (int i = 0; i != mesh_instances.size(); ++i) {
         mesh_instance *mi = mesh_instances[i];
         if (mi && mi->get_node()) {
-          mat4t nodeToWorld = mi->get_node()->calcModelToWorld();
+          const mat4t &nodeToWorld = mi->get_node()->get_modelToWorld();
           mesh *mesh = mi->get_mesh();
           aabb bb = mesh->get_aabb();
           bb = bb.get_transform(nodeToWorld);
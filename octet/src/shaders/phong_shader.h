@@ -22,7 +22,7 @@ namespace octet { namespace shaders {
     GLuint light_specular_index;    // index for specular light color
 
   public:
-    void init() {
+    void init(bool is_instanced=false) {
       // this is the vertex shader.
       // it is called for each corner of each triangle
       // it inputs pos and uv from each corner
@@ -46,6 +46,26 @@ namespace octet { namespace shaders {
         }
       );
 
+      // this is the vertex shader for instanced geometry.
+      // the model to camera matrix comes from a per-instance vertex buffer.
+      const char instanced_vertex_shader[] = SHADER_STR(
+        varying vec2 uv_;
+        varying vec3 normal_;
+      
+        attribute vec4 pos;
+        attribute vec3 normal;
+        attribute vec2 uv;
+        attribute mat4 instance_modelToCamera;
+      
+        uniform mat4 cameraToProjection;
+      
+        void main() {
+          uv_ = uv;
+          normal_ = (instance_modelToCamera * vec4(normal,0)).xyz;
+          gl_Position = cameraToProjection * (instance_modelToCamera * pos);
+        }
+      );
+
       // this is the fragment shader
       // after the rasterizer breaks the triangle into fragments
       // this is called for every fragment
@@ -77,7 +97,7 @@ namespace octet { namespace shaders {
             specular * light_specular * specular_factor;
         }
       );
-      init_uniforms(vertex_shader, fragment_shader);
+      init_uniforms(is_instanced ? instanced_vertex_shader : vertex_shader, fragment_shader);
     }
 
     void init_uniforms(const char *vertex_shader, const char *fragment_shader) {
@@ -115,6 +135,24 @@ namespace octet { namespace shaders {
       glUniform1iv(samplers_index, num_samplers, samplers);
     }
 
+    /// for shaders created with is_instanced: the model to camera matrices come from the instance buffer.
+    void render_instanced(const mat4t &cameraToProjection, const vec4 &light_direction, float shininess, vec4 &light_ambient, vec4 &light_diffuse, vec4 &light_specular, int num_samplers=4) {
+      // tell openGL to use the program
+      shader::render();
+
+      // customize the program with uniforms
+      glUniform3fv(light_direction_index, 1, light_direction.get());
+      glUniformMatrix4fv(cameraToProjection_index, 1, GL_FALSE, cameraToProjection.get());
+      glUniform4fv(light_ambient_index, 1, light_ambient.get());
+      glUniform4fv(light_diffuse_index, 1, light_diffuse.get());
+      glUniform4fv(light_specular_index, 1, light_specular.get());
+      glUniform1f(shininess_index, shininess);
+
+      // we use textures 0-3 for material properties.
+      static const GLint samplers[] = { 0, 1, 2, 3, 4 };
+      glUniform1iv(samplers_index, num_samplers, samplers);
+    }
+
     void render_skinned(const mat4t &cameraToProjection, const mat4t *modelToCamera, int num_matrices, const vec4 &light_direction, float shininess, vec4 &light_ambient, vec4 &light_diffuse, vec4 &light_specular, int num_samplers=4) {
       // tell openGL to use the program
       shader::render();
@@ -5,6 +5,8 @@
 // Modular Framework for OpenGLES2 rendering on multiple platforms.
 //
 // Common shader code - compiles and links shaders
+//
+// Programs with the same source are compiled once and shared.
 
 // "stringifying macro" makes shaders more readable 
 // (effectively puts quotes around X)
@@ -12,26 +14,160 @@
 
 namespace octet { namespace shaders {
   class shader : public resource {
+  public:
+    /// A linked program and the state of its uniforms, shared by every shader using the program.
+    struct program_state {
+      GLuint program;
+
+      /// the object whose values are in the program's uniforms, eg. a material. NULL if unknown.
+      const void *uniform_owner;
+
+      program_state(GLuint program) : program(program), uniform_owner(NULL) {
+      }
+    };
+
+  private:
+    enum {
+      // change this if the attribute slots in link() change, to ignore old program binaries.
+      cache_version = 2,
+    };
+
     GLuint program_;
+    program_state *state_;
+
+    // programs linked so far in this run, keyed by a hash of their source and defines.
+    // every shader with the same source shares one program.
+    static hash_map<uint64_t, program_state*> &programs() {
+      static hash_map<uint64_t, program_state*> instance;
+      return instance;
+    }
+
+    // 64 bit FNV-1a of a zero terminated string, including the terminator.
+    static uint64_t calc_hash(uint64_t hash, const char *text) {
+      do {
+        hash = (hash ^ (uint8_t)*text) * 0x100000001b3ull;
+      } while (*text++);
+      return hash;
+    }
+
+    // linked programs are saved in this directory so that later runs can skip compiling.
+    static const char *get_path(char *path, uint64_t key) {
+      sprintf(path, "shader_cache/%08x%08x.bin", (unsigned)(key >> 32), (unsigned)key);
+      return path;
+    }
+
+    // does the driver support glGetProgramBinary?
+    static bool has_program_binaries() {
+      #if OCTET_PROGRAM_BINARY
+        static GLint num_formats = -1;
+        if (num_formats == -1) {
+          num_formats = 0;
+          glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+          // older contexts do not know the enum.
+          glGetError();
+        }
+        return num_formats > 0;
+      #else
+        return false;
+      #endif
+    }
+
+    // load a program saved by an earlier run. returns 0 if there is none or the driver rejects it.
+    static GLuint load_program_binary(uint64_t key) {
+      #if OCTET_PROGRAM_BINARY
+        char path[64];
+        FILE *file = fopen(get_path(path, key), "rb");
+        if (!file) return 0;
+
+        dynarray<uint8_t> bytes;
+        fseek(file, 0, SEEK_END);
+        bytes.resize((unsigned)ftell(file));
+        fseek(file, 0, SEEK_SET);
+        size_t size = fread(bytes.data(), 1, bytes.size(), file);
+        fclose(file);
 
-    void link(GLuint vertex_shader, GLuint fragment_shader) {
+        // the file is the binary format followed by the binary.
+        GLenum format = 0;
+        if (size <= sizeof(format)) return 0;
+        memcpy(&format, bytes.data(), sizeof(format));
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, format, bytes.data() + sizeof(format), (GLsizei)(size - sizeof(format)));
+        GLint linked = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+          // a new driver will not load old binaries.
+          glDeleteProgram(program);
+          return 0;
+        }
+        return program;
+      #else
+        return 0;
+      #endif
+    }
+
+    // save a linked program for later runs.
+    static void save_program_binary(uint64_t key, GLuint program) {
+      #if OCTET_PROGRAM_BINARY
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+
+        GLenum format = 0;
+        dynarray<uint8_t> bytes((unsigned)(sizeof(format) + length));
+        glGetProgramBinary(program, length, &length, &format, bytes.data() + sizeof(format));
+        memcpy(bytes.data(), &format, sizeof(format));
+
+        #ifdef WIN32
+          _mkdir("shader_cache");
+        #else
+          mkdir("shader_cache", 0777);
+        #endif
+
+        char path[64];
+        FILE *file = fopen(get_path(path, key), "wb");
+        if (file) {
+          fwrite(bytes.data(), 1, sizeof(format) + length, file);
+          fclose(file);
+        }
+      #endif
+    }
+
+    /// Link a program. Particle programs (see mesh_particle_system) get the particle
+    /// attribute slots instead of the standard ones that they share locations with.
+    bool link(GLuint vertex_shader, GLuint fragment_shader, bool retrievable = false, bool particles = false) {
           // assemble the program for use by glUseProgram
       GLuint program = glCreateProgram();
       glAttachShader(program, vertex_shader);
       glAttachShader(program, fragment_shader);
-
       // standardize the attribute slots (in NVidia's CG you can do this in the shader)
-      glBindAttribLocation(program, attribute_pos, "pos");
-      glBindAttribLocation(program, attribute_normal, "normal");
-      glBindAttribLocation(program, attribute_tangent, "tangent");
-      glBindAttribLocation(program, attribute_bitangent, "bitangent");
-      glBindAttribLocation(program, attribute_blendweight, "blendweight");
-      glBindAttribLocation(program, attribute_blendindices, "blendindices");
-      glBindAttribLocation(program, attribute_color, "color");
       glBindAttribLocation(program, attribute_uv, "uv");
+      if (particles) {
+        glBindAttribLocation(program, attribute_particle_pos, "particle_pos");
+        glBindAttribLocation(program, attribute_particle_uv, "particle_uv");
+        glBindAttribLocation(program, attribute_particle_size, "particle_size");
+        glBindAttribLocation(program, attribute_particle_tail, "particle_tail");
+        glBindAttribLocation(program, attribute_particle_tail_uv, "particle_tail_uv");
+        glBindAttribLocation(program, attribute_particle_axis, "particle_axis");
+      } else {
+        glBindAttribLocation(program, attribute_pos, "pos");
+        glBindAttribLocation(program, attribute_normal, "normal");
+        glBindAttribLocation(program, attribute_tangent, "tangent");
+        glBindAttribLocation(program, attribute_bitangent, "bitangent");
+        glBindAttribLocation(program, attribute_blendweight, "blendweight");
+        glBindAttribLocation(program, attribute_blendindices, "blendindices");
+        glBindAttribLocation(program, attribute_color, "color");
+        glBindAttribLocation(program, attribute_instance, "instance_modelToCamera");
+      }
+      #if OCTET_PROGRAM_BINARY
+        if (retrievable) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+      #endif
       glLinkProgram(program);
 
       program_ = program;
+      state_ = new program_state(program);
+      GLint linked = 0;
+      glGetProgramiv(program, GL_LINK_STATUS, &linked);
       GLsizei length;
       char buf[0x10000];
       glGetProgramInfoLog(program, sizeof(buf), &length, buf);
@@ -41,21 +177,50 @@ namespace octet { namespace shaders {
       } else {
         printf("linked ok\n");
       }
+      return linked != 0;
     }
   public:
     shader() {
+      program_ = 0;
+      state_ = NULL;
     }
 
     GLuint program() { return program_; }
   
-    void init(const char *vs, const char *fs) {
+    /// Compile and link a program, or reuse one with the same source.
+    /// defines, if any, go before the source of both shaders.
+    /// Set particles for programs that read the particle attributes (see mesh_particle_system).
+    /// Where the driver allows it, programs are also kept in shader_cache/ between runs.
+    void init(const char *vs, const char *fs, const char *defines = "", bool particles = false) {
+      uint64_t key = calc_hash(0xcbf29ce484222325ull + cache_version, particles ? "particles" : "");
+      key = calc_hash(calc_hash(calc_hash(key, defines), vs), fs);
+      int index = programs().get_index(key);
+      if (index != -1) {
+        state_ = programs().get_value(index);
+        program_ = state_->program;
+        return;
+      }
+
+      bool binaries = has_program_binaries();
+      program_ = binaries ? load_program_binary(key) : 0;
+      if (program_) {
+        state_ = new program_state(program_);
+      } else if (compile(vs, fs, defines, particles) && binaries) {
+        save_program_binary(key, program_);
+      }
+      programs()[key] = state_;
+    }
+
+    /// Compile and link a program without using the cache.
+    bool compile(const char *vs, const char *fs, const char *defines = "", bool particles = false) {
       //printf("creating shader program\n");
 
       GLsizei length;
       char buf[0x10000];
       // create our vertex shader and compile it
       GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-      glShaderSource(vertex_shader, 1, &vs, NULL);
+      const char *vs_source[] = { defines, vs };
+      glShaderSource(vertex_shader, 2, vs_source, NULL);
       glCompileShader(vertex_shader);
       glGetShaderInfoLog(vertex_shader, sizeof(buf), &length, buf);
       if (length) {
@@ -64,14 +229,15 @@ namespace octet { namespace shaders {
     
       // create our fragment shader and compile it
       GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-      glShaderSource(fragment_shader, 1, &fs, NULL);
+      const char *fs_source[] = { defines, fs };
+      glShaderSource(fragment_shader, 2, fs_source, NULL);
       glCompileShader(fragment_shader);
       glGetShaderInfoLog(fragment_shader, sizeof(buf), &length, buf);
       if (length) {
         log("Fragment shader error:\n%s\n%s\n\n\n\n", buf, fs);
       }
 
-      link(vertex_shader, fragment_shader);
+      return link(vertex_shader, fragment_shader, has_program_binaries(), particles);
     }
 
     /// create a program from pre-compiled binary code. (ie. PS Vita)  
@@ -98,6 +264,11 @@ namespace octet { namespace shaders {
     GLuint get_program() const {
       return program_;
     }
+
+    /// get the state shared by every shader using this program.
+    program_state *get_program_state() const {
+      return state_;
+    }
   };
 
 }}